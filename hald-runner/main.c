@@ -179,6 +179,93 @@ malformed:
 	dbus_message_unref(reply);
 }
 
+/* StartBatch takes an array of (is_singleton, udi, environment, argv) and
+ * replies with the pids in the same order, 0 for requests that could not
+ * be started. The whole batch is parsed before anything is started, so a
+ * malformed batch starts nothing. */
+static void
+handle_start_batch(DBusConnection *con, DBusMessage *msg)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter array_iter;
+	DBusMessageIter struct_iter;
+	GPtrArray *requests;
+	GArray *pids;
+	run_request *r;
+	dbus_bool_t is_singleton;
+	guint n;
+
+	requests = g_ptr_array_new();
+
+	if (!dbus_message_iter_init(msg, &iter) ||
+	    dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+	    dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_STRUCT)
+		goto malformed;
+
+	dbus_message_iter_recurse(&iter, &array_iter);
+	while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_STRUCT) {
+		dbus_message_iter_recurse(&array_iter, &struct_iter);
+		if (dbus_message_iter_get_arg_type(&struct_iter) != DBUS_TYPE_BOOLEAN)
+			goto malformed;
+		dbus_message_iter_get_basic(&struct_iter, &is_singleton);
+		if (!dbus_message_iter_next(&struct_iter))
+			goto malformed;
+
+		r = new_run_request();
+		r->is_singleton = is_singleton;
+
+		/* singletons don't belong to a device, hald sends an empty udi */
+		if (!parse_udi(r, msg, &struct_iter) ||
+		    !parse_environment(r, msg, &struct_iter)) {
+			fprintf(stderr, "error parsing batched start request");
+			del_run_request(r);
+			goto malformed;
+		}
+		if (is_singleton) {
+			g_free(r->udi);
+			r->udi = NULL;
+		}
+		g_ptr_array_add(requests, r);
+
+		dbus_message_iter_next(&array_iter);
+	}
+
+	pids = g_array_sized_new(FALSE, FALSE, sizeof(dbus_int64_t), requests->len);
+	for (n = 0; n < requests->len; n++) {
+		dbus_int64_t ppid;
+		GPid pid;
+
+		/* run_request_run takes over the request, also on failure */
+		ppid = 0;
+		if (run_request_run(g_ptr_array_index(requests, n), con, NULL, &pid))
+			ppid = pid;
+		g_array_append_val(pids, ppid);
+	}
+	g_ptr_array_free(requests, TRUE);
+
+	reply = dbus_message_new_method_return(msg);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 DBUS_TYPE_INT64_AS_STRING, &array_iter);
+	dbus_message_iter_append_fixed_array(&array_iter, DBUS_TYPE_INT64,
+					     &pids->data, pids->len);
+	dbus_message_iter_close_container(&iter, &array_iter);
+	dbus_connection_send(con, reply, NULL);
+	dbus_message_unref(reply);
+	g_array_free(pids, TRUE);
+	return;
+
+malformed:
+	for (n = 0; n < requests->len; n++)
+		del_run_request(g_ptr_array_index(requests, n));
+	g_ptr_array_free(requests, TRUE);
+	reply = dbus_message_new_error(msg, "org.freedesktop.HalRunner.Malformed",
+				       "Malformed start batch request");
+	dbus_connection_send(con, reply, NULL);
+	dbus_message_unref(reply);
+}
+
 static void
 handle_kill(DBusConnection *con, DBusMessage *msg)
 {
@@ -219,6 +306,9 @@ filter(DBusConnection *con, DBusMessage *msg, void *user_data)
 	} else if (dbus_message_is_method_call(msg, "org.freedesktop.HalRunner", "StartSingleton")) {
 		handle_start(con, msg, TRUE);
 		return DBUS_HANDLER_RESULT_HANDLED;
+	} else if (dbus_message_is_method_call(msg, "org.freedesktop.HalRunner", "StartBatch")) {
+		handle_start_batch(con, msg);
+		return DBUS_HANDLER_RESULT_HANDLED;
 	} else if (dbus_message_is_method_call(msg, "org.freedesktop.HalRunner", "Kill")) {
 		handle_kill(con, msg);
 		return DBUS_HANDLER_RESULT_HANDLED;
@@ -27,10 +27,12 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
 
 #define DBUS_API_SUBJECT_TO_CHANGE 
 #include <dbus/dbus-glib-lowlevel.h>
@@ -51,8 +53,14 @@
 GHashTable *udi_hash = NULL;
 GList *singletons = NULL;
 
+/* Workers exit when they did not get a job for this long (ms) */
+#define WORKER_IDLE_TIMEOUT 30000
+
+typedef struct _worker worker;
+
 typedef struct {
 	run_request *r;
+	worker *w;
 	DBusMessage *msg;
 	DBusConnection *con;
 	GPid pid;
@@ -63,6 +71,28 @@ typedef struct {
 	gboolean emit_pid_exited;
 } run_data;
 
+/* A helper started with HALD_HELPER_WORKER set; it reads jobs from a
+ * socket on its stdin and writes one exit code per job to the same
+ * socket on its stdout, see hald/util_helper_worker.c */
+struct _worker {
+	gchar *program;
+	GPid pid;
+	gint fd;
+	guint child_watch;
+	guint result_watch;
+	guint idle_timeout;
+	GString *result;
+	run_data *rd;
+	gboolean dead;
+};
+
+/* basenames of the helpers that may run as workers */
+static GHashTable *worker_helpers = NULL;
+/* maximum number of workers per helper */
+static guint max_workers = 0;
+/* full program path -> GList of workers */
+static GHashTable *workers = NULL;
+
 static void
 del_run_data(run_data *rd)
 {
@@ -73,7 +103,9 @@ del_run_data(run_data *rd)
 	if (rd->msg)
 		dbus_message_unref(rd->msg);
 
-	g_spawn_close_pid(rd->pid);
+	/* the pid of a worker job belongs to the worker */
+	if (rd->w == NULL)
+		g_spawn_close_pid(rd->pid);
 
 	if (rd->stderr_v >= 0)
 		close(rd->stderr_v);
@@ -145,6 +177,284 @@ remove_run_data(run_data *rd)
 	}
 }
 
+static gboolean
+worker_eligible(run_request *r, DBusMessage *msg, GPid *out_pid)
+{
+	gchar *program;
+	gboolean ret;
+	guint i;
+
+	/* only plain Run requests; Start wants the pid of its own process */
+	if (worker_helpers == NULL || msg == NULL || out_pid != NULL)
+		return FALSE;
+	if (r->input != NULL || r->error_on_stderr || r->is_singleton)
+		return FALSE;
+	/* empty strings end the argument vector of a job */
+	for (i = 0; r->argv[i] != NULL; i++)
+		if (r->argv[i][0] == '\0')
+			return FALSE;
+
+	program = g_path_get_basename(r->argv[0]);
+	ret = g_hash_table_lookup(worker_helpers, program) != NULL;
+	g_free(program);
+	return ret;
+}
+
+/* Stop handing out jobs to w and close its socket; the worker exits on
+ * EOF and worker_exited frees it */
+static void
+worker_remove(worker *w)
+{
+	GList *list;
+
+	if (w->dead)
+		return;
+	w->dead = TRUE;
+
+	list = (GList *)g_hash_table_lookup(workers, w->program);
+	list = g_list_remove(list, w);
+	if (list != NULL)
+		g_hash_table_insert(workers, g_strdup(w->program), list);
+	else
+		g_hash_table_remove(workers, w->program);
+
+	if (w->result_watch != 0) {
+		g_source_remove(w->result_watch);
+		w->result_watch = 0;
+	}
+	if (w->idle_timeout != 0) {
+		g_source_remove(w->idle_timeout);
+		w->idle_timeout = 0;
+	}
+	shutdown(w->fd, SHUT_RDWR);
+}
+
+static void
+worker_exited(GPid pid, gint status, gpointer data)
+{
+	worker *w = (worker *)data;
+	run_data *rd;
+
+	printf("worker pid %d: rc=%d signaled=%d: %s\n",
+	       pid, WEXITSTATUS(status), WIFSIGNALED(status), w->program);
+	w->child_watch = 0;
+	worker_remove(w);
+
+	/* a job that ends the worker, e.g. by calling exit(), gets the same
+	 * reply as a helper process of its own would have */
+	rd = w->rd;
+	if (rd != NULL && rd->sent_kill) {
+		del_run_data(rd);
+	} else if (rd != NULL) {
+		if (!WIFEXITED(status))
+			send_reply(rd->con, rd->msg, HALD_RUN_FAILED, 0, NULL);
+		else
+			send_reply(rd->con, rd->msg, HALD_RUN_SUCCESS, WEXITSTATUS(status), NULL);
+		remove_run_data(rd);
+		del_run_data(rd);
+	}
+
+	g_spawn_close_pid(w->pid);
+	close(w->fd);
+	g_string_free(w->result, TRUE);
+	g_free(w->program);
+	g_free(w);
+}
+
+static gboolean
+worker_idle_timedout(gpointer data)
+{
+	worker *w = (worker *)data;
+
+	w->idle_timeout = 0;
+	worker_remove(w);
+	return FALSE;
+}
+
+static void
+worker_job_done(worker *w, gint return_code)
+{
+	run_data *rd = w->rd;
+
+	/* timed out or killed; the worker is on its way out */
+	if (rd == NULL || rd->sent_kill)
+		return;
+
+	w->rd = NULL;
+	send_reply(rd->con, rd->msg, HALD_RUN_SUCCESS, return_code, NULL);
+	remove_run_data(rd);
+	del_run_data(rd);
+
+	if (!w->dead)
+		w->idle_timeout = g_timeout_add(WORKER_IDLE_TIMEOUT, worker_idle_timedout, w);
+}
+
+static gboolean
+worker_result(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	worker *w = (worker *)data;
+	char buf[64];
+	char *nl;
+	ssize_t n;
+
+	n = read(w->fd, buf, sizeof(buf));
+	if (n < 0 && errno == EINTR)
+		return TRUE;
+	if (n <= 0) {
+		/* the worker is exiting, worker_exited replies */
+		w->result_watch = 0;
+		worker_remove(w);
+		return FALSE;
+	}
+
+	g_string_append_len(w->result, buf, n);
+	while ((nl = memchr(w->result->str, '\n', w->result->len)) != NULL) {
+		gint return_code;
+
+		*nl = '\0';
+		return_code = atoi(w->result->str);
+		g_string_erase(w->result, 0, nl - w->result->str + 1);
+		worker_job_done(w, return_code);
+	}
+
+	return TRUE;
+}
+
+static void
+worker_child_setup(gpointer data)
+{
+	gint fd = GPOINTER_TO_INT(data);
+
+	dup2(fd, 0);
+	dup2(fd, 1);
+}
+
+static worker *
+worker_spawn(run_request *r, const gchar *program_dir)
+{
+	worker *w;
+	GError *error = NULL;
+	GIOChannel *channel;
+	gchar *argv[] = { NULL, NULL };
+	gchar **env;
+	gint fds[2];
+	guint n;
+	guint i;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return NULL;
+
+	n = r->environment != NULL ? g_strv_length(r->environment) : 0;
+	env = g_new0(gchar *, n + 2);
+	for (i = 0; i < n; i++)
+		env[i] = r->environment[i];
+	env[n] = "HALD_HELPER_WORKER=1";
+
+	w = g_new0(worker, 1);
+	w->program = g_strdup(r->argv[0]);
+	argv[0] = w->program;
+
+	if (!g_spawn_async(program_dir, argv, env, G_SPAWN_DO_NOT_REAP_CHILD,
+			   worker_child_setup, GINT_TO_POINTER(fds[1]), &w->pid, &error)) {
+		printf("Could not start worker %s: %s\n", w->program, error->message);
+		g_error_free(error);
+		g_free(env);
+		close(fds[0]);
+		close(fds[1]);
+		g_free(w->program);
+		g_free(w);
+		return NULL;
+	}
+	g_free(env);
+	close(fds[1]);
+
+	w->fd = fds[0];
+	w->result = g_string_new(NULL);
+	w->child_watch = g_child_watch_add(w->pid, worker_exited, w);
+
+	channel = g_io_channel_unix_new(w->fd);
+	w->result_watch = g_io_add_watch(channel, G_IO_IN | G_IO_ERR | G_IO_HUP, worker_result, w);
+	g_io_channel_unref(channel);
+
+	printf("Started worker %d for %s\n", w->pid, w->program);
+	return w;
+}
+
+/* Returns an idle worker for the program of r, starting one if all are
+ * busy and there are less than max_workers; NULL if r has to be run in
+ * a process of its own */
+static worker *
+worker_get(run_request *r, const gchar *program_dir)
+{
+	GList *list;
+	GList *l;
+	worker *w;
+
+	list = (GList *)g_hash_table_lookup(workers, r->argv[0]);
+	for (l = list; l != NULL; l = l->next) {
+		w = (worker *)l->data;
+		if (w->rd == NULL) {
+			if (w->idle_timeout != 0) {
+				g_source_remove(w->idle_timeout);
+				w->idle_timeout = 0;
+			}
+			return w;
+		}
+	}
+
+	if (g_list_length(list) >= max_workers)
+		return NULL;
+
+	w = worker_spawn(r, program_dir);
+	if (w == NULL)
+		return NULL;
+
+	list = g_list_prepend(list, w);
+	g_hash_table_insert(workers, g_strdup(w->program), list);
+	return w;
+}
+
+static gboolean
+worker_send(worker *w, const gchar *data, gsize len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(w->fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+		data += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/* A job is the argument vector and the environment, each as a list of
+ * NUL terminated strings ended by an empty string */
+static gboolean
+worker_send_job(worker *w, run_request *r)
+{
+	GString *job;
+	gboolean ret;
+	guint i;
+
+	job = g_string_new(NULL);
+	for (i = 0; r->argv[i] != NULL; i++)
+		g_string_append_len(job, r->argv[i], strlen(r->argv[i]) + 1);
+	g_string_append_c(job, '\0');
+	if (r->environment != NULL)
+		for (i = 0; r->environment[i] != NULL; i++)
+			if (r->environment[i][0] != '\0')
+				g_string_append_len(job, r->environment[i], strlen(r->environment[i]) + 1);
+	g_string_append_c(job, '\0');
+
+	ret = worker_send(w, job->str, job->len);
+	g_string_free(job, TRUE);
+	return ret;
+}
+
 static void
 run_exited(GPid pid, gint status, gpointer data)
 {
@@ -206,6 +516,8 @@ run_timedout(gpointer data) {
 	rd->timeout = 0;
 	/* So the exit watch will know it's killed  in case it runs*/
 	rd->sent_kill = TRUE;
+	if (rd->w != NULL)
+		worker_remove(rd->w);
 
 	send_reply(rd->con, rd->msg, HALD_RUN_TIMEOUT, 0, NULL);
 	remove_run_data (rd);
@@ -251,6 +563,7 @@ run_request_run (run_request *r, DBusConnection *con, DBusMessage *msg, GPid *ou
 	gboolean program_exists = FALSE;
 	char *program_dir = NULL;
 	GList *list;
+	worker *w = NULL;
 
 	printf("Run started %s (%u) (%d) \n!", r->argv[0], r->timeout,
 		r->error_on_stderr);
@@ -268,7 +581,17 @@ run_request_run (run_request *r, DBusConnection *con, DBusMessage *msg, GPid *ou
 
 	printf("  full path is '%s', program_dir is '%s'\n", r->argv[0], program_dir);
 
-	if (!program_exists ||
+	if (program_exists && worker_eligible(r, msg, out_pid)) {
+		w = worker_get(r, program_dir);
+		if (w != NULL && !worker_send_job(w, r)) {
+			worker_remove(w);
+			w = NULL;
+		}
+	}
+
+	if (w != NULL) {
+		pid = w->pid;
+	} else if (!program_exists ||
 		!g_spawn_async_with_pipes(program_dir, r->argv, r->environment,
 		                          G_SPAWN_DO_NOT_REAP_CHILD,
 		                          NULL, NULL, &pid,
@@ -299,8 +622,13 @@ run_request_run (run_request *r, DBusConnection *con, DBusMessage *msg, GPid *ou
 	rd->stderr_v = stderr_v;
 	rd->sent_kill = FALSE;
 
-	/* Add watch for exit of the program */
-	rd->watch = g_child_watch_add(pid, run_exited, rd);
+	/* Add watch for exit of the program; a worker has its own */
+	if (w != NULL) {
+		rd->w = w;
+		w->rd = rd;
+	} else {
+		rd->watch = g_child_watch_add(pid, run_exited, rd);
+	}
 
 	/* Add timeout if needed */
 	if (r->timeout > 0)
@@ -342,6 +670,8 @@ kill_rd(gpointer data, gpointer user_data)
 
 	/* So the exit watch will know it's killed  in case it runs */
 	rd->sent_kill = TRUE;
+	if (rd->w != NULL)
+		worker_remove(rd->w);
 
 	if (rd->msg != NULL)
 		send_reply(rd->con, rd->msg, HALD_RUN_KILLED, 0, NULL);
@@ -381,5 +711,27 @@ run_kill_all()
 void
 run_init()
 {
+	const gchar *helpers;
+	const gchar *max;
+	gchar **names;
+	guint i;
+
 	udi_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	/* hald sets these when it runs with --probe-workers */
+	helpers = getenv("HALD_RUNNER_WORKER_HELPERS");
+	max = getenv("HALD_RUNNER_MAX_WORKERS");
+	if (helpers == NULL || max == NULL || atoi(max) <= 0)
+		return;
+
+	max_workers = atoi(max);
+	workers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	worker_helpers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	names = g_strsplit(helpers, ":", 0);
+	for (i = 0; names[i] != NULL; i++)
+		if (names[i][0] != '\0')
+			g_hash_table_insert(worker_helpers, g_strdup(names[i]), GINT_TO_POINTER(1));
+	g_strfreev(names);
+
+	printf("Running up to %u workers each for %s\n", max_workers, helpers);
 }
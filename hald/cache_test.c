@@ -66,6 +66,54 @@ static void test_cache(u_int32_t offset, size_t size)
     }
 }
 
+static void test_match_runs(struct cache_header *header)
+{
+    struct match_run		*runs;
+    struct match_run_entry	*entries;
+    struct rule			*first;
+    struct rule			*r;
+    u_int32_t			i, j;
+
+    if (header->magic != HALD_CACHE_MAGIC)
+	DIE(("Unknown cache format %08x", header->magic));
+
+    runs = (struct match_run *) RULES_PTR(header->match_runs);
+    for (i = 0; i < header->num_match_runs; i++) {
+	first = (struct rule *) RULES_PTR(runs[i].first);
+	entries = (struct match_run_entry *) RULES_PTR(runs[i].entries);
+
+	HAL_INFO(("match run=%08lx, key='%s', type_match=%d, num_entries=%d, end=%08lx",
+		runs[i].first, first->key, runs[i].type_match, runs[i].num_entries, runs[i].end));
+
+	for (j = 0; j < runs[i].num_entries; j++) {
+	    r = (struct rule *) RULES_PTR(entries[j].rule);
+	    if (r->rtype != RULE_MATCH || r->type_match != runs[i].type_match ||
+		strcmp (r->key, first->key) != 0)
+		DIE(("rule=%08lx is not a match on '%s'", entries[j].rule, first->key));
+	    if (entries[j].rule < runs[i].first || entries[j].rule >= runs[i].end)
+		DIE(("rule=%08lx is outside of its match run", entries[j].rule));
+	}
+    }
+}
+
+static void test_sources(struct cache_header *header)
+{
+    struct cache_source	*sources;
+    u_int32_t		i;
+
+    sources = (struct cache_source *) RULES_PTR(header->sources);
+    for (i = 0; i < header->num_sources; i++) {
+	HAL_INFO(("source='%s', size=%d, hash=%08x, rules=%08lx, rules_size=%d",
+		(char *) RULES_PTR(sources[i].path), sources[i].size, sources[i].hash,
+		sources[i].rules, sources[i].rules_size));
+
+	if (sources[i].rules_size > 0 &&
+	    (sources[i].rules < header->fdi_rules_preprobe ||
+	     sources[i].rules + sources[i].rules_size > header->all_rules_size))
+	    DIE(("rules of '%s' are outside of the rules", (char *) RULES_PTR(sources[i].path)));
+    }
+}
+
 int 
 di_rules_init (void)
 {
@@ -112,5 +160,7 @@ int main(int argc, char * argv[])
     test_cache(header->fdi_rules_preprobe, header->fdi_rules_information - header->fdi_rules_preprobe);
     test_cache(header->fdi_rules_information, header->fdi_rules_policy - header->fdi_rules_information);
     test_cache(header->fdi_rules_policy, header->all_rules_size - header->fdi_rules_policy);
+    test_match_runs(header);
+    test_sources(header);
     return 0;
 }
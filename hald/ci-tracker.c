@@ -137,6 +137,8 @@ error:
 
 struct CITracker_s {
         GHashTable *connection_name_to_caller_info;
+        GHashTable *pending_lookups;    /* unique name -> CILookup */
+        GHashTable *failed_names;       /* unique names the bus says have no owner */
         DBusConnection *dbus_connection;
 };
 
@@ -173,6 +175,34 @@ caller_info_free (CICallerInfo *ci)
 }
 
 
+typedef struct {
+	CITrackerInfoFunc func;
+	gpointer user_data;
+} CILookupWaiter;
+
+typedef enum {
+	CI_LOOKUP_UID,
+#ifdef HAVE_CONKIT
+	CI_LOOKUP_PID,
+	CI_LOOKUP_SELINUX_CONTEXT,
+	CI_LOOKUP_SESSION,
+	CI_LOOKUP_IS_ACTIVE,
+	CI_LOOKUP_IS_LOCAL,
+#endif
+	CI_LOOKUP_DONE
+} CILookupStep;
+
+/* An asynchronous resolution of one unique name; all callers asking for
+ * the same name while it is in flight are queued up as waiters. */
+typedef struct {
+	CITracker *cit;
+	CICallerInfo *ci;
+	CILookupStep step;
+	gboolean cancelled;
+	gboolean no_such_name;
+	GSList *waiters;
+} CILookup;
+
 CITracker *
 ci_tracker_new (void)
 {
@@ -196,6 +226,8 @@ ci_tracker_init (CITracker *cit)
                                                                      g_str_equal,
                                                                      NULL, /* a pointer to a CICallerInfo object */
                                                                      (GFreeFunc) caller_info_free);
+	cit->pending_lookups = g_hash_table_new (g_str_hash, g_str_equal);
+	cit->failed_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 void 
@@ -209,6 +241,14 @@ ci_tracker_name_owner_changed (CITracker *cit,
 
 	if (strlen (old_service_name) > 0) {
 		CICallerInfo *caller_info;
+		CILookup *lookup;
+
+		/* a reply still in flight describes a connection that is gone */
+		lookup = (CILookup *) g_hash_table_lookup (cit->pending_lookups, old_service_name);
+		if (lookup != NULL)
+			lookup->cancelled = TRUE;
+
+		g_hash_table_remove (cit->failed_names, old_service_name);
 
 		/* evict CICallerInfo from cache */
 		caller_info = (CICallerInfo *) g_hash_table_lookup (cit->connection_name_to_caller_info, 
@@ -294,6 +334,10 @@ ci_tracker_get_info (CITracker *cit, const char *system_bus_unique_name)
 		/*HAL_INFO (("(using cached information)"));*/
 		goto got_caller_info;
 	}
+
+	/* don't block on asking again for a name that already failed */
+	if (g_hash_table_lookup (cit->failed_names, system_bus_unique_name) != NULL)
+		goto error;
 	/*HAL_INFO (("(retrieving info from system bus and ConsoleKit)"));*/
 	
 	ci = caller_info_new ();
@@ -453,6 +497,345 @@ error:
 	return NULL;
 }
 
+static void ci_lookup_send (CILookup *lookup);
+
+static void
+ci_lookup_finish (CILookup *lookup, gboolean ok)
+{
+	CITracker *cit;
+	CICallerInfo *ci;
+	GSList *i;
+
+	cit = lookup->cit;
+	ci = lookup->ci;
+
+	g_hash_table_remove (cit->pending_lookups, ci->system_bus_unique_name);
+
+	if (lookup->cancelled) {
+		HAL_INFO (("Connection %s went away while resolving caller info", ci->system_bus_unique_name));
+		caller_info_free (ci);
+		ci = NULL;
+	} else if (ok) {
+		CICallerInfo *cached;
+
+		/* a synchronous lookup may have beaten us to it */
+		cached = g_hash_table_lookup (cit->connection_name_to_caller_info, ci->system_bus_unique_name);
+		if (cached != NULL) {
+			caller_info_free (ci);
+			ci = cached;
+		} else {
+			g_hash_table_insert (cit->connection_name_to_caller_info, ci->system_bus_unique_name, ci);
+		}
+	} else {
+		/* Only remember names the bus told us don't exist; a timeout
+		 * or a hiccup in ConsoleKit must not lock out a live caller
+		 * for the rest of its connection. */
+		if (lookup->no_such_name)
+			g_hash_table_insert (cit->failed_names, g_strdup (ci->system_bus_unique_name), GINT_TO_POINTER (1));
+		caller_info_free (ci);
+		ci = NULL;
+	}
+
+	lookup->waiters = g_slist_reverse (lookup->waiters);
+	for (i = lookup->waiters; i != NULL; i = g_slist_next (i)) {
+		CILookupWaiter *waiter = (CILookupWaiter *) i->data;
+
+		waiter->func (cit, ci, waiter->user_data);
+		g_free (waiter);
+	}
+	g_slist_free (lookup->waiters);
+	g_free (lookup);
+}
+
+static void
+ci_lookup_reply (DBusPendingCall *pending_call, void *user_data)
+{
+	CILookup *lookup = (CILookup *) user_data;
+	CICallerInfo *ci = lookup->ci;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusError error;
+	gboolean ok;
+#ifdef HAVE_CONKIT
+	DBusMessageIter sub_iter;
+	char *str;
+	int num_elems;
+#endif
+
+	ok = FALSE;
+	dbus_error_init (&error);
+
+	reply = dbus_pending_call_steal_reply (pending_call);
+	dbus_pending_call_unref (pending_call);
+
+	if (lookup->cancelled)
+		goto out;
+
+	if (reply == NULL || dbus_set_error_from_message (&error, reply)) {
+		switch (lookup->step) {
+#ifdef HAVE_CONKIT
+		case CI_LOOKUP_SELINUX_CONTEXT:
+			/* SELinux might not be enabled */
+			if (dbus_error_is_set (&error) &&
+			    strcmp (error.name, "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown") == 0) {
+				lookup->step++;
+				goto next;
+			}
+			break;
+		case CI_LOOKUP_SESSION:
+			/* OK, this is not a catastrophe; just means the caller is not a member of any session.. */
+			HAL_WARNING (("Error doing GetSessionForUnixProcess on ConsoleKit: %s: %s", error.name, error.message));
+			ok = TRUE;
+			goto out;
+#endif
+		default:
+			break;
+		}
+		if (dbus_error_has_name (&error, DBUS_ERROR_NAME_HAS_NO_OWNER))
+			lookup->no_such_name = TRUE;
+		HAL_WARNING (("Could not resolve caller info for %s (step %d): %s: %s",
+			      ci->system_bus_unique_name, lookup->step,
+			      dbus_error_is_set (&error) ? error.name : "",
+			      dbus_error_is_set (&error) ? error.message : "no reply"));
+		goto out;
+	}
+
+	dbus_message_iter_init (reply, &iter);
+	switch (lookup->step) {
+	case CI_LOOKUP_UID:
+		{
+			dbus_uint32_t uid;
+
+			if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_UINT32)
+				goto bad_reply;
+			dbus_message_iter_get_basic (&iter, &uid);
+			ci->uid = uid;
+		}
+		break;
+#ifdef HAVE_CONKIT
+	case CI_LOOKUP_PID:
+		{
+			dbus_uint32_t pid;
+
+			if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_UINT32)
+				goto bad_reply;
+			dbus_message_iter_get_basic (&iter, &pid);
+			ci->pid = pid;
+		}
+		break;
+	case CI_LOOKUP_SELINUX_CONTEXT:
+		if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY ||
+		    dbus_message_iter_get_element_type (&iter) != DBUS_TYPE_BYTE)
+			goto bad_reply;
+		dbus_message_iter_recurse (&iter, &sub_iter);
+		dbus_message_iter_get_fixed_array (&sub_iter, (void *) &str, &num_elems);
+		if (str != NULL && num_elems > 0)
+			ci->selinux_context = g_strndup (str, num_elems);
+		break;
+	case CI_LOOKUP_SESSION:
+		if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_OBJECT_PATH)
+			goto bad_reply;
+		dbus_message_iter_get_basic (&iter, &str);
+		ci->session_objpath = g_strdup (str);
+		break;
+	case CI_LOOKUP_IS_ACTIVE:
+		{
+			dbus_bool_t is_active;
+
+			if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_BOOLEAN)
+				goto bad_reply;
+			dbus_message_iter_get_basic (&iter, &is_active);
+			ci->in_active_session = is_active;
+		}
+		break;
+	case CI_LOOKUP_IS_LOCAL:
+		{
+			dbus_bool_t is_local;
+
+			if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_BOOLEAN)
+				goto bad_reply;
+			dbus_message_iter_get_basic (&iter, &is_local);
+			ci->is_local = is_local;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+	lookup->step++;
+
+#ifdef HAVE_CONKIT
+next:
+#endif
+	if (lookup->step != CI_LOOKUP_DONE) {
+		if (reply != NULL)
+			dbus_message_unref (reply);
+		dbus_error_free (&error);
+		ci_lookup_send (lookup);
+		return;
+	}
+	ok = TRUE;
+	goto out;
+
+bad_reply:
+	HAL_WARNING (("Could not resolve caller info for %s (step %d): unexpected reply signature '%s'",
+		      ci->system_bus_unique_name, lookup->step, dbus_message_get_signature (reply)));
+
+out:
+	if (reply != NULL)
+		dbus_message_unref (reply);
+	dbus_error_free (&error);
+	ci_lookup_finish (lookup, ok);
+}
+
+static void
+ci_lookup_send (CILookup *lookup)
+{
+	CICallerInfo *ci = lookup->ci;
+	DBusMessage *message;
+	DBusPendingCall *pending_call;
+	const char *name;
+
+	name = ci->system_bus_unique_name;
+
+	switch (lookup->step) {
+	case CI_LOOKUP_UID:
+		message = dbus_message_new_method_call ("org.freedesktop.DBus",
+							"/org/freedesktop/DBus",
+							"org.freedesktop.DBus",
+							"GetConnectionUnixUser");
+		dbus_message_append_args (message, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+		break;
+#ifdef HAVE_CONKIT
+	case CI_LOOKUP_PID:
+		message = dbus_message_new_method_call ("org.freedesktop.DBus",
+							"/org/freedesktop/DBus/Bus",
+							"org.freedesktop.DBus",
+							"GetConnectionUnixProcessID");
+		dbus_message_append_args (message, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+		break;
+	case CI_LOOKUP_SELINUX_CONTEXT:
+		message = dbus_message_new_method_call ("org.freedesktop.DBus",
+							"/org/freedesktop/DBus/Bus",
+							"org.freedesktop.DBus",
+							"GetConnectionSELinuxSecurityContext");
+		dbus_message_append_args (message, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+		break;
+	case CI_LOOKUP_SESSION:
+		message = dbus_message_new_method_call ("org.freedesktop.ConsoleKit",
+							"/org/freedesktop/ConsoleKit/Manager",
+							"org.freedesktop.ConsoleKit.Manager",
+							"GetSessionForUnixProcess");
+		dbus_message_append_args (message, DBUS_TYPE_UINT32, &ci->pid, DBUS_TYPE_INVALID);
+		break;
+	case CI_LOOKUP_IS_ACTIVE:
+		message = dbus_message_new_method_call ("org.freedesktop.ConsoleKit",
+							ci->session_objpath,
+							"org.freedesktop.ConsoleKit.Session",
+							"IsActive");
+		break;
+	case CI_LOOKUP_IS_LOCAL:
+		message = dbus_message_new_method_call ("org.freedesktop.ConsoleKit",
+							ci->session_objpath,
+							"org.freedesktop.ConsoleKit.Session",
+							"IsLocal");
+		break;
+#endif
+	default:
+		message = NULL;
+		break;
+	}
+
+	if (message == NULL)
+		goto fail;
+
+	if (!dbus_connection_send_with_reply (lookup->cit->dbus_connection, message, &pending_call, -1) ||
+	    pending_call == NULL) {
+		dbus_message_unref (message);
+		goto fail;
+	}
+	dbus_pending_call_set_notify (pending_call, ci_lookup_reply, lookup, NULL);
+	dbus_message_unref (message);
+	return;
+
+fail:
+	HAL_WARNING (("Could not send caller info request for %s", name));
+	ci_lookup_finish (lookup, FALSE);
+}
+
+/**
+ * ci_tracker_has_info:
+ * @cit: the tracker
+ * @system_bus_unique_name: unique name of the caller
+ *
+ * Returns: TRUE if ci_tracker_get_info() will answer for
+ * @system_bus_unique_name without talking to the bus, either because
+ * the info is cached or because the bus already told us the name has
+ * no owner.
+ */
+gboolean
+ci_tracker_has_info (CITracker *cit, const char *system_bus_unique_name)
+{
+	return g_hash_table_lookup (cit->connection_name_to_caller_info, system_bus_unique_name) != NULL ||
+		g_hash_table_lookup (cit->failed_names, system_bus_unique_name) != NULL;
+}
+
+/**
+ * ci_tracker_get_info_async:
+ * @cit: the tracker
+ * @system_bus_unique_name: unique name of the caller
+ * @func: called with the caller info, or NULL if it can't be resolved
+ * @user_data: user data for @func
+ *
+ * Non-blocking variant of ci_tracker_get_info(). If the info is cached
+ * @func is called right away; otherwise the bus daemon and ConsoleKit
+ * are queried with pending calls and @func runs from the main loop once
+ * all replies are in. Concurrent requests for the same name share one
+ * set of queries.
+ */
+void
+ci_tracker_get_info_async (CITracker *cit,
+			   const char *system_bus_unique_name,
+			   CITrackerInfoFunc func,
+			   gpointer user_data)
+{
+	CICallerInfo *ci;
+	CILookup *lookup;
+	CILookupWaiter *waiter;
+
+	if (system_bus_unique_name == NULL || !validate_bus_name (system_bus_unique_name) ||
+	    g_hash_table_lookup (cit->failed_names, system_bus_unique_name) != NULL) {
+		func (cit, NULL, user_data);
+		return;
+	}
+
+	ci = g_hash_table_lookup (cit->connection_name_to_caller_info, system_bus_unique_name);
+	if (ci != NULL) {
+		func (cit, ci, user_data);
+		return;
+	}
+
+	waiter = g_new0 (CILookupWaiter, 1);
+	waiter->func = func;
+	waiter->user_data = user_data;
+
+	lookup = g_hash_table_lookup (cit->pending_lookups, system_bus_unique_name);
+	if (lookup != NULL) {
+		lookup->waiters = g_slist_prepend (lookup->waiters, waiter);
+		return;
+	}
+
+	lookup = g_new0 (CILookup, 1);
+	lookup->cit = cit;
+	lookup->ci = caller_info_new ();
+	lookup->ci->system_bus_unique_name = g_strdup (system_bus_unique_name);
+	lookup->step = CI_LOOKUP_UID;
+	lookup->waiters = g_slist_prepend (NULL, waiter);
+	g_hash_table_insert (cit->pending_lookups, lookup->ci->system_bus_unique_name, lookup);
+
+	ci_lookup_send (lookup);
+}
+
 uid_t
 ci_tracker_caller_get_uid (CICallerInfo *ci)
 {
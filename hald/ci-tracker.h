@@ -59,6 +59,17 @@ void           ci_tracker_active_changed               (CITracker        *cit,
 CICallerInfo  *ci_tracker_get_info                     (CITracker        *cit,
                                                         const char       *system_bus_unique_name);
 
+typedef void (*CITrackerInfoFunc)                      (CITracker        *cit,
+                                                        CICallerInfo     *ci,
+                                                        gpointer          user_data);
+
+gboolean       ci_tracker_has_info                     (CITracker        *cit,
+                                                        const char       *system_bus_unique_name);
+void           ci_tracker_get_info_async               (CITracker        *cit,
+                                                        const char       *system_bus_unique_name,
+                                                        CITrackerInfoFunc func,
+                                                        gpointer          user_data);
+
 uid_t         ci_tracker_caller_get_uid                (CICallerInfo *ci);
 const char   *ci_tracker_caller_get_sysbus_unique_name (CICallerInfo *ci);
 #ifdef HAVE_CONKIT
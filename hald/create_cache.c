@@ -30,6 +30,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -51,6 +52,16 @@ static XML_Parser parser;
 static char s_error[256];
 static int haldc_verbose = 0;
 
+/* the previous cache, the rules of unchanged fdi files are copied from it */
+static char *old_cache = NULL;
+static size_t old_cache_size = 0;
+static GHashTable *old_sources = NULL;
+
+/* the fdi files of the cache being generated; the path of each
+ * struct cache_source is an offset into source_paths until written */
+static GArray *sources = NULL;
+static GString *source_paths = NULL;
+
 /* ctx of the current fdi file used for parsing */
 struct fdi_context {
 	int		depth;
@@ -457,19 +468,14 @@ end (void *data, const char *el){
 
 /* decompile an fdi file into a list of rules as this is quicker than opening then each time we want to search */
 static int
-rules_add_fdi_file (const char *filename, int fd)
+rules_add_fdi_file (const char *filename, const char *buf, gsize buflen, int fd)
 {
 	struct fdi_context *fdi_ctx;
-	char *buf;
-	gsize buflen;
 	int rc;
 	int ret;
 
 	ret = -1;
 
-	if (!g_file_get_contents (filename, &buf, &buflen, NULL))
-		goto out;
-
 	/* create new context */
 	fdi_ctx = g_new0 (struct fdi_context, 1);
 	memset(fdi_ctx, 0, sizeof(struct fdi_context));
@@ -511,12 +517,10 @@ rules_add_fdi_file (const char *filename, int fd)
 		}
 
 		XML_ParserFree (parser);
-		g_free (buf);
 		g_free (fdi_ctx);
 		goto out;
 	}
 	XML_ParserFree (parser);
-	g_free (buf);
 
 	/* insert last dummy rule into list */
 	init_rule_struct(&fdi_ctx->rule);
@@ -533,6 +537,216 @@ out:
 }
 
 
+/* FNV-1a, to recognize fdi files that were touched but not modified */
+static u_int32_t
+fdi_hash (const char *buf, gsize len)
+{
+	u_int32_t hash = 2166136261U;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) buf[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* map the previous cache, if it has the current format */
+static void
+old_cache_load (const char *cachename)
+{
+	struct cache_header *header;
+	struct cache_source *source;
+	struct stat st;
+	u_int32_t i;
+	int fd;
+
+	if ((fd = open (cachename, O_RDONLY)) < 0)
+		return;
+
+	if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (struct cache_header))
+		goto out;
+
+	old_cache = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (old_cache == MAP_FAILED) {
+		old_cache = NULL;
+		goto out;
+	}
+	old_cache_size = st.st_size;
+
+	header = (struct cache_header *) old_cache;
+	if (header->magic != HALD_CACHE_MAGIC ||
+	    header->sources + (size_t) header->num_sources * sizeof (struct cache_source) > old_cache_size)
+		goto out;
+
+	old_sources = g_hash_table_new (g_str_hash, g_str_equal);
+	source = (struct cache_source *) (old_cache + header->sources);
+	for (i = 0; i < header->num_sources; i++) {
+		if (source[i].path >= old_cache_size ||
+		    source[i].rules + (size_t) source[i].rules_size > header->all_rules_size)
+			continue;
+		g_hash_table_insert (old_sources, old_cache + source[i].path, &source[i]);
+	}
+
+	if (haldc_verbose)
+		HAL_INFO (("Reusing rules of unchanged fdi files from '%s'", cachename));
+out:
+	close (fd);
+}
+
+static void
+old_cache_unload (void)
+{
+	if (old_sources != NULL) {
+		g_hash_table_destroy (old_sources);
+		old_sources = NULL;
+	}
+	if (old_cache != NULL) {
+		munmap (old_cache, old_cache_size);
+		old_cache = NULL;
+	}
+}
+
+/* copy the rules of an unchanged fdi file from the previous cache,
+ * moving all offsets they contain to their new place */
+static int
+rules_copy_fdi_file (const struct cache_source *old, int fd)
+{
+	struct rule *rule;
+	char *buf;
+	u_int32_t start;
+	u_int32_t pos;
+	int ret;
+
+	ret = -1;
+
+	start = RULES_ROUND(lseek(fd, 0, SEEK_END));
+	buf = g_malloc (old->rules_size);
+	memcpy (buf, old_cache + old->rules, old->rules_size);
+
+	for (pos = 0; pos < old->rules_size; pos += rule->rule_size) {
+		rule = (struct rule *) (buf + pos);
+		if (rule->rule_size < sizeof (struct rule))
+			goto out;
+
+		if (rule->jump_position != 0)
+			rule->jump_position = rule->jump_position - old->rules + start;
+		if (rule->value_offset != offsetof (struct cache_header, empty_string))
+			rule->value_offset = rule->value_offset - old->rules + start;
+	}
+
+	pad32_write(fd, start, buf, old->rules_size);
+	ret = lseek(fd, 0, SEEK_END);
+out:
+	g_free (buf);
+	return ret;
+}
+
+/* add the rules of an fdi file, copying them from the previous cache if
+ * the file didn't change - returns 1 if the file was skipped, 0 if not
+ * and -1 on unrecoverable errors */
+static int
+add_fdi_file (const char *filename, int fd)
+{
+	struct cache_source source;
+	struct cache_source *old;
+	struct stat st;
+	off_t offset_before;
+	gboolean reuse;
+	char *buf;
+	gsize buflen;
+	int end;
+	int ret;
+
+	buf = NULL;
+	memset (&source, 0, sizeof (struct cache_source));
+	if (stat (filename, &st) == 0) {
+		source.mtime = st.st_mtime;
+		source.size = st.st_size;
+	}
+
+	offset_before = lseek (fd, 0, SEEK_END);
+	source.rules = RULES_ROUND(offset_before);
+
+	old = NULL;
+	if (old_sources != NULL)
+		old = g_hash_table_lookup (old_sources, filename);
+
+	reuse = FALSE;
+	if (old != NULL && old->mtime == source.mtime && old->size == source.size) {
+		source.hash = old->hash;
+		reuse = TRUE;
+	} else if (g_file_get_contents (filename, &buf, &buflen, NULL)) {
+		source.hash = fdi_hash (buf, buflen);
+		reuse = old != NULL && old->size == buflen && old->hash == source.hash;
+	}
+
+	if (reuse && old->rules_size == 0) {
+		HAL_INFO (("skipped unchanged fdi file '%s'", filename));
+		ret = 1;
+		goto out;
+	}
+
+	if (reuse) {
+		if (haldc_verbose)
+			HAL_INFO (("Reusing rules of '%s'", filename));
+		end = rules_copy_fdi_file (old, fd);
+	} else if (buf != NULL) {
+		end = rules_add_fdi_file (filename, buf, buflen, fd);
+	} else {
+		end = -1;
+	}
+
+	if (end < 0) {
+		HAL_ERROR (("error processing fdi file '%s'", filename));
+		/* try to just skip this file */
+		if (ftruncate (fd, offset_before) != 0) {
+			HAL_ERROR (("Cannot truncate rules fdi"));
+			ret = -1;
+			goto error;
+		}
+		lseek (fd, 0, SEEK_END);
+		HAL_INFO (("skipped fdi file '%s'", filename));
+		ret = 1;
+		goto out;
+	}
+
+	source.rules_size = end - source.rules;
+	ret = 0;
+out:
+	if (ret == 1)
+		source.rules_size = 0;
+	source.path = source_paths->len;
+	g_string_append_len (source_paths, filename, strlen (filename) + 1);
+	g_array_append_val (sources, source);
+error:
+	g_free (buf);
+	return ret;
+}
+
+/* append the table of fdi files to the cache */
+static void
+write_sources (int fd, struct cache_header *header)
+{
+	u_int32_t paths;
+	guint i;
+
+	header->sources = 0;
+	header->num_sources = sources->len;
+	if (sources->len == 0)
+		return;
+
+	header->sources = RULES_ROUND(lseek(fd, 0, SEEK_END));
+	paths = header->sources + sources->len * sizeof (struct cache_source);
+
+	for (i = 0; i < sources->len; i++)
+		g_array_index (sources, struct cache_source, i).path += paths;
+
+	pad32_write(fd, header->sources, sources->data, sources->len * sizeof (struct cache_source));
+	pad32_write(fd, paths, source_paths->str, source_paths->len);
+}
+
 /* recurse a directory tree, searching and adding fdi files - returns
  * number of skipped fdi files or -1 on unrecoverable errors
  */
@@ -567,21 +781,12 @@ rules_search_and_add_fdi_files (const char *dir, int fd)
 		full_path = g_strdup_printf ("%s/%s", dir, filename);
 		if (g_file_test (full_path, (G_FILE_TEST_IS_REGULAR))) {
 			if (len >= 5 && strcmp(&filename[len - 4], ".fdi") == 0) {
-				int fdi_rules_size;
-				off_t offset_before;
-				offset_before = lseek (fd, 0, SEEK_CUR);
-				fdi_rules_size = rules_add_fdi_file (full_path, fd);
-				if (fdi_rules_size < 0) {
-					HAL_ERROR (("error processing fdi file '%s'", full_path));
-					/* try to just skip this file */
-					if (ftruncate (fd, offset_before) != 0) {
-						HAL_ERROR (("Cannot truncate rules fdi"));
-						goto error;
-					}
-					lseek (fd, 0, SEEK_END);
-					HAL_INFO (("skipped fdi file '%s'", full_path));
-					num_skipped_fdi_files++;
-				}
+				int ret;
+
+				ret = add_fdi_file (full_path, fd);
+				if (ret == -1)
+					goto error;
+				num_skipped_fdi_files += ret;
 			}
 		} else if (g_file_test (full_path, (G_FILE_TEST_IS_DIR)) && filename[0] != '.') {
 			int num_bytes;
@@ -615,6 +820,179 @@ error:
 }
 
 
+/* whether a rule can be part of a match run, see rule.h */
+static gboolean
+match_run_indexable (const struct rule *rule)
+{
+	if (rule->rtype != RULE_MATCH)
+		return FALSE;
+
+	/* only properties of the device itself, keys like '@info.parent:foo' are resolved at runtime */
+	if (strchr (rule->key, ':') != NULL)
+		return FALSE;
+
+	return rule->type_match == MATCH_STRING ||
+	       rule->type_match == MATCH_INT ||
+	       rule->type_match == MATCH_CONTAINS;
+}
+
+/* returns the offset of the <match> block continuing the run of the block at offset, or 0 */
+static u_int32_t
+match_run_next (const char *rules, u_int32_t offset, u_int32_t section_end)
+{
+	const struct rule *rule = (const struct rule *) (rules + offset);
+	const struct rule *next;
+	u_int32_t pos;
+
+	pos = rule->jump_position;
+	if (pos <= offset)
+		return 0;
+
+	/* the end of an fdi file is a no-op, so runs can go on in the next one */
+	while (pos < section_end) {
+		next = (const struct rule *) (rules + pos);
+		if (next->rtype != RULE_EOF)
+			break;
+		pos += next->rule_size;
+	}
+	if (pos >= section_end)
+		return 0;
+
+	next = (const struct rule *) (rules + pos);
+	if (!match_run_indexable (next) ||
+	    next->type_match != rule->type_match ||
+	    strcmp (next->key, rule->key) != 0)
+		return 0;
+
+	return pos;
+}
+
+static gint
+match_run_entry_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const struct match_run_entry *entry_a = a;
+	const struct match_run_entry *entry_b = b;
+	const char *rules = user_data;
+	const struct rule *rule_a = (const struct rule *) (rules + entry_a->rule);
+	const struct rule *rule_b = (const struct rule *) (rules + entry_b->rule);
+	gint result;
+
+	if (rule_a->type_match == MATCH_INT)
+		result = (entry_a->int_value > entry_b->int_value) - (entry_a->int_value < entry_b->int_value);
+	else
+		result = strcmp (rules + rule_a->value_offset, rules + rule_b->value_offset);
+
+	if (result == 0)
+		result = (entry_a->rule > entry_b->rule) - (entry_a->rule < entry_b->rule);
+
+	return result;
+}
+
+/* collect the match runs of one section; run->entries is an index into entries for now */
+static void
+add_match_runs (const char *rules, u_int32_t section_start, u_int32_t section_end,
+		GHashTable *in_run, GArray *runs, GArray *entries)
+{
+	const struct rule *rule;
+	u_int32_t offset;
+
+	for (offset = section_start; offset < section_end; offset += rule->rule_size) {
+		struct match_run run;
+		u_int32_t last;
+		u_int32_t next;
+		u_int32_t n;
+
+		rule = (const struct rule *) (rules + offset);
+		if (!match_run_indexable (rule) ||
+		    g_hash_table_lookup (in_run, GUINT_TO_POINTER (offset)) != NULL)
+			continue;
+
+		n = 1;
+		last = offset;
+		while ((next = match_run_next (rules, last, section_end)) != 0 &&
+		       g_hash_table_lookup (in_run, GUINT_TO_POINTER (next)) == NULL) {
+			last = next;
+			n++;
+		}
+
+		if (n < HALD_CACHE_MIN_MATCH_RUN)
+			continue;
+
+		run.type_match = rule->type_match;
+		run.first = offset;
+		run.end = ((const struct rule *) (rules + last))->jump_position;
+		run.entries = entries->len;
+		run.num_entries = n;
+
+		for (next = offset; ; next = match_run_next (rules, next, section_end)) {
+			const struct rule *block = (const struct rule *) (rules + next);
+			struct match_run_entry entry;
+
+			entry.rule = next;
+			entry.int_value = 0;
+			if (block->type_match == MATCH_INT)
+				entry.int_value = (int) strtol (rules + block->value_offset, NULL, 0);
+			g_array_append_val (entries, entry);
+			g_hash_table_insert (in_run, GUINT_TO_POINTER (next), GUINT_TO_POINTER (1));
+
+			if (next == last)
+				break;
+		}
+
+		g_qsort_with_data (&g_array_index (entries, struct match_run_entry, run.entries),
+				   n, sizeof (struct match_run_entry),
+				   match_run_entry_compare, (gpointer) rules);
+		g_array_append_val (runs, run);
+	}
+}
+
+/* append the match run index to the cache, see rule.h */
+static void
+write_match_runs (int fd, struct cache_header *header)
+{
+	char *rules;
+	GHashTable *in_run;
+	GArray *runs;
+	GArray *entries;
+	u_int32_t entries_offset;
+	guint i;
+
+	rules = g_malloc (header->all_rules_size);
+	if (pread (fd, rules, header->all_rules_size, 0) != (ssize_t) header->all_rules_size)
+		DIE(("Disk read error"));
+
+	in_run = g_hash_table_new (g_direct_hash, g_direct_equal);
+	runs = g_array_new (FALSE, FALSE, sizeof (struct match_run));
+	entries = g_array_new (FALSE, FALSE, sizeof (struct match_run_entry));
+
+	add_match_runs (rules, header->fdi_rules_preprobe, header->fdi_rules_information, in_run, runs, entries);
+	add_match_runs (rules, header->fdi_rules_information, header->fdi_rules_policy, in_run, runs, entries);
+	add_match_runs (rules, header->fdi_rules_policy, header->all_rules_size, in_run, runs, entries);
+
+	header->match_runs = 0;
+	header->num_match_runs = runs->len;
+	if (runs->len > 0) {
+		header->match_runs = RULES_ROUND(header->all_rules_size);
+		entries_offset = header->match_runs + runs->len * sizeof (struct match_run);
+
+		for (i = 0; i < runs->len; i++) {
+			struct match_run *run = &g_array_index (runs, struct match_run, i);
+			run->entries = entries_offset + run->entries * sizeof (struct match_run_entry);
+		}
+
+		pad32_write(fd, header->match_runs, runs->data, runs->len * sizeof (struct match_run));
+		pad32_write(fd, entries_offset, entries->data, entries->len * sizeof (struct match_run_entry));
+	}
+
+	if (haldc_verbose)
+		HAL_INFO (("%d match runs covering %d match rules", runs->len, entries->len));
+
+	g_array_free (entries, TRUE);
+	g_array_free (runs, TRUE);
+	g_hash_table_destroy (in_run);
+	g_free (rules);
+}
+
 /* returns number of skipped fdi files or -1 on unrecoverable errors */
 static int
 di_rules_init (void)
@@ -639,6 +1017,10 @@ di_rules_init (void)
 
 	cachename_temp = g_strconcat (cachename, "~", NULL);
 
+	old_cache_load (cachename);
+	sources = g_array_new (FALSE, FALSE, sizeof (struct cache_source));
+	source_paths = g_string_new (NULL);
+
 	fd = open(cachename_temp, O_CREAT|O_RDWR|O_TRUNC, 0644);
 	if(fd < 0) {
 		HAL_ERROR (("Unable to open fdi cache '%s' file for writing: %s", cachename_temp, strerror(errno)));
@@ -691,6 +1073,9 @@ di_rules_init (void)
 	}
 
 	header.all_rules_size = lseek(fd, 0, SEEK_END);
+	write_match_runs(fd, &header);
+	write_sources(fd, &header);
+	header.magic = HALD_CACHE_MAGIC;
 	pad32_write(fd, 0, &header, sizeof(struct cache_header));
 	close(fd);
 	if (rename (cachename_temp, cachename) != 0) {
@@ -709,6 +1094,9 @@ di_rules_init (void)
 	}
 
 	g_free (cachename_temp);
+	g_string_free (source_paths, TRUE);
+	g_array_free (sources, TRUE);
+	old_cache_unload ();
 	return num_skipped_fdi_files;
 error:
 	HAL_ERROR (("Error generating fdi cache"));
@@ -717,6 +1105,11 @@ error:
 
 	unlink (cachename_temp);
 	g_free (cachename_temp);
+	if (sources != NULL) {
+		g_string_free (source_paths, TRUE);
+		g_array_free (sources, TRUE);
+	}
+	old_cache_unload ();
 	return -1;
 }
 
@@ -68,15 +68,129 @@ struct _HalProperty {
 };
 typedef struct _HalProperty HalProperty;
 
+/* Pool of interned string property values and strlist elements; keys
+ * are the canonical copies and values their reference counts. Most
+ * values (subsystems, drivers, capabilities, vendor names) repeat across
+ * many devices, so each distinct string is only stored once and equal
+ * values share the same pointer.
+ */
+static GHashTable *string_pool = NULL;
+
+static const char *
+string_pool_ref (const char *str)
+{
+	gpointer orig_key;
+	gpointer count;
+
+	if (string_pool == NULL)
+		string_pool = g_hash_table_new (g_str_hash, g_str_equal);
+
+	if (g_hash_table_lookup_extended (string_pool, str, &orig_key, &count)) {
+		g_hash_table_insert (string_pool, orig_key,
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+		return (const char *) orig_key;
+	}
+
+	orig_key = g_strdup (str);
+	g_hash_table_insert (string_pool, orig_key, GUINT_TO_POINTER (1));
+	return (const char *) orig_key;
+}
+
+static void
+string_pool_unref (const char *str)
+{
+	guint count;
+
+	if (str == NULL)
+		return;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (string_pool, str));
+	g_return_if_fail (count > 0);
+
+	if (count == 1) {
+		g_hash_table_remove (string_pool, str);
+		g_free ((char *) str);
+	} else {
+		g_hash_table_insert (string_pool, (gpointer) str, GUINT_TO_POINTER (count - 1));
+	}
+}
+
+/**
+ * hal_device_intern_string:
+ * @str:                String to intern
+ * Returns:             The pooled copy of @str; release it with
+ *                      hal_device_release_string()
+ *
+ * Every string property value and strlist element is pooled, so a string
+ * interned here can be compared by pointer against them instead of using
+ * strcmp().
+ */
+const char *
+hal_device_intern_string (const char *str)
+{
+	return string_pool_ref (str);
+}
+
+/**
+ * hal_device_release_string:
+ * @str:                String returned by hal_device_intern_string()
+ */
+void
+hal_device_release_string (const char *str)
+{
+	string_pool_unref (str);
+}
+
+static void
+string_pool_stats_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	gsize *stats = (gsize *) user_data;
+	gsize size = strlen ((const char *) key) + 1;
+	guint count = GPOINTER_TO_UINT (value);
+
+	stats[0] += count;
+	stats[1] += size;
+	stats[2] += size * (count - 1);
+}
+
+/**
+ * hal_device_log_string_pool_stats:
+ *
+ * Log how many strings the pool holds, the string bytes sharing them
+ * saves compared to a copy per property and roughly what the pool's hash
+ * table costs for that. Allocator overhead is left out of both; this is
+ * not a measure of resident memory.
+ */
+void
+hal_device_log_string_pool_stats (void)
+{
+	gsize stats[3];
+	gsize overhead;
+
+	if (string_pool == NULL)
+		return;
+
+	stats[0] = stats[1] = stats[2] = 0;
+	g_hash_table_foreach (string_pool, string_pool_stats_foreach, stats);
+
+	/* a hash node of key, value, hash and next, plus a bucket pointer */
+	overhead = g_hash_table_size (string_pool) * 5 * sizeof (gpointer);
+
+	HAL_INFO (("String pool: %u distinct strings in %" G_GSIZE_FORMAT " bytes for %" G_GSIZE_FORMAT
+		   " references, %" G_GSIZE_FORMAT " string bytes saved for about %" G_GSIZE_FORMAT
+		   " bytes of pool",
+		   g_hash_table_size (string_pool), stats[1], stats[0], stats[2], overhead));
+}
+
 static inline void
 hal_property_free (HalProperty *prop)
 {
 	if (prop->type == HAL_PROPERTY_TYPE_STRING) {
-		g_free (prop->v.str_value);
+		string_pool_unref (prop->v.str_value);
 	} else if (prop->type == HAL_PROPERTY_TYPE_STRLIST) {
 		GSList *i;
 		for (i = prop->v.strlist_value; i != NULL; i = g_slist_next (i)) {
-			g_free (i->data);
+			string_pool_unref (i->data);
 		}
 		g_slist_free (prop->v.strlist_value);
 	}
@@ -192,28 +306,39 @@ hal_property_get_double (HalProperty *prop)
 static inline void
 hal_property_set_string (HalProperty *prop, const char *value)
 {
+	const char *old_value;
 	char *endchar;
-	gboolean validated = TRUE;
 
 	g_return_if_fail (prop != NULL);
 	g_return_if_fail (prop->type == HAL_PROPERTY_TYPE_STRING ||
 			  prop->type == HAL_PROPERTY_TYPE_INVALID);
 
+	if (value == NULL)
+		value = "";
+
 	prop->type = HAL_PROPERTY_TYPE_STRING;
-	if (prop->v.str_value != NULL)
-		g_free (prop->v.str_value);
-	prop->v.str_value = g_strdup (value != NULL ? value : "");
-
-	while (!g_utf8_validate (prop->v.str_value, -1,
-				 (const char **) &endchar)) {
-		validated = FALSE;
-		*endchar = '?';
-	}
+	old_value = prop->v.str_value;
+
+	if (g_utf8_validate (value, -1, NULL)) {
+		prop->v.str_value = (char *) string_pool_ref (value);
+	} else {
+		char *fixed;
+
+		/* pooled strings are shared; fix up a private copy */
+		fixed = g_strdup (value);
+		while (!g_utf8_validate (fixed, -1, (const char **) &endchar)) {
+			*endchar = '?';
+		}
 
-	if (!validated) {
 		HAL_WARNING (("Property has invalid UTF-8 string '%s', it was changed to: '%s'", 
-			      value, prop->v.str_value));
+			      value, fixed));
+
+		prop->v.str_value = (char *) string_pool_ref (fixed);
+		g_free (fixed);
 	}
+
+	/* drop the old value last so setting the same string never frees it */
+	string_pool_unref (old_value);
 }
 
 static inline void
@@ -262,7 +387,7 @@ hal_property_strlist_append (HalProperty *prop, const char *value)
 	g_return_val_if_fail (prop != NULL, FALSE);
 	g_return_val_if_fail (prop->type == HAL_PROPERTY_TYPE_STRLIST, FALSE);
 
-	prop->v.strlist_value = g_slist_append (prop->v.strlist_value, g_strdup (value));
+	prop->v.strlist_value = g_slist_append (prop->v.strlist_value, (gpointer) string_pool_ref (value));
 
 	return TRUE;
 }
@@ -273,7 +398,7 @@ hal_property_strlist_prepend (HalProperty *prop, const char *value)
 	g_return_val_if_fail (prop != NULL, FALSE);
 	g_return_val_if_fail (prop->type == HAL_PROPERTY_TYPE_STRLIST, FALSE);
 
-	prop->v.strlist_value = g_slist_prepend (prop->v.strlist_value, g_strdup (value));
+	prop->v.strlist_value = g_slist_prepend (prop->v.strlist_value, (gpointer) string_pool_ref (value));
 
 	return TRUE;
 }
@@ -293,7 +418,7 @@ hal_property_strlist_remove_elem (HalProperty *prop, guint index)
 	if (elem == NULL)
 		return FALSE;
 
-	g_free (elem->data);
+	string_pool_unref (elem->data);
 	prop->v.strlist_value = g_slist_delete_link (prop->v.strlist_value, elem);
 	return TRUE;
 }
@@ -308,7 +433,7 @@ hal_property_strlist_add (HalProperty  *prop, const char *value)
 	g_return_val_if_fail (prop->type == HAL_PROPERTY_TYPE_STRLIST, FALSE);
 
 	for (elem = prop->v.strlist_value; elem != NULL; elem = g_slist_next (elem)) {
-		if (strcmp (elem->data, value) == 0) {
+		if (elem->data == value || strcmp (elem->data, value) == 0) {
 			return FALSE;
 		}
 	}
@@ -326,7 +451,7 @@ hal_property_strlist_remove (HalProperty *prop, const char *value)
 	g_return_val_if_fail (prop->type == HAL_PROPERTY_TYPE_STRLIST, FALSE);
 
 	for (elem = prop->v.strlist_value, i = 0; elem != NULL; elem = g_slist_next (elem), i++) {
-		if (strcmp (elem->data, value) == 0) {
+		if (elem->data == value || strcmp (elem->data, value) == 0) {
 			return hal_property_strlist_remove_elem (prop, i);
 		}
 	}
@@ -343,9 +468,10 @@ hal_property_strlist_clear (HalProperty *prop)
 	g_return_val_if_fail (prop->type == HAL_PROPERTY_TYPE_STRLIST, FALSE);
 
 	for (elem = prop->v.strlist_value; elem != NULL; elem = g_slist_next (elem)) {
-		g_free (elem->data);
+		string_pool_unref (elem->data);
 	}
 	g_slist_free (prop->v.strlist_value);
+	prop->v.strlist_value = NULL;
 
 	return TRUE;
 }
@@ -1077,7 +1203,8 @@ hal_device_property_set_string (HalDevice *device, const char *key,
 			return FALSE;
 
 		/* don't bother setting the same value */
-		if (strcmp (hal_property_get_string (prop), value != NULL ? value : "") == 0)
+		if (hal_property_get_string (prop) == value ||
+		    strcmp (hal_property_get_string (prop), value != NULL ? value : "") == 0)
 			return TRUE;
 
 		g_signal_emit (device, signals[PRE_PROPERTY_CHANGED], 0,
@@ -1275,7 +1402,8 @@ hal_device_property_set_strlist (HalDevice *device, const char *key,
 		if (g_slist_length (value) == g_slist_length (current)) {
 			gboolean equal = TRUE;		
 			for (l = value; l != NULL; l = l->next, current = current->next) {
-				if (strcmp (l->data, current->data) != 0) {
+				if (l->data != current->data &&
+				    strcmp (l->data, current->data) != 0) {
  					equal = FALSE;
 					break;
 				} 
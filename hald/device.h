@@ -101,6 +101,10 @@ GType         hal_device_get_type            (void);
 
 HalDevice    *hal_device_new                 (void);
 
+const char   *hal_device_intern_string       (const char   *str);
+void          hal_device_release_string      (const char   *str);
+void          hal_device_log_string_pool_stats (void);
+
 void          hal_device_merge_with_rewrite  (HalDevice    *target,
 					      HalDevice    *source,
 					      const char   *target_namespace,
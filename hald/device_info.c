@@ -285,8 +285,9 @@ out:
 	return rc;
 }
 
+/* interned_value is the value of the rule from the string pool, if known */
 static gboolean
-handle_match (struct rule *rule, HalDevice *d)
+handle_match (struct rule *rule, HalDevice *d, const char *interned_value)
 {
 	char resolve_scratch[HAL_PATH_MAX*2 + 3];
 	const char *udi_to_check;
@@ -322,6 +323,9 @@ handle_match (struct rule *rule, HalDevice *d)
 	{
 		if (hal_device_property_get_type (d, prop_to_check) != HAL_PROPERTY_TYPE_STRING)
 			return FALSE;
+		/* property values are interned too, so equal strings are the same pointer */
+		if (interned_value != NULL)
+			return hal_device_property_get_string (d, prop_to_check) == interned_value;
 		if (strcmp (hal_device_property_get_string (d, prop_to_check), value) != 0)
 			return FALSE;
 		return TRUE;
@@ -513,7 +517,7 @@ handle_match (struct rule *rule, HalDevice *d)
 				     hal_device_property_strlist_iter_is_valid (&iter);
 				     hal_device_property_strlist_iter_next (&iter)) {
 					const char *str = hal_device_property_strlist_iter_get_value (&iter);
-					if (strcmp (str, value) == 0) {
+					if (interned_value != NULL ? str == interned_value : strcmp (str, value) == 0) {
 						contains = TRUE;
 						break;
 					}
@@ -615,9 +619,7 @@ handle_match (struct rule *rule, HalDevice *d)
 			GSList *i;
 			GSList *siblings;
 
-			siblings = hal_device_store_match_multiple_key_value_string (hald_get_gdl (),
-										     "info.parent",
-										     parent_udi);
+			siblings = hal_device_store_get_children (hald_get_gdl (), parent_udi);
 			for (i = siblings; i != NULL; i = g_slist_next (i)) {
 				HalDevice *sib = HAL_DEVICE (i->data);
 
@@ -652,7 +654,6 @@ handle_match (struct rule *rule, HalDevice *d)
 					break;
 
 			} /* for all siblings */
-			g_slist_free (siblings);			
 		}
 
 		return contains;
@@ -1084,10 +1085,9 @@ static struct rule *di_next(struct rule *rule){
 	return NULL;
 }
 
-static struct rule *di_jump(struct rule *rule){
+static struct rule *di_goto(struct rule *rule, size_t next){
 	struct cache_header	*header = (struct cache_header*) RULES_PTR(0);
 	size_t			offset = (char *)rule - (char*)rules_ptr;
-	size_t			next = rule->jump_position;
 
 	if (next == 0) return NULL;
 	if (((offset >= header->fdi_rules_preprobe) && (next < header->fdi_rules_information)) ||
@@ -1098,20 +1098,140 @@ static struct rule *di_jump(struct rule *rule){
 	return NULL;
 }
 
+static struct rule *di_jump(struct rule *rule){
+	return di_goto(rule, rule->jump_position);
+}
+
+/* compare the value of a match run entry against a property value */
+static int
+match_run_entry_compare (const struct match_run *run, const struct match_run_entry *entry,
+			 const char *str_value, int int_value)
+{
+	struct rule *rule;
+
+	if (run->type_match == MATCH_INT)
+		return (entry->int_value > int_value) - (entry->int_value < int_value);
+
+	rule = (struct rule *) RULES_PTR(entry->rule);
+	return strcmp ((char *) RULES_PTR(rule->value_offset), str_value);
+}
+
+/* the first block of the run at or after offset that tests for the given value, or 0 */
+static u_int32_t
+match_run_find (const struct match_run *run, u_int32_t offset, const char *str_value, int int_value)
+{
+	struct match_run_entry *entries = (struct match_run_entry *) RULES_PTR(run->entries);
+	u_int32_t lo = 0;
+	u_int32_t hi = run->num_entries;
+
+	while (lo < hi) {
+		u_int32_t mid = lo + (hi - lo) / 2;
+		int cmp;
+
+		cmp = match_run_entry_compare (run, &entries[mid], str_value, int_value);
+		if (cmp == 0 && entries[mid].rule < offset)
+			cmp = -1;
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == run->num_entries ||
+	    match_run_entry_compare (run, &entries[lo], str_value, int_value) != 0)
+		return 0;
+
+	return entries[lo].rule;
+}
+
+/* Where to go on when reaching the <match> rule at offset which is part of
+ * a match run: the rule itself if it has to be evaluated as usual, the next
+ * block of the run that can match the device or the end of the run. The
+ * blocks in between can't match and would just be jumped over one by one. */
+static u_int32_t
+match_run_skip (const struct match_run *run, u_int32_t offset, HalDevice *d, const char *key)
+{
+	u_int32_t next;
+	u_int32_t found;
+
+	next = run->end;
+
+	switch (run->type_match) {
+	case MATCH_STRING:
+		if (hal_device_property_get_type (d, key) == HAL_PROPERTY_TYPE_STRING) {
+			found = match_run_find (run, offset, hal_device_property_get_string (d, key), 0);
+			if (found != 0)
+				next = found;
+		}
+		break;
+
+	case MATCH_INT:
+		if (hal_device_property_get_type (d, key) == HAL_PROPERTY_TYPE_INT32) {
+			found = match_run_find (run, offset, NULL, hal_device_property_get_int (d, key));
+			if (found != 0)
+				next = found;
+		}
+		break;
+
+	case MATCH_CONTAINS:
+		if (hal_device_property_get_type (d, key) == HAL_PROPERTY_TYPE_STRLIST) {
+			HalDeviceStrListIter iter;
+
+			for (hal_device_property_strlist_iter_init (d, key, &iter);
+			     hal_device_property_strlist_iter_is_valid (&iter);
+			     hal_device_property_strlist_iter_next (&iter)) {
+				found = match_run_find (run, offset, hal_device_property_strlist_iter_get_value (&iter), 0);
+				if (found != 0 && found < next)
+					next = found;
+			}
+		} else if (hal_device_property_get_type (d, key) == HAL_PROPERTY_TYPE_STRING) {
+			/* substring match, can't be looked up */
+			next = offset;
+		}
+		break;
+
+	default:
+		next = offset;
+		break;
+	}
+
+	return next;
+}
+
 
 /* process a match and merge comand for a device */
 static void
 rules_match_and_merge_device (void *fdi_rules_list, HalDevice *d)
 {
 	struct rule *rule = fdi_rules_list;
+	const struct match_info *info;
+	u_int32_t offset;
+	u_int32_t next;
+
 	while (rule != NULL){
 		/*HAL_INFO(("== Iterating rules =="));*/
 
 		switch (rule->rtype) {
 		case RULE_MATCH:
+			/* skip to the next block of a match run that can match at all */
+			offset = (char *)rule - (char *)rules_ptr;
+			info = di_match_info_lookup (offset);
+			if (info != NULL && info->run != NULL) {
+				next = match_run_skip (info->run, offset, d, rule->key);
+				if (next != offset) {
+					rule = di_goto(rule, next);
+
+					if(rule == NULL)
+						DIE(("Rule is NULL on match run skip"));
+
+					continue;
+				}
+			}
+
 			/* skip non-matching rules block */
 			/*HAL_INFO(("%p match '%s' at %s", rule, rule->key, hal_device_get_udi (d)));*/
-			if (!handle_match (rule, d)) {
+			if (!handle_match (rule, d, info != NULL ? info->value : NULL)) {
 				/*HAL_INFO(("no match, skip to rule (%llx)", rule->jump_position));*/
 				rule = di_jump(rule);
 
@@ -1152,6 +1272,10 @@ rules_match_and_merge_device (void *fdi_rules_list, HalDevice *d)
 gboolean
 di_search_and_merge (HalDevice *d, DeviceInfoType type){
 	struct cache_header *header;
+	HaldStartupPhase phase;
+
+	phase = type == DEVICE_INFO_TYPE_PREPROBE ? HALD_STARTUP_PHASE_PREPROBE : HALD_STARTUP_PHASE_FDI_MERGE;
+	hald_startup_timing_begin (phase, d);
 
         /* make sure our fdi rule cache is up to date */
         if (di_cache_coherency_check (FALSE)) {
@@ -1198,5 +1322,7 @@ di_search_and_merge (HalDevice *d, DeviceInfoType type){
 		break;
 	}
 
+	hald_startup_timing_end (phase, d);
+
 	return TRUE;
 }
@@ -37,6 +37,8 @@
 
 static GObjectClass *parent_class;
 
+static void property_index_free (gpointer data);
+
 enum {
 	STORE_CHANGED,
 	DEVICE_PROPERTY_CHANGED,
@@ -55,6 +57,11 @@ hal_device_store_finalize (GObject *obj)
 
 	g_slist_foreach (store->devices, (GFunc) g_object_unref, NULL);
 
+	g_hash_table_destroy (store->property_index);
+	g_tree_destroy (store->udi_order);
+	g_hash_table_destroy (store->udi_index);
+	g_hash_table_destroy (store->device_udis);
+
 	if (parent_class->finalize)
 		parent_class->finalize (obj);
 }
@@ -137,7 +144,15 @@ hal_device_store_class_init (HalDeviceStoreClass *klass)
 static void
 hal_device_store_init (HalDeviceStore *device)
 {
-	device->property_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	device->property_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, property_index_free);
+
+	/* keys of udi_index and udi_order are owned by the values of device_udis */
+	device->udi_index = g_hash_table_new (g_str_hash, g_str_equal);
+	device->udi_order = g_tree_new ((GCompareFunc) strcmp);
+	device->device_udis = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	/* parent -> children adjacency, see hal_device_store_get_children() */
+	hal_device_store_index_property (device, "info.parent");
 }
 
 GType
@@ -179,8 +194,71 @@ static void
 property_index_check_all (HalDeviceStore *store, HalDevice *device, gboolean add);
 
 static void
-property_index_modify_string (HalDeviceStore *store, HalDevice *device,
-			      const char *key, gboolean added);
+property_index_modify (HalDeviceStore *store, HalDevice *device,
+		       const char *key, gboolean added);
+
+static void
+property_index_sync_strlist (HalDeviceStore *store, HalDevice *device,
+			     const char *key, gboolean added);
+
+static void
+udi_index_remove (HalDeviceStore *store, HalDevice *device)
+{
+	const char *udi;
+	GSList *l;
+
+	udi = g_hash_table_lookup (store->device_udis, device);
+	if (udi == NULL)
+		return;
+
+	if (g_hash_table_lookup (store->udi_index, udi) != device) {
+		/* a device added later took over the UDI */
+		store->num_shadowed_udis--;
+		goto out;
+	}
+
+	g_hash_table_remove (store->udi_index, udi);
+	g_tree_remove (store->udi_order, udi);
+
+	/* hand the UDI to the most recently added device that still has it,
+	 * which is what a scan of the device list would find */
+	if (store->num_shadowed_udis == 0)
+		goto out;
+	for (l = store->devices; l != NULL; l = l->next) {
+		HalDevice *other = (HalDevice *) l->data;
+		char *other_udi;
+
+		if (other == device)
+			continue;
+		other_udi = g_hash_table_lookup (store->device_udis, other);
+		if (other_udi != NULL && strcmp (other_udi, udi) == 0) {
+			g_hash_table_insert (store->udi_index, other_udi, other);
+			g_tree_insert (store->udi_order, other_udi, other);
+			store->num_shadowed_udis--;
+			break;
+		}
+	}
+
+out:
+	g_hash_table_remove (store->device_udis, device);
+}
+
+static void
+udi_index_add (HalDeviceStore *store, HalDevice *device)
+{
+	char *udi;
+
+	udi_index_remove (store, device);
+
+	udi = g_strdup (hal_device_get_udi (device));
+
+	if (g_hash_table_lookup (store->udi_index, udi) != NULL)
+		store->num_shadowed_udis++;
+
+	g_hash_table_insert (store->device_udis, device, udi);
+	g_hash_table_replace (store->udi_index, udi, device);
+	g_tree_replace (store->udi_order, udi, device);
+}
 
 static void
 device_pre_property_changed (HalDevice *device,
@@ -190,9 +268,8 @@ device_pre_property_changed (HalDevice *device,
 {
 	HalDeviceStore *store = HAL_DEVICE_STORE (data);
 
-	if (hal_device_property_get_type (device, key) == HAL_PROPERTY_TYPE_STRING) {
-		property_index_modify_string(store, device, key, FALSE);
-	}
+	/* strlists are resynced after the change; appends don't emit this */
+	property_index_modify (store, device, key, FALSE);
 }
 
 
@@ -205,9 +282,12 @@ emit_device_property_changed (HalDevice *device,
 {
 	HalDeviceStore *store = HAL_DEVICE_STORE (data);
 
-	if (hal_device_property_get_type (device, key) == HAL_PROPERTY_TYPE_STRING) {
-		property_index_modify_string(store, device, key, TRUE);
-	}
+	property_index_modify (store, device, key, TRUE);
+	property_index_sync_strlist (store, device, key, TRUE);
+
+	/* hal_device_set_udi() updates info.udi after changing the UDI */
+	if (strcmp (key, "info.udi") == 0)
+		udi_index_add (store, device);
 
 	g_signal_emit (store, signals[DEVICE_PROPERTY_CHANGED], 0,
 		       device, key, added, removed);
@@ -261,6 +341,7 @@ hal_device_store_add (HalDeviceStore *store, HalDevice *device)
 	}
 	store->devices = g_slist_prepend (store->devices,
 					  g_object_ref (device));
+	udi_index_add (store, device);
 
 	g_signal_connect (device, "property_changed",
 			  G_CALLBACK (emit_device_property_changed), store);
@@ -283,10 +364,11 @@ out:
 gboolean
 hal_device_store_remove (HalDeviceStore *store, HalDevice *device)
 {
-	if (!g_slist_find (store->devices, device))
+	if (g_hash_table_lookup (store->device_udis, device) == NULL)
 		return FALSE;
 
 	store->devices = g_slist_remove (store->devices, device);
+	udi_index_remove (store, device);
 
 	g_signal_handlers_disconnect_by_func (device,
 					      (gpointer)emit_device_property_changed,
@@ -316,16 +398,59 @@ hal_device_store_remove (HalDeviceStore *store, HalDevice *device)
 HalDevice *
 hal_device_store_find (HalDeviceStore *store, const char *udi)
 {
-	GSList *iter;
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (udi != NULL, NULL);
 
-	for (iter = store->devices; iter != NULL; iter = iter->next) {
-		HalDevice *d = iter->data;
+	return g_hash_table_lookup (store->udi_index, udi);
+}
 
-		if (strcmp (hal_device_get_udi (d), udi) == 0)
-			return d;
+typedef struct {
+	const char *udi;
+	const char *next_udi;
+} UdiOrderSearch;
+
+static gint
+udi_order_search_next (gconstpointer key, gconstpointer user_data)
+{
+	UdiOrderSearch *search = (UdiOrderSearch *) user_data;
+
+	/* never report a match; remember the last key after the UDI on
+	 * the way down, which ends up being the smallest one */
+	if (strcmp ((const char *) key, search->udi) > 0) {
+		search->next_udi = key;
+		return -1;
 	}
 
-	return NULL;
+	return 1;
+}
+
+/**
+ * hal_device_store_find_next:
+ * @store: the device store
+ * @udi: UDI to continue after; the empty string to start from the beginning
+ *
+ * Walk the store in UDI order without sorting it: each call is a search
+ * in a balanced tree.
+ *
+ * Returns: the device with the smallest UDI sorting after @udi, or
+ * #NULL if there is none
+ */
+HalDevice *
+hal_device_store_find_next (HalDeviceStore *store, const char *udi)
+{
+	UdiOrderSearch search;
+
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (udi != NULL, NULL);
+
+	search.udi = udi;
+	search.next_udi = NULL;
+	g_tree_search (store->udi_order, udi_order_search_next, &search);
+
+	if (search.next_udi == NULL)
+		return NULL;
+
+	return g_tree_lookup (store->udi_order, search.next_udi);
 }
 
 void
@@ -373,153 +498,464 @@ hal_device_store_print (HalDeviceStore *store)
 	fprintf (stderr, "===============================================\n");
 }
 
-HalDevice *
-hal_device_store_match_key_value_string (HalDeviceStore *store,
-					 const char *key,
-					 const char *value)
+/* Secondary index for a single property key. Every table maps a value
+ * of the given type to a GSList of the devices having that value; a
+ * table entry is dropped when its list becomes empty.
+ */
+typedef struct {
+	GHashTable *strings;
+	GHashTable *ints;
+	GHashTable *uint64s;
+	GHashTable *bools;
+	GHashTable *strlist_elems;
+
+	/* HalDevice -> GSList of the strlist elements it is indexed
+	 * under; strlists change without pre_property_changed so we
+	 * need to remember what to remove */
+	GHashTable *strlist_snapshot;
+} PropertyIndex;
+
+static guint
+uint64_hash (gconstpointer v)
 {
-	GSList *iter;
+	dbus_uint64_t x = *((const dbus_uint64_t *) v);
+
+	return (guint) (x ^ (x >> 32));
+}
+
+static gboolean
+uint64_equal (gconstpointer a, gconstpointer b)
+{
+	return *((const dbus_uint64_t *) a) == *((const dbus_uint64_t *) b);
+}
+
+static gpointer
+uint64_dup (gconstpointer v)
+{
+	dbus_uint64_t *x;
+
+	x = g_new (dbus_uint64_t, 1);
+	*x = *((const dbus_uint64_t *) v);
+	return x;
+}
+
+static void
+free_string_list (gpointer data)
+{
+	GSList *list = data;
+
+	g_slist_foreach (list, (GFunc) g_free, NULL);
+	g_slist_free (list);
+}
+
+static PropertyIndex *
+property_index_new (void)
+{
+	PropertyIndex *index;
+
+	index = g_new0 (PropertyIndex, 1);
+	index->strings = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) g_slist_free);
+	index->ints = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					     NULL, (GDestroyNotify) g_slist_free);
+	index->uint64s = g_hash_table_new_full (uint64_hash, uint64_equal,
+						g_free, (GDestroyNotify) g_slist_free);
+	index->bools = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, (GDestroyNotify) g_slist_free);
+	index->strlist_elems = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, (GDestroyNotify) g_slist_free);
+	index->strlist_snapshot = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+							 NULL, free_string_list);
+	return index;
+}
+
+static void
+property_index_free (gpointer data)
+{
+	PropertyIndex *index = data;
+
+	g_hash_table_destroy (index->strings);
+	g_hash_table_destroy (index->ints);
+	g_hash_table_destroy (index->uint64s);
+	g_hash_table_destroy (index->bools);
+	g_hash_table_destroy (index->strlist_elems);
+	g_hash_table_destroy (index->strlist_snapshot);
+	g_free (index);
+}
+
+/* Add or remove a device from the list for value. If the table owns its
+ * keys, copy_key/free_key are used to manage them. */
+static void
+index_table_modify (GHashTable *table, gconstpointer value,
+		    gpointer (*copy_key) (gconstpointer), GDestroyNotify free_key,
+		    HalDevice *device, gboolean added)
+{
+	gpointer orig_key;
+	gpointer orig_value;
 	GSList *devices;
-	GHashTable *index;
 
-	g_return_val_if_fail (store != NULL, NULL);
-	g_return_val_if_fail (key != NULL, NULL);
-	g_return_val_if_fail (value != NULL, NULL);
+	if (g_hash_table_lookup_extended (table, value, &orig_key, &orig_value)) {
+		devices = orig_value;
+		g_hash_table_steal (table, value);
+	} else {
+		devices = NULL;
+		orig_key = copy_key != NULL ? copy_key (value) : (gpointer) value;
+	}
+
+	if (added)
+		devices = g_slist_prepend (devices, device);
+	else
+		devices = g_slist_remove_all (devices, device);
+
+	if (devices != NULL)
+		g_hash_table_insert (table, orig_key, devices);
+	else if (free_key != NULL)
+		free_key (orig_key);
+}
+
+/* Returns the table holding values of the given type, and the key to
+ * look up value with. */
+static GHashTable *
+property_index_get_table (PropertyIndex *index, int type, gconstpointer value,
+			  gconstpointer *lookup_key)
+{
+	switch (type) {
+	case HAL_PROPERTY_TYPE_STRING:
+		*lookup_key = value;
+		return index->strings;
+	case HAL_PROPERTY_TYPE_STRLIST:
+		*lookup_key = value;
+		return index->strlist_elems;
+	case HAL_PROPERTY_TYPE_INT32:
+		*lookup_key = GINT_TO_POINTER (*((const dbus_int32_t *) value));
+		return index->ints;
+	case HAL_PROPERTY_TYPE_UINT64:
+		*lookup_key = value;
+		return index->uint64s;
+	case HAL_PROPERTY_TYPE_BOOLEAN:
+		*lookup_key = GINT_TO_POINTER (*((const dbus_bool_t *) value) ? 1 : 0);
+		return index->bools;
+	default:
+		return NULL;
+	}
+}
+
+static void
+property_index_modify (HalDeviceStore *store, HalDevice *device,
+		       const char *key, gboolean added)
+{
+	PropertyIndex *index;
 
 	index = g_hash_table_lookup (store->property_index, key);
+	if (!index) return;
 
-	if (index) {
-		devices = g_hash_table_lookup (index, value);
-		if (devices)
-			return (HalDevice*) devices->data;
-		else
-			return NULL;
-	} else {
-		for (iter = store->devices; iter != NULL; iter = iter->next) {
-			HalDevice *d = HAL_DEVICE (iter->data);
-			int type;
+	switch (hal_device_property_get_type (device, key)) {
+	case HAL_PROPERTY_TYPE_STRING:
+	{
+		const char *value;
+
+		value = hal_device_property_get_string (device, key);
+		HAL_DEBUG (("%s %p %s (%s,%s)", added ? "adding" : "removing",
+			    device, added ? "to" : "from", key, value));
+		index_table_modify (index->strings, value,
+				    (gpointer (*) (gconstpointer)) g_strdup, g_free,
+				    device, added);
+		break;
+	}
+	case HAL_PROPERTY_TYPE_INT32:
+		index_table_modify (index->ints,
+				    GINT_TO_POINTER (hal_device_property_get_int (device, key)),
+				    NULL, NULL, device, added);
+		break;
+	case HAL_PROPERTY_TYPE_UINT64:
+	{
+		dbus_uint64_t value;
+
+		value = hal_device_property_get_uint64 (device, key);
+		index_table_modify (index->uint64s, &value, uint64_dup, g_free, device, added);
+		break;
+	}
+	case HAL_PROPERTY_TYPE_BOOLEAN:
+		index_table_modify (index->bools,
+				    GINT_TO_POINTER (hal_device_property_get_bool (device, key) ? 1 : 0),
+				    NULL, NULL, device, added);
+		break;
+	default:
+		/* strlists are handled by property_index_sync_strlist() */
+		break;
+	}
+}
 
-			if (!hal_device_has_property (d, key))
-				continue;
+/* Drop whatever the device was indexed under for the strlist key and,
+ * if added is TRUE, index the current elements */
+static void
+property_index_sync_strlist (HalDeviceStore *store, HalDevice *device,
+			     const char *key, gboolean added)
+{
+	PropertyIndex *index;
+	GSList *elems;
+	GSList *i;
+	HalDeviceStrListIter iter;
 
-			type = hal_device_property_get_type (d, key);
-			if (type != HAL_PROPERTY_TYPE_STRING)
-				continue;
+	index = g_hash_table_lookup (store->property_index, key);
+	if (!index) return;
 
-			if (strcmp (hal_device_property_get_string (d, key),
-				    value) == 0)
-				return d;
-		}
+	elems = g_hash_table_lookup (index->strlist_snapshot, device);
+	for (i = elems; i != NULL; i = i->next) {
+		index_table_modify (index->strlist_elems, i->data,
+				    (gpointer (*) (gconstpointer)) g_strdup, g_free,
+				    device, FALSE);
+	}
+	g_hash_table_remove (index->strlist_snapshot, device);
+
+	if (!added || hal_device_property_get_type (device, key) != HAL_PROPERTY_TYPE_STRLIST)
+		return;
+
+	elems = NULL;
+	for (hal_device_property_strlist_iter_init (device, key, &iter);
+	     hal_device_property_strlist_iter_is_valid (&iter);
+	     hal_device_property_strlist_iter_next (&iter)) {
+		const char *value;
+
+		value = hal_device_property_strlist_iter_get_value (&iter);
+		index_table_modify (index->strlist_elems, value,
+				    (gpointer (*) (gconstpointer)) g_strdup, g_free,
+				    device, TRUE);
+		elems = g_slist_prepend (elems, g_strdup (value));
 	}
 
-	return NULL;
+	if (elems != NULL)
+		g_hash_table_insert (index->strlist_snapshot, device, elems);
 }
 
-HalDevice *
-hal_device_store_match_key_value_int (HalDeviceStore *store,
-				      const char *key,
-				      int value)
+/* Returns the (not copied) list of devices matching value, or NULL. Sets
+ * indexed to FALSE if key is not indexed and the caller needs to scan. */
+static GSList *
+property_index_lookup (HalDeviceStore *store, const char *key, int type,
+		       gconstpointer value, gboolean *indexed)
+{
+	PropertyIndex *index;
+	GHashTable *table;
+	gconstpointer lookup_key;
+
+	index = g_hash_table_lookup (store->property_index, key);
+	if (!index) {
+		*indexed = FALSE;
+		return NULL;
+	}
+
+	*indexed = TRUE;
+	table = property_index_get_table (index, type, value, &lookup_key);
+	if (table == NULL)
+		return NULL;
+
+	return g_hash_table_lookup (table, lookup_key);
+}
+
+static gboolean
+device_property_matches (HalDevice *device, const char *key, int type,
+			 gconstpointer value)
+{
+	if (type == HAL_PROPERTY_TYPE_STRLIST) {
+		if (hal_device_property_get_type (device, key) != HAL_PROPERTY_TYPE_STRLIST)
+			return FALSE;
+		return hal_device_property_strlist_contains (device, key, value);
+	}
+
+	if (hal_device_property_get_type (device, key) != type)
+		return FALSE;
+
+	switch (type) {
+	case HAL_PROPERTY_TYPE_STRING:
+		return strcmp (hal_device_property_get_string (device, key), value) == 0;
+	case HAL_PROPERTY_TYPE_INT32:
+		return hal_device_property_get_int (device, key) == *((const dbus_int32_t *) value);
+	case HAL_PROPERTY_TYPE_UINT64:
+		return hal_device_property_get_uint64 (device, key) == *((const dbus_uint64_t *) value);
+	case HAL_PROPERTY_TYPE_BOOLEAN:
+		return !hal_device_property_get_bool (device, key) == !*((const dbus_bool_t *) value);
+	default:
+		return FALSE;
+	}
+}
+
+static HalDevice *
+store_match_single (HalDeviceStore *store, const char *key, int type, gconstpointer value)
 {
 	GSList *iter;
+	GSList *devices;
+	gboolean indexed;
 
-	g_return_val_if_fail (store != NULL, NULL);
-	g_return_val_if_fail (key != NULL, NULL);
+	devices = property_index_lookup (store, key, type, value, &indexed);
+	if (indexed)
+		return devices != NULL ? HAL_DEVICE (devices->data) : NULL;
 
 	for (iter = store->devices; iter != NULL; iter = iter->next) {
 		HalDevice *d = HAL_DEVICE (iter->data);
-		int type;
-
-		if (!hal_device_has_property (d, key))
-			continue;
-
-		type = hal_device_property_get_type (d, key);
-		if (type != HAL_PROPERTY_TYPE_INT32)
-			continue;
 
-		if (hal_device_property_get_int (d, key) == value)
+		if (device_property_matches (d, key, type, value))
 			return d;
 	}
 
 	return NULL;
 }
 
-GSList *
-hal_device_store_match_multiple_key_value_string (HalDeviceStore *store,
-						  const char *key,
-						  const char *value)
+static GSList *
+store_match_multiple (HalDeviceStore *store, const char *key, int type, gconstpointer value)
 {
 	GSList *iter;
 	GSList *matches = NULL;
 	GSList *devices;
-	GHashTable *index;
+	gboolean indexed;
 
+	devices = property_index_lookup (store, key, type, value, &indexed);
+	if (indexed)
+		return g_slist_copy (devices);
+
+	for (iter = store->devices; iter != NULL; iter = iter->next) {
+		HalDevice *d = HAL_DEVICE (iter->data);
+
+		if (device_property_matches (d, key, type, value))
+			matches = g_slist_prepend (matches, d);
+	}
+
+	return matches;
+}
+
+HalDevice *
+hal_device_store_match_key_value_string (HalDeviceStore *store,
+					 const char *key,
+					 const char *value)
+{
 	g_return_val_if_fail (store != NULL, NULL);
 	g_return_val_if_fail (key != NULL, NULL);
 	g_return_val_if_fail (value != NULL, NULL);
 
-	index = g_hash_table_lookup (store->property_index, key);
+	return store_match_single (store, key, HAL_PROPERTY_TYPE_STRING, value);
+}
 
-	if (index) {
-		devices = g_hash_table_lookup (index, value);
-		return g_slist_copy(devices);
-	} else {
-		for (iter = store->devices; iter != NULL; iter = iter->next) {
-			HalDevice *d = HAL_DEVICE (iter->data);
-			int type;
+HalDevice *
+hal_device_store_match_key_value_int (HalDeviceStore *store,
+				      const char *key,
+				      int value)
+{
+	dbus_int32_t v = value;
 
-			if (!hal_device_has_property (d, key))
-				continue;
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
 
-			type = hal_device_property_get_type (d, key);
-			if (type != HAL_PROPERTY_TYPE_STRING)
-				continue;
+	return store_match_single (store, key, HAL_PROPERTY_TYPE_INT32, &v);
+}
 
-			if (strcmp (hal_device_property_get_string (d, key),
-				    value) == 0)
-				matches = g_slist_prepend (matches, d);
-		}
-	}
+GSList *
+hal_device_store_match_multiple_key_value_string (HalDeviceStore *store,
+						  const char *key,
+						  const char *value)
+{
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+	g_return_val_if_fail (value != NULL, NULL);
 
-	return matches;
+	return store_match_multiple (store, key, HAL_PROPERTY_TYPE_STRING, value);
 }
 
+GSList *
+hal_device_store_match_multiple_key_value_int (HalDeviceStore *store,
+					       const char *key,
+					       int value)
+{
+	dbus_int32_t v = value;
 
-void
-hal_device_store_index_property (HalDeviceStore *store, const char *key)
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	return store_match_multiple (store, key, HAL_PROPERTY_TYPE_INT32, &v);
+}
+
+GSList *
+hal_device_store_match_multiple_key_value_uint64 (HalDeviceStore *store,
+						  const char *key,
+						  dbus_uint64_t value)
 {
-	GHashTable *index;
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
 
-	index = g_hash_table_lookup (store->property_index, key);
+	return store_match_multiple (store, key, HAL_PROPERTY_TYPE_UINT64, &value);
+}
 
-	if (!index) {
-		index = g_hash_table_new (g_str_hash, g_str_equal);
-		g_hash_table_insert (store->property_index, g_strdup (key), index);
-	}
+GSList *
+hal_device_store_match_multiple_key_value_bool (HalDeviceStore *store,
+						const char *key,
+						dbus_bool_t value)
+{
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	return store_match_multiple (store, key, HAL_PROPERTY_TYPE_BOOLEAN, &value);
 }
 
-static void
-property_index_modify_string (HalDeviceStore *store, HalDevice *device,
-			      const char *key, gboolean added)
+GSList *
+hal_device_store_match_multiple_key_strlist_contains (HalDeviceStore *store,
+						      const char *key,
+						      const char *value)
 {
-	GHashTable *index;
-	const char *value;
-	GSList *devices;
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+	g_return_val_if_fail (value != NULL, NULL);
 
-	value = hal_device_property_get_string (device, key);
-	index = g_hash_table_lookup (store->property_index, key);
+	return store_match_multiple (store, key, HAL_PROPERTY_TYPE_STRLIST, value);
+}
 
-	if (!index) return;
+/**
+ * hal_device_store_get_children:
+ * @store: the device store
+ * @parent_udi: UDI of the parent device
+ *
+ * Get the devices in the store whose info.parent is @parent_udi. The
+ * list is maintained as info.parent changes, so this is a lookup rather
+ * than a scan of the store.
+ *
+ * Returns: list of #HalDevice; owned by the store and only valid until
+ * a device is added to or removed from it or changes its info.parent
+ */
+GSList *
+hal_device_store_get_children (HalDeviceStore *store, const char *parent_udi)
+{
+	gboolean indexed;
 
-	devices = g_hash_table_lookup (index, value);
+	g_return_val_if_fail (store != NULL, NULL);
+	g_return_val_if_fail (parent_udi != NULL, NULL);
 
-	if (added) { /*add*/
-		HAL_DEBUG (("adding %p to (%s,%s)", device, key, value));
-		devices = g_slist_prepend (devices, device);
-	} else { /*remove*/
-		HAL_DEBUG (("removing %p from (%s,%s)", device, key, value));
-		devices = g_slist_remove_all (devices, device);
+	return property_index_lookup (store, "info.parent", HAL_PROPERTY_TYPE_STRING, parent_udi, &indexed);
+}
+
+/**
+ * hal_device_store_index_property:
+ * @store: the device store
+ * @key: property key to index
+ *
+ * Maintain an index of the devices in the store by the value of @key
+ * so lookups on it don't need to scan all devices. String, integer,
+ * uint64 and boolean properties are indexed by value; strlist properties
+ * are indexed by each of their elements.
+ */
+void
+hal_device_store_index_property (HalDeviceStore *store, const char *key)
+{
+	PropertyIndex *index;
+	GSList *iter;
+
+	index = g_hash_table_lookup (store->property_index, key);
+
+	if (!index) {
+		index = property_index_new ();
+		g_hash_table_insert (store->property_index, g_strdup (key), index);
+
+		for (iter = store->devices; iter != NULL; iter = iter->next) {
+			property_index_modify (store, iter->data, key, TRUE);
+			property_index_sync_strlist (store, iter->data, key, TRUE);
+		}
 	}
-	g_hash_table_insert (index, (gpointer) value, devices);
 }
 
 #if GLIB_CHECK_VERSION (2,14,0)
@@ -547,10 +983,8 @@ property_index_check_all (HalDeviceStore *store, HalDevice *device, gboolean add
 
 	indexed_properties = g_hash_table_get_keys (store->property_index);
 	for (lp = indexed_properties; lp; lp = g_list_next (lp)) {
-		if (hal_device_property_get_type (device, lp->data) == HAL_PROPERTY_TYPE_STRING) {
-			property_index_modify_string (store, device, lp->data, added);
-		}
+		property_index_modify (store, device, lp->data, added);
+		property_index_sync_strlist (store, device, lp->data, added);
 	}
 	g_list_free (indexed_properties);
 }
-
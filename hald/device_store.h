@@ -39,6 +39,19 @@ struct _HalDeviceStore {
 
 	GSList *devices;
 	GHashTable *property_index;
+
+	/* UDI -> HalDevice, and HalDevice -> indexed UDI so the entry
+	 * can be found again when the device changes its UDI */
+	GHashTable *udi_index;
+	GHashTable *device_udis;
+
+	/* devices udi_index doesn't point at because a device added
+	 * later has the same UDI */
+	guint num_shadowed_udis;
+
+	/* the entries of udi_index sorted by UDI, so the store can be
+	 * walked in UDI order from any point */
+	GTree *udi_order;
 };
 
 struct _HalDeviceStoreClass {
@@ -104,6 +117,9 @@ gboolean        hal_device_store_remove     (HalDeviceStore *store,
 HalDevice      *hal_device_store_find       (HalDeviceStore *store,
 					     const char     *udi);
 
+HalDevice      *hal_device_store_find_next  (HalDeviceStore *store,
+					     const char     *udi);
+
 void            hal_device_store_foreach    (HalDeviceStore *store,
 					     HalDeviceStoreForeachFn callback,
 					     gpointer user_data);
@@ -120,6 +136,25 @@ GSList         *hal_device_store_match_multiple_key_value_string (HalDeviceStore
 								  const char *key,
 								  const char *value);
 
+GSList         *hal_device_store_match_multiple_key_value_int (HalDeviceStore *store,
+							       const char *key,
+							       int value);
+
+GSList         *hal_device_store_match_multiple_key_value_uint64 (HalDeviceStore *store,
+								  const char *key,
+								  dbus_uint64_t value);
+
+GSList         *hal_device_store_match_multiple_key_value_bool (HalDeviceStore *store,
+								const char *key,
+								dbus_bool_t value);
+
+GSList         *hal_device_store_match_multiple_key_strlist_contains (HalDeviceStore *store,
+								      const char *key,
+								      const char *value);
+
+GSList         *hal_device_store_get_children (HalDeviceStore *store,
+					       const char *parent_udi);
+
 void hal_device_store_print (HalDeviceStore *store);
 
 void		hal_device_store_index_property (HalDeviceStore *store, const char *key);
@@ -0,0 +1,1390 @@
+/***************************************************************************
+ * CVSID: $Id$
+ *
+ * device_test.c : Unit tests for the device store and D-Bus update queue
+ *
+ * Copyright (C) 2005 David Zeuthen, <david@fubar.dk>
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "logger.h"
+#include "hald.h"
+#include "hald_dbus.h"
+#include "device_store.h"
+#include "osspec.h"
+#include "hal-file-monitor.h"
+#include "ids.h"
+#include "ci-tracker.h"
+
+/* The test links against the hald core without hald.c and without an
+ * OS backend; these stand in for the few symbols the core needs. */
+
+static HalDeviceStore *global_device_list = NULL;
+
+static HalDeviceStore *temporary_device_list = NULL;
+
+dbus_bool_t hald_is_initialising = FALSE;
+
+dbus_bool_t hald_is_shutting_down = FALSE;
+
+dbus_bool_t hald_is_verbose = FALSE;
+
+dbus_bool_t hald_use_syslog = FALSE;
+
+#ifdef HAVE_POLKIT
+PolKitContext *pk_context = NULL;
+#endif
+
+HalDeviceStore *
+hald_get_gdl (void)
+{
+	if (global_device_list == NULL)
+		global_device_list = hal_device_store_new ();
+
+	return global_device_list;
+}
+
+HalDeviceStore *
+hald_get_tdl (void)
+{
+	if (temporary_device_list == NULL)
+		temporary_device_list = hal_device_store_new ();
+
+	return temporary_device_list;
+}
+
+void
+hald_startup_timing_begin (HaldStartupPhase phase, gconstpointer key)
+{
+}
+
+void
+hald_startup_timing_end (HaldStartupPhase phase, gconstpointer key)
+{
+}
+
+gboolean
+osspec_device_rescan (HalDevice *d)
+{
+	return FALSE;
+}
+
+gboolean
+osspec_device_reprobe (HalDevice *d)
+{
+	return FALSE;
+}
+
+void
+osspec_refresh_mount_state_for_block_device (HalDevice *d)
+{
+}
+
+DBusHandlerResult
+osspec_filter_function (DBusConnection *connection, DBusMessage *message, void *user_data)
+{
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+HalFileMonitor *
+osspec_get_file_monitor (void)
+{
+	return NULL;
+}
+
+guint
+hal_file_monitor_add_notify (HalFileMonitor *monitor, const char *path, int mask,
+			     HalFileMonitorNotifyFunc notify_func, gpointer data)
+{
+	return 0;
+}
+
+/*--------------------------------------------------------------------------------------------------------------*/
+
+static gboolean
+check_store_index (void)
+{
+	HalDeviceStore *store;
+	HalDevice *d1;
+	HalDevice *d2;
+	GSList *l;
+	gboolean ret;
+
+	ret = FALSE;
+
+	printf ("Checking HalDeviceStore typed property indexes: ");
+
+	store = hal_device_store_new ();
+	hal_device_store_index_property (store, "test.int");
+	hal_device_store_index_property (store, "test.bool");
+	hal_device_store_index_property (store, "test.caps");
+
+	d1 = hal_device_new ();
+	hal_device_set_udi (d1, "/org/freedesktop/Hal/devices/index_test_1");
+	hal_device_property_set_int (d1, "test.int", 42);
+	hal_device_property_set_bool (d1, "test.bool", TRUE);
+	hal_device_property_strlist_append (d1, "test.caps", "block", FALSE);
+	hal_device_store_add (store, d1);
+
+	d2 = hal_device_new ();
+	hal_device_set_udi (d2, "/org/freedesktop/Hal/devices/index_test_2");
+	hal_device_store_add (store, d2);
+	hal_device_property_set_int (d2, "test.int", 43);
+	hal_device_property_set_bool (d2, "test.bool", TRUE);
+	hal_device_add_capability (d2, "block");
+	hal_device_add_capability (d2, "storage");
+
+	if (hal_device_store_match_key_value_int (store, "test.int", 42) != d1 ||
+	    hal_device_store_match_key_value_int (store, "test.int", 43) != d2) {
+		printf ("FAILED1\n");
+		goto out;
+	}
+
+	l = hal_device_store_match_multiple_key_value_bool (store, "test.bool", TRUE);
+	if (g_slist_length (l) != 2) {
+		printf ("FAILED2\n");
+		g_slist_free (l);
+		goto out;
+	}
+	g_slist_free (l);
+
+	l = hal_device_store_match_multiple_key_strlist_contains (store, "test.caps", "block");
+	if (g_slist_length (l) != 1 || l->data != d1) {
+		printf ("FAILED3\n");
+		g_slist_free (l);
+		goto out;
+	}
+	g_slist_free (l);
+
+	/* changes must move devices between buckets */
+	hal_device_property_set_int (d1, "test.int", 43);
+	hal_device_property_strlist_remove (d1, "test.caps", "block");
+	hal_device_property_strlist_add (d2, "test.caps", "block");
+	if (hal_device_store_match_key_value_int (store, "test.int", 42) != NULL) {
+		printf ("FAILED4\n");
+		goto out;
+	}
+	l = hal_device_store_match_multiple_key_value_int (store, "test.int", 43);
+	if (g_slist_length (l) != 2) {
+		printf ("FAILED5\n");
+		g_slist_free (l);
+		goto out;
+	}
+	g_slist_free (l);
+	l = hal_device_store_match_multiple_key_strlist_contains (store, "test.caps", "block");
+	if (g_slist_length (l) != 1 || l->data != d2) {
+		printf ("FAILED6\n");
+		g_slist_free (l);
+		goto out;
+	}
+	g_slist_free (l);
+
+	/* and removal from the store must drop them */
+	hal_device_store_remove (store, d2);
+	l = hal_device_store_match_multiple_key_value_int (store, "test.int", 43);
+	if (g_slist_length (l) != 1 || l->data != d1) {
+		printf ("FAILED7\n");
+		g_slist_free (l);
+		goto out;
+	}
+	g_slist_free (l);
+	l = hal_device_store_match_multiple_key_strlist_contains (store, "test.caps", "block");
+	if (l != NULL) {
+		printf ("FAILED8\n");
+		g_slist_free (l);
+		goto out;
+	}
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	g_object_unref (d1);
+	g_object_unref (d2);
+	g_object_unref (store);
+	return ret;
+}
+
+static gboolean
+check_store_children (void)
+{
+	HalDeviceStore *store;
+	HalDevice *parent;
+	HalDevice *child;
+	gboolean ret;
+
+	ret = FALSE;
+
+	printf ("Checking HalDeviceStore parent/children adjacency: ");
+
+	store = hal_device_store_new ();
+
+	parent = hal_device_new ();
+	hal_device_set_udi (parent, "/org/freedesktop/Hal/devices/children_test_hub");
+	hal_device_store_add (store, parent);
+
+	child = hal_device_new ();
+	hal_device_set_udi (child, "/org/freedesktop/Hal/devices/children_test_port");
+	hal_device_store_add (store, child);
+	hal_device_property_set_string (child, "info.parent", hal_device_get_udi (parent));
+
+	if (g_slist_length (hal_device_store_get_children (store, hal_device_get_udi (parent))) != 1 ||
+	    hal_device_store_get_children (store, hal_device_get_udi (parent))->data != child) {
+		printf ("FAILED1\n");
+		goto out;
+	}
+
+	/* reparenting moves the child */
+	hal_device_property_set_string (child, "info.parent", "/org/freedesktop/Hal/devices/computer");
+	if (hal_device_store_get_children (store, hal_device_get_udi (parent)) != NULL ||
+	    hal_device_store_get_children (store, "/org/freedesktop/Hal/devices/computer") == NULL) {
+		printf ("FAILED2\n");
+		goto out;
+	}
+
+	hal_device_store_remove (store, child);
+	if (hal_device_store_get_children (store, "/org/freedesktop/Hal/devices/computer") != NULL) {
+		printf ("FAILED3\n");
+		goto out;
+	}
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	g_object_unref (child);
+	g_object_unref (parent);
+	g_object_unref (store);
+	return ret;
+}
+
+/* Walk the store in UDI order with hal_device_store_find_next() while
+ * devices are added, renamed and removed */
+static gboolean
+check_store_udi_order (void)
+{
+	static const char *udis[] = {
+		"/org/freedesktop/Hal/devices/order_c",
+		"/org/freedesktop/Hal/devices/order_a",
+		"/org/freedesktop/Hal/devices/order_d",
+		"/org/freedesktop/Hal/devices/order_b"
+	};
+	HalDeviceStore *store;
+	HalDevice *devices[4];
+	HalDevice *d;
+	gboolean ret;
+	guint n;
+
+	ret = FALSE;
+
+	printf ("Checking HalDeviceStore UDI order: ");
+
+	store = hal_device_store_new ();
+	for (n = 0; n < G_N_ELEMENTS (udis); n++) {
+		devices[n] = hal_device_new ();
+		hal_device_set_udi (devices[n], udis[n]);
+		hal_device_store_add (store, devices[n]);
+	}
+
+	if (hal_device_store_find_next (store, "") != devices[1] ||
+	    hal_device_store_find_next (store, udis[1]) != devices[3] ||
+	    hal_device_store_find_next (store, udis[3]) != devices[0] ||
+	    hal_device_store_find_next (store, udis[0]) != devices[2] ||
+	    hal_device_store_find_next (store, udis[2]) != NULL) {
+		printf ("FAILED1\n");
+		goto out;
+	}
+
+	/* the cursor need not be in the store */
+	if (hal_device_store_find_next (store, "/org/freedesktop/Hal/devices/order_bb") != devices[0]) {
+		printf ("FAILED2\n");
+		goto out;
+	}
+
+	/* renaming moves the device; removing drops it */
+	hal_device_set_udi (devices[1], "/org/freedesktop/Hal/devices/order_e");
+	hal_device_store_remove (store, devices[0]);
+	for (n = 0, d = hal_device_store_find_next (store, "");
+	     d != NULL;
+	     n++, d = hal_device_store_find_next (store, hal_device_get_udi (d))) {
+		if ((n == 0 && d != devices[3]) ||
+		    (n == 1 && d != devices[2]) ||
+		    (n == 2 && d != devices[1]) ||
+		    n > 2) {
+			printf ("FAILED3\n");
+			goto out;
+		}
+	}
+	if (n != 3) {
+		printf ("FAILED4\n");
+		goto out;
+	}
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	for (n = 0; n < G_N_ELEMENTS (udis); n++)
+		g_object_unref (devices[n]);
+	g_object_unref (store);
+	return ret;
+}
+
+/* Two devices with the same UDI: the one added last is found, and
+ * removing or renaming it makes the other one findable again */
+static gboolean
+check_store_shared_udi (void)
+{
+	const char *shared = "/org/freedesktop/Hal/devices/shared_udi";
+	const char *renamed = "/org/freedesktop/Hal/devices/shared_udi_renamed";
+	HalDeviceStore *store;
+	HalDevice *d1;
+	HalDevice *d2;
+	gboolean ret;
+
+	ret = FALSE;
+
+	printf ("Checking HalDeviceStore devices sharing a UDI: ");
+
+	store = hal_device_store_new ();
+
+	d1 = hal_device_new ();
+	hal_device_set_udi (d1, shared);
+	hal_device_store_add (store, d1);
+
+	d2 = hal_device_new ();
+	hal_device_set_udi (d2, shared);
+	hal_device_store_add (store, d2);
+
+	if (hal_device_store_find (store, shared) != d2) {
+		printf ("FAILED1\n");
+		goto out;
+	}
+
+	/* removing the newer device falls back to the older one */
+	hal_device_store_remove (store, d2);
+	if (hal_device_store_find (store, shared) != d1 ||
+	    hal_device_store_find_next (store, "") != d1) {
+		printf ("FAILED2\n");
+		goto out;
+	}
+
+	/* removing the older device keeps the newer one */
+	hal_device_store_add (store, d2);
+	hal_device_store_remove (store, d1);
+	if (hal_device_store_find (store, shared) != d2) {
+		printf ("FAILED3\n");
+		goto out;
+	}
+
+	/* renaming the newer device falls back as well */
+	hal_device_store_add (store, d1);
+	hal_device_set_udi (d1, renamed);
+	if (hal_device_store_find (store, shared) != d2 ||
+	    hal_device_store_find (store, renamed) != d1) {
+		printf ("FAILED4\n");
+		goto out;
+	}
+
+	hal_device_store_remove (store, d1);
+	hal_device_store_remove (store, d2);
+	if (hal_device_store_find (store, shared) != NULL ||
+	    hal_device_store_find (store, renamed) != NULL ||
+	    hal_device_store_find_next (store, "") != NULL) {
+		printf ("FAILED5\n");
+		goto out;
+	}
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	g_object_unref (d1);
+	g_object_unref (d2);
+	g_object_unref (store);
+	return ret;
+}
+
+/* Time UDI lookups against device stores of growing size; with the
+ * UDI index the cost per lookup should stay flat */
+static gboolean
+check_store_lookup (void)
+{
+	static const guint sizes[] = {100, 1000, 10000, 50000};
+	const guint num_lookups = 200000;
+	double first_cost;
+	guint n;
+
+	printf ("Checking HalDeviceStore lookup scaling\n");
+
+	first_cost = 0.0;
+	for (n = 0; n < G_N_ELEMENTS (sizes); n++) {
+		HalDeviceStore *store;
+		GTimer *timer;
+		char udi[256];
+		double cost;
+		guint i;
+
+		store = hal_device_store_new ();
+		for (i = 0; i < sizes[n]; i++) {
+			HalDevice *d;
+
+			d = hal_device_new ();
+			g_snprintf (udi, sizeof (udi), "/org/freedesktop/Hal/devices/bench_%u", i);
+			hal_device_set_udi (d, udi);
+			hal_device_store_add (store, d);
+			g_object_unref (d);
+		}
+
+		timer = g_timer_new ();
+		for (i = 0; i < num_lookups; i++) {
+			g_snprintf (udi, sizeof (udi), "/org/freedesktop/Hal/devices/bench_%u",
+				    (i * 7919) % sizes[n]);
+			if (hal_device_store_find (store, udi) == NULL) {
+				printf ("FAILED: %s not found\n", udi);
+				g_timer_destroy (timer);
+				g_object_unref (store);
+				goto out;
+			}
+		}
+		g_timer_stop (timer);
+
+		cost = g_timer_elapsed (timer, NULL) * 1e9 / num_lookups;
+		if (n == 0)
+			first_cost = cost;
+		/* timings are only reported; a loaded machine shouldn't fail the test */
+		printf ("  %6u devices: %8.1f ns/lookup (%.1fx the smallest store)\n",
+			sizes[n], cost, cost / first_cost);
+
+		g_timer_destroy (timer);
+		g_object_unref (store);
+	}
+	printf ("PASSED\n");
+
+	return TRUE;
+out:
+	return FALSE;
+}
+
+/* Time flushing of queued PropertyModified updates; the cost per
+ * update is printed for growing numbers of queued updates */
+static gboolean
+check_atomic_update_flush (void)
+{
+	static const guint sizes[] = {1000, 10000, 100000};
+	const guint num_devices = 100;
+	const guint num_keys = 50;
+	HalDevice *devices[100];
+	char key[64];
+	double first_cost;
+	guint n;
+	guint i;
+
+	printf ("Checking flush of atomic property updates\n");
+
+	for (i = 0; i < num_devices; i++) {
+		char udi[256];
+
+		devices[i] = hal_device_new ();
+		g_snprintf (udi, sizeof (udi), "/org/freedesktop/Hal/devices/flush_%u", i);
+		hal_device_set_udi (devices[i], udi);
+	}
+
+	first_cost = 0.0;
+	for (n = 0; n < G_N_ELEMENTS (sizes); n++) {
+		GTimer *timer;
+		double cost;
+
+		timer = g_timer_new ();
+		device_property_atomic_update_begin ();
+		for (i = 0; i < sizes[n]; i++) {
+			/* spread over devices and repeat keys */
+			g_snprintf (key, sizeof (key), "test.key%u", (i / num_devices) % num_keys);
+			device_send_signal_property_modified (devices[i % num_devices], key, FALSE, FALSE);
+		}
+		device_property_atomic_update_end ();
+		g_timer_stop (timer);
+
+		cost = g_timer_elapsed (timer, NULL) * 1e9 / sizes[n];
+		if (n == 0)
+			first_cost = cost;
+		/* timings are only reported; a loaded machine shouldn't fail the test */
+		printf ("  %6u updates: %8.1f ns/update (%.1fx the smallest batch)\n",
+			sizes[n], cost, cost / first_cost);
+
+		g_timer_destroy (timer);
+	}
+	printf ("PASSED\n");
+
+	for (i = 0; i < num_devices; i++)
+		g_object_unref (devices[i]);
+	return TRUE;
+}
+
+/* A stand-in for the bus daemon (and ConsoleKit) answering the caller
+ * info queries of a CITracker in random order. Callers are named
+ * :1.n for well-behaved ones, :2.n for ones the bus gives a reply of
+ * the wrong type for, :3.n for ones the bus says have no owner and
+ * :4.n for ones that disconnect while their info is being resolved;
+ * half of those before the bus has answered anything and half once it
+ * is busy answering. */
+
+#define CI_TEST_NUM_NAMES 200
+#define CI_TEST_NUM_WAITERS 3
+
+typedef struct {
+	GPtrArray *pending;
+	GRand *rand;
+	guint idle_id;
+	guint num_answered;
+} CITestBus;
+
+typedef struct {
+	char *name;
+	guint num_calls;
+	gboolean got_info;
+	uid_t uid;
+} CITestWaiter;
+
+static int
+ci_test_kind (const char *name)
+{
+	return name[1] - '0';
+}
+
+static guint
+ci_test_number (const char *name)
+{
+	return (guint) strtoul (name + 3, NULL, 10);
+}
+
+static void
+ci_test_bus_reply (DBusConnection *connection, DBusMessage *message)
+{
+	DBusMessage *reply;
+	const char *member;
+	const char *name;
+	dbus_uint32_t val;
+
+	member = dbus_message_get_member (message);
+	name = NULL;
+	dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+
+	if (strcmp (member, "GetConnectionSELinuxSecurityContext") == 0) {
+		reply = dbus_message_new_error (message, "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown",
+						"no SELinux");
+	} else if (strcmp (member, "GetSessionForUnixProcess") == 0) {
+		reply = dbus_message_new_error (message, "org.freedesktop.ConsoleKit.Manager.GeneralError",
+						"not in a session");
+	} else if (name == NULL) {
+		reply = dbus_message_new_error (message, DBUS_ERROR_UNKNOWN_METHOD, member);
+	} else if (ci_test_kind (name) == 3) {
+		reply = dbus_message_new_error (message, DBUS_ERROR_NAME_HAS_NO_OWNER, name);
+	} else if (ci_test_kind (name) == 2) {
+		reply = dbus_message_new_method_return (message);
+		dbus_message_append_args (reply, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+	} else {
+		/* uid for GetConnectionUnixUser, pid for GetConnectionUnixProcessID */
+		val = 1000 + ci_test_number (name);
+		reply = dbus_message_new_method_return (message);
+		dbus_message_append_args (reply, DBUS_TYPE_UINT32, &val, DBUS_TYPE_INVALID);
+	}
+
+	dbus_connection_send (connection, reply, NULL);
+	dbus_message_unref (reply);
+}
+
+static gboolean
+ci_test_bus_answer (gpointer user_data)
+{
+	CITestBus *bus = (CITestBus *) user_data;
+	DBusMessage *message;
+	DBusConnection *connection;
+	guint i;
+
+	if (bus->pending->len == 0) {
+		bus->idle_id = 0;
+		return FALSE;
+	}
+
+	/* pending holds (connection, message) pairs */
+	i = 2 * g_rand_int_range (bus->rand, 0, bus->pending->len / 2);
+	connection = g_ptr_array_index (bus->pending, i);
+	message = g_ptr_array_index (bus->pending, i + 1);
+	g_ptr_array_remove_index_fast (bus->pending, i + 1);
+	g_ptr_array_remove_index_fast (bus->pending, i);
+
+	ci_test_bus_reply (connection, message);
+	dbus_message_unref (message);
+	dbus_connection_unref (connection);
+	bus->num_answered++;
+
+	return TRUE;
+}
+
+static DBusHandlerResult
+ci_test_bus_filter (DBusConnection *connection, DBusMessage *message, void *user_data)
+{
+	CITestBus *bus = (CITestBus *) user_data;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	g_ptr_array_add (bus->pending, dbus_connection_ref (connection));
+	g_ptr_array_add (bus->pending, dbus_message_ref (message));
+	if (bus->idle_id == 0)
+		bus->idle_id = g_idle_add (ci_test_bus_answer, bus);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+ci_test_bus_new_connection (DBusServer *server, DBusConnection *new_connection, void *user_data)
+{
+	dbus_connection_add_filter (new_connection, ci_test_bus_filter, user_data, NULL);
+	dbus_connection_ref (new_connection);
+	dbus_connection_setup_with_g_main (new_connection, NULL);
+}
+
+static void
+ci_test_got_info (CITracker *cit, CICallerInfo *ci, gpointer user_data)
+{
+	CITestWaiter *waiter = (CITestWaiter *) user_data;
+
+	waiter->num_calls++;
+	waiter->got_info = (ci != NULL);
+	if (ci != NULL)
+		waiter->uid = ci_tracker_caller_get_uid (ci);
+}
+
+static gboolean
+ci_test_disconnects_early (const char *name)
+{
+	return ci_test_kind (name) == 4 && ci_test_number (name) % 8 == 3;
+}
+
+static void
+ci_test_disconnect (CITracker *cit, CITestWaiter *waiters, guint num_waiters, gboolean early)
+{
+	guint i;
+
+	/* the first CI_TEST_NUM_NAMES waiters have one of each name */
+	for (i = 0; i < num_waiters && i < CI_TEST_NUM_NAMES; i++) {
+		if (ci_test_kind (waiters[i].name) == 4 &&
+		    ci_test_disconnects_early (waiters[i].name) == early)
+			ci_tracker_name_owner_changed (cit, waiters[i].name, waiters[i].name, "");
+	}
+}
+
+/* Run the main loop until the callback has run for all waiters */
+static gboolean
+ci_test_wait (CITestWaiter *waiters, guint num_waiters, CITracker *cit, CITestBus *bus)
+{
+	GTimer *timer;
+	gboolean disconnected;
+	guint num_done;
+	guint i;
+
+	disconnected = (cit == NULL);
+	timer = g_timer_new ();
+	do {
+		g_main_context_iteration (NULL, FALSE);
+
+		if (!disconnected && bus->num_answered >= CI_TEST_NUM_NAMES / 2) {
+			ci_test_disconnect (cit, waiters, num_waiters, FALSE);
+			disconnected = TRUE;
+		}
+
+		for (i = 0, num_done = 0; i < num_waiters; i++) {
+			if (waiters[i].num_calls > 0)
+				num_done++;
+		}
+	} while (num_done < num_waiters && g_timer_elapsed (timer, NULL) < 30.0);
+	g_timer_destroy (timer);
+
+	if (num_done < num_waiters) {
+		printf ("FAILED: %u of %u lookups never finished\n", num_waiters - num_done, num_waiters);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Many concurrent lookups, several per name, with some callers
+ * disconnecting before or while the bus answers */
+static gboolean
+check_caller_info_lookups (void)
+{
+	DBusServer *server;
+	DBusConnection *connection;
+	DBusError error;
+	CITestBus bus;
+	CITracker *cit;
+	CITestWaiter waiters[CI_TEST_NUM_NAMES * CI_TEST_NUM_WAITERS];
+	CITestWaiter late;
+	char *address;
+	gboolean ret;
+	guint i;
+
+	ret = FALSE;
+	server = NULL;
+	connection = NULL;
+	memset (waiters, 0, sizeof (waiters));
+	memset (&bus, 0, sizeof (bus));
+	bus.pending = g_ptr_array_new ();
+	bus.rand = g_rand_new_with_seed (42);
+
+	printf ("Checking concurrent caller info lookups\n");
+
+	dbus_error_init (&error);
+	server = dbus_server_listen ("unix:tmpdir=/tmp", &error);
+	if (server == NULL) {
+		printf ("FAILED: cannot create D-BUS server: %s\n", error.message);
+		dbus_error_free (&error);
+		goto out;
+	}
+	dbus_server_setup_with_g_main (server, NULL);
+	dbus_server_set_new_connection_function (server, ci_test_bus_new_connection, &bus, NULL);
+
+	address = dbus_server_get_address (server);
+	connection = dbus_connection_open_private (address, &error);
+	dbus_free (address);
+	if (connection == NULL) {
+		printf ("FAILED: cannot connect to D-BUS server: %s\n", error.message);
+		dbus_error_free (&error);
+		goto out;
+	}
+	dbus_connection_setup_with_g_main (connection, NULL);
+
+	cit = ci_tracker_new ();
+	ci_tracker_set_system_bus_connection (cit, connection);
+	ci_tracker_init (cit);
+
+	for (i = 0; i < G_N_ELEMENTS (waiters); i++) {
+		guint n = i % CI_TEST_NUM_NAMES;
+
+		waiters[i].name = g_strdup_printf (":%u.%u", 1 + n % 4, n);
+		ci_tracker_get_info_async (cit, waiters[i].name, ci_test_got_info, &waiters[i]);
+	}
+	ci_test_disconnect (cit, waiters, G_N_ELEMENTS (waiters), TRUE);
+
+	if (!ci_test_wait (waiters, G_N_ELEMENTS (waiters), cit, &bus))
+		goto out_tracker;
+
+	for (i = 0; i < G_N_ELEMENTS (waiters); i++) {
+		const char *name = waiters[i].name;
+		int kind = ci_test_kind (name);
+
+		if (waiters[i].num_calls != 1) {
+			printf ("FAILED: %s: callback ran %u times\n", name, waiters[i].num_calls);
+			goto out_tracker;
+		}
+		/* a caller that went away once the bus got going may or
+		 * may not have been resolved before */
+		if ((kind == 1 && !waiters[i].got_info) ||
+		    ((kind == 2 || kind == 3 || ci_test_disconnects_early (name)) && waiters[i].got_info) ||
+		    (waiters[i].got_info && waiters[i].uid != 1000 + ci_test_number (name))) {
+			printf ("FAILED: %s: wrong caller info\n", name);
+			goto out_tracker;
+		}
+		if (kind == 4 && ci_tracker_has_info (cit, name)) {
+			printf ("FAILED: %s: info kept after the caller went away\n", name);
+			goto out_tracker;
+		}
+	}
+
+	/* resolved callers are cached, as are names the bus says are gone */
+	for (i = 0; i < 4; i++) {
+		memset (&late, 0, sizeof (late));
+		late.name = g_strdup_printf (":%u.%u", 1 + i, i);
+		ci_tracker_get_info_async (cit, late.name, ci_test_got_info, &late);
+		if ((i == 0 || i == 2) && late.num_calls != 1) {
+			printf ("FAILED: %s: not answered from the cache\n", late.name);
+			g_free (late.name);
+			goto out_tracker;
+		}
+		if (!ci_test_wait (&late, 1, NULL, &bus)) {
+			g_free (late.name);
+			goto out_tracker;
+		}
+		g_free (late.name);
+	}
+
+	printf ("PASSED\n");
+	ret = TRUE;
+
+out_tracker:
+	/* let the bus answer whatever is still in flight before the
+	 * connection goes away */
+	while (bus.pending->len > 0)
+		g_main_context_iteration (NULL, TRUE);
+out:
+	for (i = 0; i < G_N_ELEMENTS (waiters); i++)
+		g_free (waiters[i].name);
+	if (connection != NULL) {
+		dbus_connection_close (connection);
+		dbus_connection_unref (connection);
+	}
+	if (server != NULL) {
+		dbus_server_disconnect (server);
+		dbus_server_unref (server);
+	}
+	if (bus.idle_id != 0)
+		g_source_remove (bus.idle_id);
+	g_ptr_array_free (bus.pending, TRUE);
+	g_rand_free (bus.rand);
+	return ret;
+}
+
+#if defined(USE_PCI_IDS) || defined(USE_USB_IDS)
+
+#define IDS_TEST_NUM_VENDORS 2000
+#define IDS_TEST_NUM_PRODUCTS 8
+#define IDS_TEST_NUM_SUBSYS 3
+#define IDS_TEST_NUM_CHECKS 2000
+#define IDS_TEST_NUM_SCANS 200
+#define IDS_TEST_NUM_LOOKUPS 200000
+
+#define REF_IDS_MAX_LINE_LEN 512
+
+#define IDS_TEST_VENDOR(v) (0x0001 + (v) * 13)
+#define IDS_TEST_PRODUCT(v, p) (0x0101 * (p) + (v) % 7)
+
+/* The lookups as they were before the ids files were indexed: a scan
+ * of the whole file per call. The indexed lookups must return the same
+ * names, and they are timed against it. */
+static const char *
+ref_ids_get_line (const char *data, size_t len, size_t *pos, unsigned int *line_len)
+{
+	static char line[REF_IDS_MAX_LINE_LEN];
+	unsigned int i;
+
+	for (i = 0; *pos < len && i < REF_IDS_MAX_LINE_LEN - 1 && data[*pos] != '\n'; i++, (*pos)++)
+		line[i] = data[*pos];
+
+	line[i] = '\0';
+	*line_len = i;
+	(*pos)++;
+
+	return line;
+}
+
+static void
+ref_ids_store_name (char *store, const char *line, unsigned int line_len, unsigned int i)
+{
+	for (; i < line_len; i++) {
+		if (!g_ascii_isspace (line[i]))
+			break;
+	}
+	g_strlcpy (store, line + i, REF_IDS_MAX_LINE_LEN);
+}
+
+static gboolean
+ids_name_equal (const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return strcmp (a, b) == 0;
+}
+
+/* Write a synthetic ids file with subsystem lines when num_levels is 3,
+ * followed by a device class section like the one in pci.ids */
+static char *
+ids_test_write_file (unsigned int num_levels, GString **contents)
+{
+	GString *s;
+	GError *error;
+	char *path;
+	guint v;
+	guint p;
+	guint n;
+	int fd;
+
+	s = g_string_new ("# Synthetic ids file for hald-device-test\n#\n");
+	for (v = 0; v < IDS_TEST_NUM_VENDORS; v++) {
+		g_string_append_printf (s, "%04x  Vendor %u\n", IDS_TEST_VENDOR (v), v);
+		for (p = 0; p < IDS_TEST_NUM_PRODUCTS; p++) {
+			g_string_append_printf (s, "\t%04x  Product %u of vendor %u\n",
+						IDS_TEST_PRODUCT (v, p), p, v);
+			if (num_levels < 3 || p % 2 != 0)
+				continue;
+			for (n = 0; n < IDS_TEST_NUM_SUBSYS; n++)
+				g_string_append_printf (s, "\t\t%04x %04x  Subsystem %u of product %u of vendor %u\n",
+							IDS_TEST_VENDOR ((v + n + 1) % IDS_TEST_NUM_VENDORS),
+							0x0011 * (n + 1), n, p, v);
+		}
+	}
+	g_string_append (s, "\n# List of known device classes\n"
+			 "C 00  Unclassified device\n"
+			 "\t00  Non-VGA unclassified device\n"
+			 "\t01  VGA compatible unclassified device\n");
+
+	error = NULL;
+	fd = g_file_open_tmp ("hald-ids-XXXXXX", &path, &error);
+	if (fd < 0) {
+		printf ("Cannot create temporary file: %s\n", error->message);
+		g_error_free (error);
+		g_string_free (s, TRUE);
+		return NULL;
+	}
+	if (write (fd, s->str, s->len) != (ssize_t) s->len) {
+		printf ("Cannot write %s\n", path);
+		close (fd);
+		unlink (path);
+		g_free (path);
+		g_string_free (s, TRUE);
+		return NULL;
+	}
+	close (fd);
+
+	*contents = s;
+	return path;
+}
+
+/* Pick an id that is mostly, but not always, in the synthetic file */
+static int
+ids_test_pick_vendor (GRand *rand)
+{
+	if (g_rand_int_range (rand, 0, 10) == 0)
+		return g_rand_int_range (rand, 0, 0x10000);
+	return IDS_TEST_VENDOR (g_rand_int_range (rand, 0, IDS_TEST_NUM_VENDORS + 50));
+}
+
+static int
+ids_test_pick_product (GRand *rand, int vendor_id)
+{
+	if (g_rand_int_range (rand, 0, 10) == 0)
+		return g_rand_int_range (rand, 0, 0x10000);
+	return IDS_TEST_PRODUCT ((vendor_id - 1) / 13, g_rand_int_range (rand, 0, IDS_TEST_NUM_PRODUCTS + 2));
+}
+
+#endif /*USE_PCI_IDS || USE_USB_IDS*/
+
+#ifdef USE_PCI_IDS
+
+static void
+ref_ids_find_pci (const char *data, size_t len,
+		  int vendor_id, int product_id,
+		  int subsys_vendor_id, int subsys_product_id,
+		  char **vendor_name, char **product_name,
+		  char **subsys_vendor_name, char **subsys_product_name)
+{
+	const char *line;
+	unsigned int line_len;
+	unsigned int num_tabs;
+	char rep_vi[8];
+	char rep_pi[8];
+	char rep_svi[8];
+	char rep_spi[8];
+	gboolean vendor_matched = FALSE;
+	gboolean product_matched = FALSE;
+	size_t pos;
+	static char store_vn[REF_IDS_MAX_LINE_LEN];
+	static char store_pn[REF_IDS_MAX_LINE_LEN];
+	static char store_svn[REF_IDS_MAX_LINE_LEN];
+	static char store_spn[REF_IDS_MAX_LINE_LEN];
+
+	g_snprintf (rep_vi, 8, "%04x", vendor_id);
+	g_snprintf (rep_pi, 8, "%04x", product_id);
+	g_snprintf (rep_svi, 8, "%04x", subsys_vendor_id);
+	g_snprintf (rep_spi, 8, "%04x", subsys_product_id);
+
+	*vendor_name = NULL;
+	*product_name = NULL;
+	*subsys_vendor_name = NULL;
+	*subsys_product_name = NULL;
+
+	for (pos = 0; pos < len;) {
+		line = ref_ids_get_line (data, len, &pos, &line_len);
+
+		if (line_len < 4 || line[0] == '#')
+			continue;
+
+		for (num_tabs = 0; num_tabs < line_len && line[num_tabs] == '\t'; num_tabs++)
+			;
+
+		switch (num_tabs) {
+		case 0:
+			vendor_matched = FALSE;
+			if (*subsys_vendor_name == NULL && subsys_vendor_id != 0 &&
+			    memcmp (line, rep_svi, 4) == 0) {
+				ref_ids_store_name (store_svn, line, line_len, 4);
+				*subsys_vendor_name = store_svn;
+			}
+			if (vendor_id != 0 && memcmp (line, rep_vi, 4) == 0) {
+				vendor_matched = TRUE;
+				ref_ids_store_name (store_vn, line, line_len, 4);
+				*vendor_name = store_vn;
+			}
+			break;
+
+		case 1:
+			product_matched = FALSE;
+			if (!vendor_matched)
+				continue;
+			if (product_id != 0 && memcmp (line + 1, rep_pi, 4) == 0) {
+				product_matched = TRUE;
+				ref_ids_store_name (store_pn, line, line_len, 5);
+				*product_name = store_pn;
+			}
+			break;
+
+		case 2:
+			if (!vendor_matched || !product_matched)
+				continue;
+			if (subsys_vendor_id != 0 && subsys_product_id != 0 &&
+			    memcmp (line + 2, rep_svi, 4) == 0 &&
+			    memcmp (line + 7, rep_spi, 4) == 0) {
+				ref_ids_store_name (store_spn, line, line_len, 11);
+				*subsys_product_name = store_spn;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/* Compare ids_find_pci() against the reference scan on a synthetic
+ * pci.ids and time both */
+static gboolean
+check_ids_pci (void)
+{
+	GString *contents;
+	GTimer *timer;
+	GRand *rand;
+	char *path;
+	char *vn[2];
+	char *pn[2];
+	char *svn[2];
+	char *spn[2];
+	double scan_cost;
+	double index_cost;
+	gboolean ret;
+	guint i;
+
+	ret = FALSE;
+	contents = NULL;
+
+	printf ("Checking pci.ids lookups\n");
+
+	path = ids_test_write_file (3, &contents);
+	if (path == NULL)
+		goto out;
+	if (!pci_ids_load (path)) {
+		printf ("FAILED: cannot load %s\n", path);
+		goto out;
+	}
+
+	rand = g_rand_new_with_seed (42);
+	for (i = 0; i < IDS_TEST_NUM_CHECKS; i++) {
+		int vendor_id;
+		int product_id;
+		int subsys_vendor_id;
+		int subsys_product_id;
+
+		vendor_id = ids_test_pick_vendor (rand);
+		product_id = ids_test_pick_product (rand, vendor_id);
+		subsys_vendor_id = ids_test_pick_vendor (rand);
+		subsys_product_id = 0x0011 * g_rand_int_range (rand, 0, IDS_TEST_NUM_SUBSYS + 2);
+
+		ref_ids_find_pci (contents->str, contents->len,
+				  vendor_id, product_id, subsys_vendor_id, subsys_product_id,
+				  &vn[0], &pn[0], &svn[0], &spn[0]);
+		ids_find_pci (vendor_id, product_id, subsys_vendor_id, subsys_product_id,
+			      &vn[1], &pn[1], &svn[1], &spn[1]);
+
+		if (!ids_name_equal (vn[0], vn[1]) || !ids_name_equal (pn[0], pn[1]) ||
+		    !ids_name_equal (svn[0], svn[1]) || !ids_name_equal (spn[0], spn[1])) {
+			printf ("FAILED: %04x:%04x %04x:%04x differs from the reference scan\n",
+				vendor_id, product_id, subsys_vendor_id, subsys_product_id);
+			g_rand_free (rand);
+			goto out;
+		}
+
+		/* only every second product of a vendor has subsystems, so
+		 * do some lookups that are sure to hit one */
+		if (i % 4 == 0) {
+			vendor_id = IDS_TEST_VENDOR (g_rand_int_range (rand, 0, IDS_TEST_NUM_VENDORS));
+			product_id = IDS_TEST_PRODUCT ((vendor_id - 1) / 13, 2);
+			subsys_vendor_id = IDS_TEST_VENDOR (((vendor_id - 1) / 13 + 1) % IDS_TEST_NUM_VENDORS);
+			subsys_product_id = 0x0011;
+			ref_ids_find_pci (contents->str, contents->len,
+					  vendor_id, product_id, subsys_vendor_id, subsys_product_id,
+					  &vn[0], &pn[0], &svn[0], &spn[0]);
+			ids_find_pci (vendor_id, product_id, subsys_vendor_id, subsys_product_id,
+				      &vn[1], &pn[1], &svn[1], &spn[1]);
+			if (spn[1] == NULL || !ids_name_equal (spn[0], spn[1]) ||
+			    !ids_name_equal (svn[0], svn[1])) {
+				printf ("FAILED: wrong subsystem name for %04x:%04x %04x:%04x\n",
+					vendor_id, product_id, subsys_vendor_id, subsys_product_id);
+				g_rand_free (rand);
+				goto out;
+			}
+		}
+	}
+	g_rand_free (rand);
+
+	rand = g_rand_new_with_seed (43);
+	timer = g_timer_new ();
+	for (i = 0; i < IDS_TEST_NUM_SCANS; i++) {
+		int vendor_id = ids_test_pick_vendor (rand);
+
+		ref_ids_find_pci (contents->str, contents->len,
+				  vendor_id, ids_test_pick_product (rand, vendor_id), 0, 0,
+				  &vn[0], &pn[0], &svn[0], &spn[0]);
+	}
+	g_timer_stop (timer);
+	scan_cost = g_timer_elapsed (timer, NULL) / IDS_TEST_NUM_SCANS;
+
+	g_timer_start (timer);
+	for (i = 0; i < IDS_TEST_NUM_LOOKUPS; i++) {
+		int vendor_id = ids_test_pick_vendor (rand);
+
+		ids_find_pci (vendor_id, ids_test_pick_product (rand, vendor_id), 0, 0,
+			      &vn[1], &pn[1], &svn[1], &spn[1]);
+	}
+	g_timer_stop (timer);
+	index_cost = g_timer_elapsed (timer, NULL) / IDS_TEST_NUM_LOOKUPS;
+
+	g_timer_destroy (timer);
+	g_rand_free (rand);
+
+	/* only reported; a loaded machine shouldn't fail the test */
+	printf ("  %u bytes: %10.0f lookups/s scanning, %10.0f lookups/s indexed (%.1fx)\n",
+		(guint) contents->len, 1.0 / scan_cost, 1.0 / index_cost, scan_cost / index_cost);
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	if (path != NULL) {
+		unlink (path);
+		g_free (path);
+	}
+	if (contents != NULL)
+		g_string_free (contents, TRUE);
+	return ret;
+}
+
+#endif /*USE_PCI_IDS*/
+
+#ifdef USE_USB_IDS
+
+static void
+ref_ids_find_usb (const char *data, size_t len,
+		  int vendor_id, int product_id,
+		  char **vendor_name, char **product_name)
+{
+	const char *line;
+	unsigned int line_len;
+	unsigned int num_tabs;
+	char rep_vi[8];
+	char rep_pi[8];
+	gboolean vendor_matched = FALSE;
+	size_t pos;
+	static char store_vn[REF_IDS_MAX_LINE_LEN];
+	static char store_pn[REF_IDS_MAX_LINE_LEN];
+
+	g_snprintf (rep_vi, 8, "%04x", vendor_id);
+	g_snprintf (rep_pi, 8, "%04x", product_id);
+
+	*vendor_name = NULL;
+	*product_name = NULL;
+
+	for (pos = 0; pos < len;) {
+		line = ref_ids_get_line (data, len, &pos, &line_len);
+
+		if (line_len < 4 || line[0] == '#')
+			continue;
+
+		for (num_tabs = 0; num_tabs < line_len && line[num_tabs] == '\t'; num_tabs++)
+			;
+
+		switch (num_tabs) {
+		case 0:
+			vendor_matched = FALSE;
+			if (vendor_id != 0 && memcmp (line, rep_vi, 4) == 0) {
+				vendor_matched = TRUE;
+				ref_ids_store_name (store_vn, line, line_len, 4);
+				*vendor_name = store_vn;
+			}
+			break;
+
+		case 1:
+			if (!vendor_matched)
+				continue;
+			if (product_id != 0 && memcmp (line + 1, rep_pi, 4) == 0) {
+				ref_ids_store_name (store_pn, line, line_len, 5);
+				*product_name = store_pn;
+				return;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/* Compare ids_find_usb() against the reference scan on a synthetic
+ * usb.ids and time both */
+static gboolean
+check_ids_usb (void)
+{
+	GString *contents;
+	GTimer *timer;
+	GRand *rand;
+	char *path;
+	char *vn[2];
+	char *pn[2];
+	double scan_cost;
+	double index_cost;
+	gboolean ret;
+	guint i;
+
+	ret = FALSE;
+	contents = NULL;
+
+	printf ("Checking usb.ids lookups\n");
+
+	path = ids_test_write_file (2, &contents);
+	if (path == NULL)
+		goto out;
+	if (!usb_ids_load (path)) {
+		printf ("FAILED: cannot load %s\n", path);
+		goto out;
+	}
+
+	rand = g_rand_new_with_seed (42);
+	for (i = 0; i < IDS_TEST_NUM_CHECKS; i++) {
+		int vendor_id;
+		int product_id;
+
+		vendor_id = ids_test_pick_vendor (rand);
+		product_id = ids_test_pick_product (rand, vendor_id);
+
+		ref_ids_find_usb (contents->str, contents->len, vendor_id, product_id, &vn[0], &pn[0]);
+		ids_find_usb (vendor_id, product_id, &vn[1], &pn[1]);
+
+		if (!ids_name_equal (vn[0], vn[1]) || !ids_name_equal (pn[0], pn[1])) {
+			printf ("FAILED: %04x:%04x differs from the reference scan\n", vendor_id, product_id);
+			g_rand_free (rand);
+			goto out;
+		}
+	}
+	g_rand_free (rand);
+
+	rand = g_rand_new_with_seed (43);
+	timer = g_timer_new ();
+	for (i = 0; i < IDS_TEST_NUM_SCANS; i++) {
+		int vendor_id = ids_test_pick_vendor (rand);
+
+		ref_ids_find_usb (contents->str, contents->len,
+				  vendor_id, ids_test_pick_product (rand, vendor_id), &vn[0], &pn[0]);
+	}
+	g_timer_stop (timer);
+	scan_cost = g_timer_elapsed (timer, NULL) / IDS_TEST_NUM_SCANS;
+
+	g_timer_start (timer);
+	for (i = 0; i < IDS_TEST_NUM_LOOKUPS; i++) {
+		int vendor_id = ids_test_pick_vendor (rand);
+
+		ids_find_usb (vendor_id, ids_test_pick_product (rand, vendor_id), &vn[1], &pn[1]);
+	}
+	g_timer_stop (timer);
+	index_cost = g_timer_elapsed (timer, NULL) / IDS_TEST_NUM_LOOKUPS;
+
+	g_timer_destroy (timer);
+	g_rand_free (rand);
+
+	/* only reported; a loaded machine shouldn't fail the test */
+	printf ("  %u bytes: %10.0f lookups/s scanning, %10.0f lookups/s indexed (%.1fx)\n",
+		(guint) contents->len, 1.0 / scan_cost, 1.0 / index_cost, scan_cost / index_cost);
+
+	printf ("PASSED\n");
+	ret = TRUE;
+out:
+	if (path != NULL) {
+		unlink (path);
+		g_free (path);
+	}
+	if (contents != NULL)
+		g_string_free (contents, TRUE);
+	return ret;
+}
+
+#endif /*USE_USB_IDS*/
+
+int
+main (int argc, char *argv[])
+{
+	int num_tests_failed;
+
+	num_tests_failed = 0;
+
+	g_type_init ();
+
+	printf ("=============================\n");
+
+	if (!check_store_index ())
+		num_tests_failed++;
+
+	if (!check_store_children ())
+		num_tests_failed++;
+
+	if (!check_store_udi_order ())
+		num_tests_failed++;
+
+	if (!check_store_shared_udi ())
+		num_tests_failed++;
+
+	if (!check_store_lookup ())
+		num_tests_failed++;
+
+	if (!check_atomic_update_flush ())
+		num_tests_failed++;
+
+	if (!check_caller_info_lookups ())
+		num_tests_failed++;
+
+#ifdef USE_PCI_IDS
+	if (!check_ids_pci ())
+		num_tests_failed++;
+#endif
+
+#ifdef USE_USB_IDS
+	if (!check_ids_usb ())
+		num_tests_failed++;
+#endif
+
+	printf ("=============================\n");
+
+	printf ("Total number of tests failed: %d\n", num_tests_failed);
+
+	return num_tests_failed != 0 ? 1 : 0;
+}
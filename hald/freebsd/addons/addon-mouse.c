@@ -45,6 +45,7 @@
 #include "libhal/libhal.h"
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 #if __FreeBSD_version < 800058
 #define CMD "/usr/bin/fstat %s"
@@ -318,7 +319,7 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  addon.device_file = getenv("HAL_PROP_FREEBSD_DEVICE_FILE");
+  addon.device_file = hal_helper_getenv("HAL_PROP_FREEBSD_DEVICE_FILE");
   if (! addon.device_file)
     goto end;
 
@@ -34,6 +34,7 @@
 #include "libhal/libhal.h"
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 #include "../libprobe/hfp-cdrom.h"
 
 static boolean is_locked_by_hal = FALSE;
@@ -374,27 +375,27 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  addon.device_file = getenv("HAL_PROP_BLOCK_DEVICE");
+  addon.device_file = hal_helper_getenv("HAL_PROP_BLOCK_DEVICE");
   if (! addon.device_file)
     goto end;
 
-  drive_type = getenv("HAL_PROP_STORAGE_DRIVE_TYPE");
+  drive_type = hal_helper_getenv("HAL_PROP_STORAGE_DRIVE_TYPE");
   if (! drive_type)
     goto end;
 
-  removable = getenv("HAL_PROP_STORAGE_REMOVABLE");
+  removable = hal_helper_getenv("HAL_PROP_STORAGE_REMOVABLE");
   if (! removable)
     goto end;
 
-  bus = getenv("HAL_PROP_STORAGE_BUS");
+  bus = hal_helper_getenv("HAL_PROP_STORAGE_BUS");
   if (! bus)
     goto end;
 
-  driver = getenv("HAL_PROP_FREEBSD_DRIVER");
+  driver = hal_helper_getenv("HAL_PROP_FREEBSD_DRIVER");
   if (! driver)
     goto end;
 
-  addon.parent = getenv("HAL_PROP_INFO_PARENT");
+  addon.parent = hal_helper_getenv("HAL_PROP_INFO_PARENT");
   if (! addon.parent)
     goto end;
 
@@ -43,6 +43,7 @@
 #include <usbhid.h>
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 #define HID_COLLECTION_APPLICATION	1
 
@@ -63,7 +64,7 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  device_file = getenv("HAL_PROP_HIDDEV_DEVICE");
+  device_file = hal_helper_getenv("HAL_PROP_HIDDEV_DEVICE");
   if (! device_file)
     goto end;
 
@@ -39,6 +39,7 @@
 #include <glib.h>
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 #if __FreeBSD_version < 800058
 #define CMD "/usr/bin/fstat %s"
@@ -296,7 +297,7 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  device_file = getenv("HAL_PROP_FREEBSD_DEVICE_FILE");
+  device_file = hal_helper_getenv("HAL_PROP_FREEBSD_DEVICE_FILE");
   if (! device_file)
     goto end;
 
@@ -33,6 +33,7 @@
 #include <camlib.h>
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 int
 main (int argc, char **argv)
@@ -43,7 +44,7 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  device_file = getenv("HAL_PROP_BLOCK_DEVICE");
+  device_file = hal_helper_getenv("HAL_PROP_BLOCK_DEVICE");
   if (! device_file)
     goto end;
 
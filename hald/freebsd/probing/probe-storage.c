@@ -40,6 +40,7 @@
 #include "libhal/libhal.h"
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 #include "../libprobe/hfp-cdrom.h"
 
 #include "freebsd_dvd_rw_utils.h"
@@ -181,15 +182,15 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  device_file = getenv("HAL_PROP_BLOCK_DEVICE");
+  device_file = hal_helper_getenv("HAL_PROP_BLOCK_DEVICE");
   if (! device_file)
     goto end;
 
-  drive_type = getenv("HAL_PROP_STORAGE_DRIVE_TYPE");
+  drive_type = hal_helper_getenv("HAL_PROP_STORAGE_DRIVE_TYPE");
   if (! drive_type)
     goto end;
 
-  parent = getenv("HAL_PROP_INFO_PARENT");
+  parent = hal_helper_getenv("HAL_PROP_INFO_PARENT");
   if (! parent)
     goto end;
 
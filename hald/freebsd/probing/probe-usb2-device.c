@@ -42,6 +42,7 @@
 #endif
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 int
 main(int argc, char **argv)
@@ -58,11 +59,11 @@ main(int argc, char **argv)
   if (pbe == NULL)
     goto end;
 
-  busstr = getenv("HAL_PROP_USB_DEVICE_BUS_NUMBER");
+  busstr = hal_helper_getenv("HAL_PROP_USB_DEVICE_BUS_NUMBER");
   if (! busstr)
     goto end;
 
-  addrstr = getenv("HAL_PROP_USB_DEVICE_PORT_NUMBER");
+  addrstr = hal_helper_getenv("HAL_PROP_USB_DEVICE_PORT_NUMBER");
   if (! addrstr)
     goto end;
 
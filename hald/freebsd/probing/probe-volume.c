@@ -51,6 +51,7 @@
 #include "libhal/libhal.h"
 
 #include "../libprobe/hfp.h"
+#include "../../util_helper_env.h"
 
 #include "freebsd_dvd_rw_utils.h"
 
@@ -340,11 +341,11 @@ main (int argc, char **argv)
   if (! hfp_init(argc, argv))
     goto end;
 
-  device_file = getenv("HAL_PROP_BLOCK_DEVICE");
+  device_file = hal_helper_getenv("HAL_PROP_BLOCK_DEVICE");
   if (! device_file)
     goto end;
 
-  parent_udi = getenv("HAL_PROP_INFO_PARENT");
+  parent_udi = hal_helper_getenv("HAL_PROP_INFO_PARENT");
   if (! parent_udi)
     goto end;
 
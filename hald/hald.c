@@ -238,6 +238,9 @@ hald_get_gdl (void)
 		g_signal_connect (global_device_list,
 				  "device_lock_released",
 				  G_CALLBACK (gdl_lock_released), NULL);
+
+		/* used by FindDeviceByCapability */
+		hal_device_store_index_property (global_device_list, "info.capabilities");
 	}
 
 	return global_device_list;
@@ -285,6 +288,112 @@ out:
 
 }
 
+/*--------------------------------------------------------------------------------------------------*/
+
+typedef struct {
+	const char *name;
+	GHashTable *started;	/* key -> start time of an instance still running */
+	double first_start;
+	double last_end;
+	double cumulative;
+	guint count;
+} StartupPhaseTiming;
+
+static StartupPhaseTiming startup_timings[HALD_STARTUP_NUM_PHASES] = {
+	{"scan", NULL, 0.0, 0.0, 0.0, 0},
+	{"preprobe", NULL, 0.0, 0.0, 0.0, 0},
+	{"probe", NULL, 0.0, 0.0, 0.0, 0},
+	{"fdi merge", NULL, 0.0, 0.0, 0.0, 0},
+	{"callouts", NULL, 0.0, 0.0, 0.0, 0}
+};
+
+static double
+startup_timing_now (void)
+{
+	GTimeVal now;
+
+	g_get_current_time (&now);
+	return now.tv_sec + now.tv_usec / 1e6;
+}
+
+/**
+ * hald_startup_timing_begin:
+ * @phase: the startup phase
+ * @key: identifies this instance of the phase, e.g. the device
+ *
+ * Start timing one instance of a startup phase; instances of a phase
+ * may overlap as long as their keys differ. Does nothing once device
+ * probing has completed.
+ */
+void
+hald_startup_timing_begin (HaldStartupPhase phase, gconstpointer key)
+{
+	StartupPhaseTiming *t;
+	double *start;
+
+	if (!hald_is_initialising)
+		return;
+
+	t = &startup_timings[phase];
+	if (t->started == NULL)
+		t->started = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	start = g_new (double, 1);
+	*start = startup_timing_now ();
+	if (t->count == 0 && g_hash_table_size (t->started) == 0)
+		t->first_start = *start;
+	g_hash_table_replace (t->started, (gpointer) key, start);
+}
+
+/**
+ * hald_startup_timing_end:
+ * @phase: the startup phase
+ * @key: the key passed to hald_startup_timing_begin()
+ *
+ * Stop timing an instance of a startup phase.
+ */
+void
+hald_startup_timing_end (HaldStartupPhase phase, gconstpointer key)
+{
+	StartupPhaseTiming *t;
+	double *start;
+
+	t = &startup_timings[phase];
+	if (t->started == NULL)
+		return;
+
+	start = g_hash_table_lookup (t->started, key);
+	if (start == NULL)
+		return;
+
+	t->last_end = startup_timing_now ();
+	t->cumulative += t->last_end - *start;
+	t->count++;
+	g_hash_table_remove (t->started, key);
+}
+
+/* Log wall-clock and cumulative time per phase; instances still running
+ * (e.g. for devices removed while probing) are dropped */
+static void
+startup_timing_log (void)
+{
+	guint i;
+
+	for (i = 0; i < HALD_STARTUP_NUM_PHASES; i++) {
+		StartupPhaseTiming *t = &startup_timings[i];
+
+		if (t->count > 0) {
+			HAL_INFO (("Startup phase %-9s: %6u runs, %8.3fs wall clock, %8.3fs cumulative",
+				   t->name, t->count, t->last_end - t->first_start, t->cumulative));
+		}
+
+		if (t->started != NULL) {
+			g_hash_table_destroy (t->started);
+			t->started = NULL;
+		}
+	}
+}
+
 /** 
  * usage: 
  *
@@ -302,7 +411,22 @@ usage (void)
 		 "        --child-timeout=time  Set this timout for the child prober. A larger\n"
 		 "                              number than the default 250s is required for systems\n"
 		 "                              with many resources to be probed at boot time\n"
- 		 "        --use-syslog          Print out debug messages to syslog instead of\n"
+ 		 "        --max-parallel-probers=N\n"
+		 "                              Run at most N probers and callouts at a time\n"
+		 "                              (default is no limit)\n"
+		 "        --probe-workers=N     Let up to N long-lived processes of each\n"
+		 "                              storage, volume and input prober do all\n"
+		 "                              the probing (default is a process per probe)\n"
+		 "        --lazy-helper-environment\n"
+		 "                              Pass device properties to probers, callouts\n"
+		 "                              and addons in a shared snapshot file instead\n"
+		 "                              of HAL_PROP_* environment variables\n"
+		 "        --log-level=debug|info|warning|error\n"
+		 "                              Lowest priority of the messages to print\n"
+		 "                              when verbose (default is debug)\n"
+		 "        --trace-ring=N        Keep the last N messages, trace level and up,\n"
+		 "                              in memory; they are written out on SIGUSR1\n"
+		 "        --use-syslog          Print out debug messages to syslog instead of\n"
 		 "                              stderr. Use this option to get debug messages\n"
 		 "                              if hald runs as a daemon.\n"
 		 "        --help                Show this information and exit\n"
@@ -351,6 +475,16 @@ handle_sigterm (int value)
 	written = write (sigterm_unix_signal_pipe_fds[1], marker, 1);
 }
 
+static void 
+handle_sigusr1 (int value)
+{
+	ssize_t written;
+	static char marker[1] = {'U'};
+
+	/* same pipe as for SIGTERM, see above */
+	written = write (sigterm_unix_signal_pipe_fds[1], marker, 1);
+}
+
 static gboolean
 sigterm_iochn_data (GIOChannel *source, 
 		    GIOCondition condition, 
@@ -369,6 +503,11 @@ sigterm_iochn_data (GIOChannel *source,
 		goto out;
 	}
 
+	if (data[0] == 'U') {
+		logger_dump_trace_ring ();
+		goto out;
+	}
+
 	HAL_INFO (("Caught SIGTERM, initiating shutdown"));
 	hald_runner_kill_all();
 	exit (0);
@@ -539,6 +678,11 @@ main (int argc, char *argv[])
 	GMainLoop *loop;
 	guint sigterm_iochn_listener_source_id;
 	guint opt_child_timeout;
+	int opt_max_parallel_probers;
+	int opt_probe_workers;
+	int opt_log_level;
+	int opt_trace_ring;
+	gboolean opt_lazy_helper_environment;
 #ifdef HAVE_POLKIT
         PolKitError *p_error;
 #endif
@@ -585,6 +729,18 @@ main (int argc, char *argv[])
 	/* set the default child timeout to 250 seconds */
 	opt_child_timeout = 250;
 
+	/* no limit on concurrent probers by default */
+	opt_max_parallel_probers = 0;
+
+	/* every probe in a process of its own by default */
+	opt_probe_workers = 0;
+
+	opt_lazy_helper_environment = FALSE;
+
+	/* log everything but trace by default, no trace ring */
+	opt_log_level = HAL_LOGPRI_DEBUG;
+	opt_trace_ring = 0;
+
 	while (1) {
 		int c;
 		int option_index = 0;
@@ -595,6 +751,11 @@ main (int argc, char *argv[])
 			{"verbose", 1, NULL, 0},
 			{"retain-privileges", 0, NULL, 0},
 			{"child-timeout", 1, NULL, 0},
+			{"max-parallel-probers", 1, NULL, 0},
+			{"probe-workers", 1, NULL, 0},
+			{"lazy-helper-environment", 0, NULL, 0},
+			{"log-level", 1, NULL, 0},
+			{"trace-ring", 1, NULL, 0},
 			{"use-syslog", 0, NULL, 0},
 			{"help", 0, NULL, 0},
 			{"version", 0, NULL, 0},
@@ -620,6 +781,20 @@ main (int argc, char *argv[])
 				hald_debug_exit_after_probing = TRUE;
 			} else if (strcmp (opt, "child-timeout") == 0) {
 				opt_child_timeout = atoi (optarg);
+			} else if (strcmp (opt, "max-parallel-probers") == 0) {
+				opt_max_parallel_probers = atoi (optarg);
+			} else if (strcmp (opt, "probe-workers") == 0) {
+				opt_probe_workers = atoi (optarg);
+			} else if (strcmp (opt, "lazy-helper-environment") == 0) {
+				opt_lazy_helper_environment = TRUE;
+			} else if (strcmp (opt, "log-level") == 0) {
+				opt_log_level = logger_priority_from_string (optarg);
+				if (opt_log_level == 0 || opt_log_level == HAL_LOGPRI_TRACE) {
+					usage ();
+					return 1;
+				}
+			} else if (strcmp (opt, "trace-ring") == 0) {
+				opt_trace_ring = atoi (optarg);
 			} else if (strcmp (opt, "daemon") == 0) {
 				if (strcmp ("yes", optarg) == 0) {
 					opt_become_daemon = TRUE;
@@ -658,6 +833,10 @@ main (int argc, char *argv[])
 	else
 		logger_disable ();
 
+	logger_set_level (opt_log_level);
+	if (opt_trace_ring > 0)
+		logger_enable_trace_ring (opt_trace_ring, HAL_LOGPRI_TRACE);
+
 	if (hald_use_syslog)
 		logger_enable_syslog ();
 	else
@@ -672,6 +851,18 @@ main (int argc, char *argv[])
 
 	HAL_INFO ((PACKAGE_STRING));
 	HAL_INFO (("using child timeout %is", opt_child_timeout));
+	if (opt_max_parallel_probers > 0) {
+		HAL_INFO (("running at most %d probers at a time", opt_max_parallel_probers));
+		hald_runner_set_max_parallel (opt_max_parallel_probers);
+	}
+	if (opt_probe_workers > 0) {
+		HAL_INFO (("using up to %d workers per prober", opt_probe_workers));
+		hald_runner_set_probe_workers (opt_probe_workers);
+	}
+	if (opt_lazy_helper_environment) {
+		HAL_INFO (("passing device properties to helpers in snapshot files"));
+		hald_runner_set_lazy_environment (TRUE);
+	}
 	
 	if (opt_become_daemon) {
 		int child_pid;
@@ -760,6 +951,7 @@ main (int argc, char *argv[])
 	
 	/* Finally, setup unix signal handler for TERM */
 	signal (SIGTERM, handle_sigterm);
+	signal (SIGUSR1, handle_sigusr1);
 
 	/* set up the local dbus server */
 	if (!hald_dbus_local_server_init ())
@@ -867,6 +1059,10 @@ osspec_probe_done (void)
 	char buf[1] = {0};
 
 	HAL_INFO (("Device probing completed"));
+	startup_timing_log ();
+	hald_runner_log_stats ();
+	hal_util_callout_log_stats ();
+	hal_device_log_string_pool_stats ();
 
 	if (hald_debug_exit_after_probing) {
 		HAL_INFO (("Exiting on user request (--exit-after-probing)"));
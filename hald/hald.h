@@ -52,6 +52,19 @@ void hald_compute_udi (gchar *dst, gsize dstsize, const gchar *format, ...);
 void property_atomic_update_begin (void);
 void property_atomic_update_end (void);
 
+/* Phases of device probing at startup; see hald_startup_timing_begin() */
+typedef enum {
+	HALD_STARTUP_PHASE_SCAN,
+	HALD_STARTUP_PHASE_PREPROBE,
+	HALD_STARTUP_PHASE_PROBE,
+	HALD_STARTUP_PHASE_FDI_MERGE,
+	HALD_STARTUP_PHASE_CALLOUTS,
+	HALD_STARTUP_NUM_PHASES
+} HaldStartupPhase;
+
+void hald_startup_timing_begin (HaldStartupPhase phase, gconstpointer key);
+void hald_startup_timing_end (HaldStartupPhase phase, gconstpointer key);
+
 extern dbus_bool_t hald_is_verbose;
 extern dbus_bool_t hald_use_syslog;
 extern dbus_bool_t hald_is_initialising;
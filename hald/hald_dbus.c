@@ -417,6 +417,140 @@ manager_get_all_devices_with_properties (DBusConnection * connection,
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+#define DEVICES_PAGE_SIZE_DEFAULT 100
+#define DEVICES_PAGE_SIZE_MAX     1000
+
+/** 
+ *  manager_get_devices_page:
+ *  @connection:         D-BUS connection
+ *  @message:            Message
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Get a page of devices with their properties, in UDI order. Pass an
+ *  empty @start for the first page and the returned @next for the
+ *  following ones; @next is empty after the last page. The cursor is
+ *  just the last UDI returned, so devices added or removed between
+ *  pages don't upset it. Only the properties named in @keys are
+ *  returned (all if @keys is empty), and only devices with the given
+ *  @capability (any if empty) are considered.
+ *
+ *  <pre>
+ *  array{struct {object_reference, map{string, any}}}, string next
+ *    Manager.GetDevicesPage(string start, int page_size,
+ *                           array{string} keys, string capability)
+ *  </pre>
+ */
+DBusHandlerResult
+manager_get_devices_page (DBusConnection * connection,
+			  DBusMessage * message)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+	DBusError error;
+	HalDevice *d;
+	HalDevice *last;
+	const char *start;
+	const char *capability;
+	const char *next;
+	dbus_int32_t page_size;
+	dbus_int32_t n;
+	char **keys;
+	int num_keys;
+	int k;
+
+	dbus_error_init (&error);
+	if (!dbus_message_get_args (message, &error,
+				    DBUS_TYPE_STRING, &start,
+				    DBUS_TYPE_INT32, &page_size,
+				    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &keys, &num_keys,
+				    DBUS_TYPE_STRING, &capability,
+				    DBUS_TYPE_INVALID)) {
+		raise_syntax (connection, message, "Manager.GetDevicesPage");
+		dbus_error_free (&error);
+
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if (page_size <= 0)
+		page_size = DEVICES_PAGE_SIZE_DEFAULT;
+	else if (page_size > DEVICES_PAGE_SIZE_MAX)
+		page_size = DEVICES_PAGE_SIZE_MAX;
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	dbus_message_iter_init_append (reply, &iter);
+	dbus_message_iter_open_container (&iter, 
+					  DBUS_TYPE_ARRAY,
+                                          "(sa{sv})",
+					  &iter_array);
+
+	/* walk the store in UDI order from the cursor; this costs a tree
+	 * search per device visited rather than a sort of the whole store */
+	n = 0;
+	last = NULL;
+	next = "";
+	for (d = hal_device_store_find_next (hald_get_gdl (), start);
+	     d != NULL;
+	     d = hal_device_store_find_next (hald_get_gdl (), hal_device_get_udi (d))) {
+		DBusMessageIter iter_struct;
+		DBusMessageIter iter_dict;
+		const char *udi;
+
+		if (capability[0] != '\0' && !hal_device_has_capability (d, capability))
+			continue;
+
+		/* more to come; continue after the last one we returned */
+		if (n == page_size) {
+			next = hal_device_get_udi (last);
+			break;
+		}
+
+		dbus_message_iter_open_container (&iter_array, DBUS_TYPE_STRUCT, NULL, &iter_struct);
+
+		udi = hal_device_get_udi (d);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &udi);
+
+		dbus_message_iter_open_container (&iter_struct, 
+						  DBUS_TYPE_ARRAY,
+						  DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+						  DBUS_TYPE_STRING_AS_STRING
+						  DBUS_TYPE_VARIANT_AS_STRING
+						  DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+						  &iter_dict);
+
+		if (num_keys == 0) {
+			hal_device_property_foreach (d, foreach_property_append, &iter_dict);
+		} else {
+			for (k = 0; k < num_keys; k++) {
+				if (hal_device_has_property (d, keys[k]))
+					foreach_property_append (d, keys[k], &iter_dict);
+			}
+		}
+
+		dbus_message_iter_close_container (&iter_struct, &iter_dict);
+		dbus_message_iter_close_container (&iter_array, &iter_struct);
+
+		last = d;
+		n++;
+	}
+
+	dbus_message_iter_close_container (&iter, &iter_array);
+
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &next);
+
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
+
+	dbus_message_unref (reply);
+	dbus_free_string_array (keys);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 /** 
  *  manager_get_all_devices: 
  *  @connection:         D-BUS connection
@@ -597,27 +731,6 @@ manager_find_device_string_match (DBusConnection * connection,
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
-typedef struct {
-	const char *capability;
-	DBusMessageIter *iter;
-} DeviceCapabilityInfo;
-
-static gboolean
-foreach_device_by_capability (HalDeviceStore *store, HalDevice *device, gpointer user_data)
-{
-	DeviceCapabilityInfo *info = (DeviceCapabilityInfo *) user_data;
-
-	if (hal_device_has_capability (device, info->capability)) {
-		const char *udi;
-		udi = hal_device_get_udi (device);
-		dbus_message_iter_append_basic (info->iter,
-						DBUS_TYPE_STRING,
-						&udi);
-	}
-
-	return TRUE;
-}
-
 /**  
  *  manager_find_device_by_capability:
  *  @connection:         D-BUS connection
@@ -641,7 +754,8 @@ manager_find_device_by_capability (DBusConnection * connection,
 	DBusMessageIter iter_array;
 	DBusError error;
 	const char *capability;
-	DeviceCapabilityInfo info;
+	GSList *devices;
+	GSList *i;
 
 	HAL_TRACE (("entering"));
 
@@ -665,12 +779,137 @@ manager_find_device_by_capability (DBusConnection * connection,
 					  DBUS_TYPE_STRING_AS_STRING,
 					  &iter_array);
 
-	info.capability = capability;
-	info.iter = &iter_array;
+	devices = hal_device_store_match_multiple_key_strlist_contains (hald_get_gdl (),
+									"info.capabilities",
+									capability);
+	for (i = devices; i != NULL; i = i->next) {
+		const char *udi;
 
-	hal_device_store_foreach (hald_get_gdl (),
-				  foreach_device_by_capability,
-				  &info);
+		udi = hal_device_get_udi (HAL_DEVICE (i->data));
+		dbus_message_iter_append_basic (&iter_array,
+						DBUS_TYPE_STRING,
+						&udi);
+	}
+	g_slist_free (devices);
+
+	dbus_message_iter_close_container (&iter, &iter_array);
+
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
+
+	dbus_message_unref (reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/**
+ *  manager_get_runner_statistics:
+ *  @connection:         D-BUS connection
+ *  @message:            Message
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Get the helper launch counters of the runner, see
+ *  hald_runner_get_stats().
+ *
+ *  <pre>
+ *  uint32 queued, uint32 in_flight, uint32 started, uint32 failed,
+ *  uint32[] start_latency Manager.GetRunnerStatistics()
+ *  </pre>
+ */
+DBusHandlerResult
+manager_get_runner_statistics (DBusConnection * connection, DBusMessage * message)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+	HaldRunnerStats stats;
+	const dbus_uint32_t *latency;
+
+	HAL_TRACE (("entering"));
+
+	hald_runner_get_stats (&stats);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	latency = stats.latency;
+	dbus_message_iter_init_append (reply, &iter);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.queued);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.in_flight);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.started);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.failed);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  DBUS_TYPE_UINT32_AS_STRING,
+					  &iter_array);
+	dbus_message_iter_append_fixed_array (&iter_array, DBUS_TYPE_UINT32,
+					      &latency, HALD_RUNNER_LATENCY_BUCKETS);
+	dbus_message_iter_close_container (&iter, &iter_array);
+
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
+
+	dbus_message_unref (reply);
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/**
+ *  manager_get_callout_statistics:
+ *  @connection:         D-BUS connection
+ *  @message:            Message
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Get the wall time spent in each callout program, see
+ *  hal_util_callout_get_stats().
+ *
+ *  <pre>
+ *  array{string program, uint32 runs, uint32 failed, uint32 total_ms,
+ *  uint32 max_ms} Manager.GetCalloutStatistics()
+ *  </pre>
+ */
+DBusHandlerResult
+manager_get_callout_statistics (DBusConnection * connection, DBusMessage * message)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+	GSList *list;
+	GSList *i;
+
+	HAL_TRACE (("entering"));
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	dbus_message_iter_init_append (reply, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					  DBUS_TYPE_STRING_AS_STRING
+					  DBUS_TYPE_UINT32_AS_STRING
+					  DBUS_TYPE_UINT32_AS_STRING
+					  DBUS_TYPE_UINT32_AS_STRING
+					  DBUS_TYPE_UINT32_AS_STRING
+					  DBUS_STRUCT_END_CHAR_AS_STRING,
+					  &iter_array);
+
+	list = hal_util_callout_get_stats ();
+	for (i = list; i != NULL; i = g_slist_next (i)) {
+		HalCalloutStats *stats = (HalCalloutStats *) i->data;
+		DBusMessageIter iter_struct;
+
+		dbus_message_iter_open_container (&iter_array, DBUS_TYPE_STRUCT, NULL, &iter_struct);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &stats->program);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &stats->runs);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &stats->failed);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &stats->total_ms);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &stats->max_ms);
+		dbus_message_iter_close_container (&iter_array, &iter_struct);
+	}
+	g_slist_free (list);
 
 	dbus_message_iter_close_container (&iter, &iter_array);
 
@@ -678,10 +917,121 @@ manager_find_device_by_capability (DBusConnection * connection,
 		DIE (("No memory"));
 
 	dbus_message_unref (reply);
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+append_trace_entry (const char *entry, void *user_data)
+{
+	DBusMessageIter *iter_array = (DBusMessageIter *) user_data;
+
+	dbus_message_iter_append_basic (iter_array, DBUS_TYPE_STRING, &entry);
+}
+
+/**
+ *  manager_get_trace:
+ *  @connection:         D-BUS connection
+ *  @message:            Message
+ *  @local_interface:    Whether the message came from a helper
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Get the entries of the trace ring, oldest first; see
+ *  logger_enable_trace_ring().
+ *
+ *  <pre>
+ *  array{string} Manager.GetTrace()
+ *  </pre>
+ */
+static DBusHandlerResult
+manager_get_trace (DBusConnection * connection, DBusMessage * message, dbus_bool_t local_interface)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+
+	if (!local_interface && !access_check_message_caller_is_root_or_hal (ci_tracker, message)) {
+		raise_permission_denied (connection, message, "GetTrace: not privileged");
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	dbus_message_iter_init_append (reply, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  DBUS_TYPE_STRING_AS_STRING,
+					  &iter_array);
+	logger_trace_ring_foreach (append_trace_entry, &iter_array);
+	dbus_message_iter_close_container (&iter, &iter_array);
+
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
 
+	dbus_message_unref (reply);
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/**
+ *  manager_set_log_level:
+ *  @connection:         D-BUS connection
+ *  @message:            Message
+ *  @local_interface:    Whether the message came from a helper
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Set the lowest priority of the messages hald prints, one of
+ *  "debug", "info", "warning" or "error"; see logger_set_level().
+ *
+ *  <pre>
+ *  void Manager.SetLogLevel(string level)
+ *
+ *    raises org.freedesktop.Hal.SyntaxError,
+ *           org.freedesktop.Hal.PermissionDenied
+ *  </pre>
+ */
+static DBusHandlerResult
+manager_set_log_level (DBusConnection * connection, DBusMessage * message, dbus_bool_t local_interface)
+{
+	DBusMessage *reply;
+	DBusError error;
+	const char *level;
+	int priority;
+
+	if (!local_interface && !access_check_message_caller_is_root_or_hal (ci_tracker, message)) {
+		raise_permission_denied (connection, message, "SetLogLevel: not privileged");
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	dbus_error_init (&error);
+	if (!dbus_message_get_args (message, &error,
+				    DBUS_TYPE_STRING, &level,
+				    DBUS_TYPE_INVALID)) {
+		raise_syntax (connection, message, "SetLogLevel");
+		dbus_error_free (&error);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	priority = logger_priority_from_string (level);
+	if (priority == 0 || priority == HAL_LOGPRI_TRACE) {
+		raise_syntax (connection, message, "SetLogLevel");
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	HAL_INFO (("Setting log level to %s", level));
+	logger_set_level (priority);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
+
+	dbus_message_unref (reply);
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
 
 /**  
  *  manager_device_exists:
@@ -1122,65 +1472,138 @@ foreach_property_append (HalDevice *device,
 						  DBUS_TYPE_STRING_AS_STRING,
 						  &iter_var);
 
-		dbus_message_iter_open_container (&iter_var,
-						  DBUS_TYPE_ARRAY,
-						  DBUS_TYPE_STRING_AS_STRING,
-						  &iter_array);
+		dbus_message_iter_open_container (&iter_var,
+						  DBUS_TYPE_ARRAY,
+						  DBUS_TYPE_STRING_AS_STRING,
+						  &iter_array);
+
+		for (hal_device_property_strlist_iter_init (device, key, &hd_iter);
+		     hal_device_property_strlist_iter_is_valid (&hd_iter);
+		     hal_device_property_strlist_iter_next (&hd_iter)) {
+			const char *v;
+			v = hal_device_property_strlist_iter_get_value (&hd_iter);
+
+			dbus_message_iter_append_basic (&iter_array, 
+							DBUS_TYPE_STRING,
+							&v);
+		}
+		
+		dbus_message_iter_close_container (&iter_var,
+						   &iter_array);
+
+		dbus_message_iter_close_container (&iter_dict_entry,
+						   &iter_var);
+		break;
+	}
+		
+	default:
+		HAL_WARNING (("Unknown property type 0x%04x", type));
+		break;
+	}
+
+	dbus_message_iter_close_container (iter, &iter_dict_entry);
+}
+		
+	
+	
+/**  
+ *  device_get_all_properties:
+ *  @connection:         D-BUS connection
+ *  @message:            D-Bus Message
+ *
+ *  Returns:             What to do with the message
+ *
+ *  Get all properties on a device.
+ *
+ *  <pre>
+ *  map{string, any} Device.GetAllProperties()
+ *
+ *    raises org.freedesktop.Hal.NoSuchDevice
+ *  </pre>
+ *
+ */
+DBusHandlerResult
+device_get_all_properties (DBusConnection * connection,
+			   DBusMessage * message)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter iter_dict;
+	HalDevice *d;
+	const char *udi;
+
+	udi = dbus_message_get_path (message);
+
+	HAL_TRACE (("entering, udi=%s", udi));
+
+	d = hal_device_store_find (hald_get_gdl (), udi);
+	if (d == NULL)
+		d = hal_device_store_find (hald_get_tdl (), udi);
+
+	if (d == NULL) {
+		raise_no_such_device (connection, message, udi);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	reply = dbus_message_new_method_return (message);
+	if (reply == NULL)
+		DIE (("No memory"));
+
+	dbus_message_iter_init_append (reply, &iter);
+
+	dbus_message_iter_open_container (&iter, 
+					  DBUS_TYPE_ARRAY,
+					  DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					  DBUS_TYPE_STRING_AS_STRING
+					  DBUS_TYPE_VARIANT_AS_STRING
+					  DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					  &iter_dict);
+
+	hal_device_property_foreach (d,
+				     foreach_property_append,
+				     &iter_dict);
 
-		for (hal_device_property_strlist_iter_init (device, key, &hd_iter);
-		     hal_device_property_strlist_iter_is_valid (&hd_iter);
-		     hal_device_property_strlist_iter_next (&hd_iter)) {
-			const char *v;
-			v = hal_device_property_strlist_iter_get_value (&hd_iter);
+	dbus_message_iter_close_container (&iter, &iter_dict);
 
-			dbus_message_iter_append_basic (&iter_array, 
-							DBUS_TYPE_STRING,
-							&v);
-		}
-		
-		dbus_message_iter_close_container (&iter_var,
-						   &iter_array);
+	if (!dbus_connection_send (connection, reply, NULL))
+		DIE (("No memory"));
 
-		dbus_message_iter_close_container (&iter_dict_entry,
-						   &iter_var);
-		break;
-	}
-		
-	default:
-		HAL_WARNING (("Unknown property type 0x%04x", type));
-		break;
-	}
+	dbus_message_unref (reply);
 
-	dbus_message_iter_close_container (iter, &iter_dict_entry);
+	return DBUS_HANDLER_RESULT_HANDLED;
 }
-		
-	
-	
+
 /**  
- *  device_get_all_properties:
+ *  device_get_properties:
  *  @connection:         D-BUS connection
  *  @message:            D-Bus Message
  *
  *  Returns:             What to do with the message
  *
- *  Get all properties on a device.
+ *  Get the given properties on a device in one go. Keys the device
+ *  doesn't have are simply left out of the result.
  *
  *  <pre>
- *  map{string, any} Device.GetAllProperties()
+ *  map{string, any} Device.GetProperties(array{string} keys)
  *
  *    raises org.freedesktop.Hal.NoSuchDevice
  *  </pre>
  *
  */
 DBusHandlerResult
-device_get_all_properties (DBusConnection * connection,
-			   DBusMessage * message)
+device_get_properties (DBusConnection * connection,
+		       DBusMessage * message)
 {
 	DBusMessage *reply;
 	DBusMessageIter iter;
 	DBusMessageIter iter_dict;
+	DBusError error;
 	HalDevice *d;
 	const char *udi;
+	char **keys;
+	int num_keys;
+	int i;
+	GHashTable *seen;
 
 	udi = dbus_message_get_path (message);
 
@@ -1195,6 +1618,15 @@ device_get_all_properties (DBusConnection * connection,
 		return DBUS_HANDLER_RESULT_HANDLED;
 	}
 
+	dbus_error_init (&error);
+	if (!dbus_message_get_args (message, &error,
+				    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &keys, &num_keys,
+				    DBUS_TYPE_INVALID)) {
+		raise_syntax (connection, message, "GetProperties");
+		dbus_error_free (&error);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
 	reply = dbus_message_new_method_return (message);
 	if (reply == NULL)
 		DIE (("No memory"));
@@ -1209,9 +1641,17 @@ device_get_all_properties (DBusConnection * connection,
 					  DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
 					  &iter_dict);
 
-	hal_device_property_foreach (d,
-				     foreach_property_append,
-				     &iter_dict);
+	/* a key asked for twice must not be a duplicate dict entry */
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < num_keys; i++) {
+		if (g_hash_table_lookup (seen, keys[i]) != NULL)
+			continue;
+		g_hash_table_insert (seen, keys[i], keys[i]);
+
+		if (hal_device_has_property (d, keys[i]))
+			foreach_property_append (d, keys[i], &iter_dict);
+	}
+	g_hash_table_destroy (seen);
 
 	dbus_message_iter_close_container (&iter, &iter_dict);
 
@@ -1219,6 +1659,7 @@ device_get_all_properties (DBusConnection * connection,
 		DIE (("No memory"));
 
 	dbus_message_unref (reply);
+	dbus_free_string_array (keys);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
@@ -2830,15 +3271,136 @@ static int atomic_count = 0;
 static int num_pending_updates = 0;
 
 /** Structure for queing updates */
-typedef struct PendingUpdate_s {
-	char *udi;                    /**< udi of device */
-	char *key;                    /**< key of property; free when done */
+typedef struct {
+	GQuark key;                   /**< key of property */
 	dbus_bool_t removed;          /**< true iff property was removed */
 	dbus_bool_t added;            /**< true iff property was added */
-	struct PendingUpdate_s *next; /**< next update or #NULL */
 } PendingUpdate;
 
-static PendingUpdate *pending_updates_head = NULL;
+/** Pending updates for a single device */
+typedef struct {
+	char *udi;                    /**< udi of device */
+	GArray *updates;              /**< PendingUpdate in order of first change */
+	GHashTable *key_to_index;     /**< GQuark -> index+1 into updates */
+} PendingDeviceUpdates;
+
+/** udi -> PendingDeviceUpdates */
+static GHashTable *pending_updates_by_udi = NULL;
+
+/** PendingDeviceUpdates in reverse order of first change */
+static GSList *pending_updates_devices = NULL;
+
+static void
+pending_device_updates_free (PendingDeviceUpdates *pdu)
+{
+	g_free (pdu->udi);
+	g_array_free (pdu->updates, TRUE);
+	g_hash_table_destroy (pdu->key_to_index);
+	g_free (pdu);
+}
+
+static void
+pending_updates_add (const char *udi, const char *key, dbus_bool_t removed, dbus_bool_t added)
+{
+	PendingDeviceUpdates *pdu;
+	GQuark quark;
+	guint index;
+
+	if (pending_updates_by_udi == NULL)
+		pending_updates_by_udi = g_hash_table_new (g_str_hash, g_str_equal);
+
+	pdu = g_hash_table_lookup (pending_updates_by_udi, udi);
+	if (pdu == NULL) {
+		pdu = g_new0 (PendingDeviceUpdates, 1);
+		pdu->udi = g_strdup (udi);
+		pdu->updates = g_array_new (FALSE, FALSE, sizeof (PendingUpdate));
+		pdu->key_to_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_insert (pending_updates_by_udi, pdu->udi, pdu);
+		pending_updates_devices = g_slist_prepend (pending_updates_devices, pdu);
+	}
+
+	quark = g_quark_from_string (key);
+	index = GPOINTER_TO_UINT (g_hash_table_lookup (pdu->key_to_index, GUINT_TO_POINTER (quark)));
+	if (index > 0) {
+		PendingUpdate *pu;
+
+		/* collapse into the existing update; it describes the
+		 * change from the state before the atomic update began */
+		pu = &g_array_index (pdu->updates, PendingUpdate, index - 1);
+		if (removed) {
+			pu->added = FALSE;
+		} else {
+			pu->added = pu->added || added || pu->removed;
+		}
+		pu->removed = removed;
+	} else {
+		PendingUpdate pu;
+
+		pu.key = quark;
+		pu.removed = removed;
+		pu.added = added;
+		g_array_append_val (pdu->updates, pu);
+		g_hash_table_insert (pdu->key_to_index, GUINT_TO_POINTER (quark),
+				     GUINT_TO_POINTER (pdu->updates->len));
+	}
+
+	num_pending_updates++;
+}
+
+static void
+pending_updates_send (PendingDeviceUpdates *pdu)
+{
+	DBusMessage *message;
+	DBusMessageIter iter;
+	DBusMessageIter iter_array;
+	dbus_int32_t num_updates_this;
+	guint i;
+
+	num_updates_this = pdu->updates->len;
+
+	message = dbus_message_new_signal (pdu->udi,
+					   "org.freedesktop.Hal.Device",
+					   "PropertyModified");
+	dbus_message_iter_init_append (message, &iter);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32,
+					&num_updates_this);
+
+	dbus_message_iter_open_container (&iter, 
+					  DBUS_TYPE_ARRAY,
+					  DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					  DBUS_TYPE_STRING_AS_STRING
+					  DBUS_TYPE_BOOLEAN_AS_STRING
+					  DBUS_TYPE_BOOLEAN_AS_STRING
+					  DBUS_STRUCT_END_CHAR_AS_STRING,
+					  &iter_array);
+
+	for (i = 0; i < pdu->updates->len; i++) {
+		PendingUpdate *pu;
+		DBusMessageIter iter_struct;
+		const char *key;
+
+		pu = &g_array_index (pdu->updates, PendingUpdate, i);
+		key = g_quark_to_string (pu->key);
+
+		dbus_message_iter_open_container (&iter_array,
+						  DBUS_TYPE_STRUCT,
+						  NULL,
+						  &iter_struct);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &key);
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_BOOLEAN, &(pu->removed));
+		dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_BOOLEAN, &(pu->added));
+		dbus_message_iter_close_container (&iter_array, &iter_struct);
+	}
+
+	dbus_message_iter_close_container (&iter, &iter_array);
+
+	if (dbus_connection != NULL) {
+		if (!dbus_connection_send (dbus_connection, message, NULL))
+			DIE (("error broadcasting message"));
+	}
+
+	dbus_message_unref (message);
+}
 
 /** 
  *  device_property_atomic_update_begin:
@@ -2857,16 +3419,16 @@ device_property_atomic_update_begin (void)
 /** 
  *  device_property_atomic_update_end:
  *
- *  End an atomic update.
+ *  End an atomic update. Updates queued since the outermost begin are
+ *  sent as one PropertyModified signal per device, with repeated changes
+ *  to the same key collapsed into one.
  *
  *  Note that an atomic update is recursive - use with caution!
  */
 void
 device_property_atomic_update_end (void)
 {
-	PendingUpdate *pu_iter = NULL;
-	PendingUpdate *pu_iter_next = NULL;
-	PendingUpdate *pu_iter2 = NULL;
+	GSList *i;
 
 	--atomic_count;
 
@@ -2876,93 +3438,20 @@ device_property_atomic_update_end (void)
 	}
 
 	if (atomic_count == 0 && num_pending_updates > 0) {
-		DBusMessage *message;
-		DBusMessageIter iter;
-		DBusMessageIter iter_array;
-
-		for (pu_iter = pending_updates_head;
-		     pu_iter != NULL; pu_iter = pu_iter_next) {
-			int num_updates_this;
-
-			pu_iter_next = pu_iter->next;
-
-			/* see if we've already processed this */
-			if (pu_iter->udi == NULL)
-				goto already_processed;
-
-			/* count number of updates for this device */
-			num_updates_this = 0;
-			for (pu_iter2 = pu_iter; pu_iter2 != NULL; pu_iter2 = pu_iter2->next) {
-				if (strcmp (pu_iter2->udi, pu_iter->udi) == 0)
-					num_updates_this++;
-			}
-
-			/* prepare message */
-			message = dbus_message_new_signal (pu_iter->udi,
-							   "org.freedesktop.Hal.Device",
-							   "PropertyModified");
-			dbus_message_iter_init_append (message, &iter);
-			dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32,
-							&num_updates_this);
-
-			dbus_message_iter_open_container (&iter, 
-							  DBUS_TYPE_ARRAY,
-							  DBUS_STRUCT_BEGIN_CHAR_AS_STRING
-							  DBUS_TYPE_STRING_AS_STRING
-							  DBUS_TYPE_BOOLEAN_AS_STRING
-							  DBUS_TYPE_BOOLEAN_AS_STRING
-							  DBUS_STRUCT_END_CHAR_AS_STRING,
-							  &iter_array);
-
-			for (pu_iter2 = pu_iter; pu_iter2 != NULL;
-			     pu_iter2 = pu_iter2->next) {
-				if (strcmp (pu_iter2->udi, pu_iter->udi) == 0) {
-					DBusMessageIter iter_struct;
-					dbus_message_iter_open_container (&iter_array,
-									  DBUS_TYPE_STRUCT,
-									  NULL,
-									  &iter_struct);
-					dbus_message_iter_append_basic
-					    (&iter_struct, 
-					     DBUS_TYPE_STRING,
-					     &(pu_iter2->key));
-					dbus_message_iter_append_basic
-					    (&iter_struct,
-					     DBUS_TYPE_BOOLEAN,
-					     &(pu_iter2->removed));
-					dbus_message_iter_append_basic
-					    (&iter_struct, 
-					     DBUS_TYPE_BOOLEAN,
-					     &(pu_iter2->added));
-
-					dbus_message_iter_close_container (&iter_array, &iter_struct);
-
-					/* signal this is already processed */
-					g_free (pu_iter2->key);
-					if (pu_iter2 != pu_iter) {
-						g_free (pu_iter2->udi);
-						pu_iter2->udi = NULL;
-					}
-				}
-			}
-
-			g_free (pu_iter->udi);
-			dbus_message_iter_close_container (&iter, &iter_array);
-
-			if (dbus_connection != NULL) {
-				if (!dbus_connection_send (dbus_connection, message, NULL))
-					DIE (("error broadcasting message"));
-			}
+		pending_updates_devices = g_slist_reverse (pending_updates_devices);
 
-			dbus_message_unref (message);
-
-		already_processed:
-			g_free (pu_iter);
+		for (i = pending_updates_devices; i != NULL; i = i->next) {
+			PendingDeviceUpdates *pdu = i->data;
 
-		} /* for all updates */
+			pending_updates_send (pdu);
+			pending_device_updates_free (pdu);
+		}
 
+		g_slist_free (pending_updates_devices);
+		pending_updates_devices = NULL;
+		g_hash_table_destroy (pending_updates_by_udi);
+		pending_updates_by_udi = NULL;
 		num_pending_updates = 0;
-		pending_updates_head = NULL;
 	}
 }
 
@@ -2985,17 +3474,7 @@ device_send_signal_property_modified (HalDevice *device, const char *key,
 */
 
 	if (atomic_count > 0) {
-		PendingUpdate *pu;
-
-		pu = g_new0 (PendingUpdate, 1);
-		pu->udi = g_strdup (udi);
-		pu->key = g_strdup (key);
-		pu->removed = removed;
-		pu->added = added;
-		pu->next = pending_updates_head;
-
-		pending_updates_head = pu;
-		num_pending_updates++;
+		pending_updates_add (udi, key, removed, added);
 	} else {
 		dbus_int32_t i;
 		DBusMessageIter iter_struct;
@@ -3545,6 +4024,44 @@ out:
 	dbus_pending_call_unref (pending_call);
 }
 
+/* Called when a singleton addon exits or could not be started at all;
+ * in the latter case its devices will never be signalled, so count the
+ * addon as ready for them and forget it */
+static void
+singleton_terminated (HalDevice *d, guint32 exit_type,
+		      gint return_code, gchar **error,
+		      gpointer data1, gpointer data2)
+{
+	char *command_line = (char *) data1;
+	SingletonInfo *info;
+	GList *lp;
+
+	if (exit_type != HALD_RUN_FAILED || singletons == NULL)
+		goto out;
+
+	info = g_hash_table_lookup (singletons, command_line);
+	if (info == NULL || info->connection != NULL)
+		goto out;
+
+	HAL_ERROR (("Cannot start singleton addon %s", command_line));
+
+	for (lp = info->devices; lp; lp = lp->next) {
+		HalDevice *device = lp->data;
+
+		if (hal_device_inc_num_ready_addons (device)) {
+			if (hal_device_are_all_addons_ready (device)) {
+				manager_send_signal_device_added (device);
+			}
+		}
+	}
+	g_list_free (info->devices);
+	info->devices = NULL;
+	g_hash_table_remove (singletons, command_line);
+
+out:
+	g_free (command_line);
+}
+
 /**
  * hald_singleton_device_added:
  * @command_line: command line identifying addon singleton
@@ -3560,6 +4077,7 @@ hald_singleton_device_added (const char * command_line,
 {
 	SingletonInfo *info;
 	gchar *extra_env[2] = {NULL, NULL};
+	gchar *singleton_command_line;
 
 	if (command_line == NULL) {
 		HAL_ERROR (("command_line == NULL"));
@@ -3576,12 +4094,16 @@ hald_singleton_device_added (const char * command_line,
 	if (!info) {
 		extra_env[0] = g_malloc (strlen (command_line) + 26);
 		g_sprintf (extra_env[0], "SINGLETON_COMMAND_LINE=%s", command_line);
-		if (hald_runner_start_singleton (command_line, extra_env, NULL, NULL, NULL)) {
+		singleton_command_line = g_strdup (command_line);
+		if (hald_runner_start_singleton (command_line, extra_env, singleton_terminated,
+						 singleton_command_line, NULL)) {
 			HAL_INFO (("Started singleton addon %s for udi %s",
 				   command_line, hal_device_get_udi(device)));
 		} else {
 			HAL_ERROR (("Cannot start singleton addon %s for udi %s",
 				    command_line, hal_device_get_udi(device)));
+			g_free (singleton_command_line);
+			g_free (extra_env[0]);
 			return FALSE;
 		}
 		g_free (extra_env[0]);
@@ -4482,6 +5004,14 @@ do_introspect (DBusConnection  *connection,
 				       "    <method name=\"GetAllDevicesWithProperties\">\n"
 				       "      <arg name=\"devices_with_props\" direction=\"out\" type=\"a(sa{sv})\"/>\n"
 				       "    </method>\n"
+				       "    <method name=\"GetDevicesPage\">\n"
+				       "      <arg name=\"devices_with_props\" direction=\"out\" type=\"a(sa{sv})\"/>\n"
+				       "      <arg name=\"next\" direction=\"out\" type=\"s\"/>\n"
+				       "      <arg name=\"start\" direction=\"in\" type=\"s\"/>\n"
+				       "      <arg name=\"page_size\" direction=\"in\" type=\"i\"/>\n"
+				       "      <arg name=\"keys\" direction=\"in\" type=\"as\"/>\n"
+				       "      <arg name=\"capability\" direction=\"in\" type=\"s\"/>\n"
+				       "    </method>\n"
 				       "    <method name=\"DeviceExists\">\n"
 				       "      <arg name=\"does_it_exist\" direction=\"out\" type=\"b\"/>\n"
 				       "      <arg name=\"udi\" direction=\"in\" type=\"s\"/>\n"
@@ -4516,6 +5046,22 @@ do_introspect (DBusConnection  *connection,
 				       "    <method name=\"SingletonAddonIsReady\">\n"
 				       "      <arg name=\"command_line\" direction=\"in\" type=\"s\"/>\n"
 				       "    </method>\n"
+				       "    <method name=\"GetRunnerStatistics\">\n"
+				       "      <arg name=\"queued\" direction=\"out\" type=\"u\"/>\n"
+				       "      <arg name=\"in_flight\" direction=\"out\" type=\"u\"/>\n"
+				       "      <arg name=\"started\" direction=\"out\" type=\"u\"/>\n"
+				       "      <arg name=\"failed\" direction=\"out\" type=\"u\"/>\n"
+				       "      <arg name=\"start_latency\" direction=\"out\" type=\"au\"/>\n"
+				       "    </method>\n"
+				       "    <method name=\"GetCalloutStatistics\">\n"
+				       "      <arg name=\"callouts\" direction=\"out\" type=\"a(suuuu)\"/>\n"
+				       "    </method>\n"
+				       "    <method name=\"GetTrace\">\n"
+				       "      <arg name=\"entries\" direction=\"out\" type=\"as\"/>\n"
+				       "    </method>\n"
+				       "    <method name=\"SetLogLevel\">\n"
+				       "      <arg name=\"level\" direction=\"in\" type=\"s\"/>\n"
+				       "    </method>\n"
 				       "    <signal name=\"DeviceAdded\">\n"
 				       "      <arg name=\"udi\" type=\"s\"/>\n"
 				       "    </signal>\n"
@@ -4556,6 +5102,10 @@ do_introspect (DBusConnection  *connection,
 				       "    <method name=\"GetAllProperties\">\n"
 				       "      <arg name=\"properties\" direction=\"out\" type=\"a{sv}\"/>\n"
 				       "    </method>\n"
+				       "    <method name=\"GetProperties\">\n"
+				       "      <arg name=\"keys\" direction=\"in\" type=\"as\"/>\n"
+				       "      <arg name=\"properties\" direction=\"out\" type=\"a{sv}\"/>\n"
+				       "    </method>\n"
 				       "    <method name=\"SetMultipleProperties\">\n"
 				       "      <arg name=\"properties\" direction=\"in\" type=\"a{sv}\"/>\n"
 				       "    </method>\n"
@@ -4882,6 +5432,12 @@ hald_dbus_filter_handle_methods (DBusConnection *connection, DBusMessage *messag
 		   strcmp (dbus_message_get_path (message),
 			   "/org/freedesktop/Hal/Manager") == 0) {
 		return manager_get_all_devices_with_properties (connection, message);
+	} else if (dbus_message_is_method_call (message,
+                                                "org.freedesktop.Hal.Manager",
+                                                "GetDevicesPage") &&
+		   strcmp (dbus_message_get_path (message),
+			   "/org/freedesktop/Hal/Manager") == 0) {
+		return manager_get_devices_page (connection, message);
 	} else if (dbus_message_is_method_call (message,
 						"org.freedesktop.Hal.Manager",
 						"DeviceExists") &&
@@ -4937,6 +5493,30 @@ hald_dbus_filter_handle_methods (DBusConnection *connection, DBusMessage *messag
 		   strcmp (dbus_message_get_path (message),
 			    "/org/freedesktop/Hal/Manager") == 0) {
 		return singleton_addon_is_ready (connection, message, local_interface);
+	} else if (dbus_message_is_method_call (message,
+						"org.freedesktop.Hal.Manager",
+						"GetRunnerStatistics") &&
+		   strcmp (dbus_message_get_path (message),
+			    "/org/freedesktop/Hal/Manager") == 0) {
+		return manager_get_runner_statistics (connection, message);
+	} else if (dbus_message_is_method_call (message,
+						"org.freedesktop.Hal.Manager",
+						"GetCalloutStatistics") &&
+		   strcmp (dbus_message_get_path (message),
+			    "/org/freedesktop/Hal/Manager") == 0) {
+		return manager_get_callout_statistics (connection, message);
+	} else if (dbus_message_is_method_call (message,
+						"org.freedesktop.Hal.Manager",
+						"GetTrace") &&
+		   strcmp (dbus_message_get_path (message),
+			    "/org/freedesktop/Hal/Manager") == 0) {
+		return manager_get_trace (connection, message, local_interface);
+	} else if (dbus_message_is_method_call (message,
+						"org.freedesktop.Hal.Manager",
+						"SetLogLevel") &&
+		   strcmp (dbus_message_get_path (message),
+			    "/org/freedesktop/Hal/Manager") == 0) {
+		return manager_set_log_level (connection, message, local_interface);
 
 	} else if (dbus_message_is_method_call (message,
 						"org.freedesktop.Hal.Device",
@@ -4962,6 +5542,10 @@ hald_dbus_filter_handle_methods (DBusConnection *connection, DBusMessage *messag
 					      "org.freedesktop.Hal.Device",
 					      "GetAllProperties")) {
 		return device_get_all_properties (connection, message);
+	} else if (dbus_message_is_method_call (message,
+					      "org.freedesktop.Hal.Device",
+					      "GetProperties")) {
+		return device_get_properties (connection, message);
 	} else if (dbus_message_is_method_call (message,
 					      "org.freedesktop.Hal.Device",
 					      "SetMultipleProperties")) {
@@ -5216,6 +5800,154 @@ out:
 	return osspec_filter_function (connection, message, user_data);
 }
 
+/* Method calls from a connection whose caller info is not known yet are
+ * held back, in arrival order, while the CITracker resolves it without
+ * blocking the main loop; once it is in they are dispatched as usual and
+ * every ci_tracker_get_info() in the handlers is answered from the cache.
+ * Reads whose handlers never look at the caller are dispatched right away
+ * unless earlier calls of the same caller are still held back.
+ */
+typedef struct {
+	char *sender;
+	DBusConnection *connection;
+	GQueue *messages;
+	gboolean vanished;
+} DeferredCaller;
+
+static GHashTable *deferred_callers = NULL;
+
+static void
+deferred_caller_resolved (CITracker *cit, CICallerInfo *ci, gpointer user_data)
+{
+	DeferredCaller *dc = (DeferredCaller *) user_data;
+	DBusMessage *message;
+
+	g_hash_table_remove (deferred_callers, dc->sender);
+
+	/* The caller disconnected while we were resolving it and its locks
+	 * etc. have already been cleaned up; don't run anything on its
+	 * behalf that nobody would ever undo. */
+	if (dc->vanished) {
+		HAL_INFO (("Dropping %d queued method calls from %s; it went away",
+			   g_queue_get_length (dc->messages), dc->sender));
+		while ((message = (DBusMessage *) g_queue_pop_head (dc->messages)) != NULL)
+			dbus_message_unref (message);
+		goto out;
+	}
+
+	while ((message = (DBusMessage *) g_queue_pop_head (dc->messages)) != NULL) {
+		if (hald_dbus_filter_handle_methods (dc->connection, message, NULL, FALSE) ==
+		    DBUS_HANDLER_RESULT_NOT_YET_HANDLED && !dbus_message_get_no_reply (message)) {
+			/* libdbus would have done this had we not taken the message */
+			raise_error (dc->connection, message, DBUS_ERROR_UNKNOWN_METHOD,
+				     "Method \"%s\" with signature \"%s\" on interface \"%s\" doesn't exist",
+				     dbus_message_get_member (message) != NULL ? dbus_message_get_member (message) : "",
+				     dbus_message_get_signature (message),
+				     dbus_message_get_interface (message) != NULL ? dbus_message_get_interface (message) : "");
+		}
+		dbus_message_unref (message);
+	}
+
+out:
+	g_queue_free (dc->messages);
+	dbus_connection_unref (dc->connection);
+	g_free (dc->sender);
+	g_free (dc);
+}
+
+/* interface and member of methods that need no caller info */
+static const char * const methods_without_caller_info[] = {
+	"org.freedesktop.Hal.Manager", "GetAllDevices",
+	"org.freedesktop.Hal.Manager", "GetAllDevicesWithProperties",
+	"org.freedesktop.Hal.Manager", "GetDevicesPage",
+	"org.freedesktop.Hal.Manager", "DeviceExists",
+	"org.freedesktop.Hal.Manager", "FindDeviceStringMatch",
+	"org.freedesktop.Hal.Manager", "FindDeviceByCapability",
+	"org.freedesktop.Hal.Manager", "GetRunnerStatistics",
+	"org.freedesktop.Hal.Manager", "GetCalloutStatistics",
+	"org.freedesktop.Hal.Device", "GetAllProperties",
+	"org.freedesktop.Hal.Device", "GetProperties",
+	"org.freedesktop.Hal.Device", "GetProperty",
+	"org.freedesktop.Hal.Device", "GetPropertyString",
+	"org.freedesktop.Hal.Device", "GetPropertyStringList",
+	"org.freedesktop.Hal.Device", "GetPropertyInteger",
+	"org.freedesktop.Hal.Device", "GetPropertyBoolean",
+	"org.freedesktop.Hal.Device", "GetPropertyDouble",
+	"org.freedesktop.Hal.Device", "GetPropertyType",
+	"org.freedesktop.Hal.Device", "PropertyExists",
+	"org.freedesktop.Hal.Device", "QueryCapability",
+	NULL
+};
+
+static gboolean
+method_needs_caller_info (DBusMessage *message)
+{
+	int n;
+
+	for (n = 0; methods_without_caller_info[n] != NULL; n += 2) {
+		if (dbus_message_is_method_call (message,
+						 methods_without_caller_info[n],
+						 methods_without_caller_info[n + 1]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+defer_method_call (DBusConnection *connection, DBusMessage *message)
+{
+	const char *sender;
+	const char *interface;
+	DeferredCaller *dc;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return FALSE;
+
+	/* introspection and friends never look at the caller */
+	sender = dbus_message_get_sender (message);
+	interface = dbus_message_get_interface (message);
+	if (sender == NULL || (interface != NULL && g_str_has_prefix (interface, "org.freedesktop.DBus")))
+		return FALSE;
+
+	if (deferred_callers == NULL)
+		deferred_callers = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* don't let anything overtake calls already held back */
+	dc = (DeferredCaller *) g_hash_table_lookup (deferred_callers, sender);
+	if (dc != NULL) {
+		g_queue_push_tail (dc->messages, dbus_message_ref (message));
+		return TRUE;
+	}
+
+	if (!method_needs_caller_info (message) || ci_tracker_has_info (ci_tracker, sender))
+		return FALSE;
+
+	dc = g_new0 (DeferredCaller, 1);
+	dc->sender = g_strdup (sender);
+	dc->connection = dbus_connection_ref (connection);
+	dc->messages = g_queue_new ();
+	g_queue_push_tail (dc->messages, dbus_message_ref (message));
+	g_hash_table_insert (deferred_callers, dc->sender, dc);
+
+	/* may call back right away, e.g. for a bogus sender */
+	ci_tracker_get_info_async (ci_tracker, sender, deferred_caller_resolved, dc);
+	return TRUE;
+}
+
+static void
+deferred_caller_vanished (const char *sender)
+{
+	DeferredCaller *dc;
+
+	if (deferred_callers == NULL)
+		return;
+
+	dc = (DeferredCaller *) g_hash_table_lookup (deferred_callers, sender);
+	if (dc != NULL)
+		dc->vanished = TRUE;
+}
+
 /**  
  *  hald_dbus_filter_function:
  *  @connection:          D-BUS connection
@@ -5278,8 +6010,10 @@ hald_dbus_filter_function (DBusConnection * connection,
 		if (services_with_locks != NULL)
 			services_with_locks_remove_lockowner(old_service_name);
 
-                if (strlen (old_service_name) > 0)
+                if (strlen (old_service_name) > 0) {
+                        deferred_caller_vanished (old_service_name);
                         hal_device_client_disconnected (old_service_name);
+                }
 
 #ifdef HAVE_CONKIT
 	} else if (dbus_message_is_signal (message,
@@ -5308,6 +6042,9 @@ hald_dbus_filter_function (DBusConnection * connection,
                         ck_tracker_process_system_bus_message (ck_tracker, message);
                 }
 #endif
+		if (defer_method_call (connection, message))
+			return DBUS_HANDLER_RESULT_HANDLED;
+
 		return hald_dbus_filter_handle_methods (connection, message, user_data, FALSE);
         }
 
@@ -5579,6 +6316,7 @@ reconfigure_all_policy (void)
 typedef struct {
         HalDevice *d;
         char **programs;
+        char **parallel;
         char **extra_env;
 } SessionChangesEntry;
 
@@ -5596,7 +6334,8 @@ session_changes_done_cb (HalDevice *d, gpointer userdata1, gpointer userdata2)
 
         g_assert (entry->d == d);
 
-        /* hal_callout_device takes ownership of entry->programs so we don't free it here */
+        /* hal_callout_device_full takes ownership of entry->programs and
+         * entry->parallel so we don't free them here */
         g_object_unref (entry->d);
         g_strfreev (entry->extra_env);
         g_free (entry);
@@ -5627,18 +6366,19 @@ session_changes_process_queue (void)
         entry = session_changes_queue->data;
         session_changes_queue = g_list_remove (session_changes_queue, entry);
 
-	hal_callout_device (entry->d, 
-			    session_changes_done_cb, /* callback */
-			    entry,                          /* userdata1 */
-			    NULL,                           /* userdata2 */
-			    entry->programs, 
-			    entry->extra_env);
+	hal_callout_device_full (entry->d, 
+				 session_changes_done_cb, /* callback */
+				 entry,                          /* userdata1 */
+				 NULL,                           /* userdata2 */
+				 entry->programs, 
+				 entry->parallel,
+				 entry->extra_env);
 
         session_changes_is_running = TRUE;
 }
 
 static void
-session_changes_push (HalDevice *d, char **programs, char **extra_env)
+session_changes_push (HalDevice *d, char **programs, char **parallel, char **extra_env)
 {
         SessionChangesEntry *entry;
 
@@ -5646,7 +6386,8 @@ session_changes_push (HalDevice *d, char **programs, char **extra_env)
 
         entry = g_new0 (SessionChangesEntry, 1);
         entry->d = g_object_ref (d);
-        entry->programs = g_strdupv (programs);
+        entry->programs = programs;
+        entry->parallel = parallel;
         entry->extra_env = g_strdupv (extra_env);
 
         /* push to end of queue */
@@ -5661,6 +6402,7 @@ hald_dbus_session_active_changed (CKTracker *tracker, CKSession *session, void *
 {
 	HalDevice *d;
 	char **programs;
+	char **parallel;
 	char *session_id;
 	char *extra_env[5] = {"HALD_ACTION=session_active_changed", 
 			      NULL /* "HALD_SESSION_ACTIVE_CHANGED_SESSION_ID=" */,
@@ -5688,7 +6430,11 @@ hald_dbus_session_active_changed (CKTracker *tracker, CKSession *session, void *
 							    ck_session_is_active (session) ?
 							    "info.callouts.session_active" :
 							    "info.callouts.session_inactive");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, 
+							    ck_session_is_active (session) ?
+							    "info.callouts.session_active.parallel" :
+							    "info.callouts.session_inactive.parallel");
+	if (programs == NULL && parallel == NULL) {
 		goto out;
 	}
 
@@ -5697,7 +6443,7 @@ hald_dbus_session_active_changed (CKTracker *tracker, CKSession *session, void *
 	extra_env[3] = g_strdup_printf ("HALD_SESSION_ACTIVE_CHANGED_SESSION_IS_ACTIVE=%s", 
 					ck_session_is_active (session) ? "true" : "false");
 
-        session_changes_push (d, programs, extra_env);
+        session_changes_push (d, programs, parallel, extra_env);
 
 	g_free (extra_env[1]);
 	g_free (extra_env[2]);
@@ -5711,6 +6457,7 @@ hald_dbus_session_added (CKTracker *tracker, CKSession *session, void *user_data
 {
 	HalDevice *d;
 	char **programs;
+	char **parallel;
 	char *session_id;
 	char *seat_id;
 	char *extra_env[5] = {"HALD_ACTION=session_add", 
@@ -5733,7 +6480,8 @@ hald_dbus_session_added (CKTracker *tracker, CKSession *session, void *user_data
 	}
 
 	programs = hal_device_property_dup_strlist_as_strv (d, "info.callouts.session_add");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, "info.callouts.session_add.parallel");
+	if (programs == NULL && parallel == NULL) {
 		goto out;
 	}
 
@@ -5742,7 +6490,7 @@ hald_dbus_session_added (CKTracker *tracker, CKSession *session, void *user_data
 	extra_env[3] = g_strdup_printf ("HALD_SESSION_ADD_SESSION_IS_ACTIVE=%s", 
 					ck_session_is_active (session) ? "true" : "false");
 
-        session_changes_push (d, programs, extra_env);
+        session_changes_push (d, programs, parallel, extra_env);
 
 	g_free (extra_env[1]);
 	g_free (extra_env[2]);
@@ -5759,6 +6507,7 @@ hald_dbus_session_removed (CKTracker *tracker, CKSession *session, void *user_da
 	char *session_id;
 	char *seat_id;
 	char **programs;
+	char **parallel;
 	char *extra_env[5] = {"HALD_ACTION=session_remove", 
 			      NULL /* "HALD_SESSION_REMOVE_SESSION_ID=" */,
 			      NULL /* "HALD_SESSION_REMOVE_SESSION_UID=" */,
@@ -5780,7 +6529,8 @@ hald_dbus_session_removed (CKTracker *tracker, CKSession *session, void *user_da
 	}
 
 	programs = hal_device_property_dup_strlist_as_strv (d, "info.callouts.session_remove");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, "info.callouts.session_remove.parallel");
+	if (programs == NULL && parallel == NULL) {
 		goto out;
 	}
 
@@ -5789,7 +6539,7 @@ hald_dbus_session_removed (CKTracker *tracker, CKSession *session, void *user_da
 	extra_env[3] = g_strdup_printf ("HALD_SESSION_REMOVE_SESSION_IS_ACTIVE=%s", 
 					ck_session_is_active (session) ? "true" : "false");
 
-        session_changes_push (d, programs, extra_env);
+        session_changes_push (d, programs, parallel, extra_env);
 
 	g_free (extra_env[1]);
 	g_free (extra_env[2]);
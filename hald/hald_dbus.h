@@ -34,14 +34,22 @@ DBusHandlerResult manager_get_all_devices           (DBusConnection *connection,
 						     DBusMessage    *message);
 DBusHandlerResult manager_get_all_devices_with_properties (DBusConnection *connection,
 						     DBusMessage    *message);
+DBusHandlerResult manager_get_devices_page          (DBusConnection *connection,
+						     DBusMessage    *message);
 DBusHandlerResult manager_find_device_string_match  (DBusConnection *connection,
 						     DBusMessage    *message);
 DBusHandlerResult manager_find_device_by_capability (DBusConnection *connection,
 						     DBusMessage    *message);
 DBusHandlerResult manager_device_exists             (DBusConnection *connection,
 						     DBusMessage    *message);
+DBusHandlerResult manager_get_runner_statistics     (DBusConnection *connection,
+						     DBusMessage    *message);
+DBusHandlerResult manager_get_callout_statistics    (DBusConnection *connection,
+						     DBusMessage    *message);
 DBusHandlerResult device_get_all_properties         (DBusConnection *connection,
 						     DBusMessage    *message);
+DBusHandlerResult device_get_properties             (DBusConnection *connection,
+						     DBusMessage    *message);
 DBusHandlerResult device_get_property               (DBusConnection *connection,
 						     DBusMessage    *message);
 DBusHandlerResult device_get_property_type          (DBusConnection *connection,
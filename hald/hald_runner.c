@@ -38,6 +38,8 @@
 
 #include <sys/types.h>
 #include <signal.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "hald.h"
 #include "util.h"
@@ -49,13 +51,45 @@
 #include "ck-tracker.h"
 #endif
 
+typedef struct _PropertySnapshotFile PropertySnapshotFile;
+
 typedef struct {
 	HalDevice *d;
 	HalRunTerminatedCB cb;
 	gpointer data1;
 	gpointer data2;
+	gboolean limited;	/* counts against max_parallel */
+	PropertySnapshotFile *snapshot;
 } HelperData;
 
+/* A hald_runner_run() request waiting for a free slot */
+typedef struct {
+	HalDevice *device;
+	gchar *command_line;
+	gchar **extra_env;
+	guint32 timeout;
+	HalRunTerminatedCB cb;
+	gpointer data1;
+	gpointer data2;
+} PendingRun;
+
+/* A hald_runner_start() request waiting for its pid */
+typedef struct {
+	HalDevice *device;
+	gchar **argv;
+	gchar **extra_env;
+	gboolean singleton;
+	gboolean cancelled;	/* device was killed while in flight */
+	HalRunTerminatedCB cb;
+	gpointer data1;
+	gpointer data2;
+	GTimeVal queued;
+	PropertySnapshotFile *snapshot;
+} PendingStart;
+
+/* Most start requests sent to the runner in one StartBatch message */
+#define HALD_RUNNER_MAX_BATCH 64
+
 #define DBUS_SERVER_ADDRESS "unix:tmpdir=" HALD_SOCKET_DIR
 
 static DBusConnection *runner_connection = NULL;
@@ -74,6 +108,42 @@ typedef struct {
 /* list of RunningProcess */
 static GSList *running_processes = NULL;
 
+/* Limit on concurrent hald_runner_run() helpers, 0 if unlimited */
+static guint max_parallel = 0;
+static guint num_parallel = 0;
+
+/* Number of worker processes hald-runner may keep per prober, 0 if none */
+static guint probe_workers = 0;
+
+/* Probers that can handle a sequence of probes in one process, see
+ * util_helper_worker.c */
+static const char *worker_helpers[] = {
+	"hald-probe-input",
+	"hald-probe-storage",
+	"hald-probe-volume",
+	NULL
+};
+
+/* queue of PendingRun, started in order as helpers finish */
+static GQueue *pending_runs = NULL;
+
+static void pending_runs_start (void);
+static void pending_starts_clear (void);
+
+/* queue of PendingStart, sent to the runner from an idle handler */
+static GQueue *pending_starts = NULL;
+static guint pending_starts_source = 0;
+
+/* StartBatch messages waiting for a reply, each a GPtrArray of PendingStart */
+static GSList *start_batches = NULL;
+
+static guint starts_in_flight = 0;
+static guint runs_in_flight = 0;
+static guint num_started = 0;
+static guint num_start_failed = 0;
+static guint num_batches = 0;
+static guint start_latency[HALD_RUNNER_LATENCY_BUCKETS];
+
 static void
 running_processes_remove_device (HalDevice * device)
 {
@@ -95,10 +165,71 @@ running_processes_remove_device (HalDevice * device)
 	}
 }
 
+/* Properties of a device as written for helpers in lazy environment mode */
+typedef struct {
+	HalDevice *device;
+	PropertySnapshotFile *current;	/* snapshot of the current properties, NULL if stale */
+	GSList *files;			/* snapshots on disk: current and still in use */
+	gulong handler;
+} PropertySnapshot;
+
+/* A snapshot file stays on disk while it is the current one or while
+ * helpers started with it are running; a helper may map it at any time */
+struct _PropertySnapshotFile {
+	PropertySnapshot *owner;	/* NULL once the file is unlinked */
+	gchar *path;
+	guint refs;			/* helpers running with this file */
+};
+
+/* If TRUE, helpers get HALD_PROPERTIES_SNAPSHOT instead of HAL_PROP_* */
+static gboolean lazy_environment = FALSE;
+
+/* HalDevice -> PropertySnapshot */
+static GHashTable *property_snapshots = NULL;
+
+/* pid -> PropertySnapshotFile of helpers started with a snapshot */
+static GHashTable *property_snapshot_pids = NULL;
+
+static void
+property_snapshot_file_remove (PropertySnapshotFile *file)
+{
+	if (file->owner != NULL) {
+		unlink (file->path);
+		file->owner->files = g_slist_remove (file->owner->files, file);
+		file->owner = NULL;
+	}
+
+	/* helpers still running keep the struct until they exit */
+	if (file->refs == 0) {
+		g_free (file->path);
+		g_free (file);
+	}
+}
+
+static void
+property_snapshot_file_unref (PropertySnapshotFile *file)
+{
+	file->refs--;
+	if (file->refs == 0 &&
+	    (file->owner == NULL || file->owner->current != file))
+		property_snapshot_file_remove (file);
+}
+
+static void
+property_snapshot_free (PropertySnapshot *ps)
+{
+	while (ps->files != NULL)
+		property_snapshot_file_remove ((PropertySnapshotFile *) ps->files->data);
+	g_signal_handler_disconnect (ps->device, ps->handler);
+	g_free (ps);
+}
+
 void
 runner_device_finalized (HalDevice * device)
 {
 	running_processes_remove_device (device);
+	if (property_snapshots != NULL)
+		g_hash_table_remove (property_snapshots, device);
 }
 
 
@@ -124,6 +255,9 @@ runner_server_message_handler (DBusConnection * connection,
 
 			HAL_INFO (("Previously started process with pid %d exited", pid));
 
+			if (property_snapshot_pids != NULL)
+				g_hash_table_remove (property_snapshot_pids, GINT_TO_POINTER (pid));
+
 			for (i = running_processes; i != NULL;
 			     i = g_slist_next (i)) {
 				RunningProcess *rp;
@@ -219,6 +353,16 @@ hald_runner_stop_runner (void)
 		g_slist_foreach (running_processes, (GFunc) g_free, NULL);
 		g_slist_free (running_processes);
 		running_processes = NULL;
+		pending_starts_clear ();
+
+		if (property_snapshot_pids != NULL) {
+			g_hash_table_destroy (property_snapshot_pids);
+			property_snapshot_pids = NULL;
+		}
+		if (property_snapshots != NULL) {
+			g_hash_table_destroy (property_snapshots);
+			property_snapshots = NULL;
+		}
 
 		HAL_INFO (("Killing runner with pid %d", runner_pid));
 
@@ -242,17 +386,41 @@ hald_runner_stop_runner (void)
 	}
 }
 
+/* Remove property snapshots left behind by a previous instance */
+static void
+property_snapshots_cleanup (void)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open (HALD_SOCKET_DIR, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (g_str_has_prefix (name, "hald-props-")) {
+			gchar *path;
+
+			path = g_build_filename (HALD_SOCKET_DIR, name, NULL);
+			unlink (path);
+			g_free (path);
+		}
+	}
+	g_dir_close (dir);
+}
+
 gboolean
 hald_runner_start_runner (void)
 {
 	DBusError err;
 	GError *error = NULL;
 	char *argv[] = { NULL, NULL };
-	char *env[] = { NULL, NULL, NULL, NULL };
+	char *env[] = { NULL, NULL, NULL, NULL, NULL };
 	const char *hald_runner_path;
 	char *server_address;
 
 	running_processes = NULL;
+	property_snapshots_cleanup ();
 
 	dbus_error_init (&err);
 	runner_server = dbus_server_listen (DBUS_SERVER_ADDRESS, &err);
@@ -286,7 +454,16 @@ hald_runner_start_runner (void)
 				     PACKAGE_BIN_DIR);
 	}
 
-	/*env[2] = "DBUS_VERBOSE=1"; */
+	if (probe_workers > 0) {
+		char *helpers;
+
+		helpers = g_strjoinv (":", (char **) worker_helpers);
+		env[2] = g_strdup_printf ("HALD_RUNNER_MAX_WORKERS=%u", probe_workers);
+		env[3] = g_strdup_printf ("HALD_RUNNER_WORKER_HELPERS=%s", helpers);
+		g_free (helpers);
+	}
+
+	/*env[4] = "DBUS_VERBOSE=1"; */
 
 
 	if (!g_spawn_async
@@ -300,6 +477,8 @@ hald_runner_start_runner (void)
 	}
 	g_free (env[0]);
 	g_free (env[1]);
+	g_free (env[2]);
+	g_free (env[3]);
 
 	HAL_INFO (("Runner has pid %d", runner_pid));
 
@@ -316,14 +495,12 @@ hald_runner_start_runner (void)
 	return FALSE;
 }
 
-static void
-add_property_to_msg (HalDevice * device,
-		     const char *key, gpointer user_data)
+static gchar *
+property_to_env (HalDevice * device, const char *key)
 {
 	char *prop_upper, *value;
 	char *c;
 	gchar *env;
-	DBusMessageIter *iter = (DBusMessageIter *) user_data;
 
 	prop_upper = g_ascii_strup (key, -1);
 
@@ -336,11 +513,158 @@ add_property_to_msg (HalDevice * device,
 
 	value = hal_device_property_to_string (device, key);
 	env = g_strdup_printf ("HAL_PROP_%s=%s", prop_upper, value);
-	dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &env);
 
-	g_free (env);
 	g_free (value);
 	g_free (prop_upper);
+	return env;
+}
+
+static void
+add_property_to_msg (HalDevice * device,
+		     const char *key, gpointer user_data)
+{
+	gchar *env;
+	DBusMessageIter *iter = (DBusMessageIter *) user_data;
+
+	env = property_to_env (device, key);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &env);
+	g_free (env);
+}
+
+static void
+add_property_to_snapshot (HalDevice * device,
+			  const char *key, gpointer user_data)
+{
+	gchar *env;
+	GString *snapshot = (GString *) user_data;
+
+	/* entries are NUL terminated, like an environment block */
+	env = property_to_env (device, key);
+	g_string_append_len (snapshot, env, strlen (env) + 1);
+	g_free (env);
+}
+
+static void
+property_snapshot_invalidate (HalDevice *device, const char *key,
+			      gboolean removed, gboolean added,
+			      gpointer user_data)
+{
+	PropertySnapshot *ps = (PropertySnapshot *) user_data;
+	PropertySnapshotFile *file;
+
+	file = ps->current;
+	ps->current = NULL;
+	if (file != NULL && file->refs == 0)
+		property_snapshot_file_remove (file);
+}
+
+/* Get a file holding the HAL_PROP_* variables for the current
+ * properties of device, writing one if they changed since the last one.
+ * The caller gets a reference for the helper it starts and drops it
+ * with property_snapshot_file_unref() when the helper has exited.
+ * Returns NULL if the file cannot be written. */
+static PropertySnapshotFile *
+property_snapshot_get (HalDevice * device)
+{
+	PropertySnapshot *ps;
+	PropertySnapshotFile *file;
+	GString *snapshot;
+	gchar *path;
+	gsize written;
+	int fd;
+
+	if (property_snapshots == NULL)
+		property_snapshots = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+							    (GDestroyNotify) property_snapshot_free);
+
+	ps = g_hash_table_lookup (property_snapshots, device);
+	if (ps != NULL && ps->current != NULL) {
+		ps->current->refs++;
+		return ps->current;
+	}
+
+	path = g_strdup (HALD_SOCKET_DIR "/hald-props-XXXXXX");
+	fd = g_mkstemp (path);
+	if (fd < 0) {
+		HAL_ERROR (("Cannot create property snapshot %s: %s", path, g_strerror (errno)));
+		g_free (path);
+		return NULL;
+	}
+
+	snapshot = g_string_new ("");
+	hal_device_property_foreach (device, add_property_to_snapshot, snapshot);
+
+	written = 0;
+	while (written < snapshot->len) {
+		ssize_t n;
+
+		n = write (fd, snapshot->str + written, snapshot->len - written);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		written += n;
+	}
+	close (fd);
+
+	if (written < snapshot->len) {
+		HAL_ERROR (("Cannot write property snapshot %s", path));
+		unlink (path);
+		g_free (path);
+		g_string_free (snapshot, TRUE);
+		return NULL;
+	}
+	g_string_free (snapshot, TRUE);
+
+	if (ps == NULL) {
+		ps = g_new0 (PropertySnapshot, 1);
+		ps->device = device;
+		ps->handler = g_signal_connect (device, "property_changed",
+						G_CALLBACK (property_snapshot_invalidate), ps);
+		g_hash_table_insert (property_snapshots, device, ps);
+	}
+	file = g_new0 (PropertySnapshotFile, 1);
+	file->owner = ps;
+	file->path = path;
+	file->refs = 1;
+	ps->files = g_slist_prepend (ps->files, file);
+	ps->current = file;
+
+	return file;
+}
+
+/* TRUE if the fdi files list the program of command_line in
+ * info.helpers.full_environment, by path or basename */
+static gboolean
+helper_wants_full_environment (HalDevice * device, const gchar * command_line)
+{
+	HalDeviceStrListIter iter;
+	gchar *program;
+	gchar *base;
+	gboolean ret;
+
+	if (!hal_device_has_property (device, "info.helpers.full_environment"))
+		return FALSE;
+
+	program = g_strndup (command_line, strcspn (command_line, " \t"));
+	base = g_path_get_basename (program);
+
+	ret = FALSE;
+	for (hal_device_property_strlist_iter_init (device, "info.helpers.full_environment", &iter);
+	     hal_device_property_strlist_iter_is_valid (&iter);
+	     hal_device_property_strlist_iter_next (&iter)) {
+		const char *name;
+
+		name = hal_device_property_strlist_iter_get_value (&iter);
+		if (strcmp (name, program) == 0 || strcmp (name, base) == 0) {
+			ret = TRUE;
+			break;
+		}
+	}
+
+	g_free (base);
+	g_free (program);
+	return ret;
 }
 
 static void
@@ -536,21 +860,12 @@ add_extra_env (DBusMessageIter * iter, gchar ** env)
 		}
 }
 
-static gboolean
-add_command (DBusMessageIter * iter, const gchar * command_line)
+static void
+add_argv (DBusMessageIter * iter, char **argv)
 {
-	gint argc;
 	gint x;
-	char **argv;
-	GError *err = NULL;
 	DBusMessageIter array_iter;
 
-	if (!g_shell_parse_argv (command_line, &argc, &argv, &err)) {
-		HAL_ERROR (("Error parsing commandline '%s': %s",
-			    command_line, err->message));
-		g_error_free (err);
-		return FALSE;
-	}
 	if (!dbus_message_iter_open_container (iter,
 					       DBUS_TYPE_ARRAY,
 					       DBUS_TYPE_STRING_AS_STRING,
@@ -562,6 +877,22 @@ add_command (DBusMessageIter * iter, const gchar * command_line)
 						&argv[x]);
 	}
 	dbus_message_iter_close_container (iter, &array_iter);
+}
+
+static gboolean
+add_command (DBusMessageIter * iter, const gchar * command_line)
+{
+	gint argc;
+	char **argv;
+	GError *err = NULL;
+
+	if (!g_shell_parse_argv (command_line, &argc, &argv, &err)) {
+		HAL_ERROR (("Error parsing commandline '%s': %s",
+			    command_line, err->message));
+		g_error_free (err);
+		return FALSE;
+	}
+	add_argv (iter, argv);
 
 	g_strfreev (argv);
 	return TRUE;
@@ -580,21 +911,46 @@ add_udi (DBusMessageIter * iter, HalDevice * device)
 	dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &udi);
 }
 
-static gboolean
-add_environment (DBusMessageIter * iter, HalDevice * device,
-		const gchar * command_line, char **extra_env)
+/* With snapshot not NULL, the properties are passed as a snapshot file
+ * if lazy environment mode is on and the helper does not need the full
+ * environment; the file is returned in snapshot with a reference for
+ * the helper */
+static void
+add_environment_array (DBusMessageIter * iter, HalDevice * device,
+		       const gchar * command_line, char **extra_env,
+		       PropertySnapshotFile **snapshot)
 {
 	DBusMessageIter array_iter;
+	PropertySnapshotFile *file;
+
 	dbus_message_iter_open_container (iter,
 					  DBUS_TYPE_ARRAY,
 					  DBUS_TYPE_STRING_AS_STRING,
 					  &array_iter);
-	if (device != NULL)
-		hal_device_property_foreach (device, add_property_to_msg,
-					     &array_iter);
+	if (device != NULL) {
+		file = NULL;
+		if (snapshot != NULL && lazy_environment &&
+		    !helper_wants_full_environment (device, command_line))
+			file = property_snapshot_get (device);
+
+		if (file != NULL) {
+			add_env (&array_iter, "HALD_PROPERTIES_SNAPSHOT", file->path);
+			*snapshot = file;
+		} else
+			hal_device_property_foreach (device, add_property_to_msg,
+						     &array_iter);
+	}
 	add_basic_env (&array_iter, device ? hal_device_get_udi (device): NULL);
 	add_extra_env (&array_iter, extra_env);
 	dbus_message_iter_close_container (iter, &array_iter);
+}
+
+static gboolean
+add_environment (DBusMessageIter * iter, HalDevice * device,
+		const gchar * command_line, char **extra_env,
+		PropertySnapshotFile **snapshot)
+{
+	add_environment_array (iter, device, command_line, extra_env, snapshot);
 
 	if (!add_command (iter, command_line)) {
 		return FALSE;
@@ -602,87 +958,302 @@ add_environment (DBusMessageIter * iter, HalDevice * device,
 	return TRUE;
 }
 
-/* Start a helper, returns true on a successfull start */
-static gboolean
-runner_start (HalDevice * device, const gchar * command_line,
-	      char **extra_env, gboolean singleton,
-	      HalRunTerminatedCB cb, gpointer data1, gpointer data2)
+static void
+pending_start_free (PendingStart *ps)
 {
-	DBusMessage *msg, *reply;
-	DBusError error;
+	if (ps->device != NULL)
+		g_object_unref (ps->device);
+	if (ps->snapshot != NULL)
+		property_snapshot_file_unref (ps->snapshot);
+	g_strfreev (ps->argv);
+	g_strfreev (ps->extra_env);
+	g_slice_free (PendingStart, ps);
+}
+
+static void
+start_latency_record (const GTimeVal *queued, const GTimeVal *now)
+{
+	glong ms;
+	guint bucket;
+
+	ms = (now->tv_sec - queued->tv_sec) * 1000 +
+	     (now->tv_usec - queued->tv_usec) / 1000;
+
+	/* bucket 0 is below 1ms, bucket n below 2^n ms, the last one the rest */
+	for (bucket = 0; bucket < HALD_RUNNER_LATENCY_BUCKETS - 1; bucket++) {
+		if (ms < (1 << bucket))
+			break;
+	}
+	start_latency[bucket]++;
+}
+
+static void
+pending_start_done (PendingStart *ps, GPid pid, const GTimeVal *now)
+{
+	if (pid <= 0) {
+		num_start_failed++;
+		HAL_ERROR (("Runner could not start '%s'", ps->argv[0]));
+		if (ps->cb != NULL && !ps->cancelled)
+			ps->cb (ps->device, HALD_RUN_FAILED, 0, NULL,
+				ps->data1, ps->data2);
+		return;
+	}
+
+	num_started++;
+	start_latency_record (&ps->queued, now);
+
+	/* keep the snapshot until the runner reports the exit */
+	if (ps->snapshot != NULL) {
+		if (property_snapshot_pids == NULL)
+			property_snapshot_pids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+									(GDestroyNotify) property_snapshot_file_unref);
+		g_hash_table_insert (property_snapshot_pids, GINT_TO_POINTER (pid), ps->snapshot);
+		ps->snapshot = NULL;
+	}
+
+	if (ps->cb != NULL && !ps->cancelled) {
+		RunningProcess *rp;
+
+		rp = g_new0 (RunningProcess, 1);
+		rp->pid = pid;
+		rp->cb = ps->cb;
+		rp->is_singleton = ps->singleton;
+		rp->device = ps->device;
+		rp->data1 = ps->data1;
+		rp->data2 = ps->data2;
+
+		running_processes = g_slist_prepend (running_processes, rp);
+		HAL_INFO (("running_processes %p, num = %d", running_processes, g_slist_length (running_processes)));
+	}
+}
+
+/* Hand the pids back to the requests of a batch, in order */
+static void
+start_batch_done (GPtrArray *batch, dbus_int64_t *pids)
+{
+	GTimeVal now;
+	guint i;
+
+	g_get_current_time (&now);
+
+	/* the batch stays in start_batches until all callbacks ran so that
+	 * hald_runner_kill_device() from a callback still cancels the rest */
+	for (i = 0; i < batch->len; i++) {
+		PendingStart *ps = (PendingStart *) g_ptr_array_index (batch, i);
+
+		starts_in_flight--;
+		pending_start_done (ps, pids != NULL ? (GPid) pids[i] : 0, &now);
+	}
+
+	start_batches = g_slist_remove (start_batches, batch);
+	for (i = 0; i < batch->len; i++)
+		pending_start_free ((PendingStart *) g_ptr_array_index (batch, i));
+	g_ptr_array_free (batch, TRUE);
+}
+
+static void
+start_batch_notify (DBusPendingCall * pending, void *user_data)
+{
+	GPtrArray *batch = (GPtrArray *) user_data;
+	DBusMessage *m;
 	DBusMessageIter iter;
+	DBusMessageIter array_iter;
+	dbus_int64_t *pids = NULL;
+	int num_pids = 0;
 
-	dbus_error_init (&error);
-	msg = dbus_message_new_method_call ("org.freedesktop.HalRunner",
-					    "/org/freedesktop/HalRunner",
-					    "org.freedesktop.HalRunner",
-					    singleton ? "StartSingleton" : "Start");
-	if (msg == NULL)
-		DIE (("No memory"));
-	dbus_message_iter_init_append (msg, &iter);
+	m = dbus_pending_call_steal_reply (pending);
 
-	if (!singleton)
-		add_udi (&iter, device);
+	if (dbus_message_get_type (m) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+	    dbus_message_iter_init (m, &iter) &&
+	    dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY &&
+	    dbus_message_iter_get_element_type (&iter) == DBUS_TYPE_INT64) {
+		dbus_message_iter_recurse (&iter, &array_iter);
+		dbus_message_iter_get_fixed_array (&array_iter, &pids, &num_pids);
+	}
 
-	if (!add_environment (&iter, device, command_line, extra_env)) {
-		HAL_ERROR (("Error adding environment, device =%p, singleton=%d",
-			device, singleton));
-		goto error;
+	if (pids == NULL || num_pids != (int) batch->len) {
+		HAL_ERROR (("Malformed or unexpected reply to StartBatch"));
+		pids = NULL;
 	}
 
-	/* Wait for the reply, should be almost instantanious */
-	reply = dbus_connection_send_with_reply_and_block (runner_connection,
-							   msg, -1, &error);
-	if (reply) {
-		gboolean ret =
-		    (dbus_message_get_type (reply) ==
-		     DBUS_MESSAGE_TYPE_METHOD_RETURN);
-
-		if (ret) {
-			dbus_int64_t pid_from_runner;
-			if (dbus_message_get_args (reply, &error,
-						   DBUS_TYPE_INT64,
-						   &pid_from_runner,
-						   DBUS_TYPE_INVALID)) {
-				if (cb != NULL) {
-					RunningProcess *rp;
-					rp = g_new0 (RunningProcess, 1);
-					rp->pid = (GPid) pid_from_runner;
-					rp->cb = cb;
-					rp->is_singleton = singleton;
-					if (singleton)
-						rp->device = NULL;
-					else
-						rp->device = device;
-					rp->data1 = data1;
-					rp->data2 = data2;
+	start_batch_done (batch, pids);
 
-					running_processes =
-					    g_slist_prepend
-					    (running_processes, rp);
-					HAL_INFO (("running_processes %p, num = %d", running_processes, g_slist_length (running_processes)));
-				}
-			} else {
-				HAL_ERROR (("Error extracting out_pid from runner's Start()"));
-				dbus_error_free (&error);
-			}
+	dbus_message_unref (m);
+	dbus_pending_call_unref (pending);
+}
+
+/* Send the queued start requests to the runner, HALD_RUNNER_MAX_BATCH
+ * per message; the pids come back in start_batch_notify() */
+static gboolean
+pending_starts_flush (gpointer user_data)
+{
+	pending_starts_source = 0;
+
+	while (pending_starts != NULL && pending_starts->length > 0) {
+		DBusMessage *msg;
+		DBusMessageIter iter;
+		DBusMessageIter array_iter;
+		DBusPendingCall *call;
+		GPtrArray *batch;
+
+		msg = dbus_message_new_method_call ("org.freedesktop.HalRunner",
+						    "/org/freedesktop/HalRunner",
+						    "org.freedesktop.HalRunner",
+						    "StartBatch");
+		if (msg == NULL)
+			DIE (("No memory"));
+		dbus_message_iter_init_append (msg, &iter);
+		if (!dbus_message_iter_open_container (&iter,
+						       DBUS_TYPE_ARRAY,
+						       DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+						       DBUS_TYPE_BOOLEAN_AS_STRING
+						       DBUS_TYPE_STRING_AS_STRING
+						       DBUS_TYPE_ARRAY_AS_STRING
+						       DBUS_TYPE_STRING_AS_STRING
+						       DBUS_TYPE_ARRAY_AS_STRING
+						       DBUS_TYPE_STRING_AS_STRING
+						       DBUS_STRUCT_END_CHAR_AS_STRING,
+						       &array_iter))
+			DIE (("No memory"));
+
+		batch = g_ptr_array_new ();
+		while (pending_starts->length > 0 && batch->len < HALD_RUNNER_MAX_BATCH) {
+			PendingStart *ps;
+			DBusMessageIter struct_iter;
+			dbus_bool_t singleton;
+
+			ps = (PendingStart *) g_queue_pop_head (pending_starts);
+			g_ptr_array_add (batch, ps);
+
+			singleton = ps->singleton;
+			dbus_message_iter_open_container (&array_iter, DBUS_TYPE_STRUCT,
+							  NULL, &struct_iter);
+			dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_BOOLEAN, &singleton);
+			add_udi (&struct_iter, ps->device);
+			add_environment_array (&struct_iter, ps->device, ps->argv[0],
+					       ps->extra_env, &ps->snapshot);
+			add_argv (&struct_iter, ps->argv);
+			dbus_message_iter_close_container (&array_iter, &struct_iter);
 		}
+		dbus_message_iter_close_container (&iter, &array_iter);
 
-		dbus_message_unref (reply);
+		starts_in_flight += batch->len;
+		num_batches++;
+		start_batches = g_slist_prepend (start_batches, batch);
+
+		if (!dbus_connection_send_with_reply (runner_connection,
+						      msg, &call, -1))
+			DIE (("No memory"));
 		dbus_message_unref (msg);
-		return ret;
-	} else {
-		if (dbus_error_is_set (&error)) {
-			HAL_ERROR (("Error running '%s': %s: %s", command_line, error.name, error.message));
-			dbus_error_free (&error);
+
+		/* disconnected from the runner */
+		if (call == NULL) {
+			HAL_ERROR (("Cannot send StartBatch to the runner"));
+			start_batch_done (batch, NULL);
+			continue;
 		}
+
+		dbus_pending_call_set_notify (call, start_batch_notify, batch, NULL);
 	}
 
-error:
-	dbus_message_unref (msg);
 	return FALSE;
 }
 
+/* Drop queued starts for device and forget about those already sent */
+static void
+pending_starts_kill (HalDevice * device)
+{
+	GList *i;
+	GList *next;
+	GSList *j;
+	guint k;
+
+	if (pending_starts != NULL) {
+		for (i = pending_starts->head; i != NULL; i = next) {
+			PendingStart *ps = (PendingStart *) i->data;
+
+			next = g_list_next (i);
+			if (ps->device == device) {
+				g_queue_delete_link (pending_starts, i);
+				pending_start_free (ps);
+			}
+		}
+	}
+
+	for (j = start_batches; j != NULL; j = g_slist_next (j)) {
+		GPtrArray *batch = (GPtrArray *) j->data;
+
+		for (k = 0; k < batch->len; k++) {
+			PendingStart *ps = (PendingStart *) g_ptr_array_index (batch, k);
+
+			if (ps->device == device)
+				ps->cancelled = TRUE;
+		}
+	}
+}
+
+static void
+pending_starts_clear (void)
+{
+	if (pending_starts_source != 0) {
+		g_source_remove (pending_starts_source);
+		pending_starts_source = 0;
+	}
+	if (pending_starts != NULL) {
+		while (pending_starts->length > 0)
+			pending_start_free (g_queue_pop_head (pending_starts));
+	}
+}
+
+/* Queue a helper to be started with the next StartBatch message. Only
+ * an unparsable command line is reported here; if the runner fails to
+ * spawn the helper, cb is called with HALD_RUN_FAILED. */
+static gboolean
+runner_start (HalDevice * device, const gchar * command_line,
+	      char **extra_env, gboolean singleton,
+	      HalRunTerminatedCB cb, gpointer data1, gpointer data2)
+{
+	PendingStart *ps;
+	gint argc;
+	char **argv;
+	GError *err = NULL;
+
+	if (!g_shell_parse_argv (command_line, &argc, &argv, &err)) {
+		HAL_ERROR (("Error parsing commandline '%s': %s",
+			    command_line, err->message));
+		g_error_free (err);
+		return FALSE;
+	}
+
+	ps = g_slice_new0 (PendingStart);
+	ps->device = singleton ? NULL : device;
+	ps->argv = argv;
+	ps->extra_env = g_strdupv (extra_env);
+	ps->singleton = singleton;
+	ps->cb = cb;
+	ps->data1 = data1;
+	ps->data2 = data2;
+	g_get_current_time (&ps->queued);
+
+	if (ps->device != NULL)
+		g_object_ref (ps->device);
+
+	if (pending_starts == NULL)
+		pending_starts = g_queue_new ();
+	g_queue_push_tail (pending_starts, ps);
+
+	/* collect everything started in this main loop iteration */
+	if (pending_starts->length >= HALD_RUNNER_MAX_BATCH) {
+		if (pending_starts_source != 0)
+			g_source_remove (pending_starts_source);
+		pending_starts_flush (NULL);
+	} else if (pending_starts_source == 0)
+		pending_starts_source = g_idle_add_full (G_PRIORITY_DEFAULT,
+							 pending_starts_flush,
+							 NULL, NULL);
+	return TRUE;
+}
+
 gboolean
 hald_runner_start (HalDevice * device, const gchar * command_line,
 		   char **extra_env, HalRunTerminatedCB cb,
@@ -707,7 +1278,9 @@ process_reply (DBusMessage *m, HelperData *hb)
 	dbus_int32_t return_code = 0;
 	GArray *error = NULL;
 	DBusMessageIter iter;
+	gboolean limited;
 
+	limited = hb->limited;
 	error = g_array_new (TRUE, FALSE, sizeof (char *));
 
 	if (dbus_message_get_type (m) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
@@ -763,6 +1336,11 @@ process_reply (DBusMessage *m, HelperData *hb)
 	g_free (hb);
 
       out:
+	if (limited) {
+		num_parallel--;
+		pending_runs_start ();
+	}
+
 	if (method_run_notify)
 		method_run_notify (method_run_notify_userdata);
 }
@@ -775,25 +1353,27 @@ call_notify (DBusPendingCall * pending, void *user_data)
 	DBusMessage *m;
 
 	m = dbus_pending_call_steal_reply (pending);
+	runs_in_flight--;
+	if (hb->snapshot != NULL)
+		property_snapshot_file_unref (hb->snapshot);
 	process_reply (m, hb);
 	dbus_pending_call_unref (pending);
 
 }
 
-/* Run a helper program using the commandline, with input as infomation on
- * stdin */
-void
-hald_runner_run_method (HalDevice * device,
-			const gchar * command_line, char **extra_env,
-			gchar * input, gboolean error_on_stderr,
-			guint32 timeout,
-			HalRunTerminatedCB cb,
-			gpointer data1, gpointer data2)
+static void
+runner_run (HalDevice * device,
+	    const gchar * command_line, char **extra_env,
+	    gchar * input, gboolean error_on_stderr,
+	    guint32 timeout, gboolean limited, gboolean lazy,
+	    HalRunTerminatedCB cb,
+	    gpointer data1, gpointer data2)
 {
 	DBusMessage *msg;
 	DBusMessageIter iter;
 	DBusPendingCall *call;
 	HelperData *hd = NULL;
+	PropertySnapshotFile *snapshot = NULL;
 
 	msg = dbus_message_new_method_call ("org.freedesktop.HalRunner",
 					    "/org/freedesktop/HalRunner",
@@ -804,7 +1384,7 @@ hald_runner_run_method (HalDevice * device,
 	dbus_message_iter_init_append (msg, &iter);
 
 	add_udi (&iter, device);
-	if (!add_environment (&iter, device, command_line, extra_env))
+	if (!add_environment (&iter, device, command_line, extra_env, lazy ? &snapshot : NULL))
 		goto error;
 
 	dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &input);
@@ -828,27 +1408,212 @@ hald_runner_run_method (HalDevice * device,
 	hd->cb = cb;
 	hd->data1 = data1;
 	hd->data2 = data2;
+	hd->limited = limited;
+	hd->snapshot = snapshot;
 
 	if (device != NULL)
 		g_object_ref (device);
 
+	if (limited)
+		num_parallel++;
+	runs_in_flight++;
+
 	dbus_pending_call_set_notify (call, call_notify, hd, NULL);
 	dbus_message_unref (msg);
 	return;
 error:
 	dbus_message_unref (msg);
 	g_free (hd);
+	if (snapshot != NULL)
+		property_snapshot_file_unref (snapshot);
 	cb (device, HALD_RUN_FAILED, 0, NULL, data1, data2);
 }
 
+/* Run a helper program using the commandline, with input as infomation on
+ * stdin */
+void
+hald_runner_run_method (HalDevice * device,
+			const gchar * command_line, char **extra_env,
+			gchar * input, gboolean error_on_stderr,
+			guint32 timeout,
+			HalRunTerminatedCB cb,
+			gpointer data1, gpointer data2)
+{
+	/* method helpers are mostly scripts reading HAL_PROP_* */
+	runner_run (device, command_line, extra_env, input, error_on_stderr,
+		    timeout, FALSE, FALSE, cb, data1, data2);
+}
+
+static void
+pending_run_free (PendingRun *pr)
+{
+	if (pr->device != NULL)
+		g_object_unref (pr->device);
+	g_free (pr->command_line);
+	g_strfreev (pr->extra_env);
+	g_slice_free (PendingRun, pr);
+}
+
+static void
+pending_runs_start (void)
+{
+	while (pending_runs != NULL && pending_runs->length > 0 &&
+	       (max_parallel == 0 || num_parallel < max_parallel)) {
+		PendingRun *pr;
+
+		pr = g_queue_pop_head (pending_runs);
+		runner_run (pr->device, pr->command_line, pr->extra_env, "", FALSE,
+			    pr->timeout, TRUE, TRUE, pr->cb, pr->data1, pr->data2);
+		pending_run_free (pr);
+	}
+}
+
+/* Fail requests for device that did not get to run yet */
+static void
+pending_runs_kill (HalDevice * device)
+{
+	GList *i;
+	GList *next;
+	GSList *killed;
+	GSList *j;
+
+	if (pending_runs == NULL)
+		return;
+
+	killed = NULL;
+	for (i = pending_runs->head; i != NULL; i = next) {
+		PendingRun *pr = (PendingRun *) i->data;
+
+		next = g_list_next (i);
+		if (pr->device == device) {
+			g_queue_delete_link (pending_runs, i);
+			killed = g_slist_prepend (killed, pr);
+		}
+	}
+
+	/* the callbacks may queue new requests */
+	killed = g_slist_reverse (killed);
+	for (j = killed; j != NULL; j = g_slist_next (j)) {
+		PendingRun *pr = (PendingRun *) j->data;
+
+		if (pr->cb != NULL)
+			pr->cb (pr->device, HALD_RUN_KILLED, 0, NULL, pr->data1, pr->data2);
+		pending_run_free (pr);
+	}
+	g_slist_free (killed);
+}
+
 void
 hald_runner_run (HalDevice * device,
 		 const gchar * command_line, char **extra_env,
 		 guint timeout,
 		 HalRunTerminatedCB cb, gpointer data1, gpointer data2)
 {
-	hald_runner_run_method (device, command_line, extra_env,
-				"", FALSE, timeout, cb, data1, data2);
+	PendingRun *pr;
+
+	if (max_parallel == 0 || num_parallel < max_parallel) {
+		runner_run (device, command_line, extra_env, "", FALSE,
+			    timeout, TRUE, TRUE, cb, data1, data2);
+		return;
+	}
+
+	HAL_INFO (("%u helpers running, queueing '%s'", num_parallel, command_line));
+
+	pr = g_slice_new (PendingRun);
+	pr->device = device;
+	pr->command_line = g_strdup (command_line);
+	pr->extra_env = g_strdupv (extra_env);
+	pr->timeout = timeout;
+	pr->cb = cb;
+	pr->data1 = data1;
+	pr->data2 = data2;
+
+	if (device != NULL)
+		g_object_ref (device);
+
+	if (pending_runs == NULL)
+		pending_runs = g_queue_new ();
+	g_queue_push_tail (pending_runs, pr);
+}
+
+/**
+ * hald_runner_get_stats:
+ * @stats: where to store the counters
+ *
+ * Get the number of helpers waiting to be sent to the runner, the number
+ * sent and waiting for a pid or an exit status, totals for addons and
+ * other helpers started with hald_runner_start() and a histogram of the
+ * time from hald_runner_start() to their pid.
+ */
+void
+hald_runner_get_stats (HaldRunnerStats *stats)
+{
+	guint i;
+
+	stats->queued = 0;
+	if (pending_starts != NULL)
+		stats->queued += pending_starts->length;
+	if (pending_runs != NULL)
+		stats->queued += pending_runs->length;
+	stats->in_flight = starts_in_flight + runs_in_flight;
+	stats->started = num_started;
+	stats->failed = num_start_failed;
+	stats->batches = num_batches;
+	for (i = 0; i < HALD_RUNNER_LATENCY_BUCKETS; i++)
+		stats->latency[i] = start_latency[i];
+}
+
+void
+hald_runner_log_stats (void)
+{
+	HaldRunnerStats stats;
+	GString *hist;
+	guint i;
+
+	hald_runner_get_stats (&stats);
+
+	hist = g_string_new ("");
+	for (i = 0; i < HALD_RUNNER_LATENCY_BUCKETS; i++) {
+		if (i < HALD_RUNNER_LATENCY_BUCKETS - 1)
+			g_string_append_printf (hist, " <%ums:%u", 1 << i, stats.latency[i]);
+		else
+			g_string_append_printf (hist, " more:%u", stats.latency[i]);
+	}
+
+	HAL_INFO (("Runner: %u queued, %u in flight, %u started in %u batches, %u failed",
+		   stats.queued, stats.in_flight, stats.started, stats.batches, stats.failed));
+	HAL_INFO (("Runner start latency:%s", hist->str));
+	g_string_free (hist, TRUE);
+}
+
+/**
+ * hald_runner_set_lazy_environment:
+ * @lazy: whether to pass device properties in a snapshot file
+ *
+ * In lazy environment mode probers, callouts and addons get the
+ * HAL_PROP_* variables in a file named by HALD_PROPERTIES_SNAPSHOT
+ * instead of their environment; see hal_helper_getenv(). The snapshot
+ * of a device is shared by all helpers started while its properties do
+ * not change. Helpers listed in info.helpers.full_environment, and all
+ * D-Bus method helpers, still get the full environment.
+ */
+void
+hald_runner_set_lazy_environment (gboolean lazy)
+{
+	lazy_environment = lazy;
+}
+
+void
+hald_runner_set_max_parallel (guint max)
+{
+	max_parallel = max;
+	pending_runs_start ();
+}
+
+void
+hald_runner_set_probe_workers (guint max)
+{
+	probe_workers = max;
 }
 
 void
@@ -874,7 +1639,7 @@ hald_runner_run_sync (HalDevice * device,
 	dbus_message_iter_init_append (msg, &iter);
 
 	add_udi (&iter, device);
-	if (!add_environment (&iter, device, command_line, extra_env))
+	if (!add_environment (&iter, device, command_line, extra_env, NULL))
 		goto error;
 
 	dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &input);
@@ -921,6 +1686,8 @@ hald_runner_kill_device (HalDevice * device)
 	const char *udi;
 
 	running_processes_remove_device (device);
+	pending_starts_kill (device);
+	pending_runs_kill (device);
 
 	msg = dbus_message_new_method_call ("org.freedesktop.HalRunner",
 					    "/org/freedesktop/HalRunner",
@@ -951,6 +1718,13 @@ hald_runner_kill_all (void)
 	DBusMessage *msg, *reply;
 	DBusError err;
 
+	/* we are about to exit; just forget about helpers not started yet */
+	pending_starts_clear ();
+	if (pending_runs != NULL) {
+		while (pending_runs->length > 0)
+			pending_run_free (g_queue_pop_head (pending_runs));
+	}
+
 	msg = dbus_message_new_method_call ("org.freedesktop.HalRunner",
 					    "/org/freedesktop/HalRunner",
 					    "org.freedesktop.HalRunner",
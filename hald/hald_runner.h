@@ -54,9 +54,10 @@ hald_runner_start_runner(void);
 void
 hald_runner_stop_runner(void);
 
-/* Start a helper, returns true on a successfull start. 
- * cb will be called on abnormal or premature termination
- * only 
+/* Start a helper, returns true if the start was queued. The helper is
+ * started asynchronously, together with others requested in the same
+ * main loop iteration; cb will be called on abnormal or premature
+ * termination only, including failure to start it.
  */
 gboolean
 hald_runner_start (HalDevice *device, const gchar *command_line, char **extra_env, 
@@ -91,6 +92,35 @@ hald_runner_run_method(HalDevice *device,
                        HalRunTerminatedCB  cb,
                        gpointer data1, gpointer data2);
 
+/* Pass device properties to probers, callouts and addons in a shared
+ * snapshot file instead of the environment */
+void hald_runner_set_lazy_environment (gboolean lazy);
+
+/* Limit the number of helpers started with hald_runner_run() that run at
+ * the same time; further requests are queued. 0 means no limit. */
+void hald_runner_set_max_parallel (guint max);
+
+/* Let hald-runner keep up to max processes of each prober that supports
+ * it running, and send them one probe after another; must be called
+ * before hald_runner_start_runner(). 0 means a process per probe. */
+void hald_runner_set_probe_workers (guint max);
+
+/* Number of buckets in the start latency histogram; bucket 0 counts
+ * starts below 1ms, bucket n those below 2^n ms, the last one the rest */
+#define HALD_RUNNER_LATENCY_BUCKETS 8
+
+typedef struct {
+	guint queued;		/* waiting to be sent to the runner */
+	guint in_flight;	/* sent, waiting for a pid or exit status */
+	guint started;		/* helpers started with hald_runner_start() */
+	guint failed;		/* ... and those the runner could not start */
+	guint batches;		/* StartBatch messages sent */
+	guint latency[HALD_RUNNER_LATENCY_BUCKETS];
+} HaldRunnerStats;
+
+void hald_runner_get_stats (HaldRunnerStats *stats);
+void hald_runner_log_stats (void);
+
 void hald_runner_kill_device(HalDevice *device);
 void hald_runner_kill_all(void);
 
@@ -44,245 +44,232 @@
 
 #include "ids.h"
 
-#ifdef USE_PCI_IDS
-/** Pointer to where the pci.ids file is loaded */
-static char *pci_ids = NULL;
-
-/** Length of data store at at pci_ids */
-static size_t pci_ids_len;
-
-/** Iterator position into pci_ids */
-static size_t pci_ids_iter_pos;
+#if defined(USE_PCI_IDS) || defined(USE_USB_IDS)
+
+/* pci.ids and usb.ids share the same format: a vendor line, followed by
+ * product lines indented with one tab, followed (pci.ids only) by
+ * subsystem lines indented with two tabs. When a file is loaded its
+ * lines are indexed once into tables sorted by id, so a lookup is a
+ * binary search instead of a scan of the whole file. */
+
+/** An indexed line; the name points into the mapped file */
+typedef struct {
+	guint64 id;
+	guint32 name_offset;
+	guint32 name_len;
+} IdsEntry;
+
+/** Lines of one level, sorted by id */
+typedef struct {
+	IdsEntry *entries;
+	guint num_entries;
+} IdsTable;
+
+enum {
+	IDS_LEVEL_VENDOR,
+	IDS_LEVEL_PRODUCT,
+	IDS_LEVEL_SUBSYS,
+	IDS_NUM_LEVELS
+};
 
-/** Initialize the pci.ids line iterator to the beginning of the file */
-static void
-pci_ids_line_iter_init (void)
-{
-	pci_ids_iter_pos = 0;
-}
+/** A loaded ids file */
+typedef struct {
+	char *data;
+	size_t len;
+	IdsTable tables[IDS_NUM_LEVELS];
+} IdsFile;
 
-/** Maximum length of lines in pci.ids */
-#define PCI_IDS_MAX_LINE_LEN 512
+/** Names handed out by lookups; they are kept for the lifetime of hald */
+static GStringChunk *ids_names = NULL;
 
-/**  
- *  pci_ids_line_iter_get_line:
- *  @line_len:           Pointer to where number of bytes in line will
- *                       be stored
- *  Returns:             Pointer to the line; only valid until the
- *                       next invocation of this function
- *
- *  Get the next line from pci.ids
- */
-static char *
-pci_ids_line_iter_get_line (unsigned int *line_len)
+/* parse exactly four lowercase hex digits, the format used by the ids files */
+static gboolean
+ids_parse_id (const char *s, guint64 *id)
 {
 	unsigned int i;
-	static char line[PCI_IDS_MAX_LINE_LEN];
 
-	for (i = 0;
-	     pci_ids_iter_pos < pci_ids_len &&
-	     i < PCI_IDS_MAX_LINE_LEN - 1 &&
-	     pci_ids[pci_ids_iter_pos] != '\n'; i++, pci_ids_iter_pos++) {
-		line[i] = pci_ids[pci_ids_iter_pos];
+	*id = 0;
+	for (i = 0; i < 4; i++) {
+		if (s[i] >= '0' && s[i] <= '9')
+			*id = (*id << 4) | (s[i] - '0');
+		else if (s[i] >= 'a' && s[i] <= 'f')
+			*id = (*id << 4) | (s[i] - 'a' + 10);
+		else
+			return FALSE;
 	}
 
-	line[i] = '\0';
-	if (line_len != NULL)
-		*line_len = i;
+	return TRUE;
+}
 
-	pci_ids_iter_pos++;
+static void
+ids_table_add (GArray *array, guint64 id, const char *data, const char *line,
+	       unsigned int line_len, unsigned int name_start)
+{
+	IdsEntry entry;
+
+	while (name_start < line_len && isspace (line[name_start]))
+		name_start++;
 
-	return line;
+	entry.id = id;
+	entry.name_offset = (line - data) + name_start;
+	entry.name_len = line_len > name_start ? line_len - name_start : 0;
+	g_array_append_val (array, entry);
 }
 
-/** 
- *  pci_ids_line_iter_has_more:
- *
- *  Returns:              #TRUE iff there are more lines to process
- *
- *  See if there are more lines to process in pci.ids 
- */
-static dbus_bool_t
-pci_ids_line_iter_has_more (void)
+static int
+ids_entry_compare (const void *a, const void *b)
 {
-	return pci_ids_iter_pos < pci_ids_len;
-}
+	const IdsEntry *entry_a = a;
+	const IdsEntry *entry_b = b;
 
+	if (entry_a->id != entry_b->id)
+		return entry_a->id < entry_b->id ? -1 : 1;
+
+	/* keep the file order for duplicates; the first one wins */
+	return (entry_a->name_offset > entry_b->name_offset) - (entry_a->name_offset < entry_b->name_offset);
+}
 
 /** 
- *  ids_find_pci:
- *  @vendor_id:           PCI vendor id or 0 if unknown
- *  @product_id:          PCI product id or 0 if unknown
- *  @subsys_vendor_id:    PCI subsystem vendor id or 0 if unknown
- *  @subsys_product_id:   PCI subsystem product id or 0 if unknown
- *  @vendor_name:         Set to pointer of result or NULL
- *  @product_name:        Set to pointer of result or NULL
- *  @subsys_vendor_name:  Set to pointer of result or NULL
- *  @subsys_product_name: Set to pointer of result or NULL
+ *  ids_file_index:
+ *  @file:               A loaded ids file
+ *  @num_levels:         2 for usb.ids, 3 for pci.ids with subsystems
  *
- *  Find the names for a PCI device.
- *
- *  The pointers returned are only valid until the next invocation of this
- *  function.
+ *  Build the sorted tables of vendors, products and subsystems.
  */
-void
-ids_find_pci (int vendor_id, int product_id,
-	      int subsys_vendor_id, int subsys_product_id,
-	      char **vendor_name, char **product_name,
-	      char **subsys_vendor_name, char **subsys_product_name)
+static void
+ids_file_index (IdsFile *file, unsigned int num_levels)
 {
-	char *line;
-	unsigned int i;
-	unsigned int line_len;
-	unsigned int num_tabs;
-	char rep_vi[8];
-	char rep_pi[8];
-	char rep_svi[8];
-	char rep_spi[8];
-	dbus_bool_t vendor_matched = FALSE;
-	dbus_bool_t product_matched = FALSE;
-	static char store_vn[PCI_IDS_MAX_LINE_LEN];
-	static char store_pn[PCI_IDS_MAX_LINE_LEN];
-	static char store_svn[PCI_IDS_MAX_LINE_LEN];
-	static char store_spn[PCI_IDS_MAX_LINE_LEN];
-
-	snprintf (rep_vi, 8, "%04x", vendor_id);
-	snprintf (rep_pi, 8, "%04x", product_id);
-	snprintf (rep_svi, 8, "%04x", subsys_vendor_id);
-	snprintf (rep_spi, 8, "%04x", subsys_product_id);
-
-	*vendor_name = NULL;
-	*product_name = NULL;
-	*subsys_vendor_name = NULL;
-	*subsys_product_name = NULL;
-
-	for (pci_ids_line_iter_init (); pci_ids_line_iter_has_more ();) {
-		line = pci_ids_line_iter_get_line (&line_len);
-
-		/* skip lines with no content */
-		if (line_len < 4)
-			continue;
-
-		/* skip comments */
-		if (line[0] == '#')
+	GArray *arrays[IDS_NUM_LEVELS];
+	gboolean vendor_valid = FALSE;
+	gboolean product_valid = FALSE;
+	guint64 vendor = 0;
+	guint64 product = 0;
+	size_t pos;
+	unsigned int n;
+
+	for (n = 0; n < num_levels; n++)
+		arrays[n] = g_array_new (FALSE, FALSE, sizeof (IdsEntry));
+
+	for (pos = 0; pos < file->len;) {
+		const char *line = file->data + pos;
+		const char *end;
+		unsigned int line_len;
+		unsigned int num_tabs;
+		guint64 id;
+		guint64 subsys;
+
+		end = memchr (line, '\n', file->len - pos);
+		line_len = end != NULL ? (unsigned int) (end - line) : (unsigned int) (file->len - pos);
+		pos += line_len + 1;
+
+		/* skip lines with no content and comments */
+		if (line_len < 4 || line[0] == '#')
 			continue;
 
-		/* count number of tabs */
-		num_tabs = 0;
-		for (i = 0; i < line_len; i++) {
-			if (line[i] != '\t')
-				break;
-			num_tabs++;
-		}
+		for (num_tabs = 0; num_tabs < line_len && line[num_tabs] == '\t'; num_tabs++)
+			;
 
 		switch (num_tabs) {
 		case 0:
-			/* vendor names */
-			vendor_matched = FALSE;
-
-			/* first check subsys_vendor_id, if haven't done 
-			 * already */
-			if (*subsys_vendor_name == NULL
-			    && subsys_vendor_id != 0) {
-				if ((*((dbus_uint32_t *) line)) ==
-				    (*((dbus_uint32_t *) rep_svi))) {
-					/* found it */
-					for (i = 4; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_svn, line + i,
-						 PCI_IDS_MAX_LINE_LEN);
-					*subsys_vendor_name = store_svn;
-				}
-			}
-
-			/* check vendor_id */
-			if (vendor_id != 0) {
-				if (memcmp (line, rep_vi, 4) == 0) {
-					/* found it */
-					vendor_matched = TRUE;
-
-					for (i = 4; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_vn, line + i,
-						 PCI_IDS_MAX_LINE_LEN);
-					*vendor_name = store_vn;
-				}
-			}
-
+			/* vendor names; anything else ends the vendor, e.g. the device classes */
+			product_valid = FALSE;
+			vendor_valid = ids_parse_id (line, &vendor);
+			if (vendor_valid)
+				ids_table_add (arrays[IDS_LEVEL_VENDOR], vendor, file->data, line, line_len, 4);
 			break;
 
 		case 1:
-			product_matched = FALSE;
-
 			/* product names */
-			if (!vendor_matched)
-				continue;
-
-			/* check product_id */
-			if (product_id != 0) {
-				if (memcmp (line + 1, rep_pi, 4) == 0) {
-					/* found it */
-
-					product_matched = TRUE;
-
-					for (i = 5; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_pn, line + i,
-						 PCI_IDS_MAX_LINE_LEN);
-					*product_name = store_pn;
-				}
-			}
+			product_valid = vendor_valid && line_len >= 5 && ids_parse_id (line + 1, &product);
+			if (product_valid)
+				ids_table_add (arrays[IDS_LEVEL_PRODUCT], (vendor << 16) | product,
+					       file->data, line, line_len, 5);
 			break;
 
 		case 2:
 			/* subsystem_vendor subsystem_product */
-			if (!vendor_matched || !product_matched)
-				continue;
-
-			/* check product_id */
-			if (subsys_vendor_id != 0
-			    && subsys_product_id != 0) {
-				if (memcmp (line + 2, rep_svi, 4) == 0
-				    && memcmp (line + 7, rep_spi,
-					       4) == 0) {
-					/* found it */
-					for (i = 11; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_spn, line + i,
-						 PCI_IDS_MAX_LINE_LEN);
-					*subsys_product_name = store_spn;
-				}
-			}
-
+			if (num_levels <= IDS_LEVEL_SUBSYS || !product_valid || line_len < 11)
+				break;
+			if (ids_parse_id (line + 2, &id) && ids_parse_id (line + 7, &subsys))
+				ids_table_add (arrays[IDS_LEVEL_SUBSYS],
+					       (vendor << 48) | (product << 32) | (id << 16) | subsys,
+					       file->data, line, line_len, 11);
 			break;
 
 		default:
 			break;
 		}
+	}
+
+	for (n = 0; n < num_levels; n++) {
+		IdsTable *table = &file->tables[n];
 
+		table->num_entries = arrays[n]->len;
+		table->entries = (IdsEntry *) g_array_free (arrays[n], FALSE);
+		qsort (table->entries, table->num_entries, sizeof (IdsEntry), ids_entry_compare);
 	}
+
+	HAL_INFO (("indexed %u vendors, %u products and %u subsystems",
+		   file->tables[IDS_LEVEL_VENDOR].num_entries,
+		   file->tables[IDS_LEVEL_PRODUCT].num_entries,
+		   file->tables[IDS_LEVEL_SUBSYS].num_entries));
 }
 
+/** 
+ *  ids_file_lookup:
+ *  @file:               A loaded ids file
+ *  @level:              Which table to search
+ *  @id:                 The id to look for
+ *
+ *  Returns:             The name for @id or NULL if not found; owned by
+ *                       the ids module and valid for the lifetime of hald
+ */
+static char *
+ids_file_lookup (IdsFile *file, unsigned int level, guint64 id)
+{
+	IdsTable *table = &file->tables[level];
+	IdsEntry *entry;
+	guint lo;
+	guint hi;
+	char *name;
+	char *interned;
+
+	lo = 0;
+	hi = table->num_entries;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (table->entries[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == table->num_entries || table->entries[lo].id != id)
+		return NULL;
+
+	entry = &table->entries[lo];
+
+	if (ids_names == NULL)
+		ids_names = g_string_chunk_new (4096);
+
+	name = g_strndup (file->data + entry->name_offset, entry->name_len);
+	interned = g_string_chunk_insert_const (ids_names, name);
+	g_free (name);
+
+	return interned;
+}
 
 /**  
- *  pci_ids_load:
- *  @path:               Path of the pci.ids file, e.g. /usr/share/hwdata/pci.ids
+ *  ids_file_load:
+ *  @file:               Where to store the mapped file
+ *  @path:               Path of the file, e.g. /usr/share/hwdata/pci.ids
+ *  @num_levels:         Number of levels to index, see ids_file_index()
  *  
  *  Returns:             #TRUE if the file was succesfully loaded
- *
- *  Load the PCI database used for mapping vendor, product, subsys_vendor
- *  and subsys_product numbers into names.
  */
 static dbus_bool_t
-pci_ids_load (const char *path)
+ids_file_load (IdsFile *file, const char *path, unsigned int num_levels)
 {
 	int fd;
 	struct stat statbuf;
@@ -291,24 +278,26 @@ pci_ids_load (const char *path)
 	ret = FALSE;
 
 	if (stat (path, &statbuf) != 0) {
-		HAL_WARNING (("Couldn't stat pci.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
+		HAL_WARNING (("Couldn't stat ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
 		goto out;
 	}
-	pci_ids_len = statbuf.st_size;
+	file->len = statbuf.st_size;
 
 	fd = open (path, O_RDONLY);
 	if (fd < 0) {
-		HAL_WARNING (("Couldn't open pci.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
+		HAL_WARNING (("Couldn't open ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
 		goto out;
 	}
 
-	pci_ids = mmap (NULL, pci_ids_len, PROT_READ, MAP_SHARED, fd, 0);
-	if (pci_ids == MAP_FAILED) {
-		HAL_WARNING (("Couldn't mmap pci.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
+	file->data = mmap (NULL, file->len, PROT_READ, MAP_SHARED, fd, 0);
+	if (file->data == MAP_FAILED) {
+		HAL_WARNING (("Couldn't mmap ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
+		file->data = NULL;
 		close (fd);
 		goto out;
 	}
 
+	ids_file_index (file, num_levels);
 	ret = TRUE;
 
 	close (fd);
@@ -316,81 +305,99 @@ out:
 	return ret;
 }
 
-void
-pci_ids_init (void)
-{
-	/* Load /usr/share/hwdata/pci.ids */
-	pci_ids_load (PCI_IDS_DIR "/pci.ids");
-}
+/* ids are 16 bit; anything else can't be in the files */
+#define IDS_VALID(id) ((id) > 0 && (id) <= 0xffff)
 
-#endif /*USE_PCI_IDS*/
+#endif /*USE_PCI_IDS || USE_USB_IDS*/
 
 /*==========================================================================*/
 
-#ifdef USE_USB_IDS
-/** Pointer to where the usb.ids file is loaded */
-static char *usb_ids = NULL;
-
-/** Length of data store at at usb_ids */
-static size_t usb_ids_len;
-
-/** Iterator position into usb_ids */
-static size_t usb_ids_iter_pos;
-
-/** Initialize the usb.ids line iterator to the beginning of the file */
-static void
-usb_ids_line_iter_init (void)
-{
-	usb_ids_iter_pos = 0;
-}
-
-/** Maximum length of lines in usb.ids */
-#define USB_IDS_MAX_LINE_LEN 512
+#ifdef USE_PCI_IDS
+/** The indexed pci.ids file */
+static IdsFile pci_ids;
 
 /** 
- *  usb_ids_line_iter_get_line:
- *  @line_len:            Pointer to where number of bytes in line will
- *                        be stored
- *  Returns:              Pointer to the line; only valid until the
- *                        next invocation of this function
+ *  ids_find_pci:
+ *  @vendor_id:           PCI vendor id or 0 if unknown
+ *  @product_id:          PCI product id or 0 if unknown
+ *  @subsys_vendor_id:    PCI subsystem vendor id or 0 if unknown
+ *  @subsys_product_id:   PCI subsystem product id or 0 if unknown
+ *  @vendor_name:         Set to pointer of result or NULL
+ *  @product_name:        Set to pointer of result or NULL
+ *  @subsys_vendor_name:  Set to pointer of result or NULL
+ *  @subsys_product_name: Set to pointer of result or NULL
  *
- *  Get the next line from usb.ids 
+ *  Find the names for a PCI device.
+ *
+ *  The strings returned are owned by the ids module and stay valid for
+ *  the lifetime of hald; they must not be modified or freed.
  */
-static char *
-usb_ids_line_iter_get_line (unsigned int *line_len)
+void
+ids_find_pci (int vendor_id, int product_id,
+	      int subsys_vendor_id, int subsys_product_id,
+	      char **vendor_name, char **product_name,
+	      char **subsys_vendor_name, char **subsys_product_name)
 {
-	unsigned int i;
-	static char line[USB_IDS_MAX_LINE_LEN];
+	*vendor_name = NULL;
+	*product_name = NULL;
+	*subsys_vendor_name = NULL;
+	*subsys_product_name = NULL;
 
-	for (i = 0;
-	     usb_ids_iter_pos < usb_ids_len &&
-	     i < USB_IDS_MAX_LINE_LEN - 1 &&
-	     usb_ids[usb_ids_iter_pos] != '\n'; i++, usb_ids_iter_pos++) {
-		line[i] = usb_ids[usb_ids_iter_pos];
-	}
+	if (pci_ids.data == NULL)
+		return;
 
-	line[i] = '\0';
-	if (line_len != NULL)
-		*line_len = i;
+	if (IDS_VALID (subsys_vendor_id))
+		*subsys_vendor_name = ids_file_lookup (&pci_ids, IDS_LEVEL_VENDOR, subsys_vendor_id);
 
-	usb_ids_iter_pos++;
+	if (!IDS_VALID (vendor_id))
+		return;
 
-	return line;
+	*vendor_name = ids_file_lookup (&pci_ids, IDS_LEVEL_VENDOR, vendor_id);
+	if (*vendor_name == NULL || !IDS_VALID (product_id))
+		return;
+
+	*product_name = ids_file_lookup (&pci_ids, IDS_LEVEL_PRODUCT,
+					 ((guint64) vendor_id << 16) | product_id);
+	if (*product_name == NULL || !IDS_VALID (subsys_vendor_id) || !IDS_VALID (subsys_product_id))
+		return;
+
+	*subsys_product_name = ids_file_lookup (&pci_ids, IDS_LEVEL_SUBSYS,
+						((guint64) vendor_id << 48) |
+						((guint64) product_id << 32) |
+						((guint64) subsys_vendor_id << 16) |
+						subsys_product_id);
 }
 
 /**  
- *  usb_ids_line_iter_has_more:
+ *  pci_ids_load:
+ *  @path:               Path of the pci.ids file, e.g. /usr/share/hwdata/pci.ids
  *  
- *  Returns:              #TRUE iff there are more lines to process
+ *  Returns:             #TRUE if the file was succesfully loaded
  *
- *  See if there are more lines to process in usb.ids
+ *  Load and index the PCI database used by ids_find_pci(). Only call
+ *  this once.
  */
-static dbus_bool_t
-usb_ids_line_iter_has_more (void)
+gboolean
+pci_ids_load (const char *path)
 {
-	return usb_ids_iter_pos < usb_ids_len;
+	return ids_file_load (&pci_ids, path, 3);
 }
 
+void
+pci_ids_init (void)
+{
+	/* Load /usr/share/hwdata/pci.ids */
+	pci_ids_load (PCI_IDS_DIR "/pci.ids");
+}
+
+#endif /*USE_PCI_IDS*/
+
+/*==========================================================================*/
+
+#ifdef USE_USB_IDS
+/** The indexed usb.ids file */
+static IdsFile usb_ids;
+
 /** 
  *  ids_find_usb:
  *  @vendor_id:          USB vendor id or 0 if unknown
@@ -400,141 +407,40 @@ usb_ids_line_iter_has_more (void)
  *
  *  Find the names for a USB device.
  *
- *  The pointers returned are only valid until the next invocation of this
- *  function.
+ *  The strings returned are owned by the ids module and stay valid for
+ *  the lifetime of hald; they must not be modified or freed.
  */
 void
 ids_find_usb (int vendor_id, int product_id,
 	      char **vendor_name, char **product_name)
 {
-	char *line;
-	unsigned int i;
-	unsigned int line_len;
-	unsigned int num_tabs;
-	char rep_vi[8];
-	char rep_pi[8];
-	static char store_vn[USB_IDS_MAX_LINE_LEN];
-	static char store_pn[USB_IDS_MAX_LINE_LEN];
-	dbus_bool_t vendor_matched = FALSE;
-
-	snprintf (rep_vi, 8, "%04x", vendor_id);
-	snprintf (rep_pi, 8, "%04x", product_id);
-
 	*vendor_name = NULL;
 	*product_name = NULL;
 
-	for (usb_ids_line_iter_init (); usb_ids_line_iter_has_more ();) {
-		line = usb_ids_line_iter_get_line (&line_len);
+	if (usb_ids.data == NULL || !IDS_VALID (vendor_id))
+		return;
 
-		/* skip lines with no content */
-		if (line_len < 4)
-			continue;
-
-		/* skip comments */
-		if (line[0] == '#')
-			continue;
-
-		/* count number of tabs */
-		num_tabs = 0;
-		for (i = 0; i < line_len; i++) {
-			if (line[i] != '\t')
-				break;
-			num_tabs++;
-		}
+	*vendor_name = ids_file_lookup (&usb_ids, IDS_LEVEL_VENDOR, vendor_id);
+	if (*vendor_name == NULL || !IDS_VALID (product_id))
+		return;
 
-		switch (num_tabs) {
-		case 0:
-			/* vendor names */
-			vendor_matched = FALSE;
-
-			/* check vendor_id */
-			if (vendor_id != 0) {
-				if (memcmp (line, rep_vi, 4) == 0) {
-					/* found it */
-					vendor_matched = TRUE;
-
-					for (i = 4; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_vn, line + i,
-						 USB_IDS_MAX_LINE_LEN);
-					*vendor_name = store_vn;
-				}
-			}
-			break;
-
-		case 1:
-			/* product names */
-			if (!vendor_matched)
-				continue;
-
-			/* check product_id */
-			if (product_id != 0) {
-				if (memcmp (line + 1, rep_pi, 4) == 0) {
-					/* found it */
-					for (i = 5; i < line_len; i++) {
-						if (!isspace (line[i]))
-							break;
-					}
-					strncpy (store_pn, line + i,
-						 USB_IDS_MAX_LINE_LEN);
-					*product_name = store_pn;
-
-					/* no need to continue the search */
-					return;
-				}
-			}
-			break;
-
-		default:
-			break;
-		}
-
-	}
+	*product_name = ids_file_lookup (&usb_ids, IDS_LEVEL_PRODUCT,
+					 ((guint64) vendor_id << 16) | product_id);
 }
 
 /**  
  *  usb_ids_load:
  *  @path:               Path of the usb.ids file, e.g. /usr/share/hwdata/usb.ids
+ *  
  *  Returns:             #TRUE if the file was succesfully loaded
  *
- *  Load the USB database used for mapping vendor, product, subsys_vendor
- *  and subsys_product numbers into names.
+ *  Load and index the USB database used by ids_find_usb(). Only call
+ *  this once.
  */
-static dbus_bool_t
+gboolean
 usb_ids_load (const char *path)
 {
-	int fd;
-	struct stat statbuf;
-	gboolean ret;
-
-	ret = FALSE;
-
-	if (stat (path, &statbuf) != 0) {
-		HAL_WARNING (("Couldn't stat usb.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
-		goto out;
-	}
-	usb_ids_len = statbuf.st_size;
-
-	fd = open (path, O_RDONLY);
-	if (fd < 0) {
-		HAL_WARNING (("Couldn't open usb.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
-		goto out;
-	}
-
-	usb_ids = mmap (NULL, usb_ids_len, PROT_READ, MAP_SHARED, fd, 0);
-	if (usb_ids == MAP_FAILED) {
-		HAL_WARNING (("Couldn't mmap usb.ids file '%s', errno=%d: %s", path, errno, strerror (errno)));
-		close (fd);
-		goto out;
-	}
-
-	ret = TRUE;
-
-	close (fd);
-out:
-	return ret;
+	return ids_file_load (&usb_ids, path, 2);
 }
 
 void
@@ -32,6 +32,8 @@
 
 void pci_ids_init (void);
 
+gboolean pci_ids_load (const char *path);
+
 void
 ids_find_pci (int vendor_id, int product_id,
 	      int subsys_vendor_id, int subsys_product_id,
@@ -40,6 +42,7 @@ ids_find_pci (int vendor_id, int product_id,
 
 #else /*USE_PCI_IDS*/
 static inline void pci_ids_init (void) {return;};
+static inline gboolean pci_ids_load (const char *path) {return FALSE;}
 
 static inline void
 ids_find_pci (int vendor_id, int product_id,
@@ -71,12 +74,15 @@ ids_find_pnp (const char *pnp_id, char **pnp_description) {
 
 void usb_ids_init (void);
 
+gboolean usb_ids_load (const char *path);
+
 void
 ids_find_usb (int vendor_id, int product_id,
 	      char **vendor_name, char **product_name);
 
 #else /*USE_USB_IDS*/
 static inline void usb_ids_init (void) {return;}
+static inline gboolean usb_ids_load (const char *path) {return FALSE;}
 static inline void
 ids_find_usb (int vendor_id, int product_id,
 	      char **vendor_name, char **product_name) {
@@ -731,10 +731,10 @@ acpi_synthesize_item (const gchar *fullpath, int acpi_type)
 {
 	HotplugEvent *hotplug_event;
 	HAL_INFO (("Processing %s", fullpath));
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_ACPI;
-	g_strlcpy (hotplug_event->acpi.acpi_path, fullpath, sizeof (hotplug_event->acpi.acpi_path));
+	hotplug_event->acpi.acpi_path = hotplug_event_strdup (hotplug_event, fullpath);
 	hotplug_event->acpi.acpi_type = acpi_type;
 	hotplug_event_enqueue (hotplug_event);
 }
@@ -859,10 +859,10 @@ acpi_synthesize_sonypi_display (void)
 	if (!found)
 		return;
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_ACPI;
-	g_strlcpy (hotplug_event->acpi.acpi_path, path, sizeof (hotplug_event->acpi.acpi_path));
+	hotplug_event->acpi.acpi_path = hotplug_event_strdup (hotplug_event, path);
 	hotplug_event->acpi.acpi_type = ACPI_TYPE_SONYPI_DISPLAY;
 	hotplug_event_enqueue (hotplug_event);
 
@@ -1275,10 +1275,10 @@ acpi_generate_add_hotplug_event (HalDevice *d)
 	acpi_path = hal_device_property_get_string (d, "linux.acpi_path");
 	acpi_type = hal_device_property_get_int (d, "linux.acpi_type");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_ACPI;
-	g_strlcpy (hotplug_event->acpi.acpi_path, acpi_path, sizeof (hotplug_event->acpi.acpi_path));
+	hotplug_event->acpi.acpi_path = hotplug_event_strdup (hotplug_event, acpi_path);
 	hotplug_event->acpi.acpi_type = acpi_type;
 	return hotplug_event;
 }
@@ -1293,10 +1293,10 @@ acpi_generate_remove_hotplug_event (HalDevice *d)
 	acpi_path = hal_device_property_get_string (d, "linux.acpi_path");
 	acpi_type = hal_device_property_get_int (d, "linux.acpi_type");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_REMOVE;
 	hotplug_event->type = HOTPLUG_EVENT_ACPI;
-	g_strlcpy (hotplug_event->acpi.acpi_path, acpi_path, sizeof (hotplug_event->acpi.acpi_path));
+	hotplug_event->acpi.acpi_path = hotplug_event_strdup (hotplug_event, acpi_path);
 	hotplug_event->acpi.acpi_type = acpi_type;
 	return hotplug_event;
 }
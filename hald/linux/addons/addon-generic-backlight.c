@@ -41,6 +41,7 @@
 
 #include "libhal/libhal.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 #include "../../util_helper.h"
 #include "../../util_helper_priv.h"
 
@@ -219,7 +220,7 @@ main (int argc, char *argv[])
 
 	setup_logger ();
 	udi = getenv ("UDI");
-	path = getenv ("HAL_PROP_LINUX_SYSFS_PATH");
+	path = hal_helper_getenv ("HAL_PROP_LINUX_SYSFS_PATH");
 
 	HAL_DEBUG (("udi='%s', path='%s'", udi, path));
 	if (udi == NULL) {
@@ -231,7 +232,7 @@ main (int argc, char *argv[])
 		return -2;
 	}
 	
-	level_str = getenv ("HAL_PROP_LAPTOP_PANEL_NUM_LEVELS");
+	level_str = hal_helper_getenv ("HAL_PROP_LAPTOP_PANEL_NUM_LEVELS");
 	if (level_str != NULL) {
 		levels = atoi (level_str);
 	} else {
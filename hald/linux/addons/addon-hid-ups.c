@@ -53,6 +53,7 @@
 #include "../../util_helper.h"
 #include "../../util_pm.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 
 #define UPS_USAGE		0x840000
 #define UPS_SERIAL		0x8400fe
@@ -316,7 +317,7 @@ main (int argc, char *argv[])
 	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
 		goto out;
 
-	device_file = getenv ("HAL_PROP_HIDDEV_DEVICE");
+	device_file = hal_helper_getenv ("HAL_PROP_HIDDEV_DEVICE");
 	if (device_file == NULL)
 		goto out;
 
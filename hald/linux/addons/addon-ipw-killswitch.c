@@ -43,6 +43,7 @@
 
 #include "libhal/libhal.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 #include "../../util_helper.h"
 #include "../../util_helper_priv.h"
 
@@ -255,7 +256,7 @@ main (int argc, char *argv[])
 
 	setup_logger ();
 	udi = getenv ("UDI");
-	method = getenv ("HAL_PROP_KILLSWITCH_ACCESS_METHOD");
+	method = hal_helper_getenv ("HAL_PROP_KILLSWITCH_ACCESS_METHOD");
 
 	HAL_DEBUG (("udi='%s'", udi));
 	if (udi == NULL) {
@@ -38,6 +38,7 @@
 #include "libhal/libhal.h"
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 #include "../../util_helper.h"
 
 int
@@ -72,7 +73,7 @@ main (int argc, char *argv[])
 
 
 	/* initial state */
-	if ((strstate = getenv ("HAL_PROP_BUTTON_STATE_VALUE")) == NULL) {
+	if ((strstate = hal_helper_getenv ("HAL_PROP_BUTTON_STATE_VALUE")) == NULL) {
 		HAL_ERROR (("Cannot get HAL_PROP_BUTTON_STATE_VALUE"));
 		goto out;
 	}
@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <glib.h>
 #include <glib/gmain.h>
 #include <dbus/dbus-glib.h>
 #include <dbus/dbus-glib-lowlevel.h>
@@ -48,34 +49,178 @@
 #include "../../logger.h"
 #include "../../util_helper.h"
 
+/* This addon is a singleton; one process polls all drives with removable
+ * media. All drives are polled from a single timer that fires on multiples
+ * of the polling interval since the epoch, so wakeups coincide with those
+ * of other processes doing the same. A drive that can't be opened is
+ * backed off to every 2nd, 4th, ... tick.
+ *
+ * Drives for which the kernel itself detects media changes, as told by
+ * events_async and events_poll_msecs in sysfs, are checked when hald
+ * passes the resulting uevent on by setting linux.media_change_time, and
+ * are otherwise only polled as rarely as a failing drive. If one of these
+ * polls finds a media change no event told us about, the drive is
+ * polled normally again. Other drives may send such events too, but only
+ * because our own open() made the kernel look, so they are still polled.
+ */
+
+enum {
+	MEDIA_STATUS_UNKNOWN = 0,
+	MEDIA_STATUS_GOT_MEDIA = 1,
+	MEDIA_STATUS_NO_MEDIA = 2
+};
+
+/* poll a failing drive at most every 2^MAX_BACKOFF ticks */
+#define MAX_BACKOFF 3
+
+/* Opening a drive or the SG_IO for the eject button can block for
+ * seconds, and all drives, CheckForMedia and DeviceAdded/DeviceRemoved
+ * share one main loop. No new drive is polled once a tick has taken
+ * this long; the rest are polled first on the next tick. */
+#define TICK_BUDGET_MSEC 500
+
+typedef struct {
+	char *udi;
+	char *device_file;
+	gboolean is_cdrom;
+	gboolean support_media_changed;
+	int media_status;
+
+	/* cached storage.media_check_enabled, refreshed on PropertyModified */
+	gboolean polling_disabled;
+	gboolean check_media_check_enabled;
+
+	/* refreshed before the next poll when a lock signal was seen */
+	gboolean check_lock_state;
+	gboolean is_locked_by_hal;
+	gboolean is_locked_via_o_excl;
+
+	/* media changes are announced by uevents */
+	gboolean event_driven;
+	gboolean check_media_change_time;
+
+	/* a media change uevent came while the drive was locked on HAL; it
+	 * is checked for once the lock is gone */
+	gboolean media_change_while_locked;
+
+	/* time from the media change uevent to our noticing the new media */
+	guint num_insertions;
+	guint64 insertion_latency_total;
+	guint64 insertion_latency_max;
+
+	guint backoff;
+	guint64 next_tick;
+} Drive;
 
-static char *udi;
-static char *device_file;
-static int media_status;
-static int is_cdrom;
-static int support_media_changed;
 static LibHalContext *ctx = NULL;
 static DBusConnection *con = NULL;
-static guint poll_timer = -1;
+static guint poll_timer = 0;
 static GMainLoop *loop;
 static gboolean system_is_idle = FALSE;
-static gboolean check_lock_state = TRUE;
+static GHashTable *drives = NULL;
+
+/* number of times the poll timer fired; unlike the wall clock this never
+ * goes backwards */
+static guint64 current_tick = 0;
+
+/* The Unmount and Teardown calls made when media goes away are not waited
+ * for in the main loop; a busy volume would otherwise stall the polling of
+ * all drives. A call that takes longer than this is given up on. */
+#define REMOVAL_CALL_TIMEOUT_MSEC (30 * 1000)
+
+/* Calls made on behalf of one media removal. Crypto mappings are torn
+ * down once all volumes replied to Unmount, and the partition table is
+ * reread once the teardowns replied. The drive may be gone by then, so
+ * its UDI and device file are copied. */
+typedef struct {
+	char *udi;
+	char *device_file;
+	guint num_pending;
+	GSList *crypto_volumes;
+	gboolean teardown_sent;
+} MediaRemoval;
 
-static gboolean polling_disabled = FALSE;
+typedef struct {
+	MediaRemoval *removal;
+	char *udi;
+	const char *method;
+} RemovalCall;
 
-static void 
-force_unmount (LibHalContext *ctx, const char *udi)
+static void media_removal_call_done (MediaRemoval *removal);
+
+static void
+removal_call_free (RemovalCall *call)
 {
+	g_free (call->udi);
+	g_free (call);
+}
+
+static void
+removal_call_notify (DBusPendingCall *pending, void *user_data)
+{
+	RemovalCall *call = (RemovalCall *) user_data;
+	DBusMessage *reply;
 	DBusError error;
+
+	dbus_error_init (&error);
+	reply = dbus_pending_call_steal_reply (pending);
+	if (reply == NULL) {
+		HAL_ERROR (("%s failed for %s: no reply", call->method, call->udi));
+	} else if (dbus_set_error_from_message (&error, reply)) {
+		HAL_ERROR (("%s failed for %s: %s : %s", call->method, call->udi, error.name, error.message));
+		dbus_error_free (&error);
+	} else {
+		HAL_DEBUG (("%s succeeded for udi '%s'", call->method, call->udi));
+	}
+
+	if (reply != NULL)
+		dbus_message_unref (reply);
+	dbus_pending_call_unref (pending);
+
+	media_removal_call_done (call->removal);
+}
+
+/* takes ownership of msg */
+static void
+media_removal_send (MediaRemoval *removal, DBusMessage *msg, const char *udi, const char *method)
+{
+	DBusPendingCall *pending = NULL;
+	RemovalCall *call;
+
+	if (!dbus_connection_send_with_reply (libhal_ctx_get_dbus_connection (ctx), msg,
+					      &pending, REMOVAL_CALL_TIMEOUT_MSEC) ||
+	    pending == NULL) {
+		HAL_ERROR (("Could not send %s for %s", method, udi));
+		goto out;
+	}
+
+	call = g_new0 (RemovalCall, 1);
+	call->removal = removal;
+	call->udi = g_strdup (udi);
+	call->method = method;
+
+	removal->num_pending++;
+	if (!dbus_pending_call_set_notify (pending, removal_call_notify, call,
+					   (DBusFreeFunction) removal_call_free)) {
+		HAL_ERROR (("Could not wait for the reply to %s for %s", method, udi));
+		removal->num_pending--;
+		removal_call_free (call);
+		dbus_pending_call_cancel (pending);
+		dbus_pending_call_unref (pending);
+	}
+
+out:
+	dbus_message_unref (msg);
+}
+
+static void 
+force_unmount (MediaRemoval *removal, const char *udi)
+{
 	DBusMessage *msg = NULL;
-	DBusMessage *reply = NULL;
 	char **options = NULL;
 	unsigned int num_options = 0;
-	DBusConnection *dbus_connection;
 	char *device_file;
 
-	dbus_connection = libhal_ctx_get_dbus_connection (ctx);
-
 	msg = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 					    "org.freedesktop.Hal.Device.Volume",
 					    "Unmount");
@@ -106,33 +251,85 @@ force_unmount (LibHalContext *ctx, const char *udi)
 		HAL_ERROR (("Could not append args to dbus message for %s", udi));
 		goto out;
 	}
-	
-	dbus_error_init (&error);
-	if (!(reply = dbus_connection_send_with_reply_and_block (dbus_connection, msg, -1, &error))) {
-		HAL_ERROR (("Unmount failed for %s: %s : %s\n", udi, error.name, error.message));
-		dbus_error_free (&error);
-		goto out;
-	}
 
-	if (dbus_error_is_set (&error)) {
-		HAL_ERROR (("Unmount failed for %s\n%s : %s\n", udi, error.name, error.message));
-		dbus_error_free (&error);
-		goto out;
-	}
-
-	HAL_DEBUG (("Succesfully unmounted udi '%s'", udi));
+	media_removal_send (removal, msg, udi, "Unmount");
+	msg = NULL;
 
 out:
 	if (options != NULL)
 		free (options);
 	if (msg != NULL)
 		dbus_message_unref (msg);
-	if (reply != NULL)
-		dbus_message_unref (reply);
+}
+
+static void
+teardown_crypto (MediaRemoval *removal, const char *vol_udi)
+{
+	DBusMessage *msg;
+
+	/* tear down mapping */
+	HAL_DEBUG (("Teardown crypto for '%s'", vol_udi));
+
+	msg = dbus_message_new_method_call ("org.freedesktop.Hal", vol_udi,
+					    "org.freedesktop.Hal.Device.Volume.Crypto",
+					    "Teardown");
+	if (msg == NULL) {
+		HAL_ERROR (("Could not create dbus message for %s", vol_udi));
+		return;
+	}
+
+	media_removal_send (removal, msg, vol_udi, "Teardown");
+}
+
+static void
+media_removal_finish (MediaRemoval *removal)
+{
+	DBusError error;
+	int fd;
+
+	/* could have a fs on the main block device; do a rescan to remove it */
+	dbus_error_init (&error);
+	libhal_device_rescan (ctx, removal->udi, &error);
+	LIBHAL_FREE_DBUS_ERROR (&error);
+
+	/* have to this to trigger appropriate hotplug events */
+	fd = open (removal->device_file, O_RDONLY | O_NONBLOCK);
+	if (fd >= 0) {
+		ioctl (fd, BLKRRPART);
+		close (fd);
+	}
+
+	g_slist_foreach (removal->crypto_volumes, (GFunc) g_free, NULL);
+	g_slist_free (removal->crypto_volumes);
+	g_free (removal->udi);
+	g_free (removal->device_file);
+	g_free (removal);
+}
+
+/* Called when a call made for the removal got its reply, and once by
+ * whoever sent a batch of calls after sending them all */
+static void
+media_removal_call_done (MediaRemoval *removal)
+{
+	GSList *l;
+
+	if (--removal->num_pending > 0)
+		return;
+
+	if (removal->teardown_sent || removal->crypto_volumes == NULL) {
+		media_removal_finish (removal);
+		return;
+	}
+
+	removal->teardown_sent = TRUE;
+	removal->num_pending = 1;
+	for (l = removal->crypto_volumes; l != NULL; l = l->next)
+		teardown_crypto (removal, (const char *) l->data);
+	media_removal_call_done (removal);
 }
 
 static dbus_bool_t
-unmount_cleartext_devices (LibHalContext *ctx, const char *udi)
+unmount_cleartext_devices (MediaRemoval *removal, const char *udi)
 {
 	DBusError error;
 	char **clear_devices;
@@ -160,7 +357,7 @@ unmount_cleartext_devices (LibHalContext *ctx, const char *udi)
 			LIBHAL_FREE_DBUS_ERROR (&error);
 			if (libhal_device_get_property_bool (ctx, clear_udi, "volume.is_mounted", &error)) {
 				HAL_DEBUG (("Forcing unmount of child '%s' (crypto)", clear_udi));
-				force_unmount (ctx, clear_udi);
+				force_unmount (removal, clear_udi);
 			}
 		}
 		libhal_free_string_array (clear_devices);
@@ -171,7 +368,7 @@ unmount_cleartext_devices (LibHalContext *ctx, const char *udi)
 }
 
 static void 
-unmount_childs (LibHalContext *ctx, const char *udi)
+unmount_childs (MediaRemoval *removal)
 {
 	int num_volumes;
 	char **volumes;
@@ -179,7 +376,7 @@ unmount_childs (LibHalContext *ctx, const char *udi)
 
 	/* need to force unmount all partitions */
 	dbus_error_init (&error);
-	if ((volumes = libhal_manager_find_device_string_match (ctx, "block.storage_device", udi, &num_volumes, &error)) != NULL) {
+	if ((volumes = libhal_manager_find_device_string_match (ctx, "block.storage_device", removal->udi, &num_volumes, &error)) != NULL) {
 		int i;
 
 		for (i = 0; i < num_volumes; i++) {
@@ -192,46 +389,18 @@ unmount_childs (LibHalContext *ctx, const char *udi)
 				dbus_bool_t is_crypto;
 
 				/* unmount all cleartext devices associated with us */
-				is_crypto = unmount_cleartext_devices (ctx, vol_udi);
+				is_crypto = unmount_cleartext_devices (removal, vol_udi);
 
 				LIBHAL_FREE_DBUS_ERROR (&error);
 				if (libhal_device_get_property_bool (ctx, vol_udi, "volume.is_mounted", &error)) {
 					HAL_DEBUG (("Forcing unmount of child '%s'", vol_udi));
-					force_unmount (ctx, vol_udi);
-				}
-
-				/* teardown crypto */
-				if (is_crypto) {
-					DBusMessage *msg = NULL;
-					DBusMessage *reply = NULL;
-
-					/* tear down mapping */
-					HAL_DEBUG (("Teardown crypto for '%s'", vol_udi));
-
-					msg = dbus_message_new_method_call ("org.freedesktop.Hal", vol_udi,
-									    "org.freedesktop.Hal.Device.Volume.Crypto",
-									    "Teardown");
-					if (msg == NULL) {
-						HAL_ERROR (("Could not create dbus message for %s", vol_udi));
-						goto teardown_failed;
-					}
-
-					LIBHAL_FREE_DBUS_ERROR (&error);
-
-					if (!(reply = dbus_connection_send_with_reply_and_block (
-						      libhal_ctx_get_dbus_connection (ctx), msg, -1, &error)) || 
-					    dbus_error_is_set (&error)) {
-						HAL_DEBUG (("Teardown failed for %s: %s : %s\n", udi, error.name, error.message));
-						dbus_error_free (&error);
-					}
-
-				teardown_failed:
-					if (msg != NULL)
-						dbus_message_unref (msg);
-					if (reply != NULL)
-						dbus_message_unref (reply);
+					force_unmount (removal, vol_udi);
 				}
 
+				/* teardown crypto once it's unmounted */
+				if (is_crypto)
+					removal->crypto_volumes = g_slist_prepend (removal->crypto_volumes,
+										   g_strdup (vol_udi));
 			}
 
 		}
@@ -240,6 +409,23 @@ unmount_childs (LibHalContext *ctx, const char *udi)
 	LIBHAL_FREE_DBUS_ERROR (&error);
 }
 
+/* Unmount everything on the drive, tear down crypto mappings and reread
+ * the partition table; returns before hald has answered */
+static void
+media_removal_start (Drive *drive)
+{
+	MediaRemoval *removal;
+
+	removal = g_new0 (MediaRemoval, 1);
+	removal->udi = g_strdup (drive->udi);
+	removal->device_file = g_strdup (drive->device_file);
+
+	/* held until all unmounts are sent */
+	removal->num_pending = 1;
+	unmount_childs (removal);
+	media_removal_call_done (removal);
+}
+
 /** Check if a filesystem on a special device file is mounted
  *
  *  @param  device_file         Special device file, e.g. /dev/cdrom
@@ -273,132 +459,87 @@ out:
 }
 
 
-enum {
-	MEDIA_STATUS_UNKNOWN = 0,
-	MEDIA_STATUS_GOT_MEDIA = 1,
-	MEDIA_STATUS_NO_MEDIA = 2
-};
+static int interval_in_seconds = 2;
 
-static gboolean poll_for_media (gpointer user_data);
-static gboolean poll_for_media_force (void);
+static void
+count_polled_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	Drive *drive = (Drive *) value;
+	int *num = (int *) user_data;
 
-static int interval_in_seconds = 2;
+	if (drive->polling_disabled || drive->is_locked_by_hal || drive->is_locked_via_o_excl)
+		return;
 
-static gboolean is_locked_by_hal = FALSE;
-static gboolean is_locked_via_o_excl = FALSE;
+	if (drive->event_driven)
+		num[1]++;
+	else
+		num[0]++;
+}
 
 static void
 update_proc_title (void)
 {
+	int num[2];
 
-        if (polling_disabled) {
-                hal_set_proc_title ("hald-addon-storage: no polling on %s because it is explicitly disabled", device_file);
-        } else if (is_locked_by_hal) {
-                if (is_locked_via_o_excl) {
-                        hal_set_proc_title ("hald-addon-storage: no polling because %s is locked via HAL and O_EXCL", device_file);
-                } else {
-                        hal_set_proc_title ("hald-addon-storage: no polling because %s is locked via HAL", device_file);
-                }
-        } else if (is_locked_via_o_excl) {
-                hal_set_proc_title ("hald-addon-storage: no polling because %s is locked via O_EXCL", device_file);
-        } else {
-                hal_set_proc_title ("hald-addon-storage: polling %s (every %d sec)", device_file, interval_in_seconds);
-        }
+	num[0] = num[1] = 0;
+	g_hash_table_foreach (drives, count_polled_foreach, num);
+
+	hal_set_proc_title ("hald-addon-storage: polling %d and watching %d of %d drives (every %d sec)", 
+			    num[0], num[1], g_hash_table_size (drives), interval_in_seconds);
 }
 
+static gboolean poll_all_drives (gpointer user_data);
+
+/* Arm the timer for the next multiple of interval_in_seconds since the epoch */
 static void
-update_polling_interval (void)
+schedule_poll (void)
 {
-	/* TODO: ideally we want all things that do polling to do it
-	 * at the same time.. such as to minimize battery
-	 * usage. Suppose we want to wake up to do poll_for_media()
-	 * every N seconds.  Suppose M is the number of seconds since
-	 * epoch. The fix is to wake up at exactly when M is divisible
-	 * by N... plus some system wide offset (ideally read from
-	 * /sys so kernel threads can use the same offset) to make Xen
-	 * + friends work.... 
-	 *
-	 * Also, the polling intervals should be powers of two to
-	 * ensure that wakeup's with different intervals happen at the
-	 * same time when possible.
-	 *
-	 * This is sorta-kinda what g_timeout_source_new_seconds()
-	 * tries to achieve, not enough I think, and it's only
-	 * available in glib >= 2.14. Too little, too late? *shrug*
-	 */
-
-	if (system_is_idle)
-		interval_in_seconds = 16;
-	else
-		interval_in_seconds = 2;
+	GTimeVal now;
+	glong period;
+	glong into_period;
 
 	if (poll_timer > 0)
 		g_source_remove (poll_timer);
 
-#ifdef HAVE_GLIB_2_14
-	poll_timer = g_timeout_add_seconds (interval_in_seconds, poll_for_media, NULL);
-#else
-	poll_timer = g_timeout_add (interval_in_seconds * 1000, poll_for_media, NULL);
-#endif
+	g_get_current_time (&now);
+	period = interval_in_seconds * 1000;
+	into_period = (now.tv_sec % interval_in_seconds) * 1000 + now.tv_usec / 1000;
 
-        update_proc_title ();
+	poll_timer = g_timeout_add (period - into_period, poll_all_drives, NULL);
 }
 
-static gboolean
-poll_for_media (gpointer user_data)
+static void
+update_polling_interval (void)
 {
-        if (check_lock_state) {
-                DBusError error;
-                dbus_bool_t should_poll;
-
-                check_lock_state = FALSE;
-
-                HAL_INFO (("Checking whether device %s is locked on HAL", device_file));
-                dbus_error_init (&error);
-                if (libhal_device_is_locked_by_others (ctx, udi, "org.freedesktop.Hal.Device.Storage", &error)) {
-                        HAL_INFO (("... device %s is locked on HAL", device_file));
-                        is_locked_by_hal = TRUE;
-                        update_proc_title ();
-			LIBHAL_FREE_DBUS_ERROR (&error);
-                        goto skip_check;
-                } else {
-                        HAL_INFO (("... device %s is not locked on HAL", device_file));
-                        is_locked_by_hal = FALSE;
-                }
-
-		LIBHAL_FREE_DBUS_ERROR (&error);
-
-                should_poll = libhal_device_get_property_bool (ctx, udi, "storage.media_check_enabled", &error);
-		LIBHAL_FREE_DBUS_ERROR (&error);
-		polling_disabled = !should_poll;
-		update_proc_title ();
-        }
-
-        /* TODO: we could remove the timeout completely... */
-        if (is_locked_by_hal || polling_disabled)
-                goto skip_check;
-
-        poll_for_media_force ();
+	/* Both intervals are powers of two such that wakeups with
+	 * different intervals happen at the same time when possible.
+	 */
+	if (system_is_idle)
+		interval_in_seconds = 16;
+	else
+		interval_in_seconds = 2;
 
-skip_check:
-	return TRUE;
+	schedule_poll ();
+	update_proc_title ();
 }
 
 /* returns: whether the state changed */
 static gboolean
-poll_for_media_force (void)
+poll_for_media_force (Drive *drive)
 {
         int fd;
         int got_media;
         int old_media_status;
+	gboolean failed;
 
 	got_media = FALSE;
+	failed = TRUE;
 
-        old_media_status = media_status;
-	if (is_cdrom) {
-		int drive;
+        old_media_status = drive->media_status;
+	if (drive->is_cdrom) {
+		int status;
 		
-		fd = open (device_file, O_RDONLY | O_NONBLOCK | O_EXCL);
+		fd = open (drive->device_file, O_RDONLY | O_NONBLOCK | O_EXCL);
 		
 		if (fd < 0 && errno == EBUSY) {
 			/* this means the disc is mounted or some other app,
@@ -409,26 +550,24 @@ poll_for_media_force (void)
 			 * actually is mounted. If it is we retry to open
 			 * without O_EXCL
 			 */
-			if (!is_mounted (device_file)) {
-                                if (!is_locked_via_o_excl) {
-                                        is_locked_via_o_excl = TRUE;
+			if (!is_mounted (drive->device_file)) {
+                                if (!drive->is_locked_via_o_excl) {
+                                        drive->is_locked_via_o_excl = TRUE;
                                         update_proc_title ();
-                                } else {
-                                        is_locked_via_o_excl = TRUE;
                                 }
 				goto skip_check;
                         }
 			
-			fd = open (device_file, O_RDONLY | O_NONBLOCK);
+			fd = open (drive->device_file, O_RDONLY | O_NONBLOCK);
 		}
 		
 		if (fd < 0) {
-			HAL_ERROR (("open failed for %s: %s", device_file, strerror (errno))); 
+			HAL_ERROR (("open failed for %s: %s", drive->device_file, strerror (errno))); 
 			goto skip_check;
 		}
 
-                if (is_locked_via_o_excl) {
-                        is_locked_via_o_excl = FALSE;
+                if (drive->is_locked_via_o_excl) {
+                        drive->is_locked_via_o_excl = FALSE;
                         update_proc_title ();
                 }
 		
@@ -437,8 +576,8 @@ poll_for_media_force (void)
 		 *
 		 * @todo Use MMC-2 API if applicable
 		 */
-		drive = ioctl (fd, CDROM_DRIVE_STATUS, CDSL_CURRENT);
-		switch (drive) {
+		status = ioctl (fd, CDROM_DRIVE_STATUS, CDSL_CURRENT);
+		switch (status) {
 		case CDS_NO_INFO:
 		case CDS_NO_DISC:
 		case CDS_TRAY_OPEN:
@@ -450,7 +589,7 @@ poll_for_media_force (void)
 			 * tray; if media check has the same value two times in
 			 * a row then this seems to be the case and we must not
 			 * report that there is a media in it. */
-			if (support_media_changed &&
+			if (drive->support_media_changed &&
 			    ioctl (fd, CDROM_MEDIA_CHANGED, CDSL_CURRENT) && 
 			    ioctl (fd, CDROM_MEDIA_CHANGED, CDSL_CURRENT)) {
 			} else {
@@ -488,56 +627,45 @@ poll_for_media_force (void)
 				
 				/* emit signal from drive device object */
 				dbus_error_init (&error);
-				libhal_device_emit_condition (ctx, udi, "EjectPressed", "", &error);
+				libhal_device_emit_condition (ctx, drive->udi, "EjectPressed", "", &error);
 				LIBHAL_FREE_DBUS_ERROR (&error);
 			}
 		}
 		close (fd);
 	} else {
-		fd = open (device_file, O_RDONLY);
+		fd = open (drive->device_file, O_RDONLY);
 		if (fd < 0 && errno == ENOMEDIUM) {
 			got_media = FALSE;
 		} else if (fd >= 0) {
 			got_media = TRUE;
 			close (fd);
 		} else {
-			HAL_ERROR (("open failed for %s: %s", device_file, strerror (errno))); 
+			HAL_ERROR (("open failed for %s: %s", drive->device_file, strerror (errno))); 
 			goto skip_check;
 		}
 	}
+
+	failed = FALSE;
 	
 	/* set correct state on startup, this avoid endless loops if there was a media in the device on startup */
-	if (media_status == MEDIA_STATUS_UNKNOWN) {
+	if (drive->media_status == MEDIA_STATUS_UNKNOWN) {
 		if (got_media) 
-			media_status = MEDIA_STATUS_NO_MEDIA;
+			drive->media_status = MEDIA_STATUS_NO_MEDIA;
 		else 
-			media_status = MEDIA_STATUS_GOT_MEDIA;	
+			drive->media_status = MEDIA_STATUS_GOT_MEDIA;	
 	}
 
-	switch (media_status) {
+	switch (drive->media_status) {
 	case MEDIA_STATUS_GOT_MEDIA:
 		if (!got_media) {
-			DBusError error;
+			HAL_DEBUG (("Media removal detected on %s", drive->device_file));
+			libhal_device_set_property_bool (ctx, drive->udi, "storage.removable.media_available", FALSE, NULL);
+			libhal_device_set_property_string (ctx, drive->udi, "storage.partitioning_scheme", "", NULL);
 			
-			HAL_DEBUG (("Media removal detected on %s", device_file));
-			libhal_device_set_property_bool (ctx, udi, "storage.removable.media_available", FALSE, NULL);
-			libhal_device_set_property_string (ctx, udi, "storage.partitioning_scheme", "", NULL);
 			
-			
-			/* attempt to unmount all childs */
-			unmount_childs (ctx, udi);
-			
-			/* could have a fs on the main block device; do a rescan to remove it */
-			dbus_error_init (&error);
-			libhal_device_rescan (ctx, udi, &error);
-			LIBHAL_FREE_DBUS_ERROR (&error);
-			
-			/* have to this to trigger appropriate hotplug events */
-			fd = open (device_file, O_RDONLY | O_NONBLOCK);
-			if (fd >= 0) {
-				ioctl (fd, BLKRRPART);
-				close (fd);
-			}
+			/* attempt to unmount all childs, then rescan and
+			 * reread the partition table */
+			media_removal_start (drive);
 		}
 		break;
 		
@@ -545,15 +673,15 @@ poll_for_media_force (void)
 		if (got_media) {
 			DBusError error;
 			
-			HAL_DEBUG (("Media insertion detected on %s", device_file));
+			HAL_DEBUG (("Media insertion detected on %s", drive->device_file));
 			
 			/* our probe will trigger the appropriate hotplug events */
 			libhal_device_set_property_bool (
-				ctx, udi, "storage.removable.media_available", TRUE, NULL);
+				ctx, drive->udi, "storage.removable.media_available", TRUE, NULL);
 			
 			/* could have a fs on the main block device; do a rescan to add it */
 			dbus_error_init (&error);
-			libhal_device_rescan (ctx, udi, &error);
+			libhal_device_rescan (ctx, drive->udi, &error);
 			LIBHAL_FREE_DBUS_ERROR (&error);
 		}
 		break;
@@ -565,14 +693,228 @@ poll_for_media_force (void)
 	
 	/* update our current status */
 	if (got_media)
-		media_status = MEDIA_STATUS_GOT_MEDIA;
+		drive->media_status = MEDIA_STATUS_GOT_MEDIA;
 	else
-		media_status = MEDIA_STATUS_NO_MEDIA;
+		drive->media_status = MEDIA_STATUS_NO_MEDIA;
 	
-	/*HAL_DEBUG (("polling %s; got media=%d", device_file, got_media));*/
+	/*HAL_DEBUG (("polling %s; got media=%d", drive->device_file, got_media));*/
 	
 skip_check:
-	return old_media_status != media_status;
+	if (failed) {
+		if (drive->backoff < MAX_BACKOFF)
+			drive->backoff++;
+	} else {
+		drive->backoff = 0;
+	}
+
+	return old_media_status != drive->media_status;
+}
+
+/* Bring cached lock state and storage.media_check_enabled up to date; this
+ * is only a round trip to hald if a signal told us something changed */
+static void
+refresh_drive_state (Drive *drive)
+{
+	DBusError error;
+
+	dbus_error_init (&error);
+
+        if (drive->check_lock_state) {
+                drive->check_lock_state = FALSE;
+
+                HAL_INFO (("Checking whether device %s is locked on HAL", drive->device_file));
+                if (libhal_device_is_locked_by_others (ctx, drive->udi, "org.freedesktop.Hal.Device.Storage", &error)) {
+                        HAL_INFO (("... device %s is locked on HAL", drive->device_file));
+                        drive->is_locked_by_hal = TRUE;
+                } else {
+                        HAL_INFO (("... device %s is not locked on HAL", drive->device_file));
+                        drive->is_locked_by_hal = FALSE;
+                }
+		LIBHAL_FREE_DBUS_ERROR (&error);
+		update_proc_title ();
+	}
+
+	if (drive->check_media_check_enabled) {
+		drive->check_media_check_enabled = FALSE;
+
+                drive->polling_disabled = !libhal_device_get_property_bool (ctx, drive->udi, 
+									    "storage.media_check_enabled", &error);
+		LIBHAL_FREE_DBUS_ERROR (&error);
+		update_proc_title ();
+	}
+}
+
+/* Published on the drive as linux.media_insertion_*, see the spec */
+static void
+record_insertion_latency (Drive *drive, guint64 change_time)
+{
+	GTimeVal now;
+	guint64 now_msec;
+	guint64 latency;
+	LibHalChangeSet *cs;
+	DBusError error;
+
+	g_get_current_time (&now);
+	now_msec = (guint64) now.tv_sec * 1000 + now.tv_usec / 1000;
+	if (change_time == 0 || change_time > now_msec)
+		return;
+
+	latency = now_msec - change_time;
+	drive->num_insertions++;
+	drive->insertion_latency_total += latency;
+	if (latency > drive->insertion_latency_max)
+		drive->insertion_latency_max = latency;
+
+	HAL_INFO (("Media insertion on %s detected %" G_GUINT64_FORMAT "ms after the uevent "
+		   "(%u insertions, %" G_GUINT64_FORMAT "ms average, %" G_GUINT64_FORMAT "ms max)",
+		   drive->device_file, latency, drive->num_insertions,
+		   drive->insertion_latency_total / drive->num_insertions, drive->insertion_latency_max));
+
+	cs = libhal_device_new_changeset (drive->udi);
+	if (cs == NULL) {
+		HAL_ERROR (("Cannot initialize changeset"));
+		return;
+	}
+
+	libhal_changeset_set_property_int (cs, "linux.media_insertion_count", drive->num_insertions);
+	libhal_changeset_set_property_uint64 (cs, "linux.media_insertion_latency", latency);
+	libhal_changeset_set_property_uint64 (cs, "linux.media_insertion_latency_average",
+					      drive->insertion_latency_total / drive->num_insertions);
+	libhal_changeset_set_property_uint64 (cs, "linux.media_insertion_latency_max",
+					      drive->insertion_latency_max);
+
+	dbus_error_init (&error);
+	libhal_device_commit_changeset (ctx, cs, &error);
+	LIBHAL_FREE_DBUS_ERROR (&error);
+	libhal_device_free_changeset (cs);
+}
+
+/* Check the drive after a media change uevent, or after the lock that
+ * held such a check back is gone; change_time is 0 in the latter case as
+ * the latency would only measure the lock */
+static void
+check_media_after_event (Drive *drive, guint64 change_time)
+{
+	refresh_drive_state (drive);
+	if (drive->is_locked_by_hal) {
+		if (!drive->media_change_while_locked)
+			HAL_INFO (("Media change on %s while locked on HAL; checking once it's unlocked",
+				   drive->device_file));
+		drive->media_change_while_locked = TRUE;
+		return;
+	}
+	drive->media_change_while_locked = FALSE;
+
+	/* unlike polling, this is fine even with storage.media_check_enabled
+	 * set to false; the device was just opened by the kernel anyway */
+	if (poll_for_media_force (drive) && drive->media_status == MEDIA_STATUS_GOT_MEDIA)
+		record_insertion_latency (drive, change_time);
+}
+
+/* hald got a media change uevent for the drive */
+static void
+handle_media_change_event (Drive *drive)
+{
+	DBusError error;
+	dbus_uint64_t change_time;
+
+	drive->check_media_change_time = FALSE;
+
+	dbus_error_init (&error);
+	change_time = libhal_device_get_property_uint64 (ctx, drive->udi, "linux.media_change_time", &error);
+	LIBHAL_FREE_DBUS_ERROR (&error);
+
+	check_media_after_event (drive, change_time);
+}
+
+static void
+poll_drive (Drive *drive)
+{
+	GTimer *timer;
+
+	refresh_drive_state (drive);
+
+        if (drive->is_locked_by_hal || drive->polling_disabled)
+                return;
+
+	timer = g_timer_new ();
+
+	if (drive->event_driven) {
+		int old_media_status;
+
+		old_media_status = drive->media_status;
+		if (poll_for_media_force (drive) && old_media_status != MEDIA_STATUS_UNKNOWN) {
+			HAL_WARNING (("Media change on %s without a uevent; polling it again", drive->device_file));
+			drive->event_driven = FALSE;
+			update_proc_title ();
+		}
+	} else {
+		poll_for_media_force (drive);
+	}
+
+	/* a drive that takes this long to answer is backed off like one
+	 * that can't be opened */
+	if (g_timer_elapsed (timer, NULL) * 1000 >= TICK_BUDGET_MSEC) {
+		HAL_WARNING (("Polling %s took %.1f seconds", drive->device_file, g_timer_elapsed (timer, NULL)));
+		if (drive->backoff < MAX_BACKOFF)
+			drive->backoff++;
+	}
+	g_timer_destroy (timer);
+
+	drive->next_tick = current_tick + (1 << (drive->event_driven ? MAX_BACKOFF : drive->backoff));
+}
+
+static void
+collect_due_drives_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	Drive *drive = (Drive *) value;
+	GSList **due = (GSList **) user_data;
+
+	if (current_tick >= drive->next_tick)
+		*due = g_slist_prepend (*due, drive);
+}
+
+static gint
+compare_next_tick (gconstpointer a, gconstpointer b)
+{
+	const Drive *da = (const Drive *) a;
+	const Drive *db = (const Drive *) b;
+
+	if (da->next_tick < db->next_tick)
+		return -1;
+	return da->next_tick > db->next_tick ? 1 : 0;
+}
+
+static gboolean
+poll_all_drives (gpointer user_data)
+{
+	GSList *due;
+	GSList *i;
+	GTimer *timer;
+
+	current_tick++;
+
+	/* most overdue first, so drives skipped last time go before the
+	 * ones that made us skip them */
+	due = NULL;
+	g_hash_table_foreach (drives, collect_due_drives_foreach, &due);
+	due = g_slist_sort (due, compare_next_tick);
+
+	timer = g_timer_new ();
+	for (i = due; i != NULL; i = g_slist_next (i)) {
+		if (g_timer_elapsed (timer, NULL) * 1000 >= TICK_BUDGET_MSEC) {
+			HAL_DEBUG (("Out of time; leaving %d drives for the next tick", g_slist_length (i)));
+			break;
+		}
+		poll_drive ((Drive *) i->data);
+	}
+	g_timer_destroy (timer);
+	g_slist_free (due);
+
+	poll_timer = 0;
+	schedule_poll ();
+
+	return FALSE;
 }
 
 #ifdef HAVE_CONKIT
@@ -625,10 +967,19 @@ direct_filter_function (DBusConnection *connection, DBusMessage *message, void *
 					 "CheckForMedia")) {
                 DBusMessage *reply;
                 dbus_bool_t call_had_sideeffect;
+		Drive *drive;
+		const char *path;
+
+		path = dbus_message_get_path (message);
+		drive = path != NULL ? g_hash_table_lookup (drives, path) : NULL;
+		if (drive == NULL) {
+			HAL_DEBUG (("CheckForMedia() called for unknown device %s", path));
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+		}
 
-                HAL_INFO (("Forcing poll for media becusse CheckForMedia() was called"));
+                HAL_INFO (("Forcing poll for media on %s becusse CheckForMedia() was called", drive->device_file));
 
-                call_had_sideeffect = poll_for_media_force ();
+                call_had_sideeffect = poll_for_media_force (drive);
 
                 reply = dbus_message_new_method_return (message);
                 dbus_message_append_args (reply,
@@ -636,14 +987,64 @@ direct_filter_function (DBusConnection *connection, DBusMessage *message, void *
                                           DBUS_TYPE_INVALID);
                 dbus_connection_send (connection, reply, NULL);
                 dbus_message_unref (reply);
+
+		return DBUS_HANDLER_RESULT_HANDLED;
         }
 
-	return DBUS_HANDLER_RESULT_HANDLED;
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void
+check_lock_state_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	Drive *drive = (Drive *) value;
+
+	drive->check_lock_state = TRUE;
+	if (drive->media_change_while_locked)
+		check_media_after_event (drive, 0);
+}
+
+/* Only changes of storage.media_check_enabled and linux.media_change_time
+ * need a round trip; all other properties, e.g. the ones we set ourselves,
+ * are ignored */
+static void
+handle_property_modified (Drive *drive, DBusMessage *message)
+{
+	DBusMessageIter iter;
+	DBusMessageIter sub;
+	DBusMessageIter sub2;
+	const char *key;
+
+	if (!dbus_message_iter_init (message, &iter) ||
+	    dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_INT32)
+		return;
+	dbus_message_iter_next (&iter);
+	if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY)
+		return;
+
+	dbus_message_iter_recurse (&iter, &sub);
+	while (dbus_message_iter_get_arg_type (&sub) == DBUS_TYPE_STRUCT) {
+		dbus_message_iter_recurse (&sub, &sub2);
+		if (dbus_message_iter_get_arg_type (&sub2) == DBUS_TYPE_STRING) {
+			dbus_message_iter_get_basic (&sub2, &key);
+			if (strcmp (key, "storage.media_check_enabled") == 0)
+				drive->check_media_check_enabled = TRUE;
+			else if (strcmp (key, "linux.media_change_time") == 0)
+				drive->check_media_change_time = TRUE;
+		}
+		dbus_message_iter_next (&sub);
+	}
+
+	if (drive->check_media_change_time)
+		handle_media_change_event (drive);
 }
 
 static DBusHandlerResult
 dbus_filter_function (DBusConnection *connection, DBusMessage *message, void *user_data)
 {
+	const char *path;
+	Drive *drive;
+
 #ifdef HAVE_CONKIT
 	gboolean system_is_idle_new;
 
@@ -666,6 +1067,18 @@ dbus_filter_function (DBusConnection *connection, DBusMessage *message, void *us
 out:
 #endif /* HAVE_CONKIT */
 
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	path = dbus_message_get_path (message);
+	drive = path != NULL ? g_hash_table_lookup (drives, path) : NULL;
+
+	if (drive != NULL &&
+	    dbus_message_is_signal (message, "org.freedesktop.Hal.Device", "PropertyModified")) {
+		handle_property_modified (drive, message);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
         /* Check, just before the next poll, whether lock state have changed; 
          * 
          * Note that we get called on at least these signals
@@ -676,23 +1089,195 @@ out:
          * 3. HAL.Device  - LockAcquired, LockReleased
          *
          * meaning that every time the locking situation changes, we
-         * will get updated.
+         * will get updated. A media change held back by a lock is
+         * checked for right away instead.
          */
-        check_lock_state = TRUE;
+	if (drive != NULL)
+		check_lock_state_foreach (NULL, drive, NULL);
+	else
+		g_hash_table_foreach (drives, check_lock_state_foreach, NULL);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+static char *
+get_device_match_rule (const char *udi)
+{
+        return g_strdup_printf ("type='signal'"
+				",interface='org.freedesktop.Hal.Device'"
+				",sender='org.freedesktop.Hal'"
+				",path='%s'",
+				udi);
+}
+
+/* Reads a sysfs attribute of the block device; NULL if it doesn't exist */
+static char *
+read_block_attr (const char *sysfs_path, const char *attr)
+{
+	char *path;
+	char *contents;
+
+	path = g_build_filename (sysfs_path, attr, NULL);
+	if (!g_file_get_contents (path, &contents, NULL, NULL))
+		contents = NULL;
+	else
+		g_strstrip (contents);
+	g_free (path);
+
+	return contents;
+}
+
+/* Whether the kernel notices media changes on its own and sends a uevent
+ * for them: either the drive raises events (events_async, e.g. SATA async
+ * notification) or the block layer polls it (events_poll_msecs; -1 means
+ * the block.events_dfl_poll_msecs default). Kernels without these
+ * attributes only forward async notification. */
+static gboolean
+kernel_detects_media_changes (const char *sysfs_path, gboolean support_async_notification)
+{
+	char *events_async;
+	char *poll_msecs;
+	gboolean ret;
+	long msecs;
+
+	if (sysfs_path == NULL)
+		return support_async_notification;
+
+	events_async = read_block_attr (sysfs_path, "events_async");
+	if (events_async == NULL)
+		return support_async_notification;
+
+	ret = (events_async[0] != '\0');
+	g_free (events_async);
+	if (ret)
+		return TRUE;
+
+	poll_msecs = read_block_attr (sysfs_path, "events_poll_msecs");
+	if (poll_msecs == NULL)
+		return FALSE;
+	msecs = strtol (poll_msecs, NULL, 10);
+	g_free (poll_msecs);
+
+	if (msecs == -1) {
+		poll_msecs = read_block_attr ("/sys/module/block/parameters", "events_dfl_poll_msecs");
+		if (poll_msecs == NULL)
+			return FALSE;
+		msecs = strtol (poll_msecs, NULL, 10);
+		g_free (poll_msecs);
+	}
+
+	return msecs > 0;
+}
+
+static void
+drive_free (Drive *drive)
+{
+	g_free (drive->udi);
+	g_free (drive->device_file);
+	g_free (drive);
+}
+
+static void
+add_device (LibHalContext *ctx,
+	    const char *udi,
+	    const LibHalPropertySet *properties)
+{
+	DBusError error;
+	Drive *drive;
+	const char *device_file;
+	const char *bus;
+	const char *drive_type;
+	char *str;
+
+	if ((device_file = libhal_ps_get_string (properties, "block.device")) == NULL) {
+		HAL_ERROR (("%s has no property block.device", udi));
+		return;
+	}
+	if ((bus = libhal_ps_get_string (properties, "storage.bus")) == NULL) {
+		HAL_ERROR (("%s has no property storage.bus", udi));
+		return;
+	}
+	if ((drive_type = libhal_ps_get_string (properties, "storage.drive_type")) == NULL) {
+		HAL_ERROR (("%s has no property storage.drive_type", udi));
+		return;
+	}
+
+	HAL_DEBUG (("**************************************************"));
+	HAL_DEBUG (("Doing addon-storage for %s (bus %s) (drive_type %s) (udi %s)", device_file, bus, drive_type, udi));
+	HAL_DEBUG (("**************************************************"));
+
+	drive = g_new0 (Drive, 1);
+	drive->udi = g_strdup (udi);
+	drive->device_file = g_strdup (device_file);
+	drive->is_cdrom = (strcmp (drive_type, "cdrom") == 0);
+	drive->support_media_changed = libhal_ps_get_bool (properties, "storage.cdrom.support_media_changed");
+	drive->polling_disabled = !libhal_ps_get_bool (properties, "storage.media_check_enabled");
+	drive->event_driven = kernel_detects_media_changes (libhal_ps_get_string (properties, "linux.sysfs_path"),
+							    libhal_ps_get_bool (properties, "storage.removable.support_async_notification"));
+	if (drive->event_driven)
+		HAL_INFO (("The kernel reports media changes on %s; not polling it", device_file));
+	drive->media_status = MEDIA_STATUS_UNKNOWN;
+	drive->check_lock_state = TRUE;
+
+	dbus_error_init (&error);
+	if (!libhal_device_claim_interface (ctx,
+					    udi, 
+					    "org.freedesktop.Hal.Device.Storage.Removable", 
+					    "    <method name=\"CheckForMedia\">\n"
+					    "      <arg name=\"call_had_sideeffect\" direction=\"out\" type=\"b\"/>\n"
+					    "    </method>\n",
+					    &error)) {
+		HAL_ERROR (("Cannot claim interface 'org.freedesktop.Hal.Device.Storage.Removable' on %s", udi));
+		LIBHAL_FREE_DBUS_ERROR (&error);
+		drive_free (drive);
+		return;
+	}
+
+	/* locking signals and PropertyModified for this drive; signals are
+	 * not pushed over direct connections (for a good reason) */
+	str = get_device_match_rule (udi);
+	dbus_bus_add_match (con, str, NULL);
+	g_free (str);
+
+	g_hash_table_insert (drives, drive->udi, drive);
+
+	update_proc_title ();
+}
+
+static void
+remove_device (LibHalContext *ctx,
+	       const char *udi,
+	       const LibHalPropertySet *properties)
+{
+	char *str;
+
+	HAL_DEBUG (("Removing drive '%s'", udi));
+
+	if (g_hash_table_lookup (drives, udi) == NULL) {
+		HAL_ERROR (("DeviceRemove called for unknown device: '%s'.", udi));
+		return;
+	}
+
+	str = get_device_match_rule (udi);
+	dbus_bus_remove_match (con, str, NULL);
+	g_free (str);
+
+	g_hash_table_remove (drives, udi);
+
+	if (g_hash_table_size (drives) == 0) {
+		HAL_INFO (("no more devices, exiting"));
+		g_main_loop_quit (loop);
+	}
+
+	update_proc_title ();
+}
+
 int
 main (int argc, char *argv[])
 {
 	DBusError error;
-        LibHalContext *ctx_direct;
         DBusConnection *con_direct;
-	char *bus;
-	char *drive_type;
-	char *support_media_changed_str;
-        char *str;
+	const char *commandline;
 
 	hal_set_proc_title_init (argc, argv);
 
@@ -701,22 +1286,14 @@ main (int argc, char *argv[])
 	 */
         /*drop_privileges (1);*/
 
-	if ((udi = getenv ("UDI")) == NULL)
-		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
-		goto out;
-	if ((bus = getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
-		goto out;
-	if ((drive_type = getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
-		goto out;
-
 	setup_logger ();
 
-	support_media_changed_str = getenv ("HAL_PROP_STORAGE_CDROM_SUPPORT_MEDIA_CHANGED");
-	if (support_media_changed_str != NULL && strcmp (support_media_changed_str, "true") == 0)
-		support_media_changed = TRUE;
-	else
-		support_media_changed = FALSE;
+	if ((commandline = getenv ("SINGLETON_COMMAND_LINE")) == NULL) {
+		HAL_WARNING (("SINGLETON_COMMAND_LINE not set"));
+		goto out;
+	}
+
+	drives = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) drive_free);
 
 	dbus_error_init (&error);
 	con = dbus_bus_get (DBUS_BUS_SYSTEM, &error);
@@ -728,37 +1305,6 @@ main (int argc, char *argv[])
 	dbus_connection_setup_with_g_main (con, NULL);
 	dbus_connection_set_exit_on_disconnect (con, 0);
 
-	if ((ctx_direct = libhal_ctx_init_direct (&error)) == NULL) {
-		HAL_ERROR (("Cannot connect to hald"));
-                goto out;
-	}
-	if (!libhal_device_addon_is_ready (ctx_direct, udi, &error)) {
-                goto out;
-	}
-	con_direct = libhal_ctx_get_dbus_connection (ctx_direct);
-	dbus_connection_setup_with_g_main (con_direct, NULL);
-	dbus_connection_set_exit_on_disconnect (con_direct, 0);
-	dbus_connection_add_filter (con_direct, direct_filter_function, NULL, NULL);
-
-
-	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
-		goto out;
-
-	if (!libhal_device_addon_is_ready (ctx, udi, &error))
-		goto out;
-
-	HAL_DEBUG (("**************************************************"));
-	HAL_DEBUG (("Doing addon-storage for %s (bus %s) (drive_type %s) (udi %s)", device_file, bus, drive_type, udi));
-	HAL_DEBUG (("**************************************************"));
-
-	if (strcmp (drive_type, "cdrom") == 0)
-		is_cdrom = 1;
-	else
-		is_cdrom = 0;
-
-	media_status = MEDIA_STATUS_UNKNOWN;
-
-
 #ifdef HAVE_CONKIT
 	/* TODO: ideally we should track the sessions on the seats on
 	 * which the device belongs to. But right now we don't really
@@ -789,37 +1335,29 @@ main (int argc, char *argv[])
 			    ",interface='org.freedesktop.Hal.Manager'"
 			    ",sender='org.freedesktop.Hal'",
 			    NULL);
-	dbus_bus_add_match (con,
-			    "type='signal'"
-			    ",interface='org.freedesktop.Hal.Manager'"
-			    ",sender='org.freedesktop.Hal'",
-			    NULL);
-        str = g_strdup_printf ("type='signal'"
-                               ",interface='org.freedesktop.Hal.Device'"
-                               ",sender='org.freedesktop.Hal'"
-                               ",path='%s'",
-                               udi);
-	dbus_bus_add_match (con,
-                            str,
-			    NULL);
-        g_free (str);
 	dbus_connection_add_filter (con, dbus_filter_function, NULL, NULL);
 
-	if (!libhal_device_claim_interface (ctx,
-					    udi, 
-					    "org.freedesktop.Hal.Device.Storage.Removable", 
-					    "    <method name=\"CheckForMedia\">\n"
-					    "      <arg name=\"call_had_sideeffect\" direction=\"out\" type=\"b\"/>\n"
-					    "    </method>\n",
-					    &error)) {
-		HAL_ERROR (("Cannot claim interface 'org.freedesktop.Hal.Device.Storage.Removable'"));
+	if ((ctx = libhal_ctx_init_direct (&error)) == NULL) {
+		HAL_ERROR (("Cannot connect to hald"));
                 goto out;
 	}
+	con_direct = libhal_ctx_get_dbus_connection (ctx);
+	dbus_connection_setup_with_g_main (con_direct, NULL);
+	dbus_connection_set_exit_on_disconnect (con_direct, 0);
+	dbus_connection_add_filter (con_direct, direct_filter_function, NULL, NULL);
 
+	libhal_ctx_set_singleton_device_added (ctx, add_device);
+	libhal_ctx_set_singleton_device_removed (ctx, remove_device);
+
+	if (!libhal_device_singleton_addon_is_ready (ctx, commandline, &error)) {
+		goto out;
+	}
 
 	update_polling_interval ();
 	g_main_loop_run (loop);
 
+	return 0;
+
 out:
 	HAL_DEBUG (("An error occured, exiting cleanly"));
 
@@ -200,178 +200,462 @@ cleanup_mountpoint_cb (HalDevice *d, guint32 exit_type,
 	g_free (mount_point);
 }
 
-void
-blockdev_refresh_mount_state (HalDevice *d)
+typedef struct {
+	guint seq;		/* position in the mount table */
+	char *mount_point;
+	gboolean read_only;
+} MountEntry;
+
+/* The mount table as last applied to all volumes by
+ * blockdev_refresh_mount_state(), see mount_table_add() for the keys */
+static GHashTable *mount_table = NULL;
+
+static void
+mount_entry_free (gpointer data)
+{
+	MountEntry *entry = (MountEntry *) data;
+
+	g_free (entry->mount_point);
+	g_slice_free (MountEntry, entry);
+}
+
+static gboolean
+mount_entry_equal (const MountEntry *a, const MountEntry *b)
+{
+	return a->read_only == b->read_only && strcmp (a->mount_point, b->mount_point) == 0;
+}
+
+/* Entries are keyed "dev:<major>:<minor>" or, if the device number of
+ * the mount source is not known (e.g. the node is already deleted),
+ * "name:<source>". Only the first mount of a device counts. */
+static void
+mount_table_add (GHashTable *table, dev_t devt, const char *source,
+		 const char *mount_point, gboolean read_only)
+{
+	MountEntry *entry;
+	char *key;
+
+	if (major (devt) != 0)
+		key = g_strdup_printf ("dev:%u:%u", major (devt), minor (devt));
+	else
+		key = g_strdup_printf ("name:%s", source);
+
+	if (g_hash_table_lookup (table, key) != NULL) {
+		g_free (key);
+		return;
+	}
+
+	entry = g_slice_new (MountEntry);
+	entry->seq = g_hash_table_size (table);
+	entry->mount_point = g_strdup (mount_point);
+	entry->read_only = read_only;
+	g_hash_table_insert (table, key, entry);
+}
+
+/* Find the device number of a mount source when the kernel does not
+ * tell it, e.g. for /proc/mounts; FALSE if the source is no device */
+static gboolean
+mount_source_get_devt (const char *source, const char *mount_point, const char *fstype, dev_t *devt)
+{
+	struct stat statbuf;
+
+	*devt = makedev (0, 0);
+
+	/* We don't handle nfs mounts in HAL and stat() on mountpoints,
+	 * and we would block on 'stale nfs handle'.
+	 */
+	if (strcmp (fstype, "nfs") == 0)
+		return FALSE;
+
+	/* skip plain names, we look for device nodes */
+	if (source[0] != '/')
+		return FALSE;
+
+	/*
+	 * We can't just stat() the mountpoint, because it breaks all sorts
+	 * non-disk filesystems. So assume, that the names in /proc/mounts
+	 * are existing device-files used to mount the filesystem.
+	 */
+	if (stat (source, &statbuf) == 0) {
+		/* not a device node */
+		if (major (statbuf.st_rdev) == 0)
+			return FALSE;
+
+		/* found major/minor */
+		*devt = statbuf.st_rdev;
+	} else {
+		/* The root filesystem may be mounted by a device name that doesn't
+		 * exist in the real root, like /dev/root, which the kernel uses
+		 * internally, when no initramfs image is used. For "/", it is safe
+		 * to get the major/minor by stat()'ing the mount-point.
+		 */
+		if (strcmp (mount_point, "/") == 0 && stat ("/", &statbuf) == 0)
+			*devt = statbuf.st_dev;
+
+		/* DING DING DING... the device-node may not exist, or is
+		 * already deleted, but the device may be still mounted.
+		 *
+		 * We will fall back to looking up the device-name, instead
+		 * of using major/minor.
+		 */
+	}
+
+	return TRUE;
+}
+
+/* Undo the octal escapes (e.g. \040 for space) of mountinfo in place */
+static void
+mountinfo_unescape (char *s)
+{
+	char *r;
+	char *w;
+
+	for (r = w = s; *r != '\0'; r++, w++) {
+		if (r[0] == '\\' &&
+		    r[1] >= '0' && r[1] <= '7' &&
+		    r[2] >= '0' && r[2] <= '7' &&
+		    r[3] >= '0' && r[3] <= '7') {
+			*w = (char) ((r[1] - '0') << 6 | (r[2] - '0') << 3 | (r[3] - '0'));
+			r += 3;
+		} else {
+			*w = *r;
+		}
+	}
+	*w = '\0';
+}
+
+static gboolean
+mount_options_read_only (const char *options)
+{
+	char **opts;
+	gboolean ret;
+	int i;
+
+	ret = FALSE;
+	opts = g_strsplit (options, ",", 0);
+	for (i = 0; opts[i] != NULL; i++) {
+		if (strcmp (opts[i], MNTOPT_RO) == 0) {
+			ret = TRUE;
+			break;
+		}
+	}
+	g_strfreev (opts);
+	return ret;
+}
+
+/* Read /proc/self/mountinfo, which has the device number of every mount
+ * so the sources need no stat(); NULL if not available (before 2.6.26) */
+static GHashTable *
+mount_table_read_mountinfo (void)
 {
+	GHashTable *table;
+	FILE *f;
+	char line[4096];
+
+	if ((f = fopen ("/proc/self/mountinfo", "r")) == NULL)
+		return NULL;
+
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, mount_entry_free);
+
+	/* 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue */
+	while (fgets (line, sizeof (line), f) != NULL) {
+		char **fields;
+		unsigned int majornum;
+		unsigned int minornum;
+		gboolean read_only;
+		dev_t devt;
+		int sep;
+		int n;
+
+		g_strchomp (line);
+		fields = g_strsplit (line, " ", 0);
+		n = g_strv_length (fields);
+
+		/* optional fields end with a single "-" */
+		for (sep = 6; sep < n; sep++) {
+			if (strcmp (fields[sep], "-") == 0)
+				break;
+		}
+		if (sep + 2 >= n ||
+		    sscanf (fields[2], "%u:%u", &majornum, &minornum) != 2)
+			goto next;
+
+		mountinfo_unescape (fields[4]);
+		mountinfo_unescape (fields[sep + 2]);
+
+		read_only = mount_options_read_only (fields[5]) ||
+			(sep + 3 < n && mount_options_read_only (fields[sep + 3]));
+
+		devt = makedev (majornum, minornum);
+		if (majornum == 0) {
+			/* e.g. btrfs has anonymous device numbers; look at the
+			 * source like for /proc/mounts */
+			if (!mount_source_get_devt (fields[sep + 2], fields[4], fields[sep + 1], &devt))
+				goto next;
+		} else if (fields[sep + 2][0] != '/') {
+			/* skip plain names, we look for device nodes */
+			goto next;
+		}
+
+		mount_table_add (table, devt, fields[sep + 2], fields[4], read_only);
+	next:
+		g_strfreev (fields);
+	}
+
+	fclose (f);
+	return table;
+}
+
+static GHashTable *
+mount_table_read_mounts (void)
+{
+	GHashTable *table;
 	FILE *f;
 	struct mntent mnt;
 	char buf[1024];
-	GSList *volumes = NULL;
-	GSList *volume;
 
 	/* open /proc/mounts */
 	g_snprintf (buf, sizeof (buf), "%s/mounts", "/proc");
-	if ((f = setmntent (buf, "r")) == NULL) {
-		HAL_ERROR (("Could not open /proc/mounts"));
-		return;
-	}
+	if ((f = setmntent (buf, "r")) == NULL)
+		return NULL;
 
-	if (d)
-		volumes = g_slist_append (NULL, d);
-	else
-		volumes = hal_device_store_match_multiple_key_value_string (hald_get_gdl (), "info.category", "volume");
-
-	if (!volumes)
-		goto exit;
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, mount_entry_free);
 
 	/* loop over /proc/mounts */
 	while (getmntent_r (f, &mnt, buf, sizeof(buf)) != NULL) {
-		struct stat statbuf;
 		dev_t devt;
 
-		/* HAL_INFO ((" * /proc/mounts contain dev %s - type %s", mnt.mnt_fsname, mnt.mnt_type)); */
-
-		/* We don't handle nfs mounts in HAL and stat() on mountpoints,
-		 * and we would block on 'stale nfs handle'.
-		 */
-		if (strcmp(mnt.mnt_type, "nfs") == 0)
+		if (!mount_source_get_devt (mnt.mnt_fsname, mnt.mnt_dir, mnt.mnt_type, &devt))
 			continue;
 
-		/* skip plain names, we look for device nodes */
-		if (mnt.mnt_fsname[0] != '/')
-			continue;
+		mount_table_add (table, devt, mnt.mnt_fsname, mnt.mnt_dir,
+				 hasmntopt (&mnt, MNTOPT_RO) ? TRUE : FALSE);
+	}
 
-		/*
-		 * We can't just stat() the mountpoint, because it breaks all sorts
-		 * non-disk filesystems. So assume, that the names in /proc/mounts
-		 * are existing device-files used to mount the filesystem.
-		 */
-		devt = makedev(0, 0);
-		if (stat (mnt.mnt_fsname, &statbuf) == 0) {
-			/* not a device node */
-			if (major (statbuf.st_rdev) == 0)
-				continue;
-
-			/* found major/minor */
-			devt = statbuf.st_rdev;
-		} else {
-			/* The root filesystem may be mounted by a device name that doesn't
-			 * exist in the real root, like /dev/root, which the kernel uses
-			 * internally, when no initramfs image is used. For "/", it is safe
-			 * to get the major/minor by stat()'ing the mount-point.
-			 */
-			if (strcmp (mnt.mnt_dir, "/") == 0 && stat ("/", &statbuf) == 0)
-				devt = statbuf.st_dev;
+	endmntent (f);
+	return table;
+}
 
-			/* DING DING DING... the device-node may not exist, or is
-			 * already deleted, but the device may be still mounted.
-			 *
-			 * We will fall back to looking up the device-name, instead
-			 * of using major/minor.
-		 	 */
-		}
+static GHashTable *
+mount_table_read (void)
+{
+	GHashTable *table;
 
-		/* HAL_INFO (("* found mounts dev %s (%i:%i)", mnt.mnt_fsname,
-			   major (devt), minor (devt))); */
+	table = mount_table_read_mountinfo ();
+	if (table == NULL)
+		table = mount_table_read_mounts ();
+	return table;
+}
 
-		for (volume = volumes; volume != NULL; volume = g_slist_next (volume)) {
-			HalDevice *dev;
-			gboolean is_match;
+/* Keys a volume can be found under in a mount table; free with g_free() */
+static char *
+volume_get_devt_key (HalDevice *d)
+{
+	int majornum;
 
-			is_match = FALSE;
-			dev = HAL_DEVICE (volume->data);
+	majornum = hal_device_property_get_int (d, "block.major");
+	if (majornum == 0)
+		return NULL;
+	return g_strdup_printf ("dev:%u:%u", majornum, hal_device_property_get_int (d, "block.minor"));
+}
 
-			/* lookup dev_t or devname of known hal devices */
-			if (major (devt) == 0) {
-				const char *device_name;
+static char *
+volume_get_name_key (HalDevice *d)
+{
+	const char *device_name;
 
-				device_name = hal_device_property_get_string (dev, "block.device");
-				if (device_name == NULL)
-					continue;
+	device_name = hal_device_property_get_string (d, "block.device");
+	if (device_name == NULL)
+		return NULL;
+	return g_strdup_printf ("name:%s", device_name);
+}
 
-				if (strcmp (device_name, mnt.mnt_fsname) == 0)
-					is_match = TRUE;
-			} else {
-				unsigned int majornum;
-				unsigned int minornum;
+static MountEntry *
+mount_table_lookup_volume (GHashTable *table, HalDevice *d)
+{
+	MountEntry *by_devt;
+	MountEntry *by_name;
+	char *key;
 
-				majornum = hal_device_property_get_int (dev, "block.major");
-				if (majornum == 0)
-					continue;
-				minornum = hal_device_property_get_int (dev, "block.minor");
-				/* HAL_INFO (("  match %s (%i:%i)", hal_device_get_udi (dev), majornum, minornum)); */
+	by_devt = NULL;
+	by_name = NULL;
 
-				if (majornum == major (devt) && minornum == minor (devt))
-					is_match = TRUE;
-			}
+	if ((key = volume_get_devt_key (d)) != NULL) {
+		by_devt = g_hash_table_lookup (table, key);
+		g_free (key);
+	}
+	if ((key = volume_get_name_key (d)) != NULL) {
+		by_name = g_hash_table_lookup (table, key);
+		g_free (key);
+	}
 
-			if (is_match) {
-				/* found entry for this device in /proc/mounts */
-				device_property_atomic_update_begin ();
-				hal_device_property_set_bool (dev, "volume.is_mounted", TRUE);
-				hal_device_property_set_bool (dev, "volume.is_mounted_read_only",
-							      hasmntopt (&mnt, MNTOPT_RO) ? TRUE : FALSE);
-				hal_device_property_set_string (dev, "volume.mount_point", mnt.mnt_dir);
-				device_property_atomic_update_end ();
-				/* HAL_INFO (("  set %s to be mounted at %s (%s)", hal_device_get_udi (dev),
-					   mnt.mnt_dir, hasmntopt (&mnt, MNTOPT_RO) ? "ro" : "rw")); */
-				volumes = g_slist_delete_link (volumes, volume);
-				break;
-			}
+	/* the first mount in the table wins */
+	if (by_devt == NULL || (by_name != NULL && by_name->seq < by_devt->seq))
+		return by_name;
+	return by_devt;
+}
+
+static void
+refresh_volume_mount_state (HalDevice *dev, GHashTable *table)
+{
+	MountEntry *entry;
+
+	entry = mount_table_lookup_volume (table, dev);
+	if (entry != NULL) {
+		/* found entry for this device in /proc/mounts */
+		device_property_atomic_update_begin ();
+		hal_device_property_set_bool (dev, "volume.is_mounted", TRUE);
+		hal_device_property_set_bool (dev, "volume.is_mounted_read_only", entry->read_only);
+		hal_device_property_set_string (dev, "volume.mount_point", entry->mount_point);
+		device_property_atomic_update_end ();
+		/* HAL_INFO (("  set %s to be mounted at %s (%s)", hal_device_get_udi (dev),
+			   entry->mount_point, entry->read_only ? "ro" : "rw")); */
+		return;
+	}
+
+	/* do nothing if we have a Unmount() method running on the object. This is
+	 * is because on Linux /proc/mounts is changed immediately while umount(8)
+	 * doesn't return until the block cache is flushed. Note that when Unmount()
+	 * terminates we'll be checking /proc/mounts again so this event is not
+	 * lost... it is merely delayed...
+	 */
+	if (device_is_executing_method (dev, "org.freedesktop.Hal.Device.Volume", "Unmount")) {
+		HAL_INFO (("/proc/mounts tells that %s is unmounted - waiting for Unmount() to complete to change mount state", hal_device_get_udi (dev)));
+	} else {
+		char *mount_point;
+
+		mount_point = g_strdup (hal_device_property_get_string (dev, "volume.mount_point"));
+		device_property_atomic_update_begin ();
+		hal_device_property_set_bool (dev, "volume.is_mounted", FALSE);
+		hal_device_property_set_bool (dev, "volume.is_mounted_read_only", FALSE);
+		hal_device_property_set_string (dev, "volume.mount_point", "");
+		device_property_atomic_update_end ();
+		/*HAL_INFO (("set %s to unmounted", hal_device_get_udi (dev)));*/
+		
+		if (mount_point != NULL && strlen (mount_point) > 0 && 
+		    hal_util_is_mounted_by_hald (mount_point)) {
+			char *cleanup_stdin;
+			char *extra_env[2];
+			
+			HAL_INFO (("Cleaning up directory '%s' since it was created by HAL's Mount()", mount_point));
+			
+			extra_env[0] = g_strdup_printf ("HALD_CLEANUP=%s", mount_point);
+			extra_env[1] = NULL;
+			cleanup_stdin = "\n";
+			
+			hald_runner_run_method (dev, 
+						"hal-storage-cleanup-mountpoint", 
+						extra_env, 
+						cleanup_stdin, TRUE,
+						0,
+						cleanup_mountpoint_cb,
+						g_strdup (mount_point), NULL);
 		}
+
+		g_free (mount_point);
 	}
+}
 
-	/* all remaining volumes are not mounted */
-	for (volume = volumes; volume != NULL; volume = g_slist_next (volume)) {
-		HalDevice *dev;
+typedef struct {
+	GHashTable *other;
+	GSList *changed;
+} MountTableDiff;
 
-		dev = HAL_DEVICE (volume->data);
-		/* do nothing if we have a Unmount() method running on the object. This is
-		 * is because on Linux /proc/mounts is changed immediately while umount(8)
-		 * doesn't return until the block cache is flushed. Note that when Unmount()
-		 * terminates we'll be checking /proc/mounts again so this event is not
-		 * lost... it is merely delayed...
-		 */
-		if (device_is_executing_method (dev, "org.freedesktop.Hal.Device.Volume", "Unmount")) {
-			HAL_INFO (("/proc/mounts tells that %s is unmounted - waiting for Unmount() to complete to change mount state", hal_device_get_udi (dev)));
-		} else {
-			char *mount_point;
-
-			mount_point = g_strdup (hal_device_property_get_string (dev, "volume.mount_point"));
-			device_property_atomic_update_begin ();
-			hal_device_property_set_bool (dev, "volume.is_mounted", FALSE);
-			hal_device_property_set_bool (dev, "volume.is_mounted_read_only", FALSE);
-			hal_device_property_set_string (dev, "volume.mount_point", "");
-			device_property_atomic_update_end ();
-			/*HAL_INFO (("set %s to unmounted", hal_device_get_udi (dev)));*/
-			
-			if (mount_point != NULL && strlen (mount_point) > 0 && 
-			    hal_util_is_mounted_by_hald (mount_point)) {
-				char *cleanup_stdin;
-				char *extra_env[2];
-				
-				HAL_INFO (("Cleaning up directory '%s' since it was created by HAL's Mount()", mount_point));
-				
-				extra_env[0] = g_strdup_printf ("HALD_CLEANUP=%s", mount_point);
-				extra_env[1] = NULL;
-				cleanup_stdin = "\n";
-				
-				hald_runner_run_method (dev, 
-							"hal-storage-cleanup-mountpoint", 
-							extra_env, 
-							cleanup_stdin, TRUE,
-							0,
-							cleanup_mountpoint_cb,
-							g_strdup (mount_point), NULL);
-			}
+static void
+mount_table_diff_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	MountTableDiff *diff = (MountTableDiff *) user_data;
+	MountEntry *other;
 
-			g_free (mount_point);
-		}
+	other = g_hash_table_lookup (diff->other, key);
+	if (other == NULL || !mount_entry_equal (value, other))
+		diff->changed = g_slist_prepend (diff->changed, key);
+}
+
+static void
+volume_index_add (GHashTable *index, HalDevice *d)
+{
+	char *key;
+
+	if ((key = volume_get_devt_key (d)) != NULL)
+		g_hash_table_insert (index, key, d);
+	if ((key = volume_get_name_key (d)) != NULL)
+		g_hash_table_insert (index, key, d);
+}
+
+/**
+ * blockdev_refresh_mount_state:
+ * @d: volume to update, or NULL for all volumes
+ *
+ * Updates volume.is_mounted and friends from the mount table. For all
+ * volumes only those are touched whose entries changed since the last
+ * call, found through an index on their device number and name.
+ */
+void
+blockdev_refresh_mount_state (HalDevice *d)
+{
+	GHashTable *table;
+	GSList *volumes;
+	GSList *volume;
 
+	table = mount_table_read ();
+	if (table == NULL) {
+		HAL_ERROR (("Could not open /proc/mounts"));
+		return;
 	}
+
+	/* the stored table stays what all other volumes were updated for */
+	if (d != NULL) {
+		refresh_volume_mount_state (d, table);
+		g_hash_table_destroy (table);
+		return;
+	}
+
+	volumes = hal_device_store_match_multiple_key_value_string (hald_get_gdl (), "info.category", "volume");
+
+	if (mount_table == NULL) {
+		for (volume = volumes; volume != NULL; volume = g_slist_next (volume))
+			refresh_volume_mount_state (HAL_DEVICE (volume->data), table);
+	} else {
+		MountTableDiff diff;
+		GSList *i;
+
+		/* entries added or changed, then entries removed */
+		diff.changed = NULL;
+		diff.other = mount_table;
+		g_hash_table_foreach (table, mount_table_diff_foreach, &diff);
+		diff.other = table;
+		g_hash_table_foreach (mount_table, mount_table_diff_foreach, &diff);
+
+		if (diff.changed != NULL && volumes != NULL) {
+			GHashTable *index;
+			GHashTable *done;
+
+			index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+			for (volume = volumes; volume != NULL; volume = g_slist_next (volume))
+				volume_index_add (index, HAL_DEVICE (volume->data));
+
+			done = g_hash_table_new (g_direct_hash, g_direct_equal);
+			for (i = diff.changed; i != NULL; i = g_slist_next (i)) {
+				HalDevice *dev;
+
+				dev = g_hash_table_lookup (index, i->data);
+				if (dev == NULL || g_hash_table_lookup (done, dev) != NULL)
+					continue;
+				g_hash_table_insert (done, dev, dev);
+				refresh_volume_mount_state (dev, table);
+			}
+			g_hash_table_destroy (done);
+			g_hash_table_destroy (index);
+		}
+		g_slist_free (diff.changed);
+	}
+
 	g_slist_free (volumes);
-exit:
-	endmntent (f);
+
+	if (mount_table != NULL)
+		g_hash_table_destroy (mount_table);
+	mount_table = table;
 }
 
 static void
@@ -387,15 +671,15 @@ generate_fakevolume_hotplug_event_add_for_storage_device (HalDevice *d)
 
 	snprintf (fake_sysfs_path, sizeof(fake_sysfs_path), "%s/fakevolume", sysfs_path);
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS_BLOCK;
-	g_strlcpy (hotplug_event->sysfs.subsystem, "block", sizeof (hotplug_event->sysfs.subsystem));
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, fake_sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
+	hotplug_event->sysfs.subsystem = g_intern_string ("block");
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, fake_sysfs_path);
 	if (device_file != NULL)
-		g_strlcpy (hotplug_event->sysfs.device_file, device_file, sizeof (hotplug_event->sysfs.device_file));
+		hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, device_file);
 	else
-		hotplug_event->sysfs.device_file[0] = '\0';
+		hotplug_event->sysfs.device_file = "";
 	hotplug_event->sysfs.net_ifindex = -1;
 
 	hotplug_event_enqueue (hotplug_event);
@@ -413,6 +697,8 @@ add_blockdev_probing_helper_done (HalDevice *d, guint32 exit_type,
 
 	HAL_INFO (("entering; exit_type=%d, return_code=%d", exit_type, return_code));
 
+	hald_startup_timing_end (HALD_STARTUP_PHASE_PROBE, end_token);
+
 	if (d == NULL) {
 		HAL_INFO (("Device object already removed"));
 		hotplug_event_end (end_token);
@@ -503,6 +789,7 @@ blockdev_callouts_preprobing_storage_done (HalDevice *d, gpointer userdata1, gpo
 			HAL_INFO (("Probing PC floppy %s to see if it is present", 
 				   hal_device_property_get_string (d, "block.device")));
 
+			hald_startup_timing_begin (HALD_STARTUP_PHASE_PROBE, end_token);
 			hald_runner_run(d, 
 			                    "hald-probe-pc-floppy", NULL,
 			                    HAL_HELPER_TIMEOUT,
@@ -529,6 +816,7 @@ blockdev_callouts_preprobing_storage_done (HalDevice *d, gpointer userdata1, gpo
 	HAL_INFO (("Probing storage device %s", hal_device_property_get_string (d, "block.device")));
 
 	/* probe the device */
+	hald_startup_timing_begin (HALD_STARTUP_PHASE_PROBE, end_token);
 	hald_runner_run(d,
 			"hald-probe-storage", NULL,
 			HAL_HELPER_TIMEOUT,
@@ -564,6 +852,7 @@ blockdev_callouts_preprobing_volume_done (HalDevice *d, gpointer userdata1, gpoi
 	}
 
 	/* probe the device */
+	hald_startup_timing_begin (HALD_STARTUP_PHASE_PROBE, end_token);
 	hald_runner_run (d,
 			 "hald-probe-volume", NULL, 
 			 HAL_HELPER_TIMEOUT,
@@ -1732,13 +2021,35 @@ out:
 }
 
 void 
-hotplug_event_refresh_blockdev (gchar *sysfs_path, HalDevice *d, void *end_token)
+hotplug_event_refresh_blockdev (const gchar *sysfs_path, HalDevice *d, void *end_token)
 {
+	HotplugEvent *hotplug_event = (HotplugEvent *) end_token;
+
 	HAL_INFO (("block_change: sysfs_path=%s", sysfs_path));
 
-        if (hal_device_property_get_bool (d, "storage.removable.support_async_notification")) {
-                blockdev_rescan_device (d);
-        }
+	/* the partition table may have been rewritten; drop the copy hald-probe-storage
+	 * left for hald-probe-volume so partitions are probed against the disk again */
+	if (!hal_device_property_get_bool (d, "block.is_volume"))
+		hal_device_property_remove (d, "linux.partition_table");
+
+	/* Media change and eject request uevents are passed on to
+	 * hald-addon-storage, which handles them like a poll that saw the
+	 * media change; drives that send them aren't polled continuously.
+	 * Drives with async notification (the kernel didn't tag these
+	 * events before 2.6.38) count every change event.
+	 */
+	if (hal_device_property_get_bool (d, "storage.removable")) {
+		if (hotplug_event->sysfs.eject_request) {
+			HAL_INFO (("Eject request for %s", sysfs_path));
+			device_send_signal_condition (d, "EjectPressed", "");
+		}
+
+		if (hotplug_event->sysfs.media_change ||
+		    hal_device_property_get_bool (d, "storage.removable.support_async_notification")) {
+			HAL_INFO (("Media change for %s", sysfs_path));
+			hal_device_property_set_uint64 (d, "linux.media_change_time", hotplug_event->sysfs.received);
+		}
+	}
 
 	/* done with change event */
 	hotplug_event_end (end_token);
@@ -1841,17 +2152,17 @@ blockdev_generate_add_hotplug_event (HalDevice *d)
 	serial      = hal_device_property_get_string (d, "storage.serial");
 	revision    = hal_device_property_get_string (d, "storage.firmware_revision");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS;
-	g_strlcpy (hotplug_event->sysfs.subsystem, "block", sizeof (hotplug_event->sysfs.subsystem));
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
+	hotplug_event->sysfs.subsystem = g_intern_string ("block");
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
 
-	g_strlcpy (hotplug_event->sysfs.device_file, device_file != NULL ? device_file : nul, HAL_NAME_MAX);
-	g_strlcpy (hotplug_event->sysfs.vendor,           vendor != NULL ?      vendor : nul, HAL_NAME_MAX);
-	g_strlcpy (hotplug_event->sysfs.model,             model != NULL ?       model : nul, HAL_NAME_MAX);
-	g_strlcpy (hotplug_event->sysfs.serial,           serial != NULL ?      serial : nul, HAL_NAME_MAX);
-	g_strlcpy (hotplug_event->sysfs.revision,       revision != NULL ?    revision : nul, HAL_NAME_MAX);
+	hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, device_file != NULL ? device_file : nul);
+	hotplug_event->sysfs.vendor      = g_intern_string (vendor != NULL ? vendor : nul);
+	hotplug_event->sysfs.model       = g_intern_string (model != NULL ? model : nul);
+	hotplug_event->sysfs.serial      = hotplug_event_strdup (hotplug_event, serial != NULL ? serial : nul);
+	hotplug_event->sysfs.revision    = g_intern_string (revision != NULL ? revision : nul);
 
 	hotplug_event->sysfs.net_ifindex = -1;
 
@@ -1866,12 +2177,12 @@ blockdev_generate_remove_hotplug_event (HalDevice *d)
 
 	sysfs_path = hal_device_property_get_string (d, "linux.sysfs_path");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_REMOVE;
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS;
-	g_strlcpy (hotplug_event->sysfs.subsystem, "block", sizeof (hotplug_event->sysfs.subsystem));
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
-	hotplug_event->sysfs.device_file[0] = '\0';
+	hotplug_event->sysfs.subsystem = g_intern_string ("block");
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
+	hotplug_event->sysfs.device_file = "";
 	hotplug_event->sysfs.net_ifindex = -1;
 
 	return hotplug_event;
@@ -1997,12 +2308,12 @@ blockdev_process_mdstat (void)
                         } else {
                                 HAL_INFO (("Adding md device at '%s' ('%s')", sysfs_path, device_file));
 
-                                hotplug_event = g_slice_new0 (HotplugEvent);
+                                hotplug_event = hotplug_event_new ();
                                 hotplug_event->action = HOTPLUG_ACTION_ADD;
                                 hotplug_event->type = HOTPLUG_EVENT_SYSFS_BLOCK;
-                                g_strlcpy (hotplug_event->sysfs.subsystem, "block", sizeof (hotplug_event->sysfs.subsystem));
-                                g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
-                                g_strlcpy (hotplug_event->sysfs.device_file, device_file, sizeof (hotplug_event->sysfs.device_file));
+                                hotplug_event->sysfs.subsystem = g_intern_string ("block");
+                                hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
+                                hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, device_file);
                                 hotplug_event->sysfs.net_ifindex = -1;
                                 hotplug_event_enqueue (hotplug_event);
                                 
@@ -2050,12 +2361,12 @@ blockdev_process_mdstat (void)
                                 
                                 HAL_INFO (("Removing md device at '%s' ('%s')", sysfs_path, device_file));
 
-                                hotplug_event = g_slice_new0 (HotplugEvent);
+                                hotplug_event = hotplug_event_new ();
                                 hotplug_event->action = HOTPLUG_ACTION_REMOVE;
                                 hotplug_event->type = HOTPLUG_EVENT_SYSFS_BLOCK;
-                                g_strlcpy (hotplug_event->sysfs.subsystem, "block", sizeof (hotplug_event->sysfs.subsystem));
-                                g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
-                                g_strlcpy (hotplug_event->sysfs.device_file, device_file, sizeof (hotplug_event->sysfs.device_file));
+                                hotplug_event->sysfs.subsystem = g_intern_string ("block");
+                                hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
+                                hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, device_file);
                                 hotplug_event->sysfs.net_ifindex = -1;
                                 hotplug_event_enqueue (hotplug_event);
                                 
@@ -87,15 +87,14 @@ udev_info_to_hotplug_event (const UdevInfo *info)
 	HotplugEvent *hotplug_event;
 	gchar *str;
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, "/sys", sizeof(hotplug_event->sysfs.sysfs_path));
-	g_strlcat (hotplug_event->sysfs.sysfs_path, info->sysfs_path, sizeof(hotplug_event->sysfs.sysfs_path));
+	hotplug_event = hotplug_event_new ();
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup_printf (hotplug_event, "/sys%s", info->sysfs_path);
 
 	HAL_INFO(("creating HotplugEvent for %s", hotplug_event->sysfs.sysfs_path));
 
 	if (info->device_file) {
-		g_snprintf (hotplug_event->sysfs.device_file, sizeof(hotplug_event->sysfs.device_file),
-			"%s/%s", dev_root, info->device_file);
+		hotplug_event->sysfs.device_file = hotplug_event_strdup_printf (hotplug_event, "%s/%s",
+									       dev_root, info->device_file);
 		HAL_INFO(("with device file %s", hotplug_event->sysfs.device_file));
 		if (strstr(hotplug_event->sysfs.device_file, "/" DMPREFIX) != NULL) {
 			HAL_INFO (("Found a dm-device (%s) , mark it", hotplug_event->sysfs.device_file));
@@ -103,47 +102,47 @@ udev_info_to_hotplug_event (const UdevInfo *info)
 		}
 	}
 	if ((str = hal_util_strdup_valid_utf8(info->vendor)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.vendor, str, sizeof(hotplug_event->sysfs.vendor));
+		hotplug_event->sysfs.vendor = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->model)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.model, str, sizeof(hotplug_event->sysfs.model));
+		hotplug_event->sysfs.model = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->revision)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.revision, str, sizeof(hotplug_event->sysfs.revision));
+		hotplug_event->sysfs.revision = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->serial)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.serial, str, sizeof(hotplug_event->sysfs.serial));
+		hotplug_event->sysfs.serial = hotplug_event_strdup (hotplug_event, str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->fsusage)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.fsusage, str, sizeof(hotplug_event->sysfs.fsusage));
+		hotplug_event->sysfs.fsusage = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->fstype)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.fstype, str, sizeof(hotplug_event->sysfs.fstype));
+		hotplug_event->sysfs.fstype = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->fsversion)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.fsversion, str, sizeof(hotplug_event->sysfs.fsversion));
+		hotplug_event->sysfs.fsversion = g_intern_string (str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->fsuuid)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.fsuuid, str, sizeof(hotplug_event->sysfs.fsuuid));
+		hotplug_event->sysfs.fsuuid = hotplug_event_strdup (hotplug_event, str);
 		g_free (str);
 	}
 
 	if ((str = hal_util_strdup_valid_utf8(info->fslabel)) != NULL) {
-		g_strlcpy (hotplug_event->sysfs.fslabel, str, sizeof(hotplug_event->sysfs.fslabel));
+		hotplug_event->sysfs.fslabel = hotplug_event_strdup (hotplug_event, str);
 		g_free (str);
 	}
 
@@ -284,10 +283,10 @@ static HotplugEvent
 		hotplug_event = udev_info_to_hotplug_event (info);
 		HAL_INFO (("new event (dev node from udev) '%s' '%s'", hotplug_event->sysfs.sysfs_path, hotplug_event->sysfs.device_file));
 	} else {
-		hotplug_event = g_slice_new0 (HotplugEvent);
+		hotplug_event = hotplug_event_new ();
 
 		/* device is not in udev database */
-		g_strlcpy(hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof(hotplug_event->sysfs.sysfs_path));
+		hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
 
 		/* look if a device node is expected */
 		g_strlcpy(path, sysfs_path, sizeof(path));
@@ -307,7 +306,7 @@ static HotplugEvent
 			goto no_node;
 
 		HAL_INFO (("new event (dev node from kernel name) '%s' '%s'", sysfs_path, path));
-		g_strlcpy(hotplug_event->sysfs.device_file, path, sizeof(hotplug_event->sysfs.device_file));
+		hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, path);
 		if (strstr(hotplug_event->sysfs.device_file, "/" DMPREFIX) != NULL) {
 			HAL_INFO (("Found a dm-device (%s) , mark it", hotplug_event->sysfs.device_file));
 			hotplug_event->sysfs.is_dm_device = TRUE;
@@ -317,7 +316,7 @@ static HotplugEvent
 no_node:
 	if (hotplug_event->sysfs.device_file[0] == '\0')
 		HAL_INFO (("new event (no dev node) '%s'", sysfs_path));
-	g_strlcpy (hotplug_event->sysfs.subsystem, subsystem, sizeof (hotplug_event->sysfs.subsystem));
+	hotplug_event->sysfs.subsystem = g_intern_string (subsystem);
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = type;
 	hotplug_event->sysfs.net_ifindex = -1;
@@ -579,6 +578,10 @@ coldplug_synthesize_events (void)
 {
 	struct stat statbuf;
 
+	/* time spent reading the udev database and scanning sysfs; the
+	 * events themselves are accounted to the later phases */
+	hald_startup_timing_begin (HALD_STARTUP_PHASE_SCAN, NULL);
+
 	if (hal_util_init_sysfs_to_udev_map () == FALSE) {
 		HAL_ERROR (("Unable to get sysfs to dev map"));
 		goto error;
@@ -588,21 +591,27 @@ coldplug_synthesize_events (void)
 	if (stat("/sys/subsystem", &statbuf) == 0) {
 		scan_subsystem ("subsystem");
 		device_list = g_slist_sort (device_list, _device_order);
+		hald_startup_timing_end (HALD_STARTUP_PHASE_SCAN, NULL);
 		process_coldplug_events ();
 	} else {
 		scan_subsystem ("bus");
 		device_list = g_slist_sort (device_list, _device_order);
+		hald_startup_timing_end (HALD_STARTUP_PHASE_SCAN, NULL);
 		process_coldplug_events ();
 
+		hald_startup_timing_begin (HALD_STARTUP_PHASE_SCAN, NULL);
 		scan_class ();
                 scan_single_bus ("bluetooth");
 		device_list = g_slist_sort (device_list, _device_order);
+		hald_startup_timing_end (HALD_STARTUP_PHASE_SCAN, NULL);
 		process_coldplug_events ();
 
 		/* scan /sys/block, if it isn't already a class */
 		if (stat("/sys/class/block", &statbuf) != 0) {
+			hald_startup_timing_begin (HALD_STARTUP_PHASE_SCAN, NULL);
 			scan_block ();
 			device_list = g_slist_sort (device_list, _device_order);
+			hald_startup_timing_end (HALD_STARTUP_PHASE_SCAN, NULL);
 			process_coldplug_events ();
 		}
 
@@ -615,5 +624,6 @@ coldplug_synthesize_events (void)
 	return TRUE;
 
 error:
+	hald_startup_timing_end (HALD_STARTUP_PHASE_SCAN, NULL);
 	return FALSE;
 }
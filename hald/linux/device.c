@@ -3060,24 +3060,18 @@ missing_scsi_host (const gchar *sysfs_path, HotplugEvent *device_event, HotplugA
 	{
 		GSList *siblings;
 
-		siblings = hal_device_store_match_multiple_key_value_string (hald_get_gdl(),
-									     "info.parent",
-									     hal_device_get_udi(d));
+		siblings = hal_device_store_get_children (hald_get_gdl(), hal_device_get_udi(d));
 		if (siblings && g_slist_next(siblings) != NULL)
-		{
-			g_slist_free(siblings);
 			goto out;
-		}
-		g_slist_free(siblings);
 	}
 
 	/* fake host event */
 	rc = TRUE;
-	host_event = g_slice_new0 (HotplugEvent);
+	host_event = hotplug_event_new ();
 	host_event->action = action;
 	host_event->type = HOTPLUG_EVENT_SYSFS_DEVICE;
-	g_strlcpy (host_event->sysfs.subsystem, "scsi_host", sizeof (host_event->sysfs.subsystem));
-	g_strlcpy (host_event->sysfs.sysfs_path, path, sizeof (host_event->sysfs.sysfs_path));
+	host_event->sysfs.subsystem = g_intern_string ("scsi_host");
+	host_event->sysfs.sysfs_path = hotplug_event_strdup (host_event, path);
 	host_event->sysfs.net_ifindex = -1;
 
 	/* insert host before our event, so we can see it as parent */
@@ -4927,6 +4921,8 @@ add_dev_probing_helper_done (HalDevice *d, guint32 exit_type,
 
 	HAL_INFO (("entering; exit_type=%d, return_code=%d", exit_type, return_code));
 
+	hald_startup_timing_end (HALD_STARTUP_PHASE_PROBE, end_token);
+
 	if (d == NULL) {
 		HAL_INFO (("Device object already removed"));
 		hotplug_event_end (end_token);
@@ -4989,6 +4985,7 @@ dev_callouts_preprobing_done (HalDevice *d, gpointer userdata1, gpointer userdat
 		prober = NULL;
 	if (prober != NULL) {
 		/* probe the device */
+		hald_startup_timing_begin (HALD_STARTUP_PHASE_PROBE, end_token);
 		hald_runner_run(d, 
 		                    prober, NULL, 
 		                    HAL_HELPER_TIMEOUT, 
@@ -5206,15 +5203,15 @@ dev_generate_add_hotplug_event (HalDevice *d)
 	sysfs_path = hal_device_property_get_string (d, "linux.sysfs_path");
 	device_file = hal_device_property_get_string (d, "linux.device_file");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS;
-	g_strlcpy (hotplug_event->sysfs.subsystem, subsystem, sizeof (hotplug_event->sysfs.subsystem));
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
+	hotplug_event->sysfs.subsystem = g_intern_string (subsystem);
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
 	if (device_file != NULL)
-		g_strlcpy (hotplug_event->sysfs.device_file, device_file, sizeof (hotplug_event->sysfs.device_file));
+		hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, device_file);
 	else
-		hotplug_event->sysfs.device_file[0] = '\0';
+		hotplug_event->sysfs.device_file = "";
 	hotplug_event->sysfs.net_ifindex = -1;
 
 	return hotplug_event;
@@ -5231,12 +5228,12 @@ dev_generate_remove_hotplug_event (HalDevice *d)
 	subsystem = hal_device_property_get_string (d, "linux.subsystem");
 	sysfs_path = hal_device_property_get_string (d, "linux.sysfs_path");
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_REMOVE;
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS;
-	g_strlcpy (hotplug_event->sysfs.subsystem, subsystem, sizeof (hotplug_event->sysfs.subsystem));
-	g_strlcpy (hotplug_event->sysfs.sysfs_path, sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path));
-	hotplug_event->sysfs.device_file[0] = '\0';
+	hotplug_event->sysfs.subsystem = g_intern_string (subsystem);
+	hotplug_event->sysfs.sysfs_path = hotplug_event_strdup (hotplug_event, sysfs_path);
+	hotplug_event->sysfs.device_file = "";
 	hotplug_event->sysfs.net_ifindex = -1;
 
 	return hotplug_event;
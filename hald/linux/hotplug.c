@@ -28,6 +28,7 @@
 #endif
 
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
@@ -48,6 +49,7 @@
 #include "pmu.h"
 
 #include "hotplug.h"
+#include "hotplug_queue.h"
 
 /** Queue of ordered hotplug events */
 static GQueue *hotplug_event_queue = NULL;
@@ -55,17 +57,84 @@ static GQueue *hotplug_event_queue = NULL;
 /* Flag indicating if the queue should be reprocessed from the start */
 static gboolean hotplug_event_queue_restart = FALSE;
 
-/** List of HotplugEvent objects we are currently processing */
-static GList *hotplug_events_in_progress = NULL;
+
+/* Initial size of the per-event string chunk; enough for a typical
+ * sysfs path and device file */
+#define HOTPLUG_EVENT_STRING_CHUNK_SIZE 256
+
+HotplugEvent *
+hotplug_event_new (void)
+{
+	HotplugEvent *hotplug_event;
+
+	hotplug_event = g_slice_new0 (HotplugEvent);
+
+	/* this also covers the acpi/apm/pmu paths sharing the union */
+	hotplug_event->sysfs.subsystem = "";
+	hotplug_event->sysfs.sysfs_path = "";
+	hotplug_event->sysfs.sysfs_path_old = "";
+	hotplug_event->sysfs.device_file = "";
+	hotplug_event->sysfs.vendor = "";
+	hotplug_event->sysfs.model = "";
+	hotplug_event->sysfs.revision = "";
+	hotplug_event->sysfs.serial = "";
+	hotplug_event->sysfs.fsusage = "";
+	hotplug_event->sysfs.fstype = "";
+	hotplug_event->sysfs.fsversion = "";
+	hotplug_event->sysfs.fslabel = "";
+	hotplug_event->sysfs.fsuuid = "";
+
+	return hotplug_event;
+}
+
+void
+hotplug_event_free (HotplugEvent *hotplug_event)
+{
+	if (hotplug_event->strings != NULL)
+		g_string_chunk_free (hotplug_event->strings);
+
+	g_slice_free (HotplugEvent, hotplug_event);
+}
+
+/** Copy a string into storage owned by the event; it is freed together
+ *  with the event. */
+const char *
+hotplug_event_strdup (HotplugEvent *hotplug_event, const char *str)
+{
+	if (str == NULL || str[0] == '\0')
+		return "";
+
+	if (hotplug_event->strings == NULL)
+		hotplug_event->strings = g_string_chunk_new (HOTPLUG_EVENT_STRING_CHUNK_SIZE);
+
+	return g_string_chunk_insert (hotplug_event->strings, str);
+}
+
+const char *
+hotplug_event_strdup_printf (HotplugEvent *hotplug_event, const char *format, ...)
+{
+	va_list args;
+	char *str;
+	const char *ret;
+
+	va_start (args, format);
+	str = g_strdup_vprintf (format, args);
+	va_end (args);
+
+	ret = hotplug_event_strdup (hotplug_event, str);
+	g_free (str);
+
+	return ret;
+}
 
 void
 hotplug_event_end (void *end_token)
 {
 	HotplugEvent *hotplug_event = (HotplugEvent *) end_token;
 
-	hotplug_events_in_progress = g_list_remove (hotplug_events_in_progress, hotplug_event);
+	hotplug_queue_untrack (hotplug_event);
 
-	g_slice_free (HotplugEvent, hotplug_event);
+	hotplug_event_free (hotplug_event);
 
 	/* An event is removed. So we need to restart from the beginning of the queue
 	 * as some events are ready to run now */
@@ -78,7 +147,10 @@ hotplug_event_reposted (void *end_token)
 	HotplugEvent *hotplug_event = (HotplugEvent *) end_token;
 
 	hotplug_event->reposted = TRUE;
-	hotplug_events_in_progress = g_list_remove (hotplug_events_in_progress, hotplug_event);
+
+	/* normally the event has been put back on the queue already */
+	if (hotplug_event->running)
+		hotplug_queue_untrack (hotplug_event);
 }
 
 static void
@@ -321,6 +393,7 @@ hotplug_event_enqueue (HotplugEvent *hotplug_event)
 		hotplug_event_queue = g_queue_new ();
 
 	g_queue_push_tail (hotplug_event_queue, hotplug_event);
+	hotplug_queue_track (hotplug_event);
 }
 
 void 
@@ -330,129 +403,13 @@ hotplug_event_enqueue_at_front (HotplugEvent *hotplug_event)
 		hotplug_event_queue = g_queue_new ();
 
 	g_queue_push_head (hotplug_event_queue, hotplug_event);
+	hotplug_queue_track (hotplug_event);
 
 	/* New event added at the start, restart processing of the queue from the
 	 * start */
 	hotplug_event_queue_restart = TRUE;
 }
 
-static gboolean
-compare_sysfspath(const char *running, const char *waiting)
-{
-	int i;
-
-	for (i = 0; i < HAL_PATH_MAX; i++) {
-		/* identical device event found */
-		if (running[i] == '\0' && waiting[i] == '\0')
-			return TRUE;
-
-		/* parent device event found */
-		if (running[i] == '\0' && waiting[i] == '/')
-			return TRUE;
-
-		/* child device event found */
-		if (running[i] == '/' && waiting[i] == '\0')
-			return TRUE;
-
-		/* no matching event */
-		if (running[i] != waiting[i])
-			break;
-	}
-
-	return FALSE;
-}
-
-/*
- * Returns TRUE if @eventl depends on @eventr
- */
-static gboolean
-compare_event (HotplugEvent *eventl, HotplugEvent *eventr)
-{
-	if (*eventl->sysfs.sysfs_path_old != '\0')
-		if (strcmp (eventr->sysfs.sysfs_path_old, eventl->sysfs.sysfs_path_old) == 0)
-			return TRUE;
-	return compare_sysfspath (eventr->sysfs.sysfs_path, eventl->sysfs.sysfs_path);
-}
-
-/*
- * Returns TRUE if @hotplug_event depends on any event in @events
- */
-static gboolean
-compare_events (HotplugEvent *hotplug_event, GList *events)
-{
-	GList *lp;
-	HotplugEvent *loop_event;
-
-	switch (hotplug_event->type) {
-
-	/* explicit fallthrough */
-	case HOTPLUG_EVENT_SYSFS:
-	case HOTPLUG_EVENT_SYSFS_DEVICE:
-	case HOTPLUG_EVENT_SYSFS_BLOCK:
-
-		for (lp = events; lp; lp = g_list_next (lp)) {
-			loop_event = (HotplugEvent*) lp->data;
-			/* skip ourselves and all later events*/
-			if (loop_event->sysfs.seqnum >= hotplug_event->sysfs.seqnum) {
-				HAL_DEBUG (("event %s: skip ourselves and all later events", hotplug_event->sysfs.sysfs_path));
-				break;
-			}
-			if (compare_event (hotplug_event, loop_event)) {
-				HAL_DEBUG (("event %s dependant on %s", hotplug_event->sysfs.sysfs_path, loop_event->sysfs.sysfs_path));
-				return TRUE;
-			} else if (hotplug_event->sysfs.is_dm_device) {
-				if ((loop_event->type == HOTPLUG_EVENT_SYSFS_BLOCK) && !loop_event->sysfs.is_dm_device) {
-					HAL_DEBUG (("event %s is dm-device, have at least one (%s) non-dm block device in queue -> held event.",
-						    hotplug_event->sysfs.sysfs_path, loop_event->sysfs.sysfs_path ));
-					return TRUE;
-				}
-			}
-		}
-		return FALSE;
-
-	default:
-		return FALSE;
-	}
-}
-
-/*
- * Returns TRUE if @hotplug_event depends on any running event in @events
- * This function checks if there is a running remove/add event for the same 
- * sysfs_path/device. (for more see fd.o#23060)
- */
-static gboolean
-compare_events_running (HotplugEvent *hotplug_event, GList *events)
-{
-	GList *lp;
-	HotplugEvent *loop_event;
-
-	switch (hotplug_event->type) {
-
-	/* explicit fallthrough */
-	case HOTPLUG_EVENT_SYSFS:
-	case HOTPLUG_EVENT_SYSFS_DEVICE:
-	case HOTPLUG_EVENT_SYSFS_BLOCK:
-
-		for (lp = events; lp; lp = g_list_next (lp)) {
-			loop_event = (HotplugEvent*) lp->data;
-			/* skip ourselves and all later events*/
-			if (!strcmp (hotplug_event->sysfs.sysfs_path, loop_event->sysfs.sysfs_path)) {
-				if (loop_event->action != hotplug_event->action) {
-					HAL_DEBUG (("there is still a event running for this device, wait!"));
-					return TRUE;
-				}
-
-			}
-		}
-		return FALSE;
-
-	default:
-		return FALSE;
-	}
-}
-
-
-
 void 
 hotplug_event_process_queue (void)
 {
@@ -479,12 +436,10 @@ hotplug_event_process_queue (void)
 		else 
 			HAL_DEBUG (("checking event %s, action: %d", hotplug_event->sysfs.sysfs_path, hotplug_event->action));
 
-		if (!compare_events (hotplug_event, hotplug_event_queue->head) && 
-		    !compare_events (hotplug_event, hotplug_events_in_progress) &&
-		    !compare_events_running (hotplug_event, hotplug_events_in_progress)) {
+		if (!hotplug_queue_is_blocked (hotplug_event)) {
 			lp2 = lp->prev;
-			g_queue_unlink(hotplug_event_queue, lp);
-			hotplug_events_in_progress = g_list_concat (hotplug_events_in_progress, lp);
+			g_queue_delete_link (hotplug_event_queue, lp);
+			hotplug_queue_set_running (hotplug_event);
 			hotplug_event_begin (hotplug_event);
 			if (lp2 == NULL || hotplug_event_queue_restart) {
 				lp = hotplug_event_queue->head;
@@ -497,11 +452,11 @@ hotplug_event_process_queue (void)
 			lp = g_list_next (lp);
 		}
 	}
-	HAL_DEBUG (("events queued = %d, events in progress = %d", hotplug_event_queue->length, g_list_length (hotplug_events_in_progress)));
+	HAL_DEBUG (("events queued = %d, events in progress = %d", hotplug_event_queue->length, hotplug_queue_get_num_running ()));
 
 	processing = FALSE;
 
-	if (hotplug_event_queue->length == 0 && g_list_length (hotplug_events_in_progress) == 0) {
+	if (hotplug_event_queue->length == 0 && hotplug_queue_get_num_running () == 0) {
 		HAL_DEBUG(("Hotplug-queue empty now ... no hotplug events in progress"));
 		hotplug_queue_now_empty ();
 	}
@@ -550,14 +505,13 @@ hotplug_reprobe_generate_remove_events (HalDevice *d)
 	HotplugEvent *e;
 
 	/* first remove childs */
-	childs = hal_device_store_match_multiple_key_value_string (hald_get_gdl (), "info.parent", hal_device_get_udi (d));
+	childs = hal_device_store_get_children (hald_get_gdl (), hal_device_get_udi (d));
 	for (i = childs; i != NULL; i = g_slist_next (i)) {
 		HalDevice *child;
 
 		child = HAL_DEVICE (i->data);
 		hotplug_reprobe_generate_remove_events (child);
 	}
-	g_slist_free (childs);
 
 	/* then remove self */
 	HAL_INFO (("Generate remove event for udi %s", hal_device_get_udi (d)));
@@ -634,14 +588,13 @@ hotplug_reprobe_generate_add_events (HalDevice *d)
 	}
 
 	/* then add childs */
-	childs = hal_device_store_match_multiple_key_value_string (hald_get_gdl (), "info.parent", hal_device_get_udi (d));
+	childs = hal_device_store_get_children (hald_get_gdl (), hal_device_get_udi (d));
 	for (i = childs; i != NULL; i = g_slist_next (i)) {
 		HalDevice *child;
 
 		child = HAL_DEVICE (i->data);
 		hotplug_reprobe_generate_add_events (child);
 	}
-	g_slist_free (childs);
 }
 
 gboolean
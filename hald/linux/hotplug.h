@@ -51,54 +51,75 @@ typedef enum {
 
 /** Data structure representing a hotplug event; also used for
  *  coldplugging.
+ *
+ *  Strings are never NULL; unset fields point to "". Values drawn from
+ *  a small vocabulary are interned with g_intern_string(), everything
+ *  else is copied into the per-event string chunk with
+ *  hotplug_event_strdup() so an event only costs what it stores.
  */
 typedef struct
 {
 	HotplugActionType action;				/* Whether the event is add or remove */
 	HotplugEventType type;					/* Type of event */
 	gboolean reposted;					/* Avoid loops */
+	gboolean running;					/* Dispatched and not yet ended */
+	gpointer queue_node;					/* Position in the dependency index; see hotplug_queue.c */
+	GStringChunk *strings;					/* Storage for the non-interned strings */
 	union {
 		struct {
-			char subsystem[HAL_NAME_MAX];		/* Kernel subsystem the device belongs to */
-			char sysfs_path[HAL_PATH_MAX];		/* Kernel device devpath */
-			char sysfs_path_old[HAL_PATH_MAX];	/* Old kernel device devpath (for 'move') */
-			char device_file[HAL_PATH_MAX];	        /* Device node for the device */
+			const char *subsystem;			/* Kernel subsystem the device belongs to (interned) */
+			const char *sysfs_path;			/* Kernel device devpath */
+			const char *sysfs_path_old;		/* Old kernel device devpath (for 'move') */
+			const char *device_file;	        /* Device node for the device */
 			unsigned long long seqnum;		/* kernel uevent sequence number */
 			int net_ifindex;			/* Kernel ifindex for network devices */
 
 			/* if the device is a Device mapper device, used to prevent multiple string compares */
 			gboolean is_dm_device;
 
+			/* set on change events of drives with removable media */
+			gboolean media_change;			/* DISK_MEDIA_CHANGE=1 */
+			gboolean eject_request;			/* DISK_EJECT_REQUEST=1 */
+			guint64 received;			/* when the uevent arrived, msec since the epoch */
+
 			/* stuff udev may tell us about the device and we don't want to query */
-			char vendor[HAL_NAME_MAX];
-			char model[HAL_NAME_MAX];
-			char revision[HAL_NAME_MAX];
-			char serial[HAL_NAME_MAX];
-			char fsusage[HAL_NAME_MAX];
-			char fstype[HAL_NAME_MAX];
-			char fsversion[HAL_NAME_MAX];
-			char fslabel[HAL_NAME_MAX];
-			char fsuuid[HAL_NAME_MAX];
+			const char *vendor;			/* interned */
+			const char *model;			/* interned */
+			const char *revision;			/* interned */
+			const char *serial;
+			const char *fsusage;			/* interned */
+			const char *fstype;			/* interned */
+			const char *fsversion;			/* interned */
+			const char *fslabel;
+			const char *fsuuid;
 		} sysfs;
 
 		struct {
 			int  acpi_type;				/* Type of ACPI object; see acpi.c */
-			char acpi_path[HAL_PATH_MAX];		/* Path into procfs, e.g. /proc/acpi/battery/BAT0/ */
+			const char *acpi_path;			/* Path into procfs, e.g. /proc/acpi/battery/BAT0/ */
 		} acpi;
 
 		struct {
 			int  apm_type;				/* Type of APM object; see apm.c */
-			char apm_path[HAL_PATH_MAX];		/* Path into procfs, e.g. /proc/apm */
+			const char *apm_path;			/* Path into procfs, e.g. /proc/apm */
 		} apm;
 
 		struct {
 			int  pmu_type;				/* Type of PMU object; see pmu.c */
-			char pmu_path[HAL_PATH_MAX];		/* Path into procfs, e.g. /proc/pmu/battery_0 */
+			const char *pmu_path;			/* Path into procfs, e.g. /proc/pmu/battery_0 */
 		} pmu;
 	};
 
 } HotplugEvent;
 
+HotplugEvent *hotplug_event_new (void);
+
+void hotplug_event_free (HotplugEvent *hotplug_event);
+
+const char *hotplug_event_strdup (HotplugEvent *hotplug_event, const char *str);
+
+const char *hotplug_event_strdup_printf (HotplugEvent *hotplug_event, const char *format, ...) G_GNUC_PRINTF (2, 3);
+
 void hotplug_event_enqueue (HotplugEvent *event);
 
 void hotplug_event_enqueue_at_front (HotplugEvent *hotplug_event);
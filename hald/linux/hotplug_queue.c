@@ -0,0 +1,369 @@
+/***************************************************************************
+ * CVSID: $Id$
+ *
+ * hotplug_queue.c : Dependency tracking for queued hotplug events
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "../logger.h"
+
+#include "hotplug_queue.h"
+
+/*
+ * Every queued or running sysfs event is hung off a trie keyed on the
+ * components of its sysfs path. An event has to wait for an earlier
+ * (lower seqnum) event on the same device, on one of its parents or on
+ * one of its children; with the trie these are found by walking up to
+ * the root and looking at the cached minimum seqnum below the event's
+ * node, instead of comparing paths against every other event.
+ *
+ * acpi/apm/pmu events never depend on anything; they only take part in
+ * the running count.
+ */
+
+typedef struct _HotplugQueueNode HotplugQueueNode;
+
+struct _HotplugQueueNode {
+	HotplugQueueNode *parent;
+	char *name;			/* path component; key in parent->children */
+	GHashTable *children;		/* name -> HotplugQueueNode, created on demand */
+	GSList *events;			/* events for exactly this path */
+	unsigned long long below_min;	/* lowest seqnum of any event strictly below */
+};
+
+#define NO_SEQNUM G_MAXUINT64
+
+static HotplugQueueNode *root = NULL;
+
+/* sets of events with a sysfs_path_old ('move') and of block events that
+ * are not device-mapper devices; scanned only for move and dm events */
+static GHashTable *moved_events = NULL;
+static GHashTable *block_events = NULL;
+
+static guint num_running = 0;
+
+static gboolean
+is_sysfs_event (HotplugEvent *hotplug_event)
+{
+	return hotplug_event->type == HOTPLUG_EVENT_SYSFS ||
+	       hotplug_event->type == HOTPLUG_EVENT_SYSFS_DEVICE ||
+	       hotplug_event->type == HOTPLUG_EVENT_SYSFS_BLOCK;
+}
+
+static HotplugQueueNode *
+node_new (HotplugQueueNode *parent, const char *name)
+{
+	HotplugQueueNode *node;
+
+	node = g_slice_new0 (HotplugQueueNode);
+	node->parent = parent;
+	node->name = g_strdup (name);
+	node->below_min = NO_SEQNUM;
+
+	if (parent != NULL) {
+		if (parent->children == NULL)
+			parent->children = g_hash_table_new (g_str_hash, g_str_equal);
+		g_hash_table_insert (parent->children, node->name, node);
+	}
+
+	return node;
+}
+
+static void
+node_free (HotplugQueueNode *node)
+{
+	if (node->parent != NULL)
+		g_hash_table_remove (node->parent->children, node->name);
+	if (node->children != NULL)
+		g_hash_table_destroy (node->children);
+	g_free (node->name);
+	g_slice_free (HotplugQueueNode, node);
+}
+
+static unsigned long long
+node_get_events_min (HotplugQueueNode *node)
+{
+	GSList *i;
+	unsigned long long min;
+
+	min = NO_SEQNUM;
+	for (i = node->events; i != NULL; i = g_slist_next (i)) {
+		HotplugEvent *hotplug_event = (HotplugEvent *) i->data;
+
+		if (hotplug_event->sysfs.seqnum < min)
+			min = hotplug_event->sysfs.seqnum;
+	}
+
+	return min;
+}
+
+static void
+child_get_min_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	HotplugQueueNode *child = (HotplugQueueNode *) value;
+	unsigned long long *min = (unsigned long long *) user_data;
+	unsigned long long child_min;
+
+	child_min = MIN (node_get_events_min (child), child->below_min);
+	if (child_min < *min)
+		*min = child_min;
+}
+
+/* Find the node for @path, creating missing nodes if @create is set */
+static HotplugQueueNode *
+lookup_node (const char *path, gboolean create)
+{
+	HotplugQueueNode *node;
+	char component[HAL_PATH_MAX];
+	const char *p;
+	const char *end;
+	gsize len;
+
+	if (root == NULL) {
+		if (!create)
+			return NULL;
+		root = node_new (NULL, "");
+	}
+
+	node = root;
+	for (p = path; *p != '\0'; p = end) {
+		HotplugQueueNode *child;
+
+		while (*p == '/')
+			p++;
+		end = strchr (p, '/');
+		if (end == NULL)
+			end = p + strlen (p);
+		len = end - p;
+		if (len == 0)
+			break;
+		if (len >= sizeof (component))
+			len = sizeof (component) - 1;
+		memcpy (component, p, len);
+		component[len] = '\0';
+
+		child = NULL;
+		if (node->children != NULL)
+			child = g_hash_table_lookup (node->children, component);
+		if (child == NULL) {
+			if (!create)
+				return NULL;
+			child = node_new (node, component);
+		}
+		node = child;
+	}
+
+	return node;
+}
+
+void
+hotplug_queue_track (HotplugEvent *hotplug_event)
+{
+	HotplugQueueNode *node;
+	unsigned long long seqnum;
+
+	/* reposted events are tracked already; they just stop running */
+	if (hotplug_event->running) {
+		hotplug_event->running = FALSE;
+		num_running--;
+	}
+
+	if (!is_sysfs_event (hotplug_event) || hotplug_event->queue_node != NULL)
+		return;
+
+	node = lookup_node (hotplug_event->sysfs.sysfs_path, TRUE);
+	node->events = g_slist_prepend (node->events, hotplug_event);
+	hotplug_event->queue_node = node;
+
+	seqnum = hotplug_event->sysfs.seqnum;
+	for (node = node->parent; node != NULL; node = node->parent) {
+		if (seqnum >= node->below_min)
+			break;
+		node->below_min = seqnum;
+	}
+
+	if (moved_events == NULL) {
+		moved_events = g_hash_table_new (g_direct_hash, g_direct_equal);
+		block_events = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+
+	if (hotplug_event->sysfs.sysfs_path_old[0] != '\0')
+		g_hash_table_insert (moved_events, hotplug_event, hotplug_event);
+
+	if (hotplug_event->type == HOTPLUG_EVENT_SYSFS_BLOCK && !hotplug_event->sysfs.is_dm_device)
+		g_hash_table_insert (block_events, hotplug_event, hotplug_event);
+}
+
+void
+hotplug_queue_set_running (HotplugEvent *hotplug_event)
+{
+	if (!hotplug_event->running) {
+		hotplug_event->running = TRUE;
+		num_running++;
+	}
+}
+
+void
+hotplug_queue_untrack (HotplugEvent *hotplug_event)
+{
+	HotplugQueueNode *node;
+	HotplugQueueNode *parent;
+	unsigned long long seqnum;
+
+	if (hotplug_event->running) {
+		hotplug_event->running = FALSE;
+		num_running--;
+	}
+
+	node = (HotplugQueueNode *) hotplug_event->queue_node;
+	if (node == NULL)
+		return;
+
+	hotplug_event->queue_node = NULL;
+	node->events = g_slist_remove (node->events, hotplug_event);
+	g_hash_table_remove (moved_events, hotplug_event);
+	g_hash_table_remove (block_events, hotplug_event);
+
+	/* only ancestors whose minimum came from this event need a new one */
+	seqnum = hotplug_event->sysfs.seqnum;
+	for (parent = node->parent; parent != NULL; parent = parent->parent) {
+		unsigned long long min;
+
+		if (parent->below_min != seqnum)
+			break;
+		min = NO_SEQNUM;
+		g_hash_table_foreach (parent->children, child_get_min_foreach, &min);
+		if (min == parent->below_min)
+			break;
+		parent->below_min = min;
+	}
+
+	/* prune nodes that no longer lead to any event */
+	while (node != NULL && node->events == NULL &&
+	       (node->children == NULL || g_hash_table_size (node->children) == 0)) {
+		parent = node->parent;
+		if (node == root)
+			root = NULL;
+		node_free (node);
+		node = parent;
+	}
+}
+
+static gboolean
+find_earlier_event (gpointer key, gpointer value, gpointer user_data)
+{
+	HotplugEvent *other = (HotplugEvent *) value;
+	HotplugEvent *hotplug_event = (HotplugEvent *) user_data;
+
+	return other->sysfs.seqnum < hotplug_event->sysfs.seqnum;
+}
+
+static gboolean
+find_earlier_move (gpointer key, gpointer value, gpointer user_data)
+{
+	HotplugEvent *other = (HotplugEvent *) value;
+	HotplugEvent *hotplug_event = (HotplugEvent *) user_data;
+
+	return other->sysfs.seqnum < hotplug_event->sysfs.seqnum &&
+	       strcmp (other->sysfs.sysfs_path_old, hotplug_event->sysfs.sysfs_path_old) == 0;
+}
+
+/**
+ * hotplug_queue_is_blocked:
+ * @hotplug_event: a tracked event
+ *
+ * Returns: TRUE if @hotplug_event has to wait for an earlier event on
+ * the same device, a parent or a child, for a running event with a
+ * different action on the same device (fd.o#23060), or - for
+ * device-mapper devices - for any earlier non-dm block event.
+ */
+gboolean
+hotplug_queue_is_blocked (HotplugEvent *hotplug_event)
+{
+	HotplugQueueNode *node;
+	HotplugQueueNode *n;
+	HotplugEvent *other;
+	unsigned long long seqnum;
+	GSList *i;
+
+	node = (HotplugQueueNode *) hotplug_event->queue_node;
+	if (node == NULL)
+		return FALSE;
+
+	for (i = node->events; i != NULL; i = g_slist_next (i)) {
+		other = (HotplugEvent *) i->data;
+
+		if (other != hotplug_event && other->running && other->action != hotplug_event->action) {
+			HAL_DEBUG (("there is still a event running for this device, wait!"));
+			return TRUE;
+		}
+	}
+
+	/* nothing sorts before seqnum 0, e.g. coldplug and synthesized events */
+	seqnum = hotplug_event->sysfs.seqnum;
+	if (seqnum == 0)
+		return FALSE;
+
+	if (node->below_min < seqnum) {
+		HAL_DEBUG (("event %s dependant on a child", hotplug_event->sysfs.sysfs_path));
+		return TRUE;
+	}
+
+	for (n = node; n != NULL; n = n->parent) {
+		if (node_get_events_min (n) < seqnum) {
+			HAL_DEBUG (("event %s dependant on an event for %s", hotplug_event->sysfs.sysfs_path,
+				    n == node ? "the same device" : "a parent"));
+			return TRUE;
+		}
+	}
+
+	if (hotplug_event->sysfs.sysfs_path_old[0] != '\0') {
+		other = g_hash_table_find (moved_events, find_earlier_move, hotplug_event);
+		if (other != NULL) {
+			HAL_DEBUG (("event %s dependant on move of %s", hotplug_event->sysfs.sysfs_path,
+				    other->sysfs.sysfs_path_old));
+			return TRUE;
+		}
+	}
+
+	if (hotplug_event->sysfs.is_dm_device) {
+		other = g_hash_table_find (block_events, find_earlier_event, hotplug_event);
+		if (other != NULL) {
+			HAL_DEBUG (("event %s is dm-device, have at least one (%s) non-dm block device in queue -> held event.",
+				    hotplug_event->sysfs.sysfs_path, other->sysfs.sysfs_path));
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+guint
+hotplug_queue_get_num_running (void)
+{
+	return num_running;
+}
@@ -0,0 +1,41 @@
+/***************************************************************************
+ * CVSID: $Id$
+ *
+ * hotplug_queue.h : Dependency tracking for queued hotplug events
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef HOTPLUG_QUEUE_H
+#define HOTPLUG_QUEUE_H
+
+#include <glib.h>
+
+#include "hotplug.h"
+
+void hotplug_queue_track (HotplugEvent *hotplug_event);
+
+void hotplug_queue_set_running (HotplugEvent *hotplug_event);
+
+void hotplug_queue_untrack (HotplugEvent *hotplug_event);
+
+gboolean hotplug_queue_is_blocked (HotplugEvent *hotplug_event);
+
+guint hotplug_queue_get_num_running (void);
+
+#endif /* HOTPLUG_QUEUE_H */
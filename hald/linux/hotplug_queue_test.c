@@ -0,0 +1,194 @@
+/***************************************************************************
+ * CVSID: $Id$
+ *
+ * hotplug_queue_test.c : Unit tests for the hotplug queue dependency index
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "hotplug_queue.h"
+
+/* hotplug_event_new() lives in hotplug.c together with the whole event
+ * dispatcher; the queue only looks at the action and the sysfs path, so
+ * build bare events here instead of linking the backend. */
+static HotplugEvent *
+test_event_new (HotplugActionType action, unsigned long long seqnum,
+		const char *format, const char *target, guint t)
+{
+	HotplugEvent *e;
+	char *path;
+
+	e = g_slice_new0 (HotplugEvent);
+	e->type = HOTPLUG_EVENT_SYSFS;
+	e->action = action;
+	e->sysfs.seqnum = seqnum;
+
+	path = g_strdup_printf (format, target, t, t);
+	e->strings = g_string_chunk_new (256);
+	e->sysfs.sysfs_path = g_string_chunk_insert (e->strings, path);
+	g_free (path);
+
+	return e;
+}
+
+static void
+test_event_free (HotplugEvent *e)
+{
+	g_string_chunk_free (e->strings);
+	g_slice_free (HotplugEvent, e);
+}
+
+/* Replay a SAN rescan - every LUN removed and added again - through the
+ * hotplug queue dependency index. Events are dispatched in rounds the
+ * way hotplug_event_process_queue() does, and every dispatched event
+ * completes at the end of its round. */
+static gboolean
+check_hotplug_queue_replay (void)
+{
+	static const guint sizes[] = {100, 1000, 5000};
+	static const char *devpaths[] = {
+		"%s/0:0:%u:0/block/sd%u",		/* removed first */
+		"%s/0:0:%u:0/scsi_disk/0:0:%u:0",
+		"%s/0:0:%u:0",
+		"%s"					/* added first */
+	};
+	const char *host = "/sys/devices/pci0000:00/0000:00:03.0/host0/rport-0:0-0";
+	double first_cost;
+	guint n;
+
+	printf ("Checking hotplug queue replay of a SAN rescan\n");
+
+	first_cost = 0.0;
+	for (n = 0; n < G_N_ELEMENTS (sizes); n++) {
+		GQueue *queue;
+		GSList *running;
+		GSList *i;
+		GList *lp;
+		GList *next;
+		GTimer *timer;
+		unsigned long long seqnum;
+		guint num_events;
+		guint rounds;
+		double cost;
+		guint t;
+		int pass;
+		int level;
+
+		queue = g_queue_new ();
+		seqnum = 1;
+		for (pass = 0; pass < 2; pass++) {
+			for (t = 0; t < sizes[n]; t++) {
+				char target[256];
+
+				g_snprintf (target, sizeof (target), "%s/target0:0:%u", host, t);
+				for (level = 0; level < (int) G_N_ELEMENTS (devpaths); level++) {
+					HotplugEvent *e;
+
+					e = test_event_new (pass == 0 ? HOTPLUG_ACTION_REMOVE : HOTPLUG_ACTION_ADD,
+							    seqnum++,
+							    devpaths[pass == 0 ? level : G_N_ELEMENTS (devpaths) - 1 - level],
+							    target, t);
+					g_queue_push_tail (queue, e);
+				}
+			}
+		}
+		num_events = queue->length;
+
+		timer = g_timer_new ();
+		for (lp = queue->head; lp != NULL; lp = lp->next)
+			hotplug_queue_track ((HotplugEvent *) lp->data);
+
+		rounds = 0;
+		while (queue->length > 0 && rounds < 100) {
+			running = NULL;
+			for (lp = queue->head; lp != NULL; lp = next) {
+				HotplugEvent *e = (HotplugEvent *) lp->data;
+
+				next = lp->next;
+				if (!hotplug_queue_is_blocked (e)) {
+					g_queue_delete_link (queue, lp);
+					hotplug_queue_set_running (e);
+					running = g_slist_prepend (running, e);
+				}
+			}
+			for (i = running; i != NULL; i = i->next) {
+				hotplug_queue_untrack ((HotplugEvent *) i->data);
+				test_event_free ((HotplugEvent *) i->data);
+			}
+			g_slist_free (running);
+			rounds++;
+		}
+		g_timer_stop (timer);
+
+		cost = g_timer_elapsed (timer, NULL) * 1e9 / num_events;
+		printf ("  %6u events: %8.1f ns/event, %u rounds\n", num_events, cost, rounds);
+		if (n == 0)
+			first_cost = cost;
+
+		g_timer_destroy (timer);
+
+		/* block and scsi_disk, LUN, target removal; target, LUN, block and scsi_disk add */
+		if (queue->length != 0 || rounds != 6 || hotplug_queue_get_num_running () != 0) {
+			printf ("FAILED: expected 6 rounds, got %u with %u events left\n", rounds, queue->length);
+			for (lp = queue->head; lp != NULL; lp = lp->next) {
+				hotplug_queue_untrack ((HotplugEvent *) lp->data);
+				test_event_free ((HotplugEvent *) lp->data);
+			}
+			g_queue_free (queue);
+			goto out;
+		}
+		g_queue_free (queue);
+
+		if (n > 0 && cost > first_cost * 10) {
+			printf ("FAILED: scheduling cost per event grows with the queue length\n");
+			goto out;
+		}
+	}
+	printf ("PASSED\n");
+
+	return TRUE;
+out:
+	return FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+	int num_tests_failed;
+
+	num_tests_failed = 0;
+
+	printf ("=============================\n");
+
+	if (!check_hotplug_queue_replay ())
+		num_tests_failed++;
+
+	printf ("=============================\n");
+
+	printf ("Total number of tests failed: %d\n", num_tests_failed);
+
+	return num_tests_failed != 0 ? 1 : 0;
+}
@@ -122,8 +122,14 @@ hald_udev_data (GIOChannel *source, GIOCondition condition, gpointer user_data)
 		goto out;
 	}
 
-	hotplug_event = g_slice_new0 (HotplugEvent);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->type = HOTPLUG_EVENT_SYSFS;
+	{
+		GTimeVal now;
+
+		g_get_current_time (&now);
+		hotplug_event->sysfs.received = (guint64) now.tv_sec * 1000 + now.tv_usec / 1000;
+	}
 
 	while (bufpos < sizeof (buf)) {
 		size_t keylen;
@@ -146,8 +152,8 @@ hald_udev_data (GIOChannel *source, GIOCondition condition, gpointer user_data)
                                 goto invalid;
                         }
 
-			g_snprintf (hotplug_event->sysfs.sysfs_path, sizeof (hotplug_event->sysfs.sysfs_path),
-				    "/sys%s", &key[8]);
+			hotplug_event->sysfs.sysfs_path = hotplug_event_strdup_printf (hotplug_event,
+										       "/sys%s", &key[8]);
 		} else if (strncmp(key, "DEVPATH_OLD=", 12) == 0) {
 
                         /* md devices are handled via looking at /proc/mdstat */
@@ -156,65 +162,69 @@ hald_udev_data (GIOChannel *source, GIOCondition condition, gpointer user_data)
                                 goto invalid;
                         }
 
-			g_snprintf (hotplug_event->sysfs.sysfs_path_old, sizeof (hotplug_event->sysfs.sysfs_path_old),
-				    "/sys%s", &key[12]);
+			hotplug_event->sysfs.sysfs_path_old = hotplug_event_strdup_printf (hotplug_event,
+											   "/sys%s", &key[12]);
 		} else if (strncmp(key, "SUBSYSTEM=", 10) == 0)
-			g_strlcpy (hotplug_event->sysfs.subsystem, &key[10], sizeof (hotplug_event->sysfs.subsystem));
+			hotplug_event->sysfs.subsystem = g_intern_string (&key[10]);
 		else if (strncmp(key, "DEVNAME=", 8) == 0)
-			g_strlcpy (hotplug_event->sysfs.device_file, &key[8], sizeof (hotplug_event->sysfs.device_file));
+			hotplug_event->sysfs.device_file = hotplug_event_strdup (hotplug_event, &key[8]);
 		else if (strncmp(key, "SEQNUM=", 7) == 0)
 			hotplug_event->sysfs.seqnum = strtoull(&key[7], NULL, 10);
 		else if (strncmp(key, "IFINDEX=", 8) == 0)
 			hotplug_event->sysfs.net_ifindex = strtoul(&key[8], NULL, 10);
 		else if (strncmp(key, "ID_VENDOR=", 10) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[10])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.vendor, str, sizeof(hotplug_event->sysfs.vendor));
+				hotplug_event->sysfs.vendor = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_MODEL=", 9) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[9])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.model, str, sizeof(hotplug_event->sysfs.model));
+				hotplug_event->sysfs.model = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_REVISION=", 12) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[12])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.revision, str, sizeof(hotplug_event->sysfs.revision));
+				hotplug_event->sysfs.revision = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_SERIAL=", 10) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[10])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.serial, str, sizeof(hotplug_event->sysfs.serial));
+				hotplug_event->sysfs.serial = hotplug_event_strdup (hotplug_event, str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_FS_USAGE=", 12) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[12])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.fsusage, str, sizeof(hotplug_event->sysfs.fsusage));
+				hotplug_event->sysfs.fsusage = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_FS_TYPE=", 11) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[11])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.fstype, str, sizeof(hotplug_event->sysfs.fstype));
+				hotplug_event->sysfs.fstype = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_FS_VERSION=", 14) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[14])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.fsversion, str, sizeof(hotplug_event->sysfs.fsversion));
+				hotplug_event->sysfs.fsversion = g_intern_string (str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_FS_UUID=", 11) == 0) {
 			if ((str = hal_util_strdup_valid_utf8(&key[11])) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.fsuuid, str, sizeof(hotplug_event->sysfs.fsuuid));
+				hotplug_event->sysfs.fsuuid = hotplug_event_strdup (hotplug_event, str);
 				g_free (str);
 			}
 		} else if (strncmp(key, "ID_FS_LABEL_ENC=", 16) == 0) {
 			dstr = g_malloc0 (keylen - 15);
-			hal_util_decode_escape (&key[16], dstr, sizeof(hotplug_event->sysfs.fslabel));
+			hal_util_decode_escape (&key[16], dstr, keylen - 16);
 
 			if ((str = hal_util_strdup_valid_utf8(dstr)) != NULL ) {
-				g_strlcpy (hotplug_event->sysfs.fslabel, str, sizeof(hotplug_event->sysfs.fslabel));
+				hotplug_event->sysfs.fslabel = hotplug_event_strdup (hotplug_event, str);
 				g_free (str);
 			}
 			g_free (dstr);
+		} else if (strcmp(key, "DISK_MEDIA_CHANGE=1") == 0) {
+			hotplug_event->sysfs.media_change = TRUE;
+		} else if (strcmp(key, "DISK_EJECT_REQUEST=1") == 0) {
+			hotplug_event->sysfs.eject_request = TRUE;
 		} else if (strncmp(key, "DM_UDEV_DISABLE_OTHER_RULES_FLAG=", 33) == 0) {
 			if (strtoul(&key[33], NULL, 10) == 1) {
 				HAL_INFO (("ignoring device requested by DM udev rules"));
@@ -288,7 +298,7 @@ hald_udev_data (GIOChannel *source, GIOCondition condition, gpointer user_data)
 	}
 
 invalid:
-	g_slice_free (HotplugEvent, hotplug_event);
+	hotplug_event_free (hotplug_event);
 
 out:
 	return TRUE;
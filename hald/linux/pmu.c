@@ -278,10 +278,10 @@ pmu_synthesize_item (const gchar *fullpath, int pmu_type)
 {
 	HotplugEvent *hotplug_event;
 	HAL_INFO (("Processing %s", fullpath));
-	hotplug_event = g_new0 (HotplugEvent, 1);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_PMU;
-	g_strlcpy (hotplug_event->pmu.pmu_path, fullpath, sizeof (hotplug_event->pmu.pmu_path));
+	hotplug_event->pmu.pmu_path = hotplug_event_strdup (hotplug_event, fullpath);
 	hotplug_event->acpi.acpi_type = pmu_type;
 	hotplug_event_enqueue (hotplug_event);
 }
@@ -582,10 +582,10 @@ pmu_generate_add_hotplug_event (HalDevice *d)
 	pmu_path = hal_device_property_get_string (d, "linux.pmu_path");
 	pmu_type = hal_device_property_get_int (d, "linux.pmu_type");
 
-	hotplug_event = g_new0 (HotplugEvent, 1);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_ADD;
 	hotplug_event->type = HOTPLUG_EVENT_PMU;
-	g_strlcpy (hotplug_event->pmu.pmu_path, pmu_path, sizeof (hotplug_event->pmu.pmu_path));
+	hotplug_event->pmu.pmu_path = hotplug_event_strdup (hotplug_event, pmu_path);
 	hotplug_event->pmu.pmu_type = pmu_type;
 	return hotplug_event;
 }
@@ -600,10 +600,10 @@ pmu_generate_remove_hotplug_event (HalDevice *d)
 	pmu_path = hal_device_property_get_string (d, "linux.pmu_path");
 	pmu_type = hal_device_property_get_int (d, "linux.pmu_type");
 
-	hotplug_event = g_new0 (HotplugEvent, 1);
+	hotplug_event = hotplug_event_new ();
 	hotplug_event->action = HOTPLUG_ACTION_REMOVE;
 	hotplug_event->type = HOTPLUG_EVENT_PMU;
-	g_strlcpy (hotplug_event->pmu.pmu_path, pmu_path, sizeof (hotplug_event->pmu.pmu_path));
+	hotplug_event->pmu.pmu_path = hotplug_event_strdup (hotplug_event, pmu_path);
 	hotplug_event->pmu.pmu_type = pmu_type;
 	return hotplug_event;
 }
@@ -39,6 +39,8 @@
 
 #include "libhal/libhal.h"
 
+#include "../../util_helper_env.h"
+
 int 
 main (int argc, char *argv[])
 {
@@ -66,7 +68,7 @@ main (int argc, char *argv[])
 	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
 		goto out;
 
-	device_file = getenv ("HAL_PROP_HIDDEV_DEVICE");
+	device_file = hal_helper_getenv ("HAL_PROP_HIDDEV_DEVICE");
 	if (device_file == NULL)
 		goto out;
 
@@ -41,6 +41,7 @@
 #include <time.h>
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 #include "libhal/libhal.h"
 
 /* Defines and structs copied from fw-device-cdev.h */
@@ -394,7 +395,7 @@ int main (int argc, char *argv[])
 	if (udi == NULL)
 		goto out;
 
-	ieee1394_udi = getenv ("HAL_PROP_IEEE1394_UNIT_ORIGINATING_DEVICE");
+	ieee1394_udi = hal_helper_getenv ("HAL_PROP_IEEE1394_UNIT_ORIGINATING_DEVICE");
 	if (ieee1394_udi == NULL)
 		goto out;
 
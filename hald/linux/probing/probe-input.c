@@ -43,6 +43,8 @@
 
 #include "libhal/libhal.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
+#include "../../util_helper_worker.h"
 
 /* we must use this kernel-compatible implementation */
 #define BITS_PER_LONG (sizeof(long) * 8)
@@ -52,8 +54,8 @@
 #define LONG(x) ((x)/BITS_PER_LONG)
 #define test_bit(bit, array)    ((array[LONG(bit)] >> OFF(bit)) & 1)
 
-int 
-main (int argc, char *argv[])
+static int
+probe_input (int argc, char *argv[])
 {
 	int fd;
 	int ret;
@@ -69,10 +71,9 @@ main (int argc, char *argv[])
 	ret = 1;
 	fd = -1;
 
-	setup_logger ();
 	dbus_error_init (&error);
 
-	button_type = getenv ("HAL_PROP_BUTTON_TYPE");
+	button_type = hal_helper_getenv ("HAL_PROP_BUTTON_TYPE");
 	if (button_type == NULL)
 		goto out;
 
@@ -89,7 +90,7 @@ main (int argc, char *argv[])
 	else
 		goto out;
 
-	device_file = getenv ("HAL_PROP_INPUT_DEVICE");
+	device_file = hal_helper_getenv ("HAL_PROP_INPUT_DEVICE");
 	if (device_file == NULL)
 		goto out;
 
@@ -97,7 +98,7 @@ main (int argc, char *argv[])
 	if (udi == NULL)
 		goto out;
 
-	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
+	if ((ctx = hal_helper_worker_get_context (&error)) == NULL)
 		goto out;
 
 	HAL_DEBUG (("Doing probe-input for %s (udi=%s)", device_file, udi));
@@ -123,11 +124,15 @@ out:
 
 	LIBHAL_FREE_DBUS_ERROR (&error);
 
-	if (ctx != NULL) {
-		libhal_ctx_shutdown (ctx, &error);
-		LIBHAL_FREE_DBUS_ERROR (&error);
-		libhal_ctx_free (ctx);
-	}
+	hal_helper_worker_release_context (ctx);
 
 	return ret;
 }
+
+int
+main (int argc, char *argv[])
+{
+	setup_logger ();
+
+	return hal_helper_worker_main (argc, argv, probe_input);
+}
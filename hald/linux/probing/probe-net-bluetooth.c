@@ -30,6 +30,7 @@
 #include <string.h>
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 #include "libhal/libhal.h"
 
 #define BLUEZ_SERVICE "org.bluez"
@@ -147,7 +148,7 @@ main (int argc, char *argv[])
 	if (udi == NULL)
 		goto out;
 
-	iface = getenv ("HAL_PROP_NET_INTERFACE");
+	iface = hal_helper_getenv ("HAL_PROP_NET_INTERFACE");
 	if (iface == NULL)
 		goto out;
 
@@ -40,6 +40,7 @@
 #include "libhal/libhal.h"
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 
 int 
 main (int argc, char *argv[])
@@ -57,7 +58,7 @@ main (int argc, char *argv[])
 
 	if (getenv ("UDI") == NULL)
 		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
 		goto out;
 
 	setup_logger ();
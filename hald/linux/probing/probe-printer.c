@@ -37,6 +37,7 @@
 
 #include "libhal/libhal.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 
 /* Stolen from kernel 2.6.4, drivers/usb/class/usblp.c */
 #define IOCNR_GET_DEVICE_ID 1
@@ -80,7 +81,7 @@ main (int argc, char *argv[])
 		goto out;
 	}
 
-	device_file = getenv ("HAL_PROP_PRINTER_DEVICE");
+	device_file = hal_helper_getenv ("HAL_PROP_PRINTER_DEVICE");
 	if (device_file == NULL) {
 		HAL_ERROR (("device_file == NULL"));
 		goto out;
@@ -41,6 +41,7 @@
 #include "libhal/libhal.h"
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 
 int 
 main (int argc, char *argv[])
@@ -62,7 +63,7 @@ main (int argc, char *argv[])
 		goto out;
 	}
 
-	if ((device_file = getenv ("HAL_PROP_SERIAL_DEVICE")) == NULL) {
+	if ((device_file = hal_helper_getenv ("HAL_PROP_SERIAL_DEVICE")) == NULL) {
 		HAL_ERROR (("HAL_PROP_SERIAL_DEVICE not set"));
 		goto out;
 	}
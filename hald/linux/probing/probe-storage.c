@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -51,6 +52,8 @@
 #include "linux_dvd_rw_utils.h"
 
 #include "../../logger.h"
+#include "../../util_helper_env.h"
+#include "../../util_helper_worker.h"
 #include "../../util_helper.h"
 
 /** Check if a filesystem on a special device file is mounted
@@ -85,8 +88,30 @@ out:
 	return rc;
 }
 
-int 
-main (int argc, char *argv[])
+/* Publish the parsed partition table as linux.partition_table, prefixed
+ * with the dev_t of the disk it was read from; an empty string means
+ * there's nothing cached. hald drops the property when the disk changes.
+ */
+static void
+set_partition_table_cache (LibHalChangeSet *cs, int fd, PartitionTable *p)
+{
+	struct stat st;
+	char *table;
+	char *value;
+
+	if (p == NULL || fstat (fd, &st) != 0 || (table = part_table_serialize (p)) == NULL) {
+		libhal_changeset_set_property_string (cs, "linux.partition_table", "");
+		return;
+	}
+
+	value = g_strdup_printf ("%" G_GUINT64_FORMAT " %s", (guint64) st.st_rdev, table);
+	libhal_changeset_set_property_string (cs, "linux.partition_table", value);
+	g_free (value);
+	g_free (table);
+}
+
+static int
+probe_storage (int argc, char *argv[])
 {
 	int fd, num_excl_tries = 5;
 	int ret;
@@ -113,23 +138,21 @@ main (int argc, char *argv[])
 
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
 		goto out;
-	if ((bus = getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
+	if ((bus = hal_helper_getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
 		goto out;
-	if ((drive_type = getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
+	if ((drive_type = hal_helper_getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
 		goto out;
-	if ((sysfs_path = getenv ("HAL_PROP_LINUX_SYSFS_PATH")) == NULL)
+	if ((sysfs_path = hal_helper_getenv ("HAL_PROP_LINUX_SYSFS_PATH")) == NULL)
 		goto out;
 
-	setup_logger ();
-
 	if (argc == 2 && strcmp (argv[1], "--only-check-for-media") == 0)
 		only_check_for_fs = TRUE;
 	else
 		only_check_for_fs = FALSE;
 
-	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
+	if ((ctx = hal_helper_worker_get_context (&error)) == NULL)
 		goto out;
 
 	cs = libhal_device_new_changeset (udi);
@@ -175,6 +198,7 @@ main (int argc, char *argv[])
 				}
 			}
 			close(fd);
+			fd = -1;
 		}
 		
 		if (model != NULL) {
@@ -201,6 +225,7 @@ main (int argc, char *argv[])
 		if (ioctl (fd, CDROM_SET_OPTIONS, CDO_USE_FFLAGS) < 0) {
 			HAL_ERROR (("Error: CDROM_SET_OPTIONS failed: %s\n", strerror(errno)));
 			close (fd);
+			fd = -1;
 			goto out;
 		}
 		
@@ -208,6 +233,7 @@ main (int argc, char *argv[])
 			capabilities = ioctl (fd, CDROM_GET_CAPABILITY, 0);
 			if (capabilities < 0) {
 				close (fd);
+				fd = -1;
 				goto out;
 			}
 			HAL_DEBUG (("CDROM_GET_CAPABILITY returned: 0x%08x", capabilities));
@@ -329,6 +355,7 @@ main (int argc, char *argv[])
 		}
 		
 		close (fd);
+		fd = -1;
 	}
 		
 	ret = 0;
@@ -342,7 +369,7 @@ main (int argc, char *argv[])
 
 		HAL_DEBUG (("Checking for optical disc on %s", device_file));
 
-		support_media_changed_str = getenv ("HAL_PROP_STORAGE_CDROM_SUPPORT_MEDIA_CHANGED");
+		support_media_changed_str = hal_helper_getenv ("HAL_PROP_STORAGE_CDROM_SUPPORT_MEDIA_CHANGED");
 		if (support_media_changed_str != NULL && strcmp (support_media_changed_str, "true") == 0)
 			support_media_changed = TRUE;
 		else
@@ -428,6 +455,7 @@ main (int argc, char *argv[])
 		}
 
 		close (fd);
+		fd = -1;
         HAL_DEBUG (("PROBE CLOSED LOCK ON CDROM"));
 	} else {
 		blkid_probe pr;
@@ -449,6 +477,7 @@ main (int argc, char *argv[])
 			HAL_DEBUG (("Cannot open %s: %s", device_file, strerror (errno)));
 			/* no media */
 			libhal_changeset_set_property_bool (cs, "storage.removable.media_available", FALSE);
+			set_partition_table_cache (cs, -1, NULL);
 			goto out;
 		}
 		HAL_DEBUG (("Returned from open(2)"));
@@ -480,7 +509,9 @@ main (int argc, char *argv[])
 				HAL_DEBUG (("partition %s found, skip probing for filesystem", partition));
 				g_dir_close (dir);
 
-				/* probe for partition table type */
+				/* probe for partition table type; the parsed table is also
+				 * handed to hald-probe-volume so the partitions don't each
+				 * have to read it again */
 				p = part_table_load_from_disk (device_file);
 				if (p != NULL) {
 
@@ -489,7 +520,10 @@ main (int argc, char *argv[])
 						"storage.partitioning_scheme", 
 						part_get_scheme_name (part_table_get_scheme (p)));
 
+					set_partition_table_cache (cs, fd, p);
 					part_table_free (p);
+				} else {
+					set_partition_table_cache (cs, fd, NULL);
 				}
 
 				goto out;
@@ -498,6 +532,7 @@ main (int argc, char *argv[])
 		g_dir_close (dir);
 
 		libhal_changeset_set_property_string (cs, "storage.partitioning_scheme", "none");
+		set_partition_table_cache (cs, fd, NULL);
 
 		/* probe for file system */
 		pr = blkid_new_probe ();
@@ -523,10 +558,14 @@ main (int argc, char *argv[])
 			blkid_free_probe (pr);
 		}
 		close (fd);
+		fd = -1;
 	}
 
 	
 out:
+	if (fd >= 0)
+		close (fd);
+
 	LIBHAL_FREE_DBUS_ERROR (&error);
 
 	if (cs != NULL) {
@@ -536,11 +575,15 @@ out:
 
 	LIBHAL_FREE_DBUS_ERROR (&error);
 		
-	if (ctx != NULL) {
-		libhal_ctx_shutdown (ctx, &error);
-		LIBHAL_FREE_DBUS_ERROR (&error);
-		libhal_ctx_free (ctx);
-	}
+	hal_helper_worker_release_context (ctx);
 
 	return ret;
 }
+
+int
+main (int argc, char *argv[])
+{
+	setup_logger ();
+
+	return hal_helper_worker_main (argc, argv, probe_storage);
+}
@@ -42,6 +42,7 @@
 
 #include "libhal/libhal.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
 
 int
 main (int argc, char *argv[])
@@ -60,7 +61,7 @@ main (int argc, char *argv[])
 
 	dbus_error_init (&error);
 
-	device_file = getenv ("HAL_PROP_VIDEO4LINUX_DEVICE");
+	device_file = hal_helper_getenv ("HAL_PROP_VIDEO4LINUX_DEVICE");
 	if (device_file == NULL)
 		goto out;
 
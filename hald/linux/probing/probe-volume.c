@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
 
@@ -48,6 +49,8 @@
 #include "partutil/partutil.h"
 #include "linux_dvd_rw_utils.h"
 #include "../../logger.h"
+#include "../../util_helper_env.h"
+#include "../../util_helper_worker.h"
 
 static gchar *
 strdup_valid_utf8 (const char *str)
@@ -284,8 +287,10 @@ handle_sigterm (int value)
 	exit (1);
 }
 
-int 
-main (int argc, char *argv[])
+static const char * const stordev_keys[] = {"block.device", "linux.partition_table", NULL};
+
+static int
+probe_volume (int argc, char *argv[])
 {
 	int fd;
 	int ret;
@@ -294,7 +299,8 @@ main (int argc, char *argv[])
 	DBusError error;
 	char *parent_udi;
 	blkid_probe pr;
-	char *stordev_dev_file;
+	LibHalPropertySet *stordev_props;
+	const char *stordev_dev_file;
 	char *partition_number_str;
 	char *partition_start_str;
 	char *is_disc_str;
@@ -311,10 +317,9 @@ main (int argc, char *argv[])
 	fd = -1;
 
 	cs = NULL;
+	stordev_props = NULL;
 	disc_may_have_data = FALSE;
 
-	setup_logger ();
-
 	/* assume failure */
 	ret = 1;
 
@@ -322,33 +327,33 @@ main (int argc, char *argv[])
 
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
 		goto out;
-	if ((parent_udi = getenv ("HAL_PROP_INFO_PARENT")) == NULL)
+	if ((parent_udi = hal_helper_getenv ("HAL_PROP_INFO_PARENT")) == NULL)
 		goto out;
-	if (getenv ("HAL_PROP_LINUX_SYSFS_PATH") == NULL)
+	if (hal_helper_getenv ("HAL_PROP_LINUX_SYSFS_PATH") == NULL)
 		goto out;
-	partition_number_str = getenv ("HAL_PROP_VOLUME_PARTITION_NUMBER");
+	partition_number_str = hal_helper_getenv ("HAL_PROP_VOLUME_PARTITION_NUMBER");
 	if (partition_number_str != NULL)
 		partition_number = (unsigned int) atoi (partition_number_str);
 	else
 		partition_number = (unsigned int) -1;
 
-	partition_start_str = getenv ("HAL_PROP_VOLUME_PARTITION_START");
+	partition_start_str = hal_helper_getenv ("HAL_PROP_VOLUME_PARTITION_START");
 	if (partition_start_str != NULL)
 		partition_start = (guint64) strtoll (partition_start_str, NULL, 0);
 	else
 		partition_start = (guint64) 0;
 
-	is_disc_str = getenv ("HAL_PROP_VOLUME_IS_DISC");
+	is_disc_str = hal_helper_getenv ("HAL_PROP_VOLUME_IS_DISC");
 	if (is_disc_str != NULL && strcmp (is_disc_str, "true") == 0)
 		is_disc = TRUE;
 	else
 		is_disc = FALSE;
 
-	fsusage = getenv ("HAL_PROP_VOLUME_FSUSAGE");
+	fsusage = hal_helper_getenv ("HAL_PROP_VOLUME_FSUSAGE");
 
-	if ((ctx = libhal_ctx_init_direct (&error)) == NULL)
+	if ((ctx = hal_helper_worker_get_context (&error)) == NULL)
 		goto out;
 
 	cs = libhal_device_new_changeset (udi);
@@ -597,10 +602,12 @@ main (int argc, char *argv[])
 
 		HAL_DEBUG(("start probing for filesystem ..."));
 
-		if ((stordev_dev_file = libhal_device_get_property_string (
-			     ctx, parent_udi, "block.device", &error)) == NULL) {
+		if ((stordev_props = libhal_device_get_properties (
+			     ctx, parent_udi, stordev_keys, &error)) == NULL) {
 			goto out;
 		}
+		if ((stordev_dev_file = libhal_ps_get_string (stordev_props, "block.device")) == NULL)
+			goto out;
 
 		/* Optical discs have problems reporting the exact
 		 * size so we should never look for data there since
@@ -655,7 +662,9 @@ main (int argc, char *argv[])
 			 */
 			if (bid_ret != 0 && is_disc) {
 				PartitionTable *p;
-				p = part_table_load_from_disk (stordev_dev_file);
+				p = part_table_load_cached ((char *) stordev_dev_file,
+							    libhal_ps_get_string (stordev_props, "linux.partition_table"),
+							    NULL);
 				if (p != NULL) {
 					int i;
 
@@ -696,15 +705,14 @@ main (int argc, char *argv[])
 		    partition_number <= 256 && partition_number > 0 &&
 		    partition_start > 0) {
 			PartitionTable *p;
+			PartitionTable *p2;
+			int entry;
 
 			HAL_INFO (("Loading part table"));
-			p = part_table_load_from_disk (stordev_dev_file);
+			p = part_table_find_cached ((char *) stordev_dev_file,
+						    libhal_ps_get_string (stordev_props, "linux.partition_table"),
+						    partition_start, vol_size, &p2, &entry, NULL);
 			if (p != NULL) {
-				PartitionTable *p2;
-				int entry;
-
-				HAL_INFO (("Looking at part table"));
-				part_table_find (p, partition_start, &p2, &entry);
 				if (entry >= 0) {
 					const char *scheme;
 					char *type;
@@ -777,8 +785,6 @@ main (int argc, char *argv[])
 				part_table_free (p);
 			}
 			HAL_INFO (("Done looking at part table"));
-
-			libhal_free_string (stordev_dev_file);
 		}
 	}
 
@@ -797,17 +803,24 @@ out:
 	}
 
 
+	if (stordev_props != NULL)
+		libhal_free_property_set (stordev_props);
+
 	if (fd >= 0)
 		close (fd);
 
 	LIBHAL_FREE_DBUS_ERROR (&error);
 
-	if (ctx != NULL) {
-		libhal_ctx_shutdown (ctx, &error);
-		LIBHAL_FREE_DBUS_ERROR (&error);
-		libhal_ctx_free (ctx);
-	}
+	hal_helper_worker_release_context (ctx);
 
 	return ret;
 
 }
+
+int
+main (int argc, char *argv[])
+{
+	setup_logger ();
+
+	return hal_helper_worker_main (argc, argv, probe_volume);
+}
@@ -48,6 +48,56 @@ static int log_pid  = 0;
 static int is_enabled = 1;
 static int syslog_enabled = 0;
 
+/* lowest priority written to stderr or syslog; trace is never written */
+static int log_level = HAL_LOGPRI_DEBUG;
+
+#define ALL_PRIORITIES (HAL_LOGPRI_TRACE | HAL_LOGPRI_DEBUG | HAL_LOGPRI_INFO | \
+			HAL_LOGPRI_WARNING | HAL_LOGPRI_ERROR)
+
+/* priorities at or above @priority; they are single bits */
+#define PRIORITIES_FROM(priority) (ALL_PRIORITIES & ~((priority) - 1))
+
+int logger_priority_mask = HAL_LOGPRI_DEBUG | HAL_LOGPRI_INFO | HAL_LOGPRI_WARNING | HAL_LOGPRI_ERROR;
+
+/* The trace ring keeps the last entries in memory, already formatted but
+ * with the raw time stamp, so tracing can stay enabled without writing
+ * anything out. Entries are only added from the main loop and the ring
+ * takes no locks; file and function point to string constants.
+ *
+ * The message is formatted when it is logged rather than when the ring
+ * is dumped: most arguments are strings the caller frees soon after, so
+ * keeping the format and arguments would mean copying every string
+ * argument anyway. Longer messages are cut off. */
+#define TRACE_MESSAGE_SIZE 160
+
+typedef struct {
+	struct timeval time;
+	int priority;
+	const char *file;
+	int line;
+	const char *function;
+	char message[TRACE_MESSAGE_SIZE];
+} TraceEntry;
+
+static TraceEntry *trace_ring = NULL;
+static unsigned int trace_ring_size = 0;
+static unsigned long trace_ring_next = 0;
+static int trace_ring_level = HAL_LOGPRI_TRACE;
+
+static void
+update_priority_mask (void)
+{
+	int mask;
+
+	mask = 0;
+	if (is_enabled)
+		mask |= PRIORITIES_FROM (log_level) & ~HAL_LOGPRI_TRACE;
+	if (trace_ring != NULL)
+		mask |= PRIORITIES_FROM (trace_ring_level);
+
+	logger_priority_mask = mask;
+}
+
 
 /** 
  * logger_disable:
@@ -59,6 +109,7 @@ void
 logger_disable (void)
 {
 	is_enabled = 0;
+	update_priority_mask ();
 }
 
 /** 
@@ -71,6 +122,7 @@ void
 logger_enable (void)
 {
 	is_enabled = 1;
+	update_priority_mask ();
 }
 
 /** 
@@ -117,6 +169,154 @@ setup_logger (void)
 		syslog_enabled = 1;
         else
                 syslog_enabled = 0;
+
+	update_priority_mask ();
+}
+
+/**
+ * logger_set_level:
+ * @priority:           Lowest priority to log, one of HAL_LOGPRI_*
+ *
+ * Set the lowest priority written to stderr or syslog. Entries below
+ * it are not even formatted, unless the trace ring wants them.
+ */
+void
+logger_set_level (int _priority)
+{
+	log_level = _priority;
+	update_priority_mask ();
+}
+
+/**
+ * logger_priority_from_string:
+ * @name:               "trace", "debug", "info", "warning" or "error"
+ *
+ * Returns: the HAL_LOGPRI_* for @name, or 0 if unknown
+ */
+int
+logger_priority_from_string (const char *name)
+{
+	if (strcmp (name, "trace") == 0)
+		return HAL_LOGPRI_TRACE;
+	else if (strcmp (name, "debug") == 0)
+		return HAL_LOGPRI_DEBUG;
+	else if (strcmp (name, "info") == 0)
+		return HAL_LOGPRI_INFO;
+	else if (strcmp (name, "warning") == 0)
+		return HAL_LOGPRI_WARNING;
+	else if (strcmp (name, "error") == 0)
+		return HAL_LOGPRI_ERROR;
+	return 0;
+}
+
+/**
+ * logger_enable_trace_ring:
+ * @size:               Number of entries to keep, 0 to disable
+ * @priority:           Lowest priority to keep, one of HAL_LOGPRI_*
+ *
+ * Keep the last @size log entries in memory, independent of whether
+ * logging is enabled; see logger_dump_trace_ring().
+ */
+void
+logger_enable_trace_ring (unsigned int size, int _priority)
+{
+	free (trace_ring);
+	trace_ring = NULL;
+	trace_ring_size = 0;
+	trace_ring_next = 0;
+
+	if (size > 0) {
+		trace_ring = calloc (size, sizeof (TraceEntry));
+		if (trace_ring != NULL)
+			trace_ring_size = size;
+	}
+	trace_ring_level = _priority;
+
+	update_priority_mask ();
+}
+
+static const char *
+priority_to_string (int _priority)
+{
+	switch (_priority) {
+		case HAL_LOGPRI_TRACE:
+			return "[T]";
+		case HAL_LOGPRI_DEBUG:
+			return "[D]";
+		case HAL_LOGPRI_INFO:
+			return "[I]";
+		case HAL_LOGPRI_WARNING:
+			return "[W]";
+		default:		/* explicit fallthrough */
+		case HAL_LOGPRI_ERROR:
+			return "[E]";
+	}
+}
+
+/**
+ * logger_trace_ring_foreach:
+ * @func:               Called for each entry, oldest first
+ * @user_data:          Passed to @func
+ *
+ * Format the entries of the trace ring like log lines, without the
+ * trailing newline.
+ */
+void
+logger_trace_ring_foreach (LoggerTraceFunc func, void *user_data)
+{
+	unsigned long i;
+	unsigned long first;
+	unsigned long last;
+	char tbuf[64];
+	char entry[TRACE_MESSAGE_SIZE + 256];
+
+	if (trace_ring == NULL)
+		return;
+
+	/* entries added by func itself are not visited */
+	last = trace_ring_next;
+	first = last > trace_ring_size ? last - trace_ring_size : 0;
+
+	for (i = first; i < last; i++) {
+		TraceEntry *e = &trace_ring[i % trace_ring_size];
+		time_t sec = e->time.tv_sec;
+		struct tm *tlocaltime;
+
+		tlocaltime = localtime (&sec);
+		strftime (tbuf, sizeof (tbuf), "%H:%M:%S", tlocaltime);
+		snprintf (entry, sizeof (entry), "%s.%03d %s %s:%d %s(): %s",
+			  tbuf, (int) (e->time.tv_usec / 1000), priority_to_string (e->priority),
+			  e->file, e->line, e->function, e->message);
+		func (entry, user_data);
+	}
+}
+
+static void
+dump_trace_entry (const char *entry, void *user_data)
+{
+	if (syslog_enabled)
+		syslog (LOG_INFO, "%s", entry);
+	else
+		fprintf (stderr, "%s\n", entry);
+}
+
+/**
+ * logger_dump_trace_ring:
+ *
+ * Write the entries of the trace ring to stderr or syslog, whether or not
+ * logging is enabled.
+ */
+void
+logger_dump_trace_ring (void)
+{
+	if (trace_ring == NULL)
+		return;
+
+	if (syslog_enabled)
+		syslog (LOG_INFO, "--- trace ring: last %u entries ---", trace_ring_size);
+	else
+		fprintf (stderr, "--- trace ring: last %u entries ---\n", trace_ring_size);
+	logger_trace_ring_foreach (dump_trace_entry, NULL);
 }
 
 /**  
@@ -157,32 +357,32 @@ logger_emit (const char *format, ...)
 	struct timezone tzone;
 	static pid_t pid = -1;
 
-	if (!is_enabled)
+	if (!(logger_priority_mask & priority))
 		return;
 
 	va_start (args, format);
 	vsnprintf (buf, sizeof (buf), format, args);
 
-	switch (priority) {
-		case HAL_LOGPRI_TRACE:
-			pri = "[T]";
-			break;
-		case HAL_LOGPRI_DEBUG:
-			pri = "[D]";
-			break;
-		case HAL_LOGPRI_INFO:
-			pri = "[I]";
-			break;
-		case HAL_LOGPRI_WARNING:
-			pri = "[W]";
-			break;
-		default:		/* explicit fallthrough */
-		case HAL_LOGPRI_ERROR:
-			pri = "[E]";
-			break;
+	gettimeofday (&tnow, &tzone);
+
+	if (trace_ring != NULL && priority >= trace_ring_level) {
+		TraceEntry *e = &trace_ring[trace_ring_next++ % trace_ring_size];
+
+		e->time = tnow;
+		e->priority = priority;
+		e->file = file;
+		e->line = line;
+		e->function = function;
+		strncpy (e->message, buf, sizeof (e->message) - 1);
+		e->message[sizeof (e->message) - 1] = '\0';
 	}
 
-	gettimeofday (&tnow, &tzone);
+	/* the rest is only for entries that are written out */
+	if (!is_enabled || priority < log_level || priority == HAL_LOGPRI_TRACE)
+		goto out;
+
+	pri = (char *) priority_to_string (priority);
+
 	tlocaltime = localtime ((time_t *) &tnow.tv_sec);
 	strftime (tbuf, sizeof (tbuf), "%H:%M:%S", tlocaltime);
 
@@ -214,6 +414,7 @@ logger_emit (const char *format, ...)
 		}
 	}
 
+out:
 	va_end (args);
 }
 
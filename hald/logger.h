@@ -42,6 +42,11 @@ enum {
 	HAL_LOGPRI_ERROR = (1 << 4)    /**< error */
 };
 
+/* Priorities for which log entries are formatted at all; maintained by
+ * the functions below, checked by the macros before evaluating any
+ * arguments */
+extern int logger_priority_mask;
+
 void logger_setup (int priority, const char *file, int line, const char *function);
 
 void logger_emit (const char *format, ...);
@@ -54,6 +59,16 @@ void logger_disable (void);
 void logger_enable_syslog (void);
 void logger_disable_syslog (void);
 
+void logger_set_level (int priority);
+int logger_priority_from_string (const char *name);
+
+void logger_enable_trace_ring (unsigned int size, int priority);
+
+typedef void (*LoggerTraceFunc) (const char *entry, void *user_data);
+
+void logger_trace_ring_foreach (LoggerTraceFunc func, void *user_data);
+void logger_dump_trace_ring (void);
+
 void setup_logger (void);
 
 #ifdef __SUNPRO_C
@@ -61,19 +76,19 @@ void setup_logger (void);
 #endif
 
 /** Trace logging macro */
-#define HAL_TRACE(expr)   do {logger_setup(HAL_LOGPRI_TRACE,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr; } while(0)
+#define HAL_TRACE(expr)   do {if (logger_priority_mask & HAL_LOGPRI_TRACE) {logger_setup(HAL_LOGPRI_TRACE,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr;}} while(0)
 
 /** Debug information logging macro */
-#define HAL_DEBUG(expr)   do {logger_setup(HAL_LOGPRI_DEBUG,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr; } while(0)
+#define HAL_DEBUG(expr)   do {if (logger_priority_mask & HAL_LOGPRI_DEBUG) {logger_setup(HAL_LOGPRI_DEBUG,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr;}} while(0)
 
 /** Information level logging macro */
-#define HAL_INFO(expr)    do {logger_setup(HAL_LOGPRI_INFO,    __FILE__, __LINE__, __FUNCTION__); logger_emit expr; } while(0)
+#define HAL_INFO(expr)    do {if (logger_priority_mask & HAL_LOGPRI_INFO) {logger_setup(HAL_LOGPRI_INFO,    __FILE__, __LINE__, __FUNCTION__); logger_emit expr;}} while(0)
 
 /** Warning level logging macro */
-#define HAL_WARNING(expr) do {logger_setup(HAL_LOGPRI_WARNING, __FILE__, __LINE__, __FUNCTION__); logger_emit expr; } while(0)
+#define HAL_WARNING(expr) do {if (logger_priority_mask & HAL_LOGPRI_WARNING) {logger_setup(HAL_LOGPRI_WARNING, __FILE__, __LINE__, __FUNCTION__); logger_emit expr;}} while(0)
 
 /** Error leve logging macro */
-#define HAL_ERROR(expr)   do {logger_setup(HAL_LOGPRI_ERROR,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr; } while(0)
+#define HAL_ERROR(expr)   do {if (logger_priority_mask & HAL_LOGPRI_ERROR) {logger_setup(HAL_LOGPRI_ERROR,   __FILE__, __LINE__, __FUNCTION__); logger_emit expr;}} while(0)
 
 /** Macro for terminating the program on an unrecoverable error */
 #define DIE(expr) do {printf("*** [DIE] %s:%s():%d : ", __FILE__, __FUNCTION__, __LINE__); printf expr; printf("\n"); exit(1); } while(0)
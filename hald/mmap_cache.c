@@ -43,6 +43,7 @@
 #include "logger.h"
 #include "rule.h"
 #include "mmap_cache.h"
+#include "device.h"
 #include "hald_runner.h"
 #include "hal-file-monitor.h"
 #include "osspec.h"
@@ -50,6 +51,108 @@
 extern void *rules_ptr;
 static size_t rules_size = 0;
 
+/* offset of a <match> rule -> struct match_info, for rules that are
+ * part of a match run or test a string value */
+static GHashTable *match_infos = NULL;
+
+static void
+match_info_free (struct match_info *info)
+{
+	if (info->value != NULL)
+		hal_device_release_string (info->value);
+	g_free (info);
+}
+
+static struct match_info *
+match_info_get (u_int32_t offset)
+{
+	struct match_info *info;
+
+	info = g_hash_table_lookup (match_infos, GUINT_TO_POINTER (offset));
+	if (info == NULL) {
+		info = g_new0 (struct match_info, 1);
+		g_hash_table_insert (match_infos, GUINT_TO_POINTER (offset), info);
+	}
+	return info;
+}
+
+/* Values of string and strlist matches are interned like the property
+ * values they are compared against, so handle_match() compares pointers */
+static void
+match_values_init (u_int32_t start, u_int32_t end)
+{
+	u_int32_t offset;
+	struct rule *rule;
+
+	for (offset = start; offset < end; offset += rule->rule_size) {
+		rule = (struct rule *) RULES_PTR(offset);
+		if (rule->rule_size == 0)
+			break;
+
+		if (rule->rtype != RULE_MATCH)
+			continue;
+
+		switch (rule->type_match) {
+		case MATCH_STRING:
+		case MATCH_CONTAINS:
+		case MATCH_CONTAINS_NOT:
+			match_info_get (offset)->value =
+				hal_device_intern_string ((const char *) RULES_PTR(rule->value_offset));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void
+match_infos_init (struct cache_header *header)
+{
+	struct match_run *runs;
+	u_int32_t i;
+	u_int32_t j;
+
+	if (match_infos != NULL)
+		g_hash_table_destroy (match_infos);
+	match_infos = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					     NULL, (GDestroyNotify) match_info_free);
+
+	match_values_init (header->fdi_rules_preprobe, header->fdi_rules_information);
+	match_values_init (header->fdi_rules_information, header->fdi_rules_policy);
+	match_values_init (header->fdi_rules_policy, header->all_rules_size);
+
+	if (header->magic != HALD_CACHE_MAGIC || header->match_runs == 0)
+		return;
+
+	runs = (struct match_run *) RULES_PTR(header->match_runs);
+	for (i = 0; i < header->num_match_runs; i++) {
+		struct match_run_entry *entries;
+
+		entries = (struct match_run_entry *) RULES_PTR(runs[i].entries);
+		for (j = 0; j < runs[i].num_entries; j++)
+			match_info_get (entries[j].rule)->run = &runs[i];
+	}
+
+	HAL_INFO (("%d match runs, %d match rules with extra info", header->num_match_runs,
+		   g_hash_table_size (match_infos)));
+}
+
+/**
+ * di_match_info_lookup:
+ * @offset: offset of a <match> rule in the cache
+ *
+ * Returns: the match run and interned value of the rule, or NULL if it
+ * has neither
+ */
+const struct match_info *
+di_match_info_lookup (u_int32_t offset)
+{
+	if (match_infos == NULL)
+		return NULL;
+
+	return g_hash_table_lookup (match_infos, GUINT_TO_POINTER (offset));
+}
+
 int di_rules_init (void)
 {
 	struct cache_header	*header;
@@ -86,6 +189,8 @@ int di_rules_init (void)
 	HAL_INFO(("policy: offset=%08lx, size=%d", header->fdi_rules_policy,
 		header->all_rules_size - header->fdi_rules_policy));
 
+	match_infos_init (header);
+
 	close(fd);
 
 	return 0;
@@ -156,7 +261,9 @@ regen_cache (void)
 	HAL_INFO (("fdi cache generation done"));
 }
 
-static gboolean cache_valid = FALSE;
+/* bumped by the file monitor whenever something in the fdi directories changes */
+static guint fdi_generation = 1;
+static guint checked_generation = 0;
 
 static void
 cache_invalidated (HalFileMonitor      *monitor,
@@ -165,55 +272,108 @@ cache_invalidated (HalFileMonitor      *monitor,
                    gpointer             user_data)
 {
         HAL_INFO (("dir '%s' changed - marking fdi cache as invalid", path));
-        cache_valid = FALSE;
+        fdi_generation++;
+}
+
+/* state for comparing the fdi directories against the sources of a cache */
+typedef struct {
+	GHashTable	*sources;	/* path -> struct cache_source */
+	guint		 num_found;
+	gboolean	 changed;
+	gboolean	 setup_watches;
+} SourceCheck;
+
+static void
+fdi_watch (const char *path)
+{
+	HalFileMonitor *file_monitor;
+
+	file_monitor = osspec_get_file_monitor ();
+	if (file_monitor != NULL) {
+		hal_file_monitor_add_notify (file_monitor,
+					     path,
+					     HAL_FILE_MONITOR_EVENT_CREATE|
+					     HAL_FILE_MONITOR_EVENT_DELETE|
+					     HAL_FILE_MONITOR_EVENT_CHANGE,
+					     cache_invalidated,
+					     NULL);
+	}
+}
+
+static void
+fdi_file_check (const char *path, struct stat *st, SourceCheck *check)
+{
+	struct cache_source *source;
+
+	if (check->setup_watches)
+		fdi_watch (path);
+
+	if (check->changed)
+		return;
+
+	source = g_hash_table_lookup (check->sources, path);
+	if (source == NULL) {
+		HAL_INFO (("fdi file '%s' is new", path));
+		check->changed = TRUE;
+	} else if (source->mtime != (u_int64_t) st->st_mtime || source->size != (u_int32_t) st->st_size) {
+		HAL_INFO (("fdi file '%s' changed", path));
+		check->changed = TRUE;
+	} else {
+		check->num_found++;
+	}
 }
 
+/* walk an fdi directory the same way hald-generate-fdi-cache does */
 static void 
-dir_mtime (const char *path, time_t *mt, gboolean setup_watches)
+fdi_dir_check (const char *path, SourceCheck *check)
 {
 	struct dirent **namelist;
 	struct stat st;
 	int n;
-
-        if (setup_watches) {
-                HalFileMonitor *file_monitor;
-
-                file_monitor = osspec_get_file_monitor ();
-                if (file_monitor != NULL) {
-                        hal_file_monitor_add_notify (file_monitor,
-                                                     path,
-                                                     HAL_FILE_MONITOR_EVENT_CREATE|
-                                                     HAL_FILE_MONITOR_EVENT_DELETE|
-                                                     HAL_FILE_MONITOR_EVENT_CHANGE,
-                                                     cache_invalidated,
-                                                     NULL);
-                }
-        }
-	
-	if (!stat(path, &st)) {
-		if(st.st_mtime > *mt)
-			*mt = st.st_mtime;
-		
-		if(S_ISDIR(st.st_mode)) {
-			n = scandir(path, &namelist, 0, alphasort);
-			if (n < 0)
-				return;
-			else {
-				while(n--) {
-					gchar *cpath;
-					cpath = g_build_filename(path, namelist[n]->d_name, NULL);
-					if(namelist[n]->d_name[0] != '.')
-						dir_mtime(cpath, mt, setup_watches);
-					
-					free(namelist[n]);
-					g_free(cpath);
-				}
-				free(namelist);
+	int i;
+
+	if (check->setup_watches)
+		fdi_watch (path);
+	else if (check->changed)
+		return;
+
+	n = scandir (path, &namelist, 0, alphasort);
+	if (n < 0)
+		return;
+
+	for (i = 0; i < n; i++) {
+		const char *name = namelist[i]->d_name;
+		size_t len = strlen (name);
+		gchar *cpath;
+
+		cpath = g_strdup_printf ("%s/%s", path, name);
+		if (stat (cpath, &st) == 0) {
+			if (S_ISDIR (st.st_mode)) {
+				if (name[0] != '.')
+					fdi_dir_check (cpath, check);
+			} else if (S_ISREG (st.st_mode) && len >= 5 && strcmp (&name[len - 4], ".fdi") == 0) {
+				fdi_file_check (cpath, &st, check);
 			}
 		}
+
+		g_free (cpath);
+		free (namelist[i]);
 	}
+	free (namelist);
 }
 
+/**
+ * di_cache_coherency_check:
+ * @setup_watches: whether to watch the fdi directories for changes
+ *
+ * Compare the fdi files the cache was generated from with the ones in
+ * the fdi directories and regenerate the cache if they differ. After
+ * the first check the directories are only walked again once the file
+ * monitor saw a change, so this is cheap enough to call for every
+ * device. Without a file monitor the cache is only checked once.
+ *
+ * Returns: TRUE if the cache was regenerated
+ */
 gboolean
 di_cache_coherency_check (gboolean setup_watches)
 {
@@ -221,63 +381,105 @@ di_cache_coherency_check (gboolean setup_watches)
 	char *hal_fdi_source_information;
 	char *hal_fdi_source_policy;
 	char *cachename;
-	time_t mt;
+	struct cache_header *header;
+	struct cache_source *sources;
+	SourceCheck check;
 	struct stat st;
-	gboolean did_regen;
+	char *cache;
+	gboolean stale;
+	guint num_sources;
+	u_int32_t i;
+	int fd;
 
-        if (cache_valid)
-                return FALSE;
+	if (!setup_watches && checked_generation == fdi_generation)
+		return FALSE;
 
-	did_regen = FALSE;
+	/* changes while we're checking will be picked up next time */
+	checked_generation = fdi_generation;
 
-	mt = 0;
-	hal_fdi_source_preprobe = getenv ("HAL_FDI_SOURCE_PREPROBE");
-	hal_fdi_source_information = getenv ("HAL_FDI_SOURCE_INFORMATION");
-	hal_fdi_source_policy = getenv ("HAL_FDI_SOURCE_POLICY");
+	cachename = getenv ("HAL_FDI_CACHE_NAME");
+	if(cachename == NULL)
+		cachename = HALD_CACHE_FILE;
 
-	if (hal_fdi_source_preprobe != NULL) {
-		dir_mtime (hal_fdi_source_preprobe, &mt, setup_watches);
-	} else {
-		dir_mtime (PACKAGE_DATA_DIR "/hal/fdi/preprobe", &mt, setup_watches);
-		dir_mtime (PACKAGE_SYSCONF_DIR "/hal/fdi/preprobe", &mt, setup_watches);
+	check.sources = g_hash_table_new (g_str_hash, g_str_equal);
+	check.num_found = 0;
+	check.changed = FALSE;
+	check.setup_watches = setup_watches;
+
+	stale = TRUE;
+	num_sources = 0;
+	cache = MAP_FAILED;
+	st.st_size = 0;
+	if ((fd = open (cachename, O_RDONLY)) >= 0) {
+		if (fstat (fd, &st) == 0 && (size_t) st.st_size >= sizeof (struct cache_header))
+			cache = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close (fd);
 	}
 
-	if (hal_fdi_source_information != NULL) {
-		dir_mtime (hal_fdi_source_information, &mt, setup_watches);
+	if (cache == MAP_FAILED) {
+		HAL_INFO(("Cache missing or zero size, so regenerating"));
 	} else {
-		dir_mtime (PACKAGE_DATA_DIR "/hal/fdi/information", &mt, setup_watches);
-		dir_mtime (PACKAGE_SYSCONF_DIR "/hal/fdi/information", &mt, setup_watches);
+		header = (struct cache_header *) cache;
+		if (header->magic != HALD_CACHE_MAGIC ||
+		    header->sources + (size_t) header->num_sources * sizeof (struct cache_source) > (size_t) st.st_size) {
+			HAL_INFO(("Cache has an old format, so regenerating"));
+		} else {
+			sources = (struct cache_source *) (cache + header->sources);
+			for (i = 0; i < header->num_sources; i++) {
+				if (sources[i].path < (size_t) st.st_size) {
+					g_hash_table_insert (check.sources, cache + sources[i].path, &sources[i]);
+					num_sources++;
+				}
+			}
+			stale = FALSE;
+		}
 	}
 
-	if (hal_fdi_source_policy != NULL) {
-		dir_mtime (hal_fdi_source_policy, &mt, setup_watches);
-	} else {
-		dir_mtime (PACKAGE_DATA_DIR "/hal/fdi/policy", &mt, setup_watches);
-		dir_mtime (PACKAGE_SYSCONF_DIR "/hal/fdi/policy", &mt, setup_watches);
-	}
+	/* the directories are walked in any case to set up the watches */
+	if (!stale || setup_watches) {
+		hal_fdi_source_preprobe = getenv ("HAL_FDI_SOURCE_PREPROBE");
+		hal_fdi_source_information = getenv ("HAL_FDI_SOURCE_INFORMATION");
+		hal_fdi_source_policy = getenv ("HAL_FDI_SOURCE_POLICY");
+
+		if (hal_fdi_source_preprobe != NULL) {
+			fdi_dir_check (hal_fdi_source_preprobe, &check);
+		} else {
+			fdi_dir_check (PACKAGE_DATA_DIR "/hal/fdi/preprobe", &check);
+			fdi_dir_check (PACKAGE_SYSCONF_DIR "/hal/fdi/preprobe", &check);
+		}
 
-	cachename = getenv ("HAL_FDI_CACHE_NAME");
-	if(cachename == NULL)
-		cachename = HALD_CACHE_FILE;
+		if (hal_fdi_source_information != NULL) {
+			fdi_dir_check (hal_fdi_source_information, &check);
+		} else {
+			fdi_dir_check (PACKAGE_DATA_DIR "/hal/fdi/information", &check);
+			fdi_dir_check (PACKAGE_SYSCONF_DIR "/hal/fdi/information", &check);
+		}
 
-	if(stat (cachename, &st) == 0) {
-		if(st.st_mtime < mt) {
-			HAL_INFO(("Cache needs update"));
-			regen_cache();
-			did_regen = TRUE;
-		} else if (st.st_size == 0) {
-			HAL_INFO(("Cache zero size, so regenerating"));
-			regen_cache();
-			did_regen = TRUE;
+		if (hal_fdi_source_policy != NULL) {
+			fdi_dir_check (hal_fdi_source_policy, &check);
+		} else {
+			fdi_dir_check (PACKAGE_DATA_DIR "/hal/fdi/policy", &check);
+			fdi_dir_check (PACKAGE_SYSCONF_DIR "/hal/fdi/policy", &check);
 		}
-	} else {
-		regen_cache();
-		did_regen = TRUE;
 	}
-	
-	HAL_INFO(("cache mtime is %d",mt));
 
-        cache_valid = TRUE;
+	if (!stale) {
+		if (check.changed) {
+			stale = TRUE;
+		} else if (check.num_found != num_sources) {
+			HAL_INFO (("fdi files were removed"));
+			stale = TRUE;
+		}
+		if (stale)
+			HAL_INFO(("Cache needs update"));
+	}
+
+	g_hash_table_destroy (check.sources);
+	if (cache != MAP_FAILED)
+		munmap (cache, st.st_size);
+
+	if (stale)
+		regen_cache();
 
-	return did_regen;
+	return stale;
 }
@@ -31,10 +31,21 @@
 #ifndef __MMAP_CACHE_H__
 #define __MMAP_CACHE_H__
 
+#include <sys/types.h>
 #include <glib.h>
 
 int di_rules_init (void);
 gboolean di_cache_coherency_check (gboolean setup_watches);
 
+struct match_run;
+
+/* what hald keeps about a <match> rule besides the cache itself */
+struct match_info {
+	const struct match_run *run;	/* match run the rule is part of, or NULL */
+	const char *value;		/* interned value of string matches, or NULL */
+};
+
+const struct match_info *di_match_info_lookup (u_int32_t offset);
+
 #define RULES_PTR(x) ((void *)((unsigned char *) rules_ptr + x))
 #endif
@@ -110,10 +110,61 @@ struct cache_header {
 	u_int32_t	fdi_rules_policy;
 	u_int32_t	all_rules_size;
 	char		empty_string[4];
+	u_int32_t	magic;		/* HALD_CACHE_MAGIC, caches without it are regenerated */
+	u_int32_t	match_runs;	/* offset of the match run index, 0 if there is none */
+	u_int32_t	num_match_runs;
+	u_int32_t	sources;	/* offset of the struct cache_source table */
+	u_int32_t	num_sources;
+};
+
+/* An fdi file the cache was generated from. hald compares the table
+ * against the fdi directories to tell whether the cache is stale, and
+ * hald-generate-fdi-cache copies the rules of files that didn't change
+ * from the previous cache instead of parsing them again.
+ */
+struct cache_source {
+	u_int64_t	mtime;
+	u_int32_t	path;		/* offset of the file name */
+	u_int32_t	size;		/* size of the file */
+	u_int32_t	hash;		/* FNV-1a hash of the contents */
+	u_int32_t	rules;		/* offset of the first rule of the file */
+	u_int32_t	rules_size;	/* size of its rules, 0 if the file was skipped */
+	u_int32_t	reserved;
+};
+
+/* A match run is a sequence of <match> blocks where each block starts
+ * right where the previous one ends (fdi file boundaries aside), and
+ * all of them test the same key of the device itself for equality with
+ * a different value. Typical examples are the usb.vendor_id and
+ * usb.product_id lists in the information fdi files.
+ *
+ * A block of a run that doesn't match is skipped entirely, so instead
+ * of evaluating every block hald looks up the value of the key in the
+ * sorted entries of the run and jumps directly to the next block that
+ * can match, or to the end of the run.
+ */
+struct match_run {
+	match_type	type_match;	/* MATCH_STRING, MATCH_INT or MATCH_CONTAINS */
+	u_int32_t	first;		/* offset of the first <match> rule of the run */
+	u_int32_t	end;		/* where to go on if no further block can match */
+	u_int32_t	entries;	/* offset of the struct match_run_entry array */
+	u_int32_t	num_entries;
+};
+
+/* entries are sorted by value, and entries with the same value by rule offset */
+struct match_run_entry {
+	u_int32_t	rule;		/* offset of the <match> rule */
+	int32_t		int_value;	/* value of MATCH_INT rules as parsed by strtol */
 };
 
 #define HAL_MAX_INDENT_DEPTH		64
 
+/* bump the low byte whenever the cache layout changes */
+#define HALD_CACHE_MAGIC		0x46444902
+
+/* shorter runs are not worth a lookup */
+#define HALD_CACHE_MIN_MATCH_RUN	4
+
 #define HALD_CACHE_FILE PACKAGE_LOCALSTATEDIR "/cache/hald/fdi-cache"
 
 #endif
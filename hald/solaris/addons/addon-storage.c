@@ -34,6 +34,7 @@
 #include <libhal.h>
 
 #include <logger.h>
+#include <util_helper_env.h>
 
 #define	SLEEP_PERIOD	5
 
@@ -237,20 +238,20 @@ main (int argc, char *argv[])
 
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
 		goto out;
-	if ((raw_device_file = getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL)
+	if ((raw_device_file = hal_helper_getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL)
 		goto out;
-	if ((bus = getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
+	if ((bus = hal_helper_getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
 		goto out;
-	if ((drive_type = getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
+	if ((drive_type = hal_helper_getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
 		goto out;
 
 	drop_privileges ();
 
 	setup_logger ();
 
-	support_media_changed_str = getenv ("HAL_PROP_STORAGE_CDROM_SUPPORT_MEDIA_CHANGED");
+	support_media_changed_str = hal_helper_getenv ("HAL_PROP_STORAGE_CDROM_SUPPORT_MEDIA_CHANGED");
 	if (support_media_changed_str != NULL && strcmp (support_media_changed_str, "true") == 0)
 		support_media_changed = TRUE;
 	else
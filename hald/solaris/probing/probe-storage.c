@@ -37,6 +37,7 @@
 #include <cdutils.h>
 #include <fsutils.h>
 #include <logger.h>
+#include <util_helper_env.h>
 
 /** Check if a filesystem on a special device file is mounted
  *
@@ -355,13 +356,13 @@ main (int argc, char *argv[])
 
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL)
 		goto out;
-	if ((raw_device_file = getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL)
+	if ((raw_device_file = hal_helper_getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL)
 		goto out;
-	if ((bus = getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
+	if ((bus = hal_helper_getenv ("HAL_PROP_STORAGE_BUS")) == NULL)
 		goto out;
-	if ((drive_type = getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
+	if ((drive_type = hal_helper_getenv ("HAL_PROP_STORAGE_DRIVE_TYPE")) == NULL)
 		goto out;
 
 	drop_privileges ();
@@ -42,6 +42,7 @@
 #include <cdutils.h>
 #include <fsutils.h>
 #include <logger.h>
+#include <util_helper_env.h>
 
 static void
 my_dbus_error_free(DBusError *error)
@@ -455,10 +456,10 @@ main (int argc, char *argv[])
 	if ((udi = getenv ("UDI")) == NULL) {
 		goto out;
 	}
-	if ((device_file = getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL) {
+	if ((device_file = hal_helper_getenv ("HAL_PROP_BLOCK_DEVICE")) == NULL) {
 		goto out;
 	}
-	if ((raw_device_file = getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL) {
+	if ((raw_device_file = hal_helper_getenv ("HAL_PROP_BLOCK_SOLARIS_RAW_DEVICE")) == NULL) {
 		goto out;
 	}
 	if (!dos_to_dev(device_file, &rdevpath, &dos_num)) {
@@ -467,14 +468,14 @@ main (int argc, char *argv[])
 	if (!(is_dos = dos_to_dev(device_file, &devpath, &dos_num))) {
 		devpath = device_file;
 	}
-	if ((parent_udi = getenv ("HAL_PROP_INFO_PARENT")) == NULL) {
+	if ((parent_udi = hal_helper_getenv ("HAL_PROP_INFO_PARENT")) == NULL) {
 		goto out;
 	}
-	if ((storage_device = getenv ("HAL_PROP_BLOCK_STORAGE_DEVICE")) == NULL) {
+	if ((storage_device = hal_helper_getenv ("HAL_PROP_BLOCK_STORAGE_DEVICE")) == NULL) {
 		goto out;
 	}
 
-	is_disc_str = getenv ("HAL_PROP_VOLUME_IS_DISC");
+	is_disc_str = hal_helper_getenv ("HAL_PROP_VOLUME_IS_DISC");
 	if (is_disc_str != NULL && strcmp (is_disc_str, "true") == 0) {
 		is_disc = TRUE;
 	} else {
@@ -925,66 +925,149 @@ hal_util_dup_strv_from_g_slist (GSList *strlist)
 
 typedef struct {
 	HalDevice *d;
-	gchar **programs;
+	gchar **programs;	/* run one after another, in order */
+	gchar **parallel;	/* parallel-safe, all started at once */
 	gchar **extra_env;
 	guint next_program;
+	guint num_running;
+	gboolean ordered_done;
 
 	HalCalloutsDone callback;
 	gpointer userdata1;
 	gpointer userdata2;
 
+	int phase;	/* HaldStartupPhase to account the callouts to, or -1 */
 } Callout;
 
+typedef struct {
+	gchar *program;
+	gboolean ordered;
+	GTimeVal started;
+} CalloutRun;
+
+/* program -> HalCalloutStats */
+static GHashTable *callout_stats = NULL;
+
 static void callout_do_next (Callout *c);
 
+static void
+callout_stats_record (const gchar *program, guint32 exit_type, guint ms)
+{
+	HalCalloutStats *stats;
+
+	if (callout_stats == NULL)
+		callout_stats = g_hash_table_new (g_str_hash, g_str_equal);
+
+	stats = g_hash_table_lookup (callout_stats, program);
+	if (stats == NULL) {
+		stats = g_new0 (HalCalloutStats, 1);
+		stats->program = g_strdup (program);
+		g_hash_table_insert (callout_stats, stats->program, stats);
+	}
+
+	stats->runs++;
+	if (exit_type != HALD_RUN_SUCCESS)
+		stats->failed++;
+	stats->total_ms += ms;
+	if (ms > stats->max_ms)
+		stats->max_ms = ms;
+}
+
+static void
+callout_check_done (Callout *c)
+{
+	HalDevice *d;
+	gpointer userdata1;
+	gpointer userdata2;
+	HalCalloutsDone callback;
+
+	if (!c->ordered_done || c->num_running > 0)
+		return;
+
+	d = c->d;
+	userdata1 = c->userdata1;
+	userdata2 = c->userdata2;
+	callback = c->callback;
+
+	if (c->phase >= 0)
+		hald_startup_timing_end (c->phase, c);
+
+	g_strfreev (c->programs);
+	g_strfreev (c->parallel);
+	g_strfreev (c->extra_env);
+	g_free (c);
+
+	if (callback != NULL) {
+		callback (d, userdata1, userdata2);
+	}
+}
+
 static void 
 callout_terminated (HalDevice *d, guint32 exit_type, 
                    gint return_code, gchar **error, 
                    gpointer data1, gpointer data2)
 {
 	Callout *c;
+	CalloutRun *run;
+	GTimeVal now;
+	glong ms;
 
 	c = (Callout *) data1;
-	callout_do_next (c);
+	run = (CalloutRun *) data2;
+
+	g_get_current_time (&now);
+	ms = (now.tv_sec - run->started.tv_sec) * 1000 + (now.tv_usec - run->started.tv_usec) / 1000;
+	if (ms < 0)
+		ms = 0;
+	HAL_DEBUG (("Callout %s for %s took %ldms", run->program, hal_device_get_udi (c->d), ms));
+	callout_stats_record (run->program, exit_type, (guint) ms);
+
+	c->num_running--;
+	if (run->ordered)
+		callout_do_next (c);
+	else
+		callout_check_done (c);
+
+	g_free (run->program);
+	g_free (run);
 }
 
 static void
-callout_do_next (Callout *c)
+callout_run (Callout *c, const gchar *program, gboolean ordered)
 {
+	CalloutRun *run;
+
+	run = g_new0 (CalloutRun, 1);
+	run->program = g_strdup (program);
+	run->ordered = ordered;
+	g_get_current_time (&run->started);
+
+	/* the callback may run before hald_runner_run() returns */
+	c->num_running++;
+	hald_runner_run (c->d, program, c->extra_env,
+			 HAL_HELPER_TIMEOUT, callout_terminated,
+			 (gpointer) c, (gpointer) run);
+}
 
+static void
+callout_do_next (Callout *c)
+{
 	/* Check if we're done */
-	if (c->programs[c->next_program] == NULL) {
-		HalDevice *d;
-		gpointer userdata1;
-		gpointer userdata2;
-		HalCalloutsDone callback;
-
-		d = c->d;
-		userdata1 = c->userdata1;
-		userdata2 = c->userdata2;
-		callback = c->callback;
-
-		g_strfreev (c->programs);
-		g_strfreev (c->extra_env);
-		g_free (c);
-
-		if (callback != NULL) {
-			callback (d, userdata1, userdata2);
-		}
-
+	if (c->programs == NULL || c->programs[c->next_program] == NULL) {
+		c->ordered_done = TRUE;
+		callout_check_done (c);
 	} else {
-		hald_runner_run(c->d, c->programs[c->next_program], c->extra_env,
-				HAL_HELPER_TIMEOUT, callout_terminated,
-				(gpointer)c, NULL);
 		c->next_program++;
+		callout_run (c, c->programs[c->next_program - 1], TRUE);
 	}
 }
 
-void
-hal_callout_device (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
-		    char **programs, gchar **extra_env)
+static void
+callout_device (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
+		char **programs, char **parallel, gchar **extra_env, int phase)
 {
 	Callout *c;
+	guint i;
 
 	c = g_new0 (Callout, 1);
 	c->d = d;
@@ -992,20 +1075,104 @@ hal_callout_device (HalDevice *d, HalCalloutsDone callback, gpointer userdata1,
 	c->userdata1 = userdata1;
 	c->userdata2 = userdata2;
 	c->programs = programs;
+	c->parallel = parallel;
 	c->extra_env = g_strdupv (extra_env);
 	c->next_program = 0;
+	c->phase = phase;
+
+	if (phase >= 0)
+		hald_startup_timing_begin (phase, c);
+
+	/* parallel-safe callouts do not wait for, and are not waited for by,
+	 * any other callout of the device; the callback runs once all of
+	 * them and the ordered ones are done */
+	if (parallel != NULL) {
+		for (i = 0; parallel[i] != NULL; i++)
+			callout_run (c, parallel[i], FALSE);
+	}
 
 	callout_do_next (c);
 }
 
+void
+hal_callout_device (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
+		    char **programs, gchar **extra_env)
+{
+	callout_device (d, callback, userdata1, userdata2, programs, NULL, extra_env, -1);
+}
+
+/* Like hal_callout_device(), but also starts the parallel-safe callouts in
+ * @parallel; takes ownership of @programs and @parallel, either may be NULL */
+void
+hal_callout_device_full (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
+			 char **programs, char **parallel, gchar **extra_env)
+{
+	callout_device (d, callback, userdata1, userdata2, programs, parallel, extra_env, -1);
+}
+
+static void
+callout_stats_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	GSList **list = (GSList **) user_data;
+
+	*list = g_slist_prepend (*list, value);
+}
+
+static gint
+callout_stats_compare (gconstpointer a, gconstpointer b)
+{
+	const HalCalloutStats *sa = (const HalCalloutStats *) a;
+	const HalCalloutStats *sb = (const HalCalloutStats *) b;
+
+	if (sa->total_ms != sb->total_ms)
+		return sa->total_ms < sb->total_ms ? 1 : -1;
+	return strcmp (sa->program, sb->program);
+}
+
+/**
+ * hal_util_callout_get_stats:
+ *
+ * Returns: list of HalCalloutStats, one for each callout program that
+ * ran so far, slowest in total first; free the list (not the elements)
+ * with g_slist_free()
+ */
+GSList *
+hal_util_callout_get_stats (void)
+{
+	GSList *list;
+
+	list = NULL;
+	if (callout_stats != NULL)
+		g_hash_table_foreach (callout_stats, callout_stats_foreach, &list);
+	return g_slist_sort (list, callout_stats_compare);
+}
+
+void
+hal_util_callout_log_stats (void)
+{
+	GSList *list;
+	GSList *i;
+
+	list = hal_util_callout_get_stats ();
+	for (i = list; i != NULL; i = g_slist_next (i)) {
+		HalCalloutStats *stats = (HalCalloutStats *) i->data;
+
+		HAL_INFO (("Callout %s: %u runs (%u failed), %ums total, %ums max",
+			   stats->program, stats->runs, stats->failed, stats->total_ms, stats->max_ms));
+	}
+	g_slist_free (list);
+}
+
 void
 hal_util_callout_device_add (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2)
 {
 	char **programs;
+	char **parallel;
 	gchar *extra_env[2] = {"HALD_ACTION=add", NULL};
 
 	programs = hal_device_property_dup_strlist_as_strv (d, "info.callouts.add");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, "info.callouts.add.parallel");
+	if (programs == NULL && parallel == NULL) {
 		callback (d, userdata1, userdata2);
 		goto out;
 	}	
@@ -1013,7 +1180,7 @@ hal_util_callout_device_add (HalDevice *d, HalCalloutsDone callback, gpointer us
 
 	HAL_INFO (("Add callouts for udi=%s", hal_device_get_udi (d)));
 
-	hal_callout_device (d, callback, userdata1, userdata2, programs, extra_env);
+	callout_device (d, callback, userdata1, userdata2, programs, parallel, extra_env, HALD_STARTUP_PHASE_CALLOUTS);
 out:
 	;
 }
@@ -1022,17 +1189,19 @@ void
 hal_util_callout_device_remove (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2)
 {
 	char **programs;
+	char **parallel;
 	gchar *extra_env[2] = {"HALD_ACTION=remove", NULL};
 
 	programs = hal_device_property_dup_strlist_as_strv (d, "info.callouts.remove");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, "info.callouts.remove.parallel");
+	if (programs == NULL && parallel == NULL) {
 		callback (d, userdata1, userdata2);
 		goto out;
 	}	
 
 	HAL_INFO (("Remove callouts for udi=%s", hal_device_get_udi (d)));
 
-	hal_callout_device (d, callback, userdata1, userdata2, programs, extra_env);
+	callout_device (d, callback, userdata1, userdata2, programs, parallel, extra_env, -1);
 out:
 	;
 }
@@ -1041,17 +1210,19 @@ void
 hal_util_callout_device_preprobe (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2)
 {
 	char **programs;
+	char **parallel;
 	gchar *extra_env[2] = {"HALD_ACTION=preprobe", NULL};
 
 	programs = hal_device_property_dup_strlist_as_strv (d, "info.callouts.preprobe");
-	if (programs == NULL) {
+	parallel = hal_device_property_dup_strlist_as_strv (d, "info.callouts.preprobe.parallel");
+	if (programs == NULL && parallel == NULL) {
 		callback (d, userdata1, userdata2);
 		goto out;
 	}	
 
 	HAL_INFO (("Preprobe callouts for udi=%s", hal_device_get_udi (d)));
 
-	hal_callout_device (d, callback, userdata1, userdata2, programs, extra_env);
+	callout_device (d, callback, userdata1, userdata2, programs, parallel, extra_env, HALD_STARTUP_PHASE_PREPROBE);
 out:
 	;
 }
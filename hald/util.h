@@ -105,10 +105,26 @@ typedef void (*HalCalloutsDone) (HalDevice *d, gpointer userdata1, gpointer user
 void hal_callout_device (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
 			 char **programs, gchar **extra_env);
 
+void hal_callout_device_full (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2, 
+			      char **programs, char **parallel, gchar **extra_env);
+
 void hal_util_callout_device_add (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2);
 void hal_util_callout_device_remove (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2);
 void hal_util_callout_device_preprobe (HalDevice *d, HalCalloutsDone callback, gpointer userdata1, gpointer userdata2);
 
+/* Wall time spent in a callout program, over all devices */
+typedef struct {
+	gchar *program;
+	guint runs;
+	guint failed;		/* runs not ending with HALD_RUN_SUCCESS */
+	guint total_ms;
+	guint max_ms;
+} HalCalloutStats;
+
+GSList *hal_util_callout_get_stats (void);
+
+void hal_util_callout_log_stats (void);
+
 void hal_util_hexdump (const void *buf, unsigned int size);
 
 gboolean hal_util_is_mounted_by_hald (const char *mount_point);
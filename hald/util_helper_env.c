@@ -0,0 +1,135 @@
+/***************************************************************************
+ *
+ * util_helper_env.c - Device properties for helpers
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "util_helper_env.h"
+
+/* When hald runs with --lazy-helper-environment, the HAL_PROP_* variables
+ * are not in the environment of the helper but in a file named by
+ * HALD_PROPERTIES_SNAPSHOT, as a sequence of NUL terminated NAME=value
+ * entries. The file is shared by all helpers started for the same
+ * properties of a device and only mapped when a property is asked for. */
+
+static const char *snapshot = NULL;
+static size_t snapshot_size = 0;
+static int snapshot_loaded = 0;
+
+static void
+snapshot_load (void)
+{
+	const char *path;
+	struct stat st;
+	void *map;
+	int fd;
+
+	snapshot_loaded = 1;
+
+	path = getenv ("HALD_PROPERTIES_SNAPSHOT");
+	if (path == NULL)
+		return;
+
+	fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	if (fstat (fd, &st) == 0 && st.st_size > 0) {
+		map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			snapshot = (const char *) map;
+			snapshot_size = st.st_size;
+		}
+	}
+	close (fd);
+}
+
+/**
+ * hal_helper_getenv:
+ * @name: name of the variable, e.g. HAL_PROP_BLOCK_DEVICE
+ *
+ * Like getenv(), but also finds HAL_PROP_* variables that hald passed
+ * in a property snapshot instead of the environment.
+ *
+ * Returns: the value or NULL if not set; like the result of getenv(),
+ * it must not be modified
+ */
+char *
+hal_helper_getenv (const char *name)
+{
+	char *value;
+	const char *p;
+	const char *end;
+	size_t len;
+
+	value = getenv (name);
+	if (value != NULL)
+		return value;
+
+	if (!snapshot_loaded)
+		snapshot_load ();
+	if (snapshot == NULL)
+		return NULL;
+
+	len = strlen (name);
+	end = snapshot + snapshot_size;
+	for (p = snapshot; p < end; ) {
+		const char *next;
+
+		next = memchr (p, '\0', end - p);
+		if (next == NULL)
+			break;
+
+		if ((size_t) (next - p) > len && p[len] == '=' && strncmp (p, name, len) == 0)
+			return (char *) p + len + 1;
+
+		p = next + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * hal_helper_env_reset:
+ *
+ * Forget the property snapshot, e.g. after a worker changed the
+ * environment for its next job. Values returned by hal_helper_getenv()
+ * before are no longer valid.
+ */
+void
+hal_helper_env_reset (void)
+{
+	if (snapshot != NULL)
+		munmap ((void *) snapshot, snapshot_size);
+	snapshot = NULL;
+	snapshot_size = 0;
+	snapshot_loaded = 0;
+}
@@ -0,0 +1,30 @@
+/***************************************************************************
+ *
+ * util_helper_env.h - Device properties for helpers
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifndef UTIL_HELPER_ENV_H
+#define UTIL_HELPER_ENV_H
+
+char *hal_helper_getenv (const char *name);
+
+void hal_helper_env_reset (void);
+
+#endif /* UTIL_HELPER_ENV_H */
@@ -0,0 +1,301 @@
+/***************************************************************************
+ *
+ * util_helper_worker.c - Running probers as persistent workers
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libhal/libhal.h"
+#include "logger.h"
+#include "util_helper_env.h"
+#include "util_helper_worker.h"
+
+/* When hald runs with --probe-workers, hald-runner starts a prober once
+ * with HALD_HELPER_WORKER set and sends it one job per device over a
+ * socket on stdin: the argument vector and the environment, each as a
+ * sequence of NUL terminated strings ended by an empty string. The exit
+ * code of each job is written as a decimal line to the same socket on
+ * stdout. A job that calls exit() or crashes ends the worker; the runner
+ * then replies as it would have for a prober process of its own. */
+
+extern char **environ;
+
+static int worker_mode = 0;
+static LibHalContext *worker_ctx = NULL;
+
+static void
+free_strings (char **strings)
+{
+	int i;
+
+	if (strings == NULL)
+		return;
+	for (i = 0; strings[i] != NULL; i++)
+		free (strings[i]);
+	free (strings);
+}
+
+/* Read strings up to an empty one; returns NULL on EOF or error */
+static char **
+read_strings (FILE *f)
+{
+	char **strings;
+	char *s;
+	size_t n;
+	size_t len;
+	size_t size;
+	int c;
+
+	strings = calloc (1, sizeof (char *));
+	if (strings == NULL)
+		return NULL;
+	n = 0;
+
+	for (;;) {
+		len = 0;
+		size = 64;
+		s = malloc (size);
+		if (s == NULL)
+			goto error;
+
+		while ((c = getc (f)) != '\0') {
+			if (c == EOF)
+				goto error;
+			if (len + 1 == size) {
+				char *t;
+
+				size *= 2;
+				t = realloc (s, size);
+				if (t == NULL)
+					goto error;
+				s = t;
+			}
+			s[len++] = (char) c;
+		}
+		s[len] = '\0';
+
+		if (len == 0) {
+			free (s);
+			return strings;
+		}
+
+		{
+			char **t;
+
+			t = realloc (strings, (n + 2) * sizeof (char *));
+			if (t == NULL)
+				goto error;
+			strings = t;
+			strings[n++] = s;
+			strings[n] = NULL;
+		}
+	}
+
+error:
+	free (s);
+	free_strings (strings);
+	return NULL;
+}
+
+/* Replace the whole environment by env */
+static void
+set_environment (char **env)
+{
+	char **names;
+	int n;
+	int i;
+
+	for (n = 0; environ != NULL && environ[n] != NULL; n++)
+		;
+	names = calloc (n + 1, sizeof (char *));
+	if (names == NULL)
+		return;
+	for (i = 0; i < n; i++) {
+		const char *eq;
+
+		eq = strchr (environ[i], '=');
+		if (eq != NULL)
+			names[i] = strndup (environ[i], eq - environ[i]);
+		else
+			names[i] = strdup (environ[i]);
+	}
+	for (i = 0; i < n; i++) {
+		if (names[i] != NULL)
+			unsetenv (names[i]);
+	}
+	free_strings (names);
+
+	for (i = 0; env[i] != NULL; i++) {
+		char *eq;
+
+		eq = strchr (env[i], '=');
+		if (eq == NULL)
+			continue;
+		*eq = '\0';
+		setenv (env[i], eq + 1, 1);
+		*eq = '=';
+	}
+
+	hal_helper_env_reset ();
+}
+
+static int
+write_result (int fd, int code)
+{
+	char buf[32];
+	size_t len;
+	ssize_t n;
+	char *p;
+
+	snprintf (buf, sizeof (buf), "%d\n", code);
+	len = strlen (buf);
+	for (p = buf; len > 0; ) {
+		n = write (fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * hal_helper_worker_main:
+ * @argc: argument count from main()
+ * @argv: argument vector from main()
+ * @job: the probing code
+ *
+ * Runs @job once with @argc and @argv, or - when started by hald-runner
+ * as a worker - once for every job read from stdin, with the arguments
+ * and environment of the job.
+ *
+ * Returns: the exit code for main()
+ */
+int
+hal_helper_worker_main (int argc, char *argv[], HalHelperJobFunc job)
+{
+	char **job_argv;
+	char **job_env;
+	int result_fd;
+	int job_argc;
+
+	if (getenv ("HALD_HELPER_WORKER") == NULL)
+		return job (argc, argv);
+
+	worker_mode = 1;
+
+	/* keep stray output of the probing code off the result socket */
+	result_fd = dup (STDOUT_FILENO);
+	if (result_fd < 0 || dup2 (STDERR_FILENO, STDOUT_FILENO) < 0)
+		return 1;
+
+	while ((job_argv = read_strings (stdin)) != NULL) {
+		int code;
+
+		job_env = read_strings (stdin);
+		if (job_env == NULL) {
+			free_strings (job_argv);
+			break;
+		}
+
+		set_environment (job_env);
+		for (job_argc = 0; job_argv[job_argc] != NULL; job_argc++)
+			;
+
+		code = job (job_argc, job_argv);
+
+		fflush (stdout);
+		fflush (stderr);
+		free_strings (job_argv);
+		free_strings (job_env);
+
+		if (write_result (result_fd, code) != 0)
+			break;
+	}
+
+	hal_helper_worker_release_context (NULL);
+	return 0;
+}
+
+/**
+ * hal_helper_worker_get_context:
+ * @error: pointer to an initialized dbus error object
+ *
+ * Like libhal_ctx_init_direct(), but in a worker the connection to hald
+ * is opened once and used for all jobs.
+ *
+ * Returns: the context or NULL on error
+ */
+LibHalContext *
+hal_helper_worker_get_context (DBusError *error)
+{
+	if (!worker_mode)
+		return libhal_ctx_init_direct (error);
+
+	if (worker_ctx != NULL &&
+	    !dbus_connection_get_is_connected (libhal_ctx_get_dbus_connection (worker_ctx))) {
+		HAL_DEBUG (("Lost the connection to hald, reconnecting"));
+		hal_helper_worker_release_context (NULL);
+	}
+
+	if (worker_ctx == NULL)
+		worker_ctx = libhal_ctx_init_direct (error);
+
+	return worker_ctx;
+}
+
+/**
+ * hal_helper_worker_release_context:
+ * @ctx: context from hal_helper_worker_get_context() or NULL
+ *
+ * Shuts down and frees @ctx, unless it is the shared context of a
+ * worker; with @ctx NULL the shared context is freed.
+ */
+void
+hal_helper_worker_release_context (LibHalContext *ctx)
+{
+	DBusError error;
+
+	if (ctx == NULL) {
+		ctx = worker_ctx;
+		worker_ctx = NULL;
+	} else if (ctx == worker_ctx) {
+		return;
+	}
+
+	if (ctx == NULL)
+		return;
+
+	dbus_error_init (&error);
+	libhal_ctx_shutdown (ctx, &error);
+	LIBHAL_FREE_DBUS_ERROR (&error);
+	libhal_ctx_free (ctx);
+}
@@ -241,6 +241,8 @@ struct LibHalProperty_s {
 	UT_hash_handle hh;		/*makes this hashable*/
 };
 
+typedef struct LibHalCachedDevice_s LibHalCachedDevice;
+
 /**
  * LibHalContext:
  *
@@ -252,6 +254,8 @@ struct LibHalContext_s {
 	dbus_bool_t is_initialized;           /**< Are we initialised */
 	dbus_bool_t is_shutdown;              /**< Have we been shutdown */
 	dbus_bool_t cache_enabled;            /**< Is the cache enabled */
+	dbus_bool_t cache_primed;             /**< Has the cache been filled with all devices */
+	LibHalCachedDevice *cache;            /**< Cached properties, keyed by UDI */
 	dbus_bool_t is_direct;                /**< Whether the connection to hald is direct */
 
 	/** Device added */
@@ -402,11 +406,11 @@ libhal_property_fill_value_from_variant (LibHalProperty *p, DBusMessageIter *var
 	}
 	case DBUS_TYPE_BOOLEAN:
 	{
-		double v;
+		dbus_bool_t v;
 
 		dbus_message_iter_get_basic (var_iter, &v);
 
-		p->v.double_value = v;
+		p->v.bool_value = v;
 		p->type = LIBHAL_PROPERTY_TYPE_BOOLEAN; 
 
 		break;
@@ -560,6 +564,259 @@ libhal_device_get_all_properties (LibHalContext *ctx, const char *udi, DBusError
 	return result;
 }
 
+/**
+ * libhal_device_get_properties:
+ * @ctx: the context for the connection to hald
+ * @udi: the Unique id of device
+ * @keys: NULL-terminated list of property names
+ * @error: pointer to an initialized dbus error object for returning errors or NULL
+ *
+ * Retrieve the given properties of a device in one round trip. Keys the
+ * device doesn't have are not in the returned set; use
+ * libhal_ps_get_type() to tell.
+ *
+ * Returns: An object represent the properties. Must be freed with libhal_free_property_set().
+ */
+LibHalPropertySet *
+libhal_device_get_properties (LibHalContext *ctx, const char *udi, const char * const *keys, DBusError *error)
+{
+	DBusMessage *message;
+	DBusMessage *reply;
+	DBusMessageIter iter, iter_keys, reply_iter;
+	LibHalPropertySet *result;
+	DBusError _error;
+	unsigned int i;
+
+	LIBHAL_CHECK_LIBHALCONTEXT(ctx, NULL);
+	LIBHAL_CHECK_UDI_VALID(udi, NULL);
+	LIBHAL_CHECK_PARAM_VALID(keys, "*keys", NULL);
+
+	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
+						"org.freedesktop.Hal.Device",
+						"GetProperties");
+
+	if (message == NULL) {
+		fprintf (stderr,
+			 "%s %d : Couldn't allocate D-BUS message\n",
+			 __FILE__, __LINE__);
+		return NULL;
+	}
+
+	dbus_message_iter_init_append (message, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING_AS_STRING, &iter_keys);
+	for (i = 0; keys[i] != NULL; i++)
+		dbus_message_iter_append_basic (&iter_keys, DBUS_TYPE_STRING, &keys[i]);
+	dbus_message_iter_close_container (&iter, &iter_keys);
+
+	dbus_error_init (&_error);
+	reply = dbus_connection_send_with_reply_and_block (ctx->connection,
+							   message, -1,
+							   &_error);
+
+	dbus_message_unref (message);
+
+	dbus_move_error (&_error, error);
+	if (error != NULL && dbus_error_is_set (error)) {
+		fprintf (stderr,
+			 "%s %d : %s\n",
+			 __FILE__, __LINE__, error->message);
+		return NULL;
+	}
+
+	if (reply == NULL) {
+		return NULL;
+	}
+
+	dbus_message_iter_init (reply, &reply_iter);
+
+	result = get_property_set (&reply_iter);
+
+	dbus_message_unref (reply);
+
+	return result;
+}
+
+/*
+ * Client-side property cache, see libhal_ctx_set_cache(). Each cached
+ * device holds a complete snapshot of its properties as returned by
+ * GetAllProperties; a PropertyModified signal or a change made through
+ * this context drops the snapshot and the next read fetches a new one.
+ */
+struct LibHalCachedDevice_s {
+	char *udi;
+	LibHalPropertySet *properties;
+	UT_hash_handle hh;
+};
+
+#define LIBHAL_CACHE_MATCH_RULE					\
+	"type='signal',"					\
+	"interface='org.freedesktop.Hal.Device',"		\
+	"sender='org.freedesktop.Hal',"				\
+	"member='PropertyModified'"
+
+static dbus_bool_t
+cache_is_usable (LibHalContext *ctx)
+{
+	/* without signals from the bus there is nothing keeping it coherent */
+	return ctx->cache_enabled && ctx->is_initialized && !ctx->is_direct;
+}
+
+static void
+cache_add_device (LibHalContext *ctx, char *udi, LibHalPropertySet *properties)
+{
+	LibHalCachedDevice *d;
+
+	d = malloc (sizeof (LibHalCachedDevice));
+	if (d == NULL) {
+		free (udi);
+		libhal_free_property_set (properties);
+		return;
+	}
+	d->udi = udi;
+	d->properties = properties;
+	HASH_ADD_KEYPTR (hh, ctx->cache, d->udi, strlen (d->udi), d);
+}
+
+static void
+cache_invalidate_device (LibHalContext *ctx, const char *udi)
+{
+	LibHalCachedDevice *d;
+
+	if (udi == NULL || ctx->cache == NULL)
+		return;
+
+	HASH_FIND_STR (ctx->cache, udi, d);
+	if (d != NULL) {
+		HASH_DELETE (hh, ctx->cache, d);
+		free (d->udi);
+		libhal_free_property_set (d->properties);
+		free (d);
+	}
+}
+
+static void
+cache_flush (LibHalContext *ctx)
+{
+	while (ctx->cache != NULL)
+		cache_invalidate_device (ctx, ctx->cache->udi);
+	ctx->cache_primed = FALSE;
+}
+
+#define LIBHAL_CACHE_PRIME_PAGE_SIZE 256
+
+/* The first read after the cache is switched on fetches every device a
+ * page of GetDevicesPage at a time; devices missing after that (new or
+ * invalidated ones) are fetched one at a time. */
+static void
+cache_prime (LibHalContext *ctx)
+{
+	int num_devices;
+	char **udis;
+	LibHalPropertySet **properties;
+	char *start;
+	char *next;
+	int i;
+
+	ctx->cache_primed = TRUE;
+
+	start = NULL;
+	do {
+		if (!libhal_get_devices_page (ctx, start, LIBHAL_CACHE_PRIME_PAGE_SIZE, NULL, NULL,
+					      &num_devices, &udis, &properties, &next, NULL))
+			next = NULL;
+		else {
+			for (i = 0; i < num_devices; i++) {
+				LibHalCachedDevice *d;
+
+				/* never add a device twice */
+				HASH_FIND_STR (ctx->cache, udis[i], d);
+				if (properties[i] != NULL && d == NULL) {
+					cache_add_device (ctx, udis[i], properties[i]);
+				} else {
+					free (udis[i]);
+					libhal_free_property_set (properties[i]);
+				}
+			}
+			free (udis);
+			free (properties);
+		}
+
+		libhal_free_string (start);
+		start = next;
+	} while (start != NULL);
+}
+
+/* Returns the cached property or NULL, in which case the caller asks hald
+ * as usual. *@have_device tells whether the device itself is cached, i.e.
+ * whether a NULL return means that the property doesn't exist. */
+static LibHalProperty *
+cache_lookup (LibHalContext *ctx, const char *udi, const char *key, dbus_bool_t *have_device)
+{
+	LibHalCachedDevice *d;
+	LibHalProperty *p;
+
+	if (have_device != NULL)
+		*have_device = FALSE;
+
+	if (!cache_is_usable (ctx))
+		return NULL;
+
+	if (!ctx->cache_primed)
+		cache_prime (ctx);
+
+	HASH_FIND_STR (ctx->cache, udi, d);
+	if (d == NULL) {
+		LibHalPropertySet *properties;
+		char *udi_copy;
+
+		properties = libhal_device_get_all_properties (ctx, udi, NULL);
+		if (properties == NULL)
+			return NULL;
+		udi_copy = strdup (udi);
+		if (udi_copy == NULL) {
+			libhal_free_property_set (properties);
+			return NULL;
+		}
+		cache_add_device (ctx, udi_copy, properties);
+		HASH_FIND_STR (ctx->cache, udi, d);
+		if (d == NULL)
+			return NULL;
+	}
+
+	if (have_device != NULL)
+		*have_device = TRUE;
+
+	HASH_FIND_STR (d->properties->properties, key, p);
+	return p;
+}
+
+static char **
+string_array_dup (char **strlist)
+{
+	char **copy;
+	unsigned int n;
+	unsigned int i;
+
+	for (n = 0; strlist[n] != NULL; n++)
+		;
+
+	copy = malloc (sizeof (char *) * (n + 1));
+	if (copy == NULL)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		copy[i] = strdup (strlist[i]);
+		if (copy[i] == NULL) {
+			libhal_free_string_array (copy);
+			return NULL;
+		}
+		copy[i + 1] = NULL;
+	}
+	copy[n] = NULL;
+
+	return copy;
+}
+
 static int
 key_sort (LibHalProperty *a, LibHalProperty *b)
 {
@@ -1063,6 +1320,7 @@ filter_func (DBusConnection * connection,
 		if (dbus_message_get_args (message, &error,
 					   DBUS_TYPE_STRING, &udi,
 					   DBUS_TYPE_INVALID)) {
+			cache_invalidate_device (ctx, udi);
 			if (ctx->device_removed != NULL) {
 				ctx->device_removed (ctx, udi);
 			}
@@ -1163,6 +1421,8 @@ filter_func (DBusConnection * connection,
 		}
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	} else if (dbus_message_is_signal (message, "org.freedesktop.Hal.Device", "PropertyModified")) {
+		cache_invalidate_device (ctx, object_path);
+
 		if (ctx->device_property_modified != NULL) {
 			int i;
 			char *key;
@@ -1299,12 +1559,16 @@ libhal_device_get_property_type (LibHalContext *ctx, const char *udi, const char
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	LibHalPropertyType type;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, LIBHAL_PROPERTY_TYPE_INVALID); /* or return NULL? */
 	LIBHAL_CHECK_UDI_VALID(udi, LIBHAL_PROPERTY_TYPE_INVALID);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", LIBHAL_PROPERTY_TYPE_INVALID);
 
+	if ((p = cache_lookup (ctx, udi, key, NULL)) != NULL)
+		return p->type;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyType");
@@ -1359,12 +1623,17 @@ libhal_device_get_property_strlist (LibHalContext *ctx, const char *udi, const c
 	DBusMessage *reply;
 	DBusMessageIter iter, iter_array, reply_iter;
 	char **our_strings;
+	LibHalProperty *p;
 	DBusError _error;
 	
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, NULL);
 	LIBHAL_CHECK_UDI_VALID(udi, NULL);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", NULL);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_STRLIST)
+		return string_array_dup (p->v.strlist_value);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyStringList");
@@ -1431,12 +1700,17 @@ libhal_device_get_property_string (LibHalContext *ctx,
 	DBusMessageIter iter, reply_iter;
 	char *value;
 	char *dbus_str;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, NULL);
 	LIBHAL_CHECK_UDI_VALID(udi, NULL);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", NULL);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_STRING)
+		return strdup (p->v.str_value);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyString");
@@ -1505,12 +1779,17 @@ libhal_device_get_property_int (LibHalContext *ctx,
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	dbus_int32_t value;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, -1);
 	LIBHAL_CHECK_UDI_VALID(udi, -1);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", -1);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_INT32)
+		return p->v.int_value;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyInteger");
@@ -1576,12 +1855,17 @@ libhal_device_get_property_uint64 (LibHalContext *ctx,
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	dbus_uint64_t value;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, -1);
 	LIBHAL_CHECK_UDI_VALID(udi, -1);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", -1);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_UINT64)
+		return p->v.uint64_value;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyInteger");
@@ -1646,12 +1930,17 @@ libhal_device_get_property_double (LibHalContext *ctx,
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	double value;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, -1.0);
 	LIBHAL_CHECK_UDI_VALID(udi, -1.0);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", -1.0);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_DOUBLE)
+		return p->v.double_value;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyDouble");
@@ -1716,12 +2005,17 @@ libhal_device_get_property_bool (LibHalContext *ctx,
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	dbus_bool_t value;
+	LibHalProperty *p;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 
+	p = cache_lookup (ctx, udi, key, NULL);
+	if (p != NULL && p->type == LIBHAL_PROPERTY_TYPE_BOOLEAN)
+		return p->v.bool_value;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"GetPropertyBoolean");
@@ -1790,6 +2084,8 @@ libhal_device_set_property_helper (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	/** @todo  sanity check incoming params */
 	switch (type) {
 	case DBUS_TYPE_INVALID:
@@ -2052,6 +2348,8 @@ libhal_device_property_strlist_append (LibHalContext *ctx,
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 	LIBHAL_CHECK_PARAM_VALID(value, "*value", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"StringListAppend");
@@ -2111,6 +2409,8 @@ libhal_device_property_strlist_prepend (LibHalContext *ctx,
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 	LIBHAL_CHECK_PARAM_VALID(value, "*value", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"StringListPrepend");
@@ -2169,6 +2469,8 @@ libhal_device_property_strlist_remove_index (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"StringListRemoveIndex");
@@ -2227,6 +2529,8 @@ libhal_device_property_strlist_remove (LibHalContext *ctx,
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 	LIBHAL_CHECK_PARAM_VALID(value, "*value", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"StringListRemove");
@@ -2486,6 +2790,9 @@ libhal_device_commit_to_gdl (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(temp_udi, FALSE);
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 
+	cache_invalidate_device (ctx, temp_udi);
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal",
 						"/org/freedesktop/Hal/Manager",
 						"org.freedesktop.Hal.Manager",
@@ -2663,12 +2970,18 @@ libhal_device_property_exists (LibHalContext *ctx,
 	DBusMessage *reply;
 	DBusMessageIter iter, reply_iter;
 	dbus_bool_t value;
+	dbus_bool_t have_device;
 	DBusError _error;
 
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(key, "*key", FALSE);
 
+	if (cache_lookup (ctx, udi, key, &have_device) != NULL)
+		return TRUE;
+	else if (have_device)
+		return FALSE;
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"PropertyExists");
@@ -2736,6 +3049,8 @@ libhal_merge_properties (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(target_udi, FALSE);
 	LIBHAL_CHECK_UDI_VALID(source_udi, FALSE);
 
+	cache_invalidate_device (ctx, target_udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal",
 						"/org/freedesktop/Hal/Manager",
 						"org.freedesktop.Hal.Manager",
@@ -3032,6 +3347,8 @@ libhal_device_add_capability (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(capability, "*capability", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"AddCapability");
@@ -3311,8 +3628,14 @@ libhal_ctx_new (void)
  * @ctx: context to enable/disable cache for
  * @use_cache: whether or not to use cache
  *
- * Enable or disable caching. Note: Caching is not actually
- * implemented yet.
+ * Enable or disable caching of device properties. With the cache
+ * enabled the libhal_device_get_property_*() family of functions and
+ * libhal_device_property_exists() are answered from a local copy of the
+ * properties of each device; the copy of a device is dropped when hald
+ * signals that one of its properties changed. The application must
+ * dispatch messages on its D-Bus connection (e.g. run a main loop) for
+ * these signals to arrive. Contexts connected directly to hald (see
+ * libhal_ctx_init_direct()) never cache.
  *
  * Returns: TRUE if cache was successfully enabled/disabled, FALSE otherwise
  */
@@ -3321,6 +3644,16 @@ libhal_ctx_set_cache (LibHalContext *ctx, dbus_bool_t use_cache)
 {
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 
+	if (ctx->is_initialized && !ctx->is_direct && use_cache != ctx->cache_enabled) {
+		if (use_cache)
+			dbus_bus_add_match (ctx->connection, LIBHAL_CACHE_MATCH_RULE, NULL);
+		else
+			dbus_bus_remove_match (ctx->connection, LIBHAL_CACHE_MATCH_RULE, NULL);
+	}
+
+	if (!use_cache)
+		cache_flush (ctx);
+
 	ctx->cache_enabled = use_cache;
 	return TRUE;
 }
@@ -3408,6 +3741,10 @@ libhal_ctx_init (LibHalContext *ctx, DBusError *error)
 	if (error != NULL && dbus_error_is_set (error)) {
 		return FALSE;
 	}
+
+	if (ctx->cache_enabled)
+		dbus_bus_add_match (ctx->connection, LIBHAL_CACHE_MATCH_RULE, NULL);
+
 	ctx->is_initialized = TRUE;
 	ctx->is_direct = FALSE;
 
@@ -3495,11 +3832,15 @@ libhal_ctx_shutdown (LibHalContext *ctx, DBusError *error)
 			/** @todo  clean up */
 		}
 
+		if (ctx->cache_enabled)
+			dbus_bus_remove_match (ctx->connection, LIBHAL_CACHE_MATCH_RULE, NULL);
+
 		/* TODO: remove other matches */
 
 		dbus_connection_remove_filter (ctx->connection, filter_func, ctx);
 	}
 
+	cache_flush (ctx);
 	ctx->is_initialized = FALSE;
 
 	return TRUE;
@@ -3516,6 +3857,7 @@ libhal_ctx_shutdown (LibHalContext *ctx, DBusError *error)
 dbus_bool_t    
 libhal_ctx_free (LibHalContext *ctx)
 {
+	cache_flush (ctx);
 	free (ctx);
 	return TRUE;
 }
@@ -3708,6 +4050,8 @@ libhal_device_rescan (LibHalContext *ctx, const char *udi, DBusError *error)
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal", udi,
 						"org.freedesktop.Hal.Device",
 						"Rescan");
@@ -3765,6 +4109,8 @@ libhal_device_reprobe (LibHalContext *ctx, const char *udi, DBusError *error)
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal",
 						udi,
 						"org.freedesktop.Hal.Device",
@@ -4016,6 +4362,8 @@ libhal_device_claim_interface (LibHalContext *ctx,
 	LIBHAL_CHECK_UDI_VALID(udi, FALSE);
 	LIBHAL_CHECK_PARAM_VALID(interface_name, "*interface_name", FALSE);
 
+	cache_invalidate_device (ctx, udi);
+
 	message = dbus_message_new_method_call ("org.freedesktop.Hal",
 						udi,
 						"org.freedesktop.Hal.Device",
@@ -4418,6 +4766,8 @@ libhal_device_commit_changeset (LibHalContext *ctx, LibHalChangeSet *changeset,
 	LIBHAL_CHECK_LIBHALCONTEXT(ctx, FALSE);
 	LIBHAL_CHECK_UDI_VALID(changeset->udi, FALSE);
 
+	cache_invalidate_device (ctx, changeset->udi);
+
 	if (changeset->head == NULL) {
 		return TRUE;
 	}
@@ -5072,28 +5422,14 @@ libhal_device_is_caller_privileged (LibHalContext *ctx,
 	return value;
 }
 
-/**
- * libhal_get_all_devices_with_properties:
- * @out_num_devices: Return location for number of devices
- * @out_udi: Return location for array of of udi's. Caller should free this with libhal_free_string_array() when done with it.
- * @out_properties: Return location for array of #LibHalPropertySet objects. Caller should free each one of them with libhal_free_property_set() when done with it
- * @error: Return location for error
- *
- * Get all devices in the hal database as well as all properties for each device.
- *
- * Return: %TRUE if success; %FALSE and @error will be set.
- **/
-dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx, 
-                                                    int                 *out_num_devices, 
-                                                    char              ***out_udi,
-                                                    LibHalPropertySet ***out_properties, 
-                                                    DBusError           *error)
+/* Parses an array of (udi, properties) structs as returned by
+ * GetAllDevicesWithProperties and GetDevicesPage. */
+static dbus_bool_t
+get_devices_with_properties (DBusMessageIter      *iter_array,
+                             int                  *out_num_devices,
+                             char               ***out_udi,
+                             LibHalPropertySet  ***out_properties)
 {
-
-	DBusMessage *message;
-	DBusMessage *reply;
-	DBusMessageIter iter_array, reply_iter;
-	DBusError _error;
         char **udi_array;
         char **_udi_array;
         LibHalPropertySet **prop_array;
@@ -5101,51 +5437,10 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
         size_t count;
         unsigned int n;
 
-	LIBHAL_CHECK_LIBHALCONTEXT (ctx, FALSE);
-	LIBHAL_CHECK_PARAM_VALID (out_num_devices, "*out_num_devices",FALSE);
-	LIBHAL_CHECK_PARAM_VALID (out_udi, "***out_udi", FALSE);
-	LIBHAL_CHECK_PARAM_VALID (out_properties, "***out_properties", FALSE);
-
-	*out_num_devices = 0;
-        *out_udi = NULL;
-        *out_properties = NULL;
-
         count = 0;
         udi_array  = NULL;
         prop_array = NULL;
 
-	message = dbus_message_new_method_call ("org.freedesktop.Hal",
-						"/org/freedesktop/Hal/Manager",
-						"org.freedesktop.Hal.Manager",
-						"GetAllDevicesWithProperties");
-	if (message == NULL) {
-		fprintf (stderr, "%s %d : Could not allocate D-BUS message\n", __FILE__, __LINE__);
-		goto fail;
-	}
-
-	dbus_error_init (&_error);
-	reply = dbus_connection_send_with_reply_and_block (ctx->connection, message, -1, &_error);
-
-	dbus_move_error (&_error, error);
-	if (error != NULL && dbus_error_is_set (error)) {
-		dbus_message_unref (message);
-		goto fail;
-	}
-	if (reply == NULL) {
-		dbus_message_unref (message);
-		goto fail;
-	}
-
-	/* now analyze reply */
-	dbus_message_iter_init (reply, &reply_iter);
-
-	if (dbus_message_iter_get_arg_type (&reply_iter) != DBUS_TYPE_ARRAY) {
-		fprintf (stderr, "%s %d : wrong reply from hald.  Expecting an array.\n", __FILE__, __LINE__);
-		goto fail;
-	}
-	
-	dbus_message_iter_recurse (&reply_iter, &iter_array);
-
         #define _BLOCK_SIZE 32
 
         udi_array = (char **) malloc (sizeof (char*) * _BLOCK_SIZE);
@@ -5156,7 +5451,7 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
         if (prop_array == NULL)
                 goto fail;
 
-	while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT) {
+	while (dbus_message_iter_get_arg_type (iter_array) == DBUS_TYPE_STRUCT) {
                 DBusMessageIter iter_struct;
 		const char *value;
                 LibHalPropertySet *pset;
@@ -5171,7 +5466,7 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
                         prop_array = _prop_array;
 		}
 
-                dbus_message_iter_recurse (&iter_array, &iter_struct);
+                dbus_message_iter_recurse (iter_array, &iter_struct);
 		
 		dbus_message_iter_get_basic (&iter_struct, &value);
 		udi = strdup (value);
@@ -5186,7 +5481,7 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
                 prop_array[count] = pset;
                 count++;
 
-		dbus_message_iter_next (&iter_array);
+		dbus_message_iter_next (iter_array);
 	}
 
         if ((count % _BLOCK_SIZE) == 0 && count > 0) {
@@ -5203,9 +5498,6 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
 	*out_num_devices = count;
         *out_udi = udi_array;
         *out_properties = prop_array;
-		      
-	dbus_message_unref (reply);
-	dbus_message_unref (message);
 
 	return TRUE;
 
@@ -5226,3 +5518,214 @@ fail:
 
         return FALSE;
 }
+
+/**
+ * libhal_get_all_devices_with_properties:
+ * @out_num_devices: Return location for number of devices
+ * @out_udi: Return location for array of of udi's. Caller should free this with libhal_free_string_array() when done with it.
+ * @out_properties: Return location for array of #LibHalPropertySet objects. Caller should free each one of them with libhal_free_property_set() when done with it
+ * @error: Return location for error
+ *
+ * Get all devices in the hal database as well as all properties for each device.
+ *
+ * Return: %TRUE if success; %FALSE and @error will be set.
+ **/
+dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx, 
+                                                    int                 *out_num_devices, 
+                                                    char              ***out_udi,
+                                                    LibHalPropertySet ***out_properties, 
+                                                    DBusError           *error)
+{
+
+	DBusMessage *message;
+	DBusMessage *reply;
+	DBusMessageIter iter_array, reply_iter;
+	DBusError _error;
+	dbus_bool_t ret;
+
+	LIBHAL_CHECK_LIBHALCONTEXT (ctx, FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_num_devices, "*out_num_devices",FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_udi, "***out_udi", FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_properties, "***out_properties", FALSE);
+
+	*out_num_devices = 0;
+        *out_udi = NULL;
+        *out_properties = NULL;
+
+	message = dbus_message_new_method_call ("org.freedesktop.Hal",
+						"/org/freedesktop/Hal/Manager",
+						"org.freedesktop.Hal.Manager",
+						"GetAllDevicesWithProperties");
+	if (message == NULL) {
+		fprintf (stderr, "%s %d : Could not allocate D-BUS message\n", __FILE__, __LINE__);
+		return FALSE;
+	}
+
+	dbus_error_init (&_error);
+	reply = dbus_connection_send_with_reply_and_block (ctx->connection, message, -1, &_error);
+	dbus_message_unref (message);
+
+	dbus_move_error (&_error, error);
+	if (error != NULL && dbus_error_is_set (error)) {
+		return FALSE;
+	}
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	/* now analyze reply */
+	dbus_message_iter_init (reply, &reply_iter);
+
+	if (dbus_message_iter_get_arg_type (&reply_iter) != DBUS_TYPE_ARRAY) {
+		fprintf (stderr, "%s %d : wrong reply from hald.  Expecting an array.\n", __FILE__, __LINE__);
+		dbus_message_unref (reply);
+		return FALSE;
+	}
+	
+	dbus_message_iter_recurse (&reply_iter, &iter_array);
+
+	ret = get_devices_with_properties (&iter_array, out_num_devices, out_udi, out_properties);
+
+	dbus_message_unref (reply);
+	return ret;
+}
+
+/**
+ * libhal_get_devices_page:
+ * @ctx: the context for the connection to hald
+ * @start: UDI to continue after; NULL or "" for the first page
+ * @page_size: maximum number of devices to return; hald caps this at 1000, 0 means its default
+ * @keys: NULL-terminated list of properties to return for each device; NULL for all
+ * @capability: only return devices with this capability; NULL for all devices
+ * @out_num_devices: Return location for number of devices
+ * @out_udi: Return location for array of udi's. Caller should free this with libhal_free_string_array() when done with it.
+ * @out_properties: Return location for array of #LibHalPropertySet objects. Caller should free each one of them with libhal_free_property_set() when done with it
+ * @out_next: Return location for the @start of the next page, or NULL after the last page. Caller should free this with libhal_free_string().
+ * @error: Return location for error
+ *
+ * Get devices and their properties in bounded chunks, ordered by UDI.
+ * Unlike libhal_get_all_devices_with_properties() neither hald nor the
+ * client ever has to hold the whole device list in one message:
+ *
+ * <programlisting>
+ * char *start = NULL;
+ * do {
+ *         char *next;
+ *         ... libhal_get_devices_page (ctx, start, 200, NULL, NULL, &n, &udis, &props, &next, &error) ...
+ *         libhal_free_string (start);
+ *         start = next;
+ * } while (start != NULL);
+ * </programlisting>
+ *
+ * Return: %TRUE if success; %FALSE and @error will be set.
+ **/
+dbus_bool_t
+libhal_get_devices_page (LibHalContext       *ctx,
+			 const char          *start,
+			 int                  page_size,
+			 const char * const  *keys,
+			 const char          *capability,
+			 int                 *out_num_devices,
+			 char              ***out_udi,
+			 LibHalPropertySet ***out_properties,
+			 char               **out_next,
+			 DBusError           *error)
+{
+	DBusMessage *message;
+	DBusMessage *reply;
+	DBusMessageIter iter, iter_keys, iter_array, reply_iter;
+	DBusError _error;
+	const char *next;
+	dbus_int32_t size;
+	unsigned int i;
+
+	LIBHAL_CHECK_LIBHALCONTEXT (ctx, FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_num_devices, "*out_num_devices",FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_udi, "***out_udi", FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_properties, "***out_properties", FALSE);
+	LIBHAL_CHECK_PARAM_VALID (out_next, "**out_next", FALSE);
+
+	*out_num_devices = 0;
+	*out_udi = NULL;
+	*out_properties = NULL;
+	*out_next = NULL;
+
+	if (start == NULL)
+		start = "";
+	if (capability == NULL)
+		capability = "";
+	size = page_size;
+
+	message = dbus_message_new_method_call ("org.freedesktop.Hal",
+						"/org/freedesktop/Hal/Manager",
+						"org.freedesktop.Hal.Manager",
+						"GetDevicesPage");
+	if (message == NULL) {
+		fprintf (stderr, "%s %d : Could not allocate D-BUS message\n", __FILE__, __LINE__);
+		return FALSE;
+	}
+
+	dbus_message_iter_init_append (message, &iter);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &start);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &size);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING_AS_STRING, &iter_keys);
+	for (i = 0; keys != NULL && keys[i] != NULL; i++)
+		dbus_message_iter_append_basic (&iter_keys, DBUS_TYPE_STRING, &keys[i]);
+	dbus_message_iter_close_container (&iter, &iter_keys);
+	dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &capability);
+
+	dbus_error_init (&_error);
+	reply = dbus_connection_send_with_reply_and_block (ctx->connection, message, -1, &_error);
+	dbus_message_unref (message);
+
+	dbus_move_error (&_error, error);
+	if (error != NULL && dbus_error_is_set (error)) {
+		return FALSE;
+	}
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_iter_init (reply, &reply_iter);
+
+	if (dbus_message_iter_get_arg_type (&reply_iter) != DBUS_TYPE_ARRAY) {
+		fprintf (stderr, "%s %d : wrong reply from hald.  Expecting an array.\n", __FILE__, __LINE__);
+		dbus_message_unref (reply);
+		return FALSE;
+	}
+
+	dbus_message_iter_recurse (&reply_iter, &iter_array);
+	dbus_message_iter_next (&reply_iter);
+
+	if (dbus_message_iter_get_arg_type (&reply_iter) != DBUS_TYPE_STRING) {
+		fprintf (stderr, "%s %d : wrong reply from hald.  Expecting a string.\n", __FILE__, __LINE__);
+		dbus_message_unref (reply);
+		return FALSE;
+	}
+	dbus_message_iter_get_basic (&reply_iter, &next);
+
+	if (!get_devices_with_properties (&iter_array, out_num_devices, out_udi, out_properties)) {
+		dbus_message_unref (reply);
+		return FALSE;
+	}
+
+	if (next[0] != '\0') {
+		*out_next = strdup (next);
+		if (*out_next == NULL) {
+			int n;
+
+			for (n = 0; n < *out_num_devices; n++)
+				libhal_free_property_set ((*out_properties)[n]);
+			free (*out_properties);
+			libhal_free_string_array (*out_udi);
+			*out_num_devices = 0;
+			*out_udi = NULL;
+			*out_properties = NULL;
+			dbus_message_unref (reply);
+			return FALSE;
+		}
+	}
+
+	dbus_message_unref (reply);
+	return TRUE;
+}
@@ -518,6 +518,12 @@ LibHalPropertySet *libhal_device_get_all_properties (LibHalContext *ctx,
 						     const char *udi,
 						     DBusError *error);
 
+/* Retrieve the given properties on a device. */
+LibHalPropertySet *libhal_device_get_properties (LibHalContext *ctx,
+						 const char *udi,
+						 const char * const *keys,
+						 DBusError *error);
+
 /* Get all devices and their properties */
 dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx, 
                                                     int                 *out_num_devices, 
@@ -525,6 +531,18 @@ dbus_bool_t libhal_get_all_devices_with_properties (LibHalContext       *ctx,
                                                     LibHalPropertySet ***out_properties, 
                                                     DBusError           *error);
 
+/* Get devices and their properties a page at a time */
+dbus_bool_t libhal_get_devices_page (LibHalContext       *ctx,
+				     const char          *start,
+				     int                  page_size,
+				     const char * const  *keys,
+				     const char          *capability,
+				     int                 *out_num_devices,
+				     char              ***out_udi,
+				     LibHalPropertySet ***out_properties,
+				     char               **out_next,
+				     DBusError           *error);
+
 /* sort all properties according to property name */
 void libhal_property_set_sort (LibHalPropertySet *set);
 
@@ -293,6 +293,49 @@ out:
 }
 #endif
 
+/* Partition tables are read through this so the parsers can work on
+ * whole sectors; reads within the first PART_READ_AHEAD bytes of the
+ * disk are served from a single read done up front. */
+typedef struct {
+	int fd;
+	guint64 size;
+
+	guint8 *head;
+	gsize head_len;
+
+	/* statistics */
+	int num_reads;
+	guint64 num_bytes;
+} PartReader;
+
+#define PART_READ_AHEAD (64 * 1024)
+
+static gboolean
+part_read (PartReader *r, guint64 offset, void *buf, gsize len)
+{
+	ssize_t n;
+
+	/* offsets come from on-disk data; don't let offset + len wrap */
+	if (offset < r->head_len && len <= r->head_len - offset) {
+		memcpy (buf, r->head + offset, len);
+		return TRUE;
+	}
+
+	n = pread (r->fd, buf, len, offset);
+	r->num_reads++;
+	if (n < 0) {
+		HAL_INFO (("read at offset %" G_GUINT64_FORMAT " failed (%s)", offset, strerror (errno)));
+		return FALSE;
+	}
+	r->num_bytes += n;
+	if ((gsize) n != len) {
+		HAL_INFO (("short read at offset %" G_GUINT64_FORMAT, offset));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static PartitionEntry *
 part_entry_new (PartitionTable *e_part_table, const guint8 *data, int length, guint64 offset)
 {
@@ -350,7 +393,7 @@ part_table_free (PartitionTable *p)
 
 #if 0
 static PartitionTable *
-part_table_parse_bsd (int fd, guint64 offset, guint64 size)
+part_table_parse_bsd (PartReader *r, guint64 offset, guint64 size)
 {
 	PartitionTable *p;
 
@@ -412,7 +455,7 @@ hexdump (const guint8 *mem, int size)
 #endif
 
 static PartitionTable *
-part_table_parse_msdos_extended (int fd, guint64 offset, guint64 size)
+part_table_parse_msdos_extended (PartReader *r, guint64 offset, guint64 size)
 {
 	int n;
 	PartitionTable *p;
@@ -426,21 +469,15 @@ part_table_parse_msdos_extended (int fd, guint64 offset, guint64 size)
 
 	while (next != 0) {
 		guint64 readfrom;
-		const guint8 embr[512];
+		guint8 embr[512];
 
 		readfrom = next;
 		next = 0;
 
 		//HAL_INFO (("readfrom = %lld", readfrom));
 
-		if (lseek (fd, readfrom, SEEK_SET) < 0) {
-			HAL_INFO (("lseek failed (%s)", strerror (errno)));
-			goto out;
-		}
-		if (read (fd, &embr, sizeof (embr)) != sizeof (embr)) {
-			HAL_INFO (("read failed (%s)", strerror (errno)));
+		if (!part_read (r, readfrom, embr, sizeof (embr)))
 			goto out;
-		}
 		
 		if (memcmp (&embr[MSDOS_SIG_OFF], MSDOS_MAGIC, 2) != 0) {
 			HAL_INFO (("No MSDOS_MAGIC found"));
@@ -503,10 +540,10 @@ out:
 }
 
 static PartitionTable *
-part_table_parse_msdos (int fd, guint64 offset, guint64 size, gboolean *found_gpt)
+part_table_parse_msdos (PartReader *r, guint64 offset, guint64 size, gboolean *found_gpt)
 {
 	int n;
-	const guint8 mbr[512] __attribute__ ((aligned));
+	guint8 mbr[512];
 	PartitionTable *p;
 
 	//HAL_INFO (("Entering MS-DOS parser"));
@@ -515,14 +552,8 @@ part_table_parse_msdos (int fd, guint64 offset, guint64 size, gboolean *found_gp
 
 	p = NULL;
 
-	if (lseek (fd, offset, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, &mbr, sizeof (mbr)) != sizeof (mbr)) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
+	if (!part_read (r, offset, mbr, sizeof (mbr)))
 		goto out;
-	}
 
 	if (memcmp (&mbr[MSDOS_SIG_OFF], MSDOS_MAGIC, 2) != 0) {
 		HAL_INFO (("No MSDOS_MAGIC found"));
@@ -574,7 +605,7 @@ part_table_parse_msdos (int fd, guint64 offset, guint64 size, gboolean *found_gp
 		case 0x05: /* MS-DOS */
 		case 0x0f: /* Win95 */
 		case 0x85: /* Linux */
-			e_part_table = part_table_parse_msdos_extended (fd, pstart, psize);
+			e_part_table = part_table_parse_msdos_extended (r, pstart, psize);
 			if (e_part_table != NULL) {
 				pe = part_entry_new (e_part_table,
 						     &(mbr[MSDOS_PARTTABLE_OFFSET + n * 16]),
@@ -586,7 +617,7 @@ part_table_parse_msdos (int fd, guint64 offset, guint64 size, gboolean *found_gp
 		case 0xa5: /* FreeBSD */
 		case 0xa6: /* OpenBSD */
 		case 0xa9: /* NetBSD */
-			//e_part_table = part_table_parse_bsd (fd, pstart, psize);
+			//e_part_table = part_table_parse_bsd (r, pstart, psize);
 			//break;
 
 		default:
@@ -614,12 +645,15 @@ out:
 
 #define GPT_PART_TYPE_GUID_EMPTY "00000000-0000-0000-0000-000000000000"
 
+#define GPT_MAX_ENTRY_ARRAY_SIZE (1024 * 1024)
+
 static PartitionTable *
-part_table_parse_gpt (int fd, guint64 offset, guint64 size)
+part_table_parse_gpt (PartReader *r, guint64 offset, guint64 size)
 {
 	int n;
 	PartitionTable *p;
-	guint8 buf[16];
+	guint8 header[512];
+	guint8 *entries;
 	guint64 partition_entry_lba;
 	int num_entries;
 	int size_of_entry;
@@ -629,95 +663,65 @@ part_table_parse_gpt (int fd, guint64 offset, guint64 size)
 	/* by way of getting here, we've already checked for a protective MBR */
 
 	p = NULL;
+	entries = NULL;
 
-	/* Check GPT signature */
-	if (lseek (fd, offset + 512 + 0, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, buf, 8) != 8) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
+	if (!part_read (r, offset + 512, header, sizeof (header)))
 		goto out;
-	}
-	if (memcmp (buf, GPT_MAGIC, 8) != 0) {
+
+	/* Check GPT signature */
+	if (memcmp (header, GPT_MAGIC, 8) != 0) {
 		HAL_INFO (("No GPT_MAGIC found"));
 		goto out;
 	}
 
 	HAL_INFO (("GPT magic found"));
 
-	/* Disk UUID */
-	if (lseek (fd, offset + 512 + 56, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, buf, 16) != 16) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
-		goto out;
-	}
-	//hexdump ((guint8*) buf, 16);
+	/* Disk UUID is at 56 */
+	//hexdump (header + 56, 16);
 
-	if (lseek (fd, offset + 512 + 72, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, buf, 8) != 8) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
-		goto out;
-	}
-	partition_entry_lba = get_le64 (buf);
+	partition_entry_lba = get_le64 (header + 72);
+	num_entries = get_le32 (header + 80);
+	size_of_entry = get_le32 (header + 84);
 
-	if (lseek (fd, offset + 512 + 80, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, buf, 4) != 4) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
-		goto out;
-	}
-	num_entries = get_le32 (buf);
+	HAL_INFO (("partition_entry_lba=%" G_GUINT64_FORMAT, partition_entry_lba));
+	HAL_INFO (("num_entries=%d", num_entries));
+	HAL_INFO (("size_of_entry=%d", size_of_entry));
 
-	if (lseek (fd, offset + 512 + 84, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
+	/* the UEFI spec requires at least 16k for the entry array; anything
+	 * much bigger than that is garbage we don't want to allocate for */
+	if (size_of_entry < 128 || num_entries < 0 || 
+	    (guint64) num_entries * size_of_entry > GPT_MAX_ENTRY_ARRAY_SIZE) {
+		HAL_INFO (("Bogus GPT entry array"));
 		goto out;
 	}
-	if (read (fd, buf, 4) != 4) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
+
+	/* partition_entry_lba comes straight from the header; make sure the
+	 * byte offset of the entry array can't overflow */
+	if (offset > G_MAXUINT64 - GPT_MAX_ENTRY_ARRAY_SIZE ||
+	    partition_entry_lba > (G_MAXUINT64 - offset - GPT_MAX_ENTRY_ARRAY_SIZE) / 512) {
+		HAL_INFO (("Bogus GPT partition_entry_lba"));
 		goto out;
 	}
-	size_of_entry = get_le32(buf);
 
+	/* the whole entry array is read in one go */
+	entries = g_new (guint8, num_entries * size_of_entry);
+	if (!part_read (r, offset + partition_entry_lba * 512, entries, num_entries * size_of_entry))
+		goto out;
 
 	p = part_table_new_empty (PART_TYPE_GPT);
 	p->offset = offset;
 	p->size = size;
 
-	HAL_INFO (("partition_entry_lba=%d", partition_entry_lba));
-	HAL_INFO (("num_entries=%d", num_entries));
-	HAL_INFO (("size_of_entry=%d", size_of_entry));
-
 	for (n = 0; n < num_entries; n++) {
 		PartitionEntry *pe;
-		struct {
-			guint8 partition_type_guid[16];
-			guint8 partition_guid[16];
-			guint8 starting_lba[8];
-			guint8 ending_lba[8];
-			guint8 attributes[8];
-			guint8 partition_name[72];
-		} gpt_part_entry;
+		guint8 *gpt_part_entry;
 		char *partition_type_guid;
 
-		if (lseek (fd, offset + partition_entry_lba * 512 + n * size_of_entry, SEEK_SET) < 0) {
-			HAL_INFO (("lseek failed (%s)", strerror (errno)));
-			goto out;
-		}
-		if (read (fd, &gpt_part_entry, 128) != 128) {
-			HAL_INFO (("read failed (%s)", strerror (errno)));
-			goto out;
-		}
+		/* type guid (16), partition guid (16), starting lba (8),
+		 * ending lba (8), attributes (8) and name (72) */
+		gpt_part_entry = entries + n * size_of_entry;
 
-		partition_type_guid = get_le_guid (gpt_part_entry.partition_type_guid);
+		partition_type_guid = get_le_guid (gpt_part_entry);
 
 		if (strcmp (partition_type_guid, GPT_PART_TYPE_GUID_EMPTY) == 0) {
 			g_free (partition_type_guid);
@@ -725,19 +729,20 @@ part_table_parse_gpt (int fd, guint64 offset, guint64 size)
 		}
 
 		pe = part_entry_new (NULL,
-				     (guint8*) &gpt_part_entry,
+				     gpt_part_entry,
 				     128, 
 				     offset + partition_entry_lba * 512 + n * size_of_entry);
 		p->entries = g_slist_append (p->entries, pe);
 
 		g_free (partition_type_guid);
 
-		//hexdump ((guint8 *) &gpt_part_entry, 128);
+		//hexdump (gpt_part_entry, 128);
 
 	}
 
 
 out:
+	g_free (entries);
 	HAL_INFO (("Leaving EFI GPT parser"));
 	return p;
 }
@@ -745,8 +750,10 @@ out:
 #define MAC_MAGIC "ER"
 #define MAC_PART_MAGIC "PM"
 
+#define APPLE_MAX_MAP_SIZE (1024 * 1024)
+
 static PartitionTable *
-part_table_parse_apple (int fd, guint64 offset, guint64 size)
+part_table_parse_apple (PartReader *r, guint64 offset, guint64 size)
 {
 	int n;
 	PartitionTable *p;
@@ -779,20 +786,16 @@ part_table_parse_apple (int fd, guint64 offset, guint64 size)
 	} __attribute__ ((packed)) mac_part;
 	int block_size;
 	int map_count;
+	guint8 *map;
 
 	HAL_INFO (("Entering Apple parser"));
 
 	p = NULL;
+	map = NULL;
 
 	/* Check Mac start of disk signature */
-	if (lseek (fd, offset + 0, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, &mac_header, sizeof (mac_header)) != sizeof (mac_header)) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
+	if (!part_read (r, offset + 0, &mac_header, sizeof (mac_header)))
 		goto out;
-	}
 	if (memcmp (&(mac_header.signature), MAC_MAGIC, 2) != 0) {
 		HAL_INFO (("No MAC_MAGIC found"));
 		goto out;
@@ -802,40 +805,42 @@ part_table_parse_apple (int fd, guint64 offset, guint64 size)
 
 	HAL_INFO (("Mac MAGIC found, block_size=%d", block_size));
 
+	if (block_size < (int) sizeof (mac_part)) {
+		HAL_INFO (("Bogus block_size"));
+		goto out;
+	}
+
 	p = part_table_new_empty (PART_TYPE_APPLE);
 	p->offset = offset;
 	p->size = size;
 
 	/* get number of entries from first entry   */
-	if (lseek (fd, offset + block_size, SEEK_SET) < 0) {
-		HAL_INFO (("lseek failed (%s)", strerror (errno)));
-		goto out;
-	}
-	if (read (fd, &mac_part, sizeof (mac_part)) != sizeof (mac_part)) {
-		HAL_INFO (("read failed (%s)", strerror (errno)));
+	if (!part_read (r, offset + block_size, &mac_part, sizeof (mac_part)))
 		goto out;
-	}
 	map_count = GUINT32_FROM_BE (mac_part.map_count); /* num blocks in part map */
 
 	HAL_INFO (("map_count = %d", map_count));
 
+	if (map_count < 0 || (guint64) map_count * block_size > APPLE_MAX_MAP_SIZE) {
+		HAL_INFO (("Bogus map_count"));
+		goto out;
+	}
+
+	/* the whole partition map is read in one go */
+	map = g_new (guint8, map_count * block_size);
+	if (!part_read (r, offset + block_size, map, map_count * block_size))
+		goto out;
+
 	for (n = 0; n < map_count; n++) {
 		PartitionEntry *pe;
 
+		memcpy (&mac_part, map + n * block_size, sizeof (mac_part));
+
 		if (memcmp (&(mac_part.signature), MAC_PART_MAGIC, 2) != 0) {
 			HAL_INFO (("No MAC_PART_MAGIC found"));
 			break;
 		}
 
-		if (lseek (fd, offset + (n + 1) * block_size, SEEK_SET) < 0) {
-			HAL_INFO (("lseek failed (%s)", strerror (errno)));
-			goto out;
-		}
-		if (read (fd, &mac_part, sizeof (mac_part)) != sizeof (mac_part)) {
-			HAL_INFO (("read failed (%s)", strerror (errno)));
-			goto out;
-		}
-
 		pe = part_entry_new (NULL,
 				     (guint8*) &mac_part,
 				     sizeof (mac_part), 
@@ -845,6 +850,7 @@ part_table_parse_apple (int fd, guint64 offset, guint64 size)
 	}
 
 out:
+	g_free (map);
 	HAL_INFO (("Leaving Apple parser"));
 	return p;
 }
@@ -852,39 +858,63 @@ out:
 PartitionTable *
 part_table_load_from_disk (char *device)
 {
-	int fd;
-	guint64 size;
+	return part_table_load_from_disk_with_stats (device, NULL, NULL);
+}
+
+PartitionTable *
+part_table_load_from_disk_with_stats (char *device, int *out_num_reads, guint64 *out_num_bytes)
+{
+	PartReader r;
+	ssize_t n;
 	PartitionTable *p;
 	gboolean found_gpt;
+	struct stat st;
 
 	p = NULL;
+	memset (&r, 0, sizeof (r));
 
-	fd = open (device, O_RDONLY);
-	if (fd < 0) {
+	r.fd = open (device, O_RDONLY);
+	if (r.fd < 0) {
 		HAL_INFO (("Cannot open device %s", device));
 		goto out;
 	}
 
-	if (ioctl (fd, BLKGETSIZE64, &size) != 0) {
-		HAL_INFO (("Cannot determine size of device"));
+	if (ioctl (r.fd, BLKGETSIZE64, &r.size) != 0) {
+		/* disk images are regular files */
+		if (fstat (r.fd, &st) != 0 || !S_ISREG (st.st_mode)) {
+			HAL_INFO (("Cannot determine size of device"));
+			goto out;
+		}
+		r.size = st.st_size;
+	}
+
+	/* one read covers the MBR, the GPT header and a standard size GPT
+	 * entry array as well as the Apple partition map on most disks */
+	r.head = g_new (guint8, PART_READ_AHEAD);
+	n = pread (r.fd, r.head, MIN (r.size, PART_READ_AHEAD), 0);
+	if (n < 0) {
+		HAL_INFO (("read failed (%s)", strerror (errno)));
 		goto out;
 	}
+	r.num_reads++;
+	r.num_bytes += n;
+	r.head_len = n;
 
-	p = part_table_parse_msdos (fd, 0, size, &found_gpt);
+	p = part_table_parse_msdos (&r, 0, r.size, &found_gpt);
 	if (p != NULL) {
 		HAL_INFO (("MSDOS partition table detected"));
 		goto out;
 	}
 
 	if (found_gpt) {
-		p = part_table_parse_gpt (fd, 0, size);
+		p = part_table_parse_gpt (&r, 0, r.size);
 		if (p != NULL) {
 			HAL_INFO (("EFI GPT partition table detected"));
 			goto out;
 		}
 	}
 
-	p = part_table_parse_apple (fd, 0, size);
+	p = part_table_parse_apple (&r, 0, r.size);
 	if (p != NULL) {
 		HAL_INFO (("Apple partition table detected"));
 		goto out;
@@ -894,12 +924,234 @@ part_table_load_from_disk (char *device)
 
 
 out:
-	if (fd >= 0)
-		close (fd);
+	HAL_DEBUG (("Read %" G_GUINT64_FORMAT " bytes from %s in %d reads",
+		    r.num_bytes, device, r.num_reads));
+	if (out_num_reads != NULL)
+		*out_num_reads = r.num_reads;
+	if (out_num_bytes != NULL)
+		*out_num_bytes = r.num_bytes;
+	g_free (r.head);
+	if (r.fd >= 0)
+		close (r.fd);
 
 	return p;
 }
 
+/* The encoding is
+ *
+ *   table := scheme ',' offset ',' size '[' [ entry { ';' entry } ] ']'
+ *   entry := offset ':' hex-data [ '/' table ]
+ *
+ * with all numbers in decimal. The raw entry data is kept, so the
+ * accessors below work unchanged on a deserialized table.
+ */
+
+static void
+part_table_serialize_append (GString *s, PartitionTable *p)
+{
+	GSList *i;
+	int n;
+
+	g_string_append_printf (s, "%d,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "[",
+				(int) p->scheme, p->offset, p->size);
+
+	for (i = p->entries; i != NULL; i = i->next) {
+		PartitionEntry *pe = i->data;
+
+		if (i != p->entries)
+			g_string_append_c (s, ';');
+		g_string_append_printf (s, "%" G_GUINT64_FORMAT ":", pe->offset);
+		for (n = 0; n < pe->length; n++)
+			g_string_append_printf (s, "%02x", pe->data[n]);
+		if (pe->is_part_table) {
+			g_string_append_c (s, '/');
+			part_table_serialize_append (s, pe->part_table);
+		}
+	}
+
+	g_string_append_c (s, ']');
+}
+
+char *
+part_table_serialize (PartitionTable *p)
+{
+	GString *s;
+
+	if (p == NULL)
+		return NULL;
+
+	s = g_string_new (NULL);
+	part_table_serialize_append (s, p);
+	return g_string_free (s, FALSE);
+}
+
+static gboolean
+parse_uint64 (const char **data, guint64 *val)
+{
+	char *end;
+
+	if (!g_ascii_isdigit (**data))
+		return FALSE;
+	*val = g_ascii_strtoull (*data, &end, 10);
+	*data = end;
+	return TRUE;
+}
+
+static PartitionTable *
+part_table_deserialize_parse (const char **data, int depth)
+{
+	PartitionTable *p;
+	guint64 scheme;
+	const char *s;
+
+	p = NULL;
+	s = *data;
+
+	/* MS-DOS extended partitions are the only nesting we produce */
+	if (depth > 2)
+		goto error;
+
+	if (!parse_uint64 (&s, &scheme) || scheme > PART_TYPE_GPT || *s++ != ',')
+		goto error;
+	p = part_table_new_empty ((PartitionScheme) scheme);
+	if (!parse_uint64 (&s, &p->offset) || *s++ != ',')
+		goto error;
+	if (!parse_uint64 (&s, &p->size) || *s++ != '[')
+		goto error;
+
+	while (*s != ']') {
+		PartitionEntry *pe;
+		const char *hex;
+		int n;
+
+		if (p->entries != NULL && *s++ != ';')
+			goto error;
+
+		pe = g_new0 (PartitionEntry, 1);
+		p->entries = g_slist_append (p->entries, pe);
+
+		if (!parse_uint64 (&s, &pe->offset) || *s++ != ':')
+			goto error;
+
+		for (hex = s; g_ascii_isxdigit (*s); s++)
+			;
+		if ((s - hex) % 2 != 0)
+			goto error;
+		pe->length = (s - hex) / 2;
+		pe->data = g_new0 (guint8, pe->length);
+		for (n = 0; n < pe->length; n++)
+			pe->data[n] = (g_ascii_xdigit_value (hex[2*n]) << 4) | g_ascii_xdigit_value (hex[2*n + 1]);
+
+		if (*s == '/') {
+			s++;
+			pe->part_table = part_table_deserialize_parse (&s, depth + 1);
+			if (pe->part_table == NULL)
+				goto error;
+			pe->is_part_table = TRUE;
+		}
+	}
+	s++;
+
+	*data = s;
+	return p;
+
+error:
+	part_table_free (p);
+	return NULL;
+}
+
+PartitionTable *
+part_table_deserialize (const char *data)
+{
+	PartitionTable *p;
+
+	if (data == NULL)
+		return NULL;
+
+	p = part_table_deserialize_parse (&data, 0);
+	if (p != NULL && *data != '\0') {
+		part_table_free (p);
+		p = NULL;
+	}
+
+	return p;
+}
+
+/* hald-probe-storage leaves the table of a disk in its linux.partition_table
+ * property, prefixed with the dev_t it was read from; a table for another
+ * device node (e.g. the disk was replaced) is ignored. */
+PartitionTable *
+part_table_load_cached (char *device, const char *cached, gboolean *out_from_cache)
+{
+	PartitionTable *p;
+	struct stat st;
+	guint64 rdev;
+	char *end;
+
+	p = NULL;
+	if (out_from_cache != NULL)
+		*out_from_cache = FALSE;
+
+	if (cached != NULL && cached[0] != '\0' && stat (device, &st) == 0) {
+		rdev = g_ascii_strtoull (cached, &end, 10);
+		if (end != cached && *end == ' ' && rdev == (guint64) st.st_rdev)
+			p = part_table_deserialize (end + 1);
+	}
+
+	if (p != NULL) {
+		HAL_DEBUG (("Using cached partition table of %s", device));
+		if (out_from_cache != NULL)
+			*out_from_cache = TRUE;
+		return p;
+	}
+
+	return part_table_load_from_disk (device);
+}
+
+/* If the cached table doesn't describe the partition looked for it's stale
+ * (e.g. the disk was repartitioned and the change event hasn't been
+ * processed yet). The kernel only exposes the first sectors of an extended
+ * partition, so the size of those isn't compared. */
+PartitionTable *
+part_table_find_cached (char *device, const char *cached, guint64 offset, guint64 size,
+			PartitionTable **out_part_table, int *out_entry, gboolean *out_from_cache)
+{
+	PartitionTable *p;
+	gboolean from_cache;
+
+	*out_part_table = NULL;
+	*out_entry = -1;
+
+	p = part_table_load_cached (device, cached, &from_cache);
+	if (p == NULL)
+		goto out;
+
+	part_table_find (p, offset, out_part_table, out_entry);
+
+	if (from_cache &&
+	    (*out_entry < 0 ||
+	     part_table_entry_get_offset (*out_part_table, *out_entry) != offset ||
+	     (size != 0 &&
+	      part_table_entry_get_nested (*out_part_table, *out_entry) == NULL &&
+	      part_table_entry_get_size (*out_part_table, *out_entry) != size))) {
+		HAL_INFO (("Cached partition table doesn't match partition at %" G_GUINT64_FORMAT "; reading disk",
+			   offset));
+		from_cache = FALSE;
+		part_table_free (p);
+		*out_part_table = NULL;
+		*out_entry = -1;
+		p = part_table_load_from_disk (device);
+		if (p == NULL)
+			goto out;
+		part_table_find (p, offset, out_part_table, out_entry);
+	}
+
+out:
+	if (out_from_cache != NULL)
+		*out_from_cache = from_cache;
+	return p;
+}
+
 
 
 PartitionScheme
@@ -64,6 +64,20 @@ typedef struct PartitionTable_s PartitionTable;
  */
 PartitionTable       *part_table_load_from_disk   (char *device);
 
+/**
+ * part_table_load_from_disk_with_stats:
+ * @device: name of device file for entire disk or a disk image
+ * @out_num_reads: return location for the number of read calls made, or NULL
+ * @out_num_bytes: return location for the number of bytes read, or NULL
+ *
+ * Like part_table_load_from_disk() but also reports how much I/O it took.
+ *
+ * Returns: A partition table object. Use part_table_free() to free this object.
+ */
+PartitionTable       *part_table_load_from_disk_with_stats (char *device,
+							    int *out_num_reads,
+							    guint64 *out_num_bytes);
+
 /**
  * part_table_free:
  * @part_table: the partition table
@@ -72,6 +86,71 @@ PartitionTable       *part_table_load_from_disk   (char *device);
  */
 void                  part_table_free             (PartitionTable *part_table);
 
+/**
+ * part_table_serialize:
+ * @part_table: the partition table
+ *
+ * Encode a partition table, including nested partition tables, as a
+ * printable string such that it can be passed to another process, e.g.
+ * stored in a HAL property, and loaded again with part_table_deserialize()
+ * without touching the disk.
+ *
+ * Returns: The encoded partition table. Caller shall free this with g_free().
+ */
+char                 *part_table_serialize        (PartitionTable *part_table);
+
+/**
+ * part_table_deserialize:
+ * @data: string returned by part_table_serialize()
+ *
+ * Decodes a partition table encoded with part_table_serialize().
+ *
+ * Returns: A partition table object or NULL if @data is malformed. Use
+ *          part_table_free() to free this object.
+ */
+PartitionTable       *part_table_deserialize      (const char *data);
+
+/**
+ * part_table_load_cached:
+ * @device: name of device file for entire disk, e.g. /dev/sda
+ * @cached: the disk's dev_t in decimal, a space and a table encoded with
+ *          part_table_serialize(), or NULL
+ * @out_from_cache: return location for whether @cached was used, or NULL
+ *
+ * Decodes @cached if it was made for the device node @device currently
+ * refers to, and reads the partition table from @device otherwise.
+ *
+ * Returns: A partition table object. Use part_table_free() to free this object.
+ */
+PartitionTable       *part_table_load_cached      (char *device,
+						   const char *cached,
+						   gboolean *out_from_cache);
+
+/**
+ * part_table_find_cached:
+ * @device: name of device file for entire disk, e.g. /dev/sda
+ * @cached: cached partition table, see part_table_load_cached()
+ * @offset: offset of the partition on the disk
+ * @size: size of the partition or 0 if unknown
+ * @out_part_table: return location for the (nested) table holding the partition
+ * @out_entry: return location for the entry or -1 if not found
+ * @out_from_cache: return location for whether @cached was used, or NULL
+ *
+ * Like part_table_find() on the table from part_table_load_cached(), but
+ * a cached table without a partition at @offset of @size is taken to be
+ * stale and the table is read from @device instead.
+ *
+ * Returns: The partition table @out_part_table belongs to, or NULL. Use
+ *          part_table_free() to free this object.
+ */
+PartitionTable       *part_table_find_cached      (char *device,
+						   const char *cached,
+						   guint64 offset,
+						   guint64 size,
+						   PartitionTable **out_part_table,
+						   int *out_entry,
+						   gboolean *out_from_cache);
+
 /* partition table inspection */
 
 /**
@@ -0,0 +1,1229 @@
+/***************************************************************************
+ *
+ * partutil_test.c : Tests for reading partition tables
+ *
+ * Copyright (C) 2006 David Zeuthen, <david@fubar.dk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ **************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "../hald/logger.h"
+#include "partutil.h"
+
+static void
+put_le32 (guint8 *buf, guint32 val)
+{
+	val = GUINT32_TO_LE (val);
+	memcpy (buf, &val, sizeof (val));
+}
+
+static void
+put_le64 (guint8 *buf, guint64 val)
+{
+	val = GUINT64_TO_LE (val);
+	memcpy (buf, &val, sizeof (val));
+}
+
+static void
+put_be16 (guint8 *buf, guint16 val)
+{
+	val = GUINT16_TO_BE (val);
+	memcpy (buf, &val, sizeof (val));
+}
+
+static void
+put_be32 (guint8 *buf, guint32 val)
+{
+	val = GUINT32_TO_BE (val);
+	memcpy (buf, &val, sizeof (val));
+}
+
+static guint32
+ref_get_le32 (const void *buf)
+{
+	guint32 i;
+
+	memcpy (&i, buf, sizeof (i));
+	return GUINT32_FROM_LE (i);
+}
+
+static guint64
+ref_get_le64 (const void *buf)
+{
+	guint64 i;
+
+	memcpy (&i, buf, sizeof (i));
+	return GUINT64_FROM_LE (i);
+}
+
+/**************************************************************************/
+
+/* The reader as it was before it was changed to read whole sectors up
+ * front: one lseek and one small read per field or entry. It is kept
+ * here, reading regular files only, as the reference the current reader
+ * is compared with and to show how much I/O the old one did. */
+
+typedef struct RefPartitionTable_s RefPartitionTable;
+
+typedef struct {
+	/* NULL unless the entry holds an extended partition */
+	RefPartitionTable *part_table;
+
+	guint8 *data;
+	int length;
+
+	/* offset _on disk_ where the entry starts */
+	guint64 offset;
+} RefPartitionEntry;
+
+struct RefPartitionTable_s {
+	PartitionScheme scheme;
+	guint64 offset;
+	guint64 size;
+	GSList *entries;
+};
+
+typedef struct {
+	int fd;
+
+	/* statistics */
+	int num_syscalls;
+	guint64 num_bytes;
+} RefReader;
+
+static gboolean
+ref_read (RefReader *r, guint64 offset, void *buf, gsize len)
+{
+	ssize_t n;
+
+	r->num_syscalls++;
+	if (lseek (r->fd, offset, SEEK_SET) < 0)
+		return FALSE;
+
+	r->num_syscalls++;
+	n = read (r->fd, buf, len);
+	if (n < 0)
+		return FALSE;
+	r->num_bytes += n;
+
+	return (gsize) n == len;
+}
+
+static RefPartitionEntry *
+ref_part_entry_new (RefPartitionTable *e_part_table, const guint8 *data, int length, guint64 offset)
+{
+	RefPartitionEntry *pe;
+
+	pe = g_new0 (RefPartitionEntry, 1);
+	pe->part_table = e_part_table;
+	pe->offset = offset;
+	pe->length = length;
+	pe->data = g_memdup (data, length);
+
+	return pe;
+}
+
+static RefPartitionTable *
+ref_part_table_new (PartitionScheme scheme, guint64 offset, guint64 size)
+{
+	RefPartitionTable *p;
+
+	p = g_new0 (RefPartitionTable, 1);
+	p->scheme = scheme;
+	p->offset = offset;
+	p->size = size;
+
+	return p;
+}
+
+static void
+ref_part_table_free (RefPartitionTable *p)
+{
+	GSList *i;
+
+	if (p == NULL)
+		return;
+
+	for (i = p->entries; i != NULL; i = i->next) {
+		RefPartitionEntry *pe = i->data;
+
+		ref_part_table_free (pe->part_table);
+		g_free (pe->data);
+		g_free (pe);
+	}
+	g_slist_free (p->entries);
+	g_free (p);
+}
+
+/* same encoding as part_table_serialize() so the two can be compared */
+static void
+ref_part_table_serialize_append (GString *s, RefPartitionTable *p)
+{
+	GSList *i;
+	int n;
+
+	g_string_append_printf (s, "%d,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "[",
+				(int) p->scheme, p->offset, p->size);
+
+	for (i = p->entries; i != NULL; i = i->next) {
+		RefPartitionEntry *pe = i->data;
+
+		if (i != p->entries)
+			g_string_append_c (s, ';');
+		g_string_append_printf (s, "%" G_GUINT64_FORMAT ":", pe->offset);
+		for (n = 0; n < pe->length; n++)
+			g_string_append_printf (s, "%02x", pe->data[n]);
+		if (pe->part_table != NULL) {
+			g_string_append_c (s, '/');
+			ref_part_table_serialize_append (s, pe->part_table);
+		}
+	}
+
+	g_string_append_c (s, ']');
+}
+
+static char *
+ref_part_table_serialize (RefPartitionTable *p)
+{
+	GString *s;
+
+	s = g_string_new (NULL);
+	ref_part_table_serialize_append (s, p);
+	return g_string_free (s, FALSE);
+}
+
+#define MSDOS_MAGIC			"\x55\xaa"
+#define MSDOS_PARTTABLE_OFFSET		0x1be
+#define MSDOS_SIG_OFF			0x1fe
+
+static RefPartitionTable *
+ref_part_table_parse_msdos_extended (RefReader *r, guint64 offset, guint64 size)
+{
+	int n;
+	RefPartitionTable *p;
+	guint64 next;
+
+	p = NULL;
+
+	next = offset;
+
+	while (next != 0) {
+		guint64 readfrom;
+		guint8 embr[512];
+
+		readfrom = next;
+		next = 0;
+
+		if (!ref_read (r, readfrom, embr, sizeof (embr)))
+			goto out;
+
+		if (memcmp (&embr[MSDOS_SIG_OFF], MSDOS_MAGIC, 2) != 0)
+			goto out;
+
+		if (p == NULL)
+			p = ref_part_table_new (PART_TYPE_MSDOS_EXTENDED, offset, size);
+
+		for (n = 0; n < 2; n++) {
+			guint64 pstart;
+			guint64 psize;
+
+			pstart = 0x200 * ((guint64) ref_get_le32 (&(embr[MSDOS_PARTTABLE_OFFSET + n * 16 + 8])));
+			psize  = 0x200 * ((guint64) ref_get_le32 (&(embr[MSDOS_PARTTABLE_OFFSET + n * 16 + 12])));
+
+			if (psize == 0)
+				continue;
+
+			if (n == 0) {
+				p->entries = g_slist_append (p->entries,
+							     ref_part_entry_new (NULL,
+										 &(embr[MSDOS_PARTTABLE_OFFSET + n * 16]),
+										 16,
+										 readfrom + MSDOS_PARTTABLE_OFFSET + n * 16));
+			} else if (pstart != 0) {
+				next = offset + pstart;
+			}
+		}
+	}
+
+out:
+	return p;
+}
+
+static RefPartitionTable *
+ref_part_table_parse_msdos (RefReader *r, guint64 offset, guint64 size, gboolean *found_gpt)
+{
+	int n;
+	guint8 mbr[512];
+	RefPartitionTable *p;
+
+	*found_gpt = FALSE;
+
+	p = NULL;
+
+	if (!ref_read (r, offset, mbr, sizeof (mbr)))
+		goto out;
+
+	if (memcmp (&mbr[MSDOS_SIG_OFF], MSDOS_MAGIC, 2) != 0)
+		goto out;
+
+	for (n = 0; n < 4; n++) {
+		if (mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 0] != 0 &&
+		    mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 0] != 0x80)
+			goto out;
+		if (mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 4] == 0xee) {
+			*found_gpt = TRUE;
+			goto out;
+		}
+	}
+
+	p = ref_part_table_new (PART_TYPE_MSDOS, offset, size);
+
+	for (n = 0; n < 4; n++) {
+		RefPartitionEntry *pe;
+		guint64 pstart;
+		guint64 psize;
+		guint8 ptype;
+		RefPartitionTable *e_part_table;
+
+		pstart = 0x200 * ((guint64) ref_get_le32 (&(mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 8])));
+		psize  = 0x200 * ((guint64) ref_get_le32 (&(mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 12])));
+		ptype = mbr[MSDOS_PARTTABLE_OFFSET + n * 16 + 4];
+
+		pe = NULL;
+
+		switch (ptype) {
+		case 0x05:
+		case 0x0f:
+		case 0x85:
+			e_part_table = ref_part_table_parse_msdos_extended (r, pstart, psize);
+			if (e_part_table != NULL) {
+				pe = ref_part_entry_new (e_part_table,
+							 &(mbr[MSDOS_PARTTABLE_OFFSET + n * 16]),
+							 16,
+							 offset + MSDOS_PARTTABLE_OFFSET + n * 16);
+			}
+			break;
+
+		default:
+			pe = ref_part_entry_new (NULL,
+						 &(mbr[MSDOS_PARTTABLE_OFFSET + n * 16]),
+						 16,
+						 offset + MSDOS_PARTTABLE_OFFSET + n * 16);
+			break;
+		}
+
+		if (pe != NULL)
+			p->entries = g_slist_append (p->entries, pe);
+	}
+
+out:
+	return p;
+}
+
+#define GPT_MAGIC "EFI PART"
+
+static RefPartitionTable *
+ref_part_table_parse_gpt (RefReader *r, guint64 offset, guint64 size)
+{
+	int n;
+	RefPartitionTable *p;
+	guint8 buf[16];
+	guint64 partition_entry_lba;
+	int num_entries;
+	int size_of_entry;
+	static const guint8 empty_guid[16];
+
+	p = NULL;
+
+	if (!ref_read (r, offset + 512 + 0, buf, 8))
+		goto out;
+	if (memcmp (buf, GPT_MAGIC, 8) != 0)
+		goto out;
+
+	/* Disk UUID */
+	if (!ref_read (r, offset + 512 + 56, buf, 16))
+		goto out;
+
+	if (!ref_read (r, offset + 512 + 72, buf, 8))
+		goto out;
+	partition_entry_lba = ref_get_le64 (buf);
+
+	if (!ref_read (r, offset + 512 + 80, buf, 4))
+		goto out;
+	num_entries = ref_get_le32 (buf);
+
+	if (!ref_read (r, offset + 512 + 84, buf, 4))
+		goto out;
+	size_of_entry = ref_get_le32 (buf);
+
+	p = ref_part_table_new (PART_TYPE_GPT, offset, size);
+
+	for (n = 0; n < num_entries; n++) {
+		guint8 gpt_part_entry[128];
+
+		if (!ref_read (r, offset + partition_entry_lba * 512 + n * size_of_entry,
+			       gpt_part_entry, sizeof (gpt_part_entry)))
+			goto out;
+
+		if (memcmp (gpt_part_entry, empty_guid, 16) == 0)
+			continue;
+
+		p->entries = g_slist_append (p->entries,
+					     ref_part_entry_new (NULL,
+								 gpt_part_entry,
+								 128,
+								 offset + partition_entry_lba * 512 + n * size_of_entry));
+	}
+
+out:
+	return p;
+}
+
+#define MAC_MAGIC "ER"
+#define MAC_PART_MAGIC "PM"
+
+/* signature, res1, map_count, start_block, block_count, name[32],
+ * type[32], data_start, data_count, status, boot_start, boot_size,
+ * boot_load, boot_load2, boot_entry, boot_entry2, boot_cksum and
+ * processor[16] */
+#define MAC_PART_LEN 136
+
+static RefPartitionTable *
+ref_part_table_parse_apple (RefReader *r, guint64 offset, guint64 size)
+{
+	int n;
+	RefPartitionTable *p;
+	guint8 mac_header[8];
+	guint8 mac_part[MAC_PART_LEN];
+	guint16 block_size;
+	guint32 map_count;
+
+	p = NULL;
+
+	if (!ref_read (r, offset + 0, mac_header, sizeof (mac_header)))
+		goto out;
+	if (memcmp (mac_header, MAC_MAGIC, 2) != 0)
+		goto out;
+
+	memcpy (&block_size, mac_header + 2, 2);
+	block_size = GUINT16_FROM_BE (block_size);
+
+	p = ref_part_table_new (PART_TYPE_APPLE, offset, size);
+
+	if (!ref_read (r, offset + block_size, mac_part, sizeof (mac_part)))
+		goto out;
+	memcpy (&map_count, mac_part + 4, 4);
+	map_count = GUINT32_FROM_BE (map_count);
+
+	for (n = 0; n < (int) map_count; n++) {
+		if (memcmp (mac_part, MAC_PART_MAGIC, 2) != 0)
+			break;
+
+		if (!ref_read (r, offset + (n + 1) * block_size, mac_part, sizeof (mac_part)))
+			goto out;
+
+		p->entries = g_slist_append (p->entries,
+					     ref_part_entry_new (NULL,
+								 mac_part,
+								 sizeof (mac_part),
+								 offset + (n + 1) * block_size));
+	}
+
+out:
+	return p;
+}
+
+static RefPartitionTable *
+ref_part_table_load_from_disk (const char *path, int *out_num_syscalls, guint64 *out_num_bytes)
+{
+	RefReader r;
+	struct stat st;
+	RefPartitionTable *p;
+	gboolean found_gpt;
+
+	p = NULL;
+	memset (&r, 0, sizeof (r));
+
+	r.fd = open (path, O_RDONLY);
+	if (r.fd < 0)
+		goto out;
+	if (fstat (r.fd, &st) != 0)
+		goto out;
+
+	p = ref_part_table_parse_msdos (&r, 0, st.st_size, &found_gpt);
+	if (p != NULL)
+		goto out;
+
+	if (found_gpt) {
+		p = ref_part_table_parse_gpt (&r, 0, st.st_size);
+		if (p != NULL)
+			goto out;
+	}
+
+	p = ref_part_table_parse_apple (&r, 0, st.st_size);
+
+out:
+	*out_num_syscalls = r.num_syscalls;
+	*out_num_bytes = r.num_bytes;
+	if (r.fd >= 0)
+		close (r.fd);
+	return p;
+}
+
+/**************************************************************************/
+
+/* A corpus of small disk images; sizes and offsets are in 512 byte
+ * sectors. Every image lists the partitions (start, count) a reader
+ * must find in it, terminated by a zero count. */
+
+typedef struct {
+	const char *name;
+	guint32 num_sectors;
+	gboolean (*build) (int fd, guint32 num_sectors);
+	const guint32 *partitions;
+} PartTestImage;
+
+static gboolean
+image_write (int fd, guint64 offset, const void *buf, gsize len)
+{
+	return pwrite (fd, buf, len, offset) == (ssize_t) len;
+}
+
+static void
+mbr_set_entry (guint8 *sector, int n, guint8 boot, guint8 type, guint32 start, guint32 count)
+{
+	guint8 *e;
+
+	e = sector + MSDOS_PARTTABLE_OFFSET + n * 16;
+	e[0] = boot;
+	e[4] = type;
+	put_le32 (e + 8, start);
+	put_le32 (e + 12, count);
+	memcpy (sector + MSDOS_SIG_OFF, MSDOS_MAGIC, 2);
+}
+
+static gboolean
+build_mbr (int fd, guint32 num_sectors)
+{
+	guint8 mbr[512];
+
+	memset (mbr, 0, sizeof (mbr));
+	mbr_set_entry (mbr, 0, 0x80, 0x83, 2048, 2048);
+	mbr_set_entry (mbr, 1, 0x00, 0x07, 4096, 1024);
+	mbr_set_entry (mbr, 3, 0x00, 0x82, 6144, 512);
+
+	return image_write (fd, 0, mbr, sizeof (mbr));
+}
+
+static const guint32 partitions_mbr[] = {
+	2048, 2048,
+	4096, 1024,
+	6144, 512,
+	0, 0
+};
+
+/* a chain of three logical partitions, the last two beyond the first
+ * 64k of the disk, and a second extended partition without an EBR */
+static gboolean
+build_mbr_extended (int fd, guint32 num_sectors)
+{
+	guint8 mbr[512];
+	guint8 ebr[3][512];
+	int n;
+
+	memset (mbr, 0, sizeof (mbr));
+	mbr_set_entry (mbr, 0, 0x80, 0x83, 2048, 1024);
+	mbr_set_entry (mbr, 1, 0x00, 0x05, 4096, 4096);
+	mbr_set_entry (mbr, 2, 0x00, 0x85, 8192, 1024);
+	mbr_set_entry (mbr, 3, 0x00, 0x83, 9216, 1024);
+
+	/* start of a logical partition is relative to its EBR, start of
+	 * the next EBR is relative to the extended partition */
+	memset (ebr, 0, sizeof (ebr));
+	mbr_set_entry (ebr[0], 0, 0x00, 0x83, 63, 961);
+	mbr_set_entry (ebr[0], 1, 0x00, 0x05, 1024, 1024);
+	mbr_set_entry (ebr[1], 0, 0x00, 0x07, 63, 961);
+	mbr_set_entry (ebr[1], 1, 0x00, 0x05, 2048, 2048);
+	mbr_set_entry (ebr[2], 0, 0x00, 0x83, 63, 1985);
+
+	if (!image_write (fd, 0, mbr, sizeof (mbr)))
+		return FALSE;
+	for (n = 0; n < 3; n++) {
+		if (!image_write (fd, (4096 + 1024 * n) * 512ULL, ebr[n], sizeof (ebr[n])))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static const guint32 partitions_mbr_extended[] = {
+	2048, 1024,
+	4096, 4096,
+	4096 + 63, 961,
+	4096 + 1024 + 63, 961,
+	4096 + 2048 + 63, 1985,
+	9216, 1024,
+	0, 0
+};
+
+/* Linux filesystem data, 0FC63DAF-8483-4772-8E79-3D69D8477DE4 */
+static const guint8 gpt_type_linux[16] = {
+	0xaf, 0x3d, 0xc6, 0x0f, 0x83, 0x84, 0x72, 0x47,
+	0x8e, 0x79, 0x3d, 0x69, 0xd8, 0x47, 0x7d, 0xe4
+};
+
+static gboolean
+build_gpt_table (int fd, guint32 num_sectors, guint64 entry_lba, int num_entries, int size_of_entry,
+		 const guint32 *partitions, const int *slots)
+{
+	guint8 mbr[512];
+	guint8 header[512];
+	guint8 *entries;
+	int n;
+	int c;
+	gboolean ret;
+
+	memset (mbr, 0, sizeof (mbr));
+	mbr_set_entry (mbr, 0, 0x00, 0xee, 1, num_sectors - 1);
+
+	memset (header, 0, sizeof (header));
+	memcpy (header, GPT_MAGIC, 8);
+	put_le32 (header + 8, 0x00010000);
+	put_le32 (header + 12, 92);
+	put_le64 (header + 24, 1);
+	put_le64 (header + 72, entry_lba);
+	put_le32 (header + 80, num_entries);
+	put_le32 (header + 84, size_of_entry);
+
+	entries = g_new0 (guint8, num_entries * size_of_entry);
+	for (n = 0; partitions[2 * n + 1] != 0; n++) {
+		guint8 *e;
+		const char *name = "partition";
+
+		e = entries + slots[n] * size_of_entry;
+		memcpy (e, gpt_type_linux, 16);
+		memset (e + 16, 0x11 * (n + 1), 16);
+		put_le64 (e + 32, partitions[2 * n]);
+		put_le64 (e + 40, partitions[2 * n] + partitions[2 * n + 1] - 1);
+		for (c = 0; name[c] != '\0'; c++)
+			e[56 + 2 * c] = name[c];
+		e[56 + 2 * c] = '0' + n;
+	}
+
+	ret = image_write (fd, 0, mbr, sizeof (mbr)) &&
+		image_write (fd, 512, header, sizeof (header)) &&
+		image_write (fd, entry_lba * 512, entries, num_entries * size_of_entry);
+
+	g_free (entries);
+	return ret;
+}
+
+static const guint32 partitions_gpt[] = {
+	34, 2014,
+	2048, 2048,
+	4096, 4063,
+	0, 0
+};
+
+static gboolean
+build_gpt (int fd, guint32 num_sectors)
+{
+	static const int slots[] = {0, 1, 5};
+
+	return build_gpt_table (fd, num_sectors, 2, 128, 128, partitions_gpt, slots);
+}
+
+static const guint32 partitions_gpt_far[] = {
+	34, 1000,
+	10000, 2000,
+	0, 0
+};
+
+/* entry array past the first 64k and with entries bigger than 128 bytes */
+static gboolean
+build_gpt_far (int fd, guint32 num_sectors)
+{
+	static const int slots[] = {3, 15};
+
+	return build_gpt_table (fd, num_sectors, 8192, 16, 256, partitions_gpt_far, slots);
+}
+
+static const guint32 partitions_apple[] = {
+	1, 63,
+	64, 4000,
+	4064, 4128,
+	0, 0
+};
+
+static gboolean
+build_apple_map (int fd, guint32 num_sectors, guint16 block_size)
+{
+	static const char *names[] = {"Apple", "disk", ""};
+	static const char *types[] = {"Apple_partition_map", "Apple_HFS", "Apple_Free"};
+	guint8 block[2048];
+	int n;
+
+	memset (block, 0, sizeof (block));
+	memcpy (block, MAC_MAGIC, 2);
+	put_be16 (block + 2, block_size);
+	put_be32 (block + 4, num_sectors * 512 / block_size);
+	if (!image_write (fd, 0, block, block_size))
+		return FALSE;
+
+	for (n = 0; n < 3; n++) {
+		memset (block, 0, sizeof (block));
+		memcpy (block, MAC_PART_MAGIC, 2);
+		put_be32 (block + 4, 3);
+		put_be32 (block + 8, partitions_apple[2 * n]);
+		put_be32 (block + 12, partitions_apple[2 * n + 1]);
+		strcpy ((char *) block + 16, names[n]);
+		strcpy ((char *) block + 48, types[n]);
+		if (!image_write (fd, (n + 1) * block_size, block, block_size))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+build_apple (int fd, guint32 num_sectors)
+{
+	return build_apple_map (fd, num_sectors, 512);
+}
+
+/* optical discs use 2048 byte blocks */
+static gboolean
+build_apple_cd (int fd, guint32 num_sectors)
+{
+	return build_apple_map (fd, num_sectors, 2048);
+}
+
+static const PartTestImage test_images[] = {
+	{"mbr",          8192,  build_mbr,          partitions_mbr},
+	{"mbr-extended", 16384, build_mbr_extended, partitions_mbr_extended},
+	{"gpt",          8192,  build_gpt,          partitions_gpt},
+	{"gpt-far",      16384, build_gpt_far,      partitions_gpt_far},
+	{"apple",        8192,  build_apple,        partitions_apple},
+	{"apple-cd",     8192,  build_apple_cd,     partitions_apple},
+	{"empty",        8192,  NULL,               NULL},
+};
+
+/* Write the image to a temporary file and return its path */
+static char *
+image_create (const PartTestImage *image)
+{
+	int fd;
+	char *path;
+	gboolean ok;
+
+	fd = g_file_open_tmp ("partutil-test-XXXXXX", &path, NULL);
+	if (fd < 0)
+		return NULL;
+
+	ok = ftruncate (fd, (off_t) image->num_sectors * 512) == 0 &&
+		(image->build == NULL || image->build (fd, image->num_sectors));
+	close (fd);
+
+	if (!ok) {
+		unlink (path);
+		g_free (path);
+		path = NULL;
+	}
+
+	return path;
+}
+
+/* Check that every partition the image was built with is found */
+static gboolean
+check_partitions (const PartTestImage *image, PartitionTable *p)
+{
+	int n;
+
+	for (n = 0; image->partitions[2 * n + 1] != 0; n++) {
+		guint64 start;
+		guint64 size;
+		PartitionTable *t;
+		int entry;
+
+		start = 512ULL * image->partitions[2 * n];
+		size = 512ULL * image->partitions[2 * n + 1];
+
+		part_table_find (p, start, &t, &entry);
+		if (entry < 0 ||
+		    part_table_entry_get_offset (t, entry) != start ||
+		    part_table_entry_get_size (t, entry) != size) {
+			printf ("FAILED: %s: no partition at %" G_GUINT64_FORMAT " of size %" G_GUINT64_FORMAT "\n",
+				image->name, start, size);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+check_load_image (const PartTestImage *image)
+{
+	char *path;
+	PartitionTable *p;
+	RefPartitionTable *ref;
+	char *s;
+	char *ref_s;
+	int num_reads;
+	guint64 num_bytes;
+	int ref_num_syscalls;
+	guint64 ref_num_bytes;
+	gboolean ret;
+
+	ret = FALSE;
+	p = NULL;
+	ref = NULL;
+	s = NULL;
+	ref_s = NULL;
+
+	path = image_create (image);
+	if (path == NULL) {
+		printf ("FAILED: %s: cannot create image\n", image->name);
+		goto out;
+	}
+
+	p = part_table_load_from_disk_with_stats (path, &num_reads, &num_bytes);
+	ref = ref_part_table_load_from_disk (path, &ref_num_syscalls, &ref_num_bytes);
+
+	printf ("  %-12s: %3d syscalls, %7" G_GUINT64_FORMAT " bytes (was %3d syscalls, %7" G_GUINT64_FORMAT " bytes)\n",
+		image->name, num_reads, num_bytes, ref_num_syscalls, ref_num_bytes);
+
+	if (image->partitions == NULL) {
+		if (p != NULL || ref != NULL) {
+			printf ("FAILED: %s: found a partition table\n", image->name);
+			goto out;
+		}
+		ret = TRUE;
+		goto out;
+	}
+
+	if (p == NULL || ref == NULL) {
+		printf ("FAILED: %s: no partition table found (%s)\n", image->name,
+			p == NULL ? "reader" : "reference");
+		goto out;
+	}
+
+	s = part_table_serialize (p);
+	ref_s = ref_part_table_serialize (ref);
+	if (strcmp (s, ref_s) != 0) {
+		printf ("FAILED: %s: differs from the reference\n  %s\n  %s\n", image->name, s, ref_s);
+		goto out;
+	}
+
+	if (!check_partitions (image, p))
+		goto out;
+
+	ret = TRUE;
+
+out:
+	g_free (s);
+	g_free (ref_s);
+	part_table_free (p);
+	ref_part_table_free (ref);
+	if (path != NULL) {
+		unlink (path);
+		g_free (path);
+	}
+	return ret;
+}
+
+/* Read every image of the corpus with both readers and compare */
+static gboolean
+check_load (void)
+{
+	gboolean ret;
+	guint i;
+
+	printf ("Checking partition tables against the reference reader\n");
+
+	ret = TRUE;
+	for (i = 0; i < G_N_ELEMENTS (test_images); i++) {
+		if (!check_load_image (&test_images[i]))
+			ret = FALSE;
+	}
+
+	if (ret)
+		printf ("PASSED\n");
+
+	return ret;
+}
+
+static gboolean
+str_equal (const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return strcmp (a, b) == 0;
+}
+
+/* Compare two tables through the accessors, recursing into nested tables */
+static gboolean
+tables_equal (PartitionTable *a, PartitionTable *b)
+{
+	int n;
+
+	if (part_table_get_scheme (a) != part_table_get_scheme (b) ||
+	    part_table_get_offset (a) != part_table_get_offset (b) ||
+	    part_table_get_size (a) != part_table_get_size (b) ||
+	    part_table_get_num_entries (a) != part_table_get_num_entries (b))
+		return FALSE;
+
+	for (n = 0; n < part_table_get_num_entries (a); n++) {
+		PartitionTable *nested_a;
+		PartitionTable *nested_b;
+		char *sa[3];
+		char *sb[3];
+		char **flags_a;
+		char **flags_b;
+		gboolean equal;
+		int i;
+
+		if (part_table_entry_get_offset (a, n) != part_table_entry_get_offset (b, n) ||
+		    part_table_entry_get_size (a, n) != part_table_entry_get_size (b, n))
+			return FALSE;
+
+		sa[0] = part_table_entry_get_type (a, n);
+		sb[0] = part_table_entry_get_type (b, n);
+		sa[1] = part_table_entry_get_label (a, n);
+		sb[1] = part_table_entry_get_label (b, n);
+		sa[2] = part_table_entry_get_uuid (a, n);
+		sb[2] = part_table_entry_get_uuid (b, n);
+		flags_a = part_table_entry_get_flags (a, n);
+		flags_b = part_table_entry_get_flags (b, n);
+
+		equal = TRUE;
+		for (i = 0; i < 3; i++) {
+			if (!str_equal (sa[i], sb[i]))
+				equal = FALSE;
+			g_free (sa[i]);
+			g_free (sb[i]);
+		}
+		for (i = 0; flags_a != NULL && flags_b != NULL && flags_a[i] != NULL; i++) {
+			if (!str_equal (flags_a[i], flags_b[i]))
+				equal = FALSE;
+		}
+		if (flags_a == NULL || flags_b == NULL ? flags_a != flags_b : flags_b[i] != NULL)
+			equal = FALSE;
+		g_strfreev (flags_a);
+		g_strfreev (flags_b);
+		if (!equal)
+			return FALSE;
+
+		nested_a = part_table_entry_get_nested (a, n);
+		nested_b = part_table_entry_get_nested (b, n);
+		if (nested_a == NULL || nested_b == NULL) {
+			if (nested_a != nested_b)
+				return FALSE;
+		} else if (!tables_equal (nested_a, nested_b)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+check_serialize_image (const PartTestImage *image)
+{
+	char *path;
+	PartitionTable *p;
+	PartitionTable *q;
+	char *s;
+	char *s2;
+	gboolean ret;
+
+	ret = FALSE;
+	p = NULL;
+	q = NULL;
+	s = NULL;
+	s2 = NULL;
+
+	path = image_create (image);
+	if (path == NULL) {
+		printf ("FAILED: %s: cannot create image\n", image->name);
+		goto out;
+	}
+
+	p = part_table_load_from_disk (path);
+	if (p == NULL) {
+		printf ("FAILED: %s: no partition table found\n", image->name);
+		goto out;
+	}
+
+	s = part_table_serialize (p);
+	q = part_table_deserialize (s);
+	if (q == NULL) {
+		printf ("FAILED: %s: cannot decode '%s'\n", image->name, s);
+		goto out;
+	}
+
+	s2 = part_table_serialize (q);
+	if (strcmp (s, s2) != 0 || !tables_equal (p, q)) {
+		printf ("FAILED: %s: decoded table differs\n  %s\n  %s\n", image->name, s, s2);
+		goto out;
+	}
+
+	if (!check_partitions (image, q))
+		goto out;
+
+	ret = TRUE;
+
+out:
+	g_free (s);
+	g_free (s2);
+	part_table_free (p);
+	part_table_free (q);
+	if (path != NULL) {
+		unlink (path);
+		g_free (path);
+	}
+	return ret;
+}
+
+/* Encode and decode every table of the corpus */
+static gboolean
+check_serialize (void)
+{
+	static const char *malformed[] = {
+		"",
+		"0,0,4194304",
+		"0,0,4194304[",
+		"0,0,4194304[446:00",
+		"0,0,4194304[446:000/1,0,0[]",
+		"0,0,4194304[446:00/1,0,0[462:00/1,0,0[478:00/1,0,0[]]]]",
+		"9,0,4194304[]",
+		"0,0,4194304[]x",
+	};
+	gboolean ret;
+	guint i;
+
+	printf ("Checking encoding and decoding of partition tables\n");
+
+	ret = TRUE;
+	for (i = 0; i < G_N_ELEMENTS (test_images); i++) {
+		if (test_images[i].partitions != NULL && !check_serialize_image (&test_images[i]))
+			ret = FALSE;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (malformed); i++) {
+		PartitionTable *p;
+
+		p = part_table_deserialize (malformed[i]);
+		if (p != NULL) {
+			printf ("FAILED: decoded malformed '%s'\n", malformed[i]);
+			part_table_free (p);
+			ret = FALSE;
+		}
+	}
+
+	if (ret)
+		printf ("PASSED\n");
+
+	return ret;
+}
+
+/* Cache string as hald-probe-storage makes it for the disk at path */
+static char *
+cache_new (const char *path, guint64 rdev_delta)
+{
+	PartitionTable *p;
+	struct stat st;
+	char *table;
+	char *cached;
+
+	if (stat (path, &st) != 0 || (p = part_table_load_from_disk ((char *) path)) == NULL)
+		return NULL;
+
+	table = part_table_serialize (p);
+	cached = g_strdup_printf ("%" G_GUINT64_FORMAT " %s", (guint64) st.st_rdev + rdev_delta, table);
+	g_free (table);
+	part_table_free (p);
+
+	return cached;
+}
+
+/* Look up a partition of the extended partition image with the given
+ * cache; the result must always match the disk */
+static gboolean
+check_cache_lookup (const char *what, const char *path, const char *cached,
+		    guint32 start, guint32 count, gboolean expect_from_cache)
+{
+	PartitionTable *p;
+	PartitionTable *t;
+	int entry;
+	gboolean from_cache;
+	gboolean ret;
+
+	ret = FALSE;
+
+	p = part_table_find_cached ((char *) path, cached, 512ULL * start, 512ULL * count,
+				    &t, &entry, &from_cache);
+	if (p == NULL || entry < 0 ||
+	    part_table_entry_get_offset (t, entry) != 512ULL * start ||
+	    part_table_entry_get_size (t, entry) != 512ULL * count) {
+		printf ("FAILED: %s: wrong partition at %u\n", what, start);
+		goto out;
+	}
+
+	if (from_cache != expect_from_cache) {
+		printf ("FAILED: %s: %s\n", what,
+			from_cache ? "used a stale cache" : "didn't use the cache");
+		goto out;
+	}
+
+	ret = TRUE;
+
+out:
+	part_table_free (p);
+	return ret;
+}
+
+static gboolean
+check_cache (void)
+{
+	char *path;
+	char *other_path;
+	char *cached;
+	char *other_cached;
+	char *wrong_rdev;
+	PartitionTable *p;
+	gboolean from_cache;
+	gboolean ret;
+
+	ret = FALSE;
+	other_path = NULL;
+	cached = NULL;
+	other_cached = NULL;
+	wrong_rdev = NULL;
+
+	printf ("Checking cached partition tables\n");
+
+	/* test_images[1] has logical partitions, test_images[0] is a
+	 * different layout of the same disk */
+	path = image_create (&test_images[1]);
+	other_path = image_create (&test_images[0]);
+	if (path == NULL || other_path == NULL) {
+		printf ("FAILED: cannot create images\n");
+		goto out;
+	}
+
+	cached = cache_new (path, 0);
+	other_cached = cache_new (other_path, 0);
+	wrong_rdev = cache_new (path, 1);
+	if (cached == NULL || other_cached == NULL || wrong_rdev == NULL) {
+		printf ("FAILED: cannot read images\n");
+		goto out;
+	}
+
+	p = part_table_load_cached (path, cached, &from_cache);
+	part_table_free (p);
+	if (p == NULL || !from_cache) {
+		printf ("FAILED: didn't use the cache\n");
+		goto out;
+	}
+
+	p = part_table_load_cached (path, wrong_rdev, &from_cache);
+	part_table_free (p);
+	if (p == NULL || from_cache) {
+		printf ("FAILED: used the cache of another device\n");
+		goto out;
+	}
+
+	p = part_table_load_cached (path, "0 0,0,0[", &from_cache);
+	part_table_free (p);
+	if (p == NULL || from_cache) {
+		printf ("FAILED: used a malformed cache\n");
+		goto out;
+	}
+
+	/* a primary and a logical partition, found in an up to date cache */
+	if (!check_cache_lookup ("current", path, cached, 2048, 1024, TRUE) ||
+	    !check_cache_lookup ("current", path, cached, 4096 + 1024 + 63, 961, TRUE))
+		goto out;
+
+	/* the cache of the other layout has a partition at 2048 but of a
+	 * different size, and none at the start of the logical partition */
+	if (!check_cache_lookup ("stale size", path, other_cached, 2048, 1024, FALSE) ||
+	    !check_cache_lookup ("stale offset", path, other_cached, 4096 + 1024 + 63, 961, FALSE))
+		goto out;
+
+	if (!check_cache_lookup ("no cache", path, NULL, 4096 + 2048 + 63, 1985, FALSE) ||
+	    !check_cache_lookup ("other device", path, wrong_rdev, 4096 + 2048 + 63, 1985, FALSE))
+		goto out;
+
+	printf ("PASSED\n");
+	ret = TRUE;
+
+out:
+	g_free (cached);
+	g_free (other_cached);
+	g_free (wrong_rdev);
+	if (path != NULL) {
+		unlink (path);
+		g_free (path);
+	}
+	if (other_path != NULL) {
+		unlink (other_path);
+		g_free (other_path);
+	}
+	return ret;
+}
+
+int
+main (int argc, char *argv[])
+{
+	int num_tests_failed;
+
+	num_tests_failed = 0;
+
+	setup_logger ();
+
+	printf ("=============================\n");
+
+	if (!check_load ())
+		num_tests_failed++;
+
+	if (!check_serialize ())
+		num_tests_failed++;
+
+	if (!check_cache ())
+		num_tests_failed++;
+
+	printf ("=============================\n");
+
+	printf ("Total number of tests failed: %d\n", num_tests_failed);
+
+	return num_tests_failed != 0 ? 1 : 0;
+}
@@ -35,6 +35,8 @@
 #include <libhal.h>
 #include <polkit/polkit.h>
 
+#include "hald/util_helper_env.h"
+
 /* How this works (or "An introduction to this code")
  *
  * - all ACL's granted by this tool is kept in /var/run/hald/acl-list
@@ -946,10 +948,10 @@ acl_device_added (void)
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
 
-	if ((device = getenv ("HAL_PROP_ACCESS_CONTROL_FILE")) == NULL)
+	if ((device = hal_helper_getenv ("HAL_PROP_ACCESS_CONTROL_FILE")) == NULL)
 		goto out;
 
-	if ((type = getenv ("HAL_PROP_ACCESS_CONTROL_TYPE")) == NULL)
+	if ((type = hal_helper_getenv ("HAL_PROP_ACCESS_CONTROL_TYPE")) == NULL)
 		goto out;
 
 	afd = acl_for_device_new (udi);
@@ -958,13 +960,13 @@ acl_device_added (void)
 	afd_list = g_slist_prepend (NULL, afd);
 
 	/* get ACL granting policy from HAL properties */
-	if ((s = getenv ("HAL_PROP_ACCESS_CONTROL_GRANT_USER")) != NULL) {
+	if ((s = hal_helper_getenv ("HAL_PROP_ACCESS_CONTROL_GRANT_USER")) != NULL) {
 		char **sv;
 		sv = g_strsplit (s, "\t", 0);
 		afd_grant_to_uid_from_userlist (afd, sv);
 		g_strfreev (sv);
 	}
-	if ((s = getenv ("HAL_PROP_ACCESS_CONTROL_GRANT_GROUP")) != NULL) {
+	if ((s = hal_helper_getenv ("HAL_PROP_ACCESS_CONTROL_GRANT_GROUP")) != NULL) {
 		char **sv;
 		sv = g_strsplit (s, "\t", 0);
 		afd_grant_to_gid_from_grouplist (afd, sv);
@@ -1006,7 +1008,7 @@ acl_device_removed (void)
 	if ((udi = getenv ("UDI")) == NULL)
 		goto out;
 
-	if ((device = getenv ("HAL_PROP_ACCESS_CONTROL_FILE")) == NULL)
+	if ((device = hal_helper_getenv ("HAL_PROP_ACCESS_CONTROL_FILE")) == NULL)
 		goto out;
 
 	afd = acl_for_device_new (udi);
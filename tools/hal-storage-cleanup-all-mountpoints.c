@@ -34,6 +34,7 @@
 #include <glib/gstdio.h>
 
 #include "hal-storage-shared.h"
+#include "hald/util_helper_env.h"
 
 /*#define DEBUG*/
 #define DEBUG
@@ -165,7 +166,7 @@ main (int argc, char *argv[])
 
         unlink ("/media/.hal-mtab-lock");
 
-	if (getenv ("HAL_PROP_INFO_UDI") == NULL)
+	if (hal_helper_getenv ("HAL_PROP_INFO_UDI") == NULL)
 		usage ();
 
 #ifdef DEBUG
@@ -32,6 +32,8 @@
 #include <unistd.h>
 #include <syslog.h>
 
+#include "hald/util_helper_env.h"
+
 #define MAX_CMD_LENGTH 256
 
 static int debug = 0;
@@ -53,10 +55,10 @@ int main (int argc, const char *argv[])
         	syslog (LOG_INFO, "hal-system-setserial started in debug mode." );
 
 	udi = getenv("UDI");
-	irq = getenv("HAL_PROP_PNP_SERIAL_IRQ");
-	port = getenv("HAL_PROP_PNP_SERIAL_PORT");
-	baud_base = getenv("HAL_PROP_PNP_SERIAL_BAUD_BASE");
-	input_dev = getenv("HAL_PROP_INPUT_DEVICE_SET");
+	irq = hal_helper_getenv ("HAL_PROP_PNP_SERIAL_IRQ");
+	port = hal_helper_getenv ("HAL_PROP_PNP_SERIAL_PORT");
+	baud_base = hal_helper_getenv ("HAL_PROP_PNP_SERIAL_BAUD_BASE");
+	input_dev = hal_helper_getenv ("HAL_PROP_INPUT_DEVICE_SET");
 
 	if (udi == NULL || irq == NULL || port == NULL || input_dev == NULL) {
 		syslog (LOG_INFO, "Missing env variable, exit NOW." );